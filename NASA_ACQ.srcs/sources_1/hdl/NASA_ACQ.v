@@ -256,6 +256,7 @@ localparam TIMESTAMP_WIDTH = 64;
 wire [TIMESTAMP_WIDTH-1:0] sysTimestamp, acqTimestamp;
 wire acqPPSstrobe;
 wire evrRxStartACQstrobe, evrRxStopACQstrobe, evrRxClearMPSstrobe;
+wire evrRxCaptureStrobe;
 wire  [7:0] evgTxCode;
 wire        evgTxCodeValid;
 wire [15:0] mpsTxChars;
@@ -269,6 +270,7 @@ fiberLinks #(
     .EVR_ACQ_START_CODE(CFG_EVR_ACQ_START_CODE),
     .EVR_ACQ_STOP_CODE(CFG_EVR_ACQ_STOP_CODE),
     .EVR_MPS_CLEAR_CODE(CFG_EVR_MPS_CLEAR_CODE),
+    .EVR_CAPTURE_CODE(CFG_EVR_CAPTURE_CODE),
     .DEBUG("false"),
     .DEBUG_MGT("false"),
     .DEBUG_EVR("false"),
@@ -283,11 +285,19 @@ fiberLinks #(
     .sysEVGsetTimeStrobe(GPIO_STROBES[GPIO_IDX_EVG_CSR]),
     .sysMPSmergeStrobe(GPIO_STROBES[GPIO_IDX_MPS_MERGE_CSR]),
     .sysMPSmergeStatus(GPIO_IN[GPIO_IDX_MPS_MERGE_CSR]),
+    .sysMPSmergeDataStrobe(GPIO_STROBES[GPIO_IDX_MPS_MERGE_DATA]),
+    .sysMPSmergeData(GPIO_IN[GPIO_IDX_MPS_MERGE_DATA]),
+    .sysEVGbufferStrobe(GPIO_STROBES[GPIO_IDX_EVG_BUFFER]),
+    .sysEVGbufferStatus(GPIO_IN[GPIO_IDX_EVG_BUFFER]),
+    .sysEVRbufferStrobe(GPIO_STROBES[GPIO_IDX_EVR_BUFFER_DATA]),
+    .sysEVRbufferData(GPIO_IN[GPIO_IDX_EVR_BUFFER_DATA]),
+    .sysEVRbufferStatus(GPIO_IN[GPIO_IDX_EVR_BUFFER_CSR]),
     .sysEVGstatus(GPIO_IN[GPIO_IDX_EVG_CSR]),
     .evrRxClk(evrRxClk),
     .evrRxStartACQstrobe(evrRxStartACQstrobe),
     .evrRxStopACQstrobe(evrRxStopACQstrobe),
     .evrRxClearMPSstrobe(evrRxClearMPSstrobe),
+    .evrRxCaptureStrobe(evrRxCaptureStrobe),
     .evfRxClk(evfRxClk),
     .ppsValid(ppsValid),
     .hwPPSmarker_a(ppsMarker),
@@ -523,7 +533,7 @@ ad7768recorder #(
     .acqMisalignedMarker(acqMisalignedMarker));
 
 ///////////////////////////////////////////////////////////////////////////////
-// AC/DC coupling
+// AC/DC coupling and per-channel filtering
 wire coupledDataStrobe;
 wire [(CFG_AD7768_CHIP_COUNT*CFG_AD7768_ADC_PER_CHIP*CFG_AD7768_WIDTH)-1:0]
                                                                    coupledData;
@@ -534,8 +544,10 @@ inputCoupling #(
   inputCoupling_i (
     .sysClk(sysClk),
     .sysCsrStrobe(GPIO_STROBES[GPIO_IDX_INPUT_COUPLING_CSR]),
+    .sysFilterStrobe(GPIO_STROBES[GPIO_IDX_INPUT_FILTER_CSR]),
     .sysGPIO_OUT(GPIO_OUT),
     .sysStatus(GPIO_IN[GPIO_IDX_INPUT_COUPLING_CSR]),
+    .sysFilterStatus(GPIO_IN[GPIO_IDX_INPUT_FILTER_CSR]),
     .clk(acqClk),
     .inTDATA(ad7768Data),
     .inTVALID(ad7768Strobe),
@@ -562,7 +574,6 @@ wire acqEnableAcquisition;
 wire acqStrobe;
 wire [(CFG_AD7768_CHIP_COUNT*CFG_AD7768_ADC_PER_CHIP*CFG_AD7768_WIDTH)-1:0]
                                                                         acqData;
-`ifdef notdef
 rateSelect #(
     .CHANNEL_COUNT(CFG_AD7768_CHIP_COUNT*CFG_AD7768_ADC_PER_CHIP),
     .DATA_WIDTH(CFG_AD7768_WIDTH),
@@ -573,22 +584,20 @@ rateSelect #(
     .sysFilterStrobe5(GPIO_STROBES[GPIO_IDX_DOWNSAMPLE_5_CSR]),
     .sysFilterStrobe2(GPIO_STROBES[GPIO_IDX_DOWNSAMPLE_2_CSR]),
     .sysGPIO_OUT(GPIO_OUT),
+    .sysStatus(GPIO_IN[GPIO_IDX_RATE_SELECT_CSR]),
     .acqClk(acqClk),
     .acqEnabled(acqEnableAcquisition),
     .S_TDATA(coupledData),
     .S_TVALID(coupledDataStrobe),
     .M_TDATA(acqData),
     .M_TVALID(acqStrobe));
-`else
-assign acqData = coupledData;
-assign acqStrobe = coupledDataStrobe;
-`endif
 
 ///////////////////////////////////////////////////////////////////////////////
 // Build packet
 wire [7:0] unbufPK_TDATA;
 wire unbufPK_TVALID, unbufPK_TLAST, unbufPK_TREADY;
 wire [(4*CFG_AD7768_CHIP_COUNT*CFG_AD7768_ADC_PER_CHIP)-1:0] acqLimitExcursions;
+wire acqLimitExcursionsTVALID;
 buildPacket #(
     .ADC_CHIP_COUNT(CFG_AD7768_CHIP_COUNT),
     .ADC_PER_CHIP(CFG_AD7768_ADC_PER_CHIP),
@@ -603,12 +612,14 @@ buildPacket #(
     .sysActiveBitmapStrobe(GPIO_STROBES[GPIO_IDX_BUILD_PACKET_BITMAP]),
     .sysByteCountStrobe(GPIO_STROBES[GPIO_IDX_BUILD_PACKET_BYTECOUNT]),
     .sysThresholdStrobe(GPIO_STROBES[GPIO_IDX_ADC_THRESHOLDS]),
+    .sysEncodingStrobe(GPIO_STROBES[GPIO_IDX_BUILD_PACKET_ENCODING]),
     .sysLimitExcursionStrobe(GPIO_STROBES[GPIO_IDX_ADC_EXCURSIONS]),
     .sysGPIO_OUT(GPIO_OUT),
     .sysStatus(GPIO_IN[GPIO_IDX_BUILD_PACKET_STATUS]),
     .sysActiveRbk(GPIO_IN[GPIO_IDX_BUILD_PACKET_BITMAP]),
     .sysByteCountRbk(GPIO_IN[GPIO_IDX_BUILD_PACKET_BYTECOUNT]),
     .sysThresholdRbk(GPIO_IN[GPIO_IDX_ADC_THRESHOLDS]),
+    .sysEncodingRbk(GPIO_IN[GPIO_IDX_BUILD_PACKET_ENCODING]),
     .sysLimitExcursions(GPIO_IN[GPIO_IDX_ADC_EXCURSIONS]),
     .sysSequenceNumber(GPIO_IN[GPIO_IDX_ADC_SEQNO]),
     .sysTimeValid(GPIO_IN[GPIO_IDX_LINK_STATUS][31]),
@@ -616,6 +627,7 @@ buildPacket #(
     .acqStrobe(acqStrobe),
     .acqData(acqData),
     .acqLimitExcursions(acqLimitExcursions),
+    .acqLimitExcursionsTVALID(acqLimitExcursionsTVALID),
     .acqSeconds(acqTimestamp[63:32]),
     .acqTicks(acqTimestamp[31:0]),
     .acqClkLocked(GPIO_IN[GPIO_IDX_ACQCLK_PLL_CSR][31]),
@@ -626,8 +638,8 @@ buildPacket #(
     .M_TREADY(unbufPK_TREADY));
 
 // Provide some elastic buffering to fast data stream
-wire [7:0] PK_TDATA;
-wire PK_TVALID, PK_TLAST, PK_TREADY;
+wire [7:0] fifoPK_TDATA;
+wire fifoPK_TVALID, fifoPK_TLAST, fifoPK_TREADY;
 fastDataFIFO fastDataFIFO (
   .s_axis_aresetn(1'b1),
   .s_axis_aclk(acqClk),
@@ -635,10 +647,222 @@ fastDataFIFO fastDataFIFO (
   .s_axis_tready(unbufPK_TREADY),
   .s_axis_tdata(unbufPK_TDATA),
   .s_axis_tlast(unbufPK_TLAST),
-  .m_axis_tvalid(PK_TVALID),
-  .m_axis_tready(PK_TREADY),
-  .m_axis_tdata(PK_TDATA),
-  .m_axis_tlast(PK_TLAST));
+  .m_axis_tvalid(fifoPK_TVALID),
+  .m_axis_tready(fifoPK_TREADY),
+  .m_axis_tdata(fifoPK_TDATA),
+  .m_axis_tlast(fifoPK_TLAST));
+
+///////////////////////////////////////////////////////////////////////////////
+// Low-rate summary (min/max/sum/sum of squares) of ADC readings
+wire [7:0] summaryPK_TDATA;
+wire summaryPK_TVALID, summaryPK_TLAST, summaryPK_TREADY;
+summarizeADC #(
+    .ADC_CHIP_COUNT(CFG_AD7768_CHIP_COUNT),
+    .ADC_PER_CHIP(CFG_AD7768_ADC_PER_CHIP),
+    .ADC_WIDTH(CFG_AD7768_WIDTH),
+    .DEBUG("false"))
+  summarizeADC (
+    .sysClk(sysClk),
+    .sysCsrStrobe(GPIO_STROBES[GPIO_IDX_ADC_SUMMARY_CSR]),
+    .sysGPIO_OUT(GPIO_OUT),
+    .sysStatus(GPIO_IN[GPIO_IDX_ADC_SUMMARY_CSR]),
+    .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
+    .acqData(acqData),
+    .acqSeconds(acqTimestamp[63:32]),
+    .acqTicks(acqTimestamp[31:0]),
+    .acqEnableAcquisition(acqEnableAcquisition),
+    .M_TVALID(summaryPK_TVALID),
+    .M_TLAST(summaryPK_TLAST),
+    .M_TDATA(summaryPK_TDATA),
+    .M_TREADY(summaryPK_TREADY));
+
+///////////////////////////////////////////////////////////////////////////////
+// Averaged power spectra of selected ADC channels
+wire [7:0] spectrumPK_TDATA;
+wire spectrumPK_TVALID, spectrumPK_TLAST, spectrumPK_TREADY;
+spectrumADC #(
+    .ADC_CHIP_COUNT(CFG_AD7768_CHIP_COUNT),
+    .ADC_PER_CHIP(CFG_AD7768_ADC_PER_CHIP),
+    .ADC_WIDTH(CFG_AD7768_WIDTH),
+    .UDP_PACKET_CAPACITY(CFG_UDP_PACKET_CAPACITY),
+    .DEBUG("false"))
+  spectrumADC (
+    .sysClk(sysClk),
+    .sysCsrStrobe(GPIO_STROBES[GPIO_IDX_ADC_SPECTRUM_CSR]),
+    .sysTableStrobe(GPIO_STROBES[GPIO_IDX_ADC_SPECTRUM_TABLE]),
+    .sysGPIO_OUT(GPIO_OUT),
+    .sysStatus(GPIO_IN[GPIO_IDX_ADC_SPECTRUM_CSR]),
+    .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
+    .acqData(acqData),
+    .acqSeconds(acqTimestamp[63:32]),
+    .acqTicks(acqTimestamp[31:0]),
+    .acqEnableAcquisition(acqEnableAcquisition),
+    .M_TVALID(spectrumPK_TVALID),
+    .M_TLAST(spectrumPK_TLAST),
+    .M_TDATA(spectrumPK_TDATA),
+    .M_TREADY(spectrumPK_TREADY));
+
+// Summary and spectrum packets share a stream
+wire [7:0] lowRatePK_TDATA;
+wire lowRatePK_TVALID, lowRatePK_TLAST, lowRatePK_TREADY;
+fastStreamMux #(.DEBUG("false"))
+  lowRateStreamMux (
+    .clk(acqClk),
+    .S0_TDATA(summaryPK_TDATA),
+    .S0_TVALID(summaryPK_TVALID),
+    .S0_TLAST(summaryPK_TLAST),
+    .S0_TREADY(summaryPK_TREADY),
+    .S1_TDATA(spectrumPK_TDATA),
+    .S1_TVALID(spectrumPK_TVALID),
+    .S1_TLAST(spectrumPK_TLAST),
+    .S1_TREADY(spectrumPK_TREADY),
+    .M_TDATA(lowRatePK_TDATA),
+    .M_TVALID(lowRatePK_TVALID),
+    .M_TLAST(lowRatePK_TLAST),
+    .M_TUSER(),
+    .M_TREADY(lowRatePK_TREADY));
+
+///////////////////////////////////////////////////////////////////////////////
+// Pre/post-trigger capture of full-resolution ADC readings
+wire acqMPStripped;
+wire [7:0] capturePK_TDATA;
+wire capturePK_TVALID, capturePK_TLAST, capturePK_TREADY;
+captureADC #(
+    .ADC_CHIP_COUNT(CFG_AD7768_CHIP_COUNT),
+    .ADC_PER_CHIP(CFG_AD7768_ADC_PER_CHIP),
+    .ADC_WIDTH(CFG_AD7768_WIDTH),
+    .UDP_PACKET_CAPACITY(CFG_UDP_PACKET_CAPACITY),
+    .DEBUG("false"))
+  captureADC (
+    .sysClk(sysClk),
+    .sysCsrStrobe(GPIO_STROBES[GPIO_IDX_ADC_CAPTURE_CSR]),
+    .sysGPIO_OUT(GPIO_OUT),
+    .sysStatus(GPIO_IN[GPIO_IDX_ADC_CAPTURE_CSR]),
+    .evrClk(evrRxClk),
+    .evrTriggerStrobe(evrRxCaptureStrobe),
+    .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
+    .acqData(acqData),
+    .acqSeconds(acqTimestamp[63:32]),
+    .acqTicks(acqTimestamp[31:0]),
+    .acqMPStripped(acqMPStripped),
+    .M_TVALID(capturePK_TVALID),
+    .M_TLAST(capturePK_TLAST),
+    .M_TDATA(capturePK_TDATA),
+    .M_TREADY(capturePK_TREADY));
+
+// Summary, spectrum and capture packets share a stream
+wire [7:0] bulkPK_TDATA;
+wire bulkPK_TVALID, bulkPK_TLAST, bulkPK_TREADY;
+fastStreamMux #(.DEBUG("false"))
+  auxStreamMux (
+    .clk(acqClk),
+    .S0_TDATA(lowRatePK_TDATA),
+    .S0_TVALID(lowRatePK_TVALID),
+    .S0_TLAST(lowRatePK_TLAST),
+    .S0_TREADY(lowRatePK_TREADY),
+    .S1_TDATA(capturePK_TDATA),
+    .S1_TVALID(capturePK_TVALID),
+    .S1_TLAST(capturePK_TLAST),
+    .S1_TREADY(capturePK_TREADY),
+    .M_TDATA(bulkPK_TDATA),
+    .M_TVALID(bulkPK_TVALID),
+    .M_TLAST(bulkPK_TLAST),
+    .M_TUSER(),
+    .M_TREADY(bulkPK_TREADY));
+
+///////////////////////////////////////////////////////////////////////////////
+// Time-stamped limit excursion events
+wire [7:0] eventPK_TDATA;
+wire eventPK_TVALID, eventPK_TLAST, eventPK_TREADY;
+excursionEvents #(
+    .ADC_CHIP_COUNT(CFG_AD7768_CHIP_COUNT),
+    .ADC_PER_CHIP(CFG_AD7768_ADC_PER_CHIP),
+    .UDP_PACKET_CAPACITY(CFG_UDP_PACKET_CAPACITY),
+    .DEBUG("false"))
+  excursionEvents (
+    .sysClk(sysClk),
+    .sysCsrStrobe(GPIO_STROBES[GPIO_IDX_ADC_EVENT_CSR]),
+    .sysGPIO_OUT(GPIO_OUT),
+    .sysStatus(GPIO_IN[GPIO_IDX_ADC_EVENT_CSR]),
+    .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
+    .acqLimitExcursions(acqLimitExcursions),
+    .acqLimitExcursionsTVALID(acqLimitExcursionsTVALID),
+    .acqSeconds(acqTimestamp[63:32]),
+    .acqTicks(acqTimestamp[31:0]),
+    .acqEnableAcquisition(acqEnableAcquisition),
+    .M_TVALID(eventPK_TVALID),
+    .M_TLAST(eventPK_TLAST),
+    .M_TDATA(eventPK_TDATA),
+    .M_TREADY(eventPK_TREADY));
+
+// MPS trip history packets, from mpsLocal below, share a stream with
+// limit excursion events, events taking priority.
+wire [7:0] historyPK_TDATA;
+wire historyPK_TVALID, historyPK_TLAST, historyPK_TREADY;
+wire [7:0] mpsEventPK_TDATA;
+wire mpsEventPK_TVALID, mpsEventPK_TLAST, mpsEventPK_TREADY;
+fastStreamMux #(.DEBUG("false"))
+  historyStreamMux (
+    .clk(acqClk),
+    .S0_TDATA(historyPK_TDATA),
+    .S0_TVALID(historyPK_TVALID),
+    .S0_TLAST(historyPK_TLAST),
+    .S0_TREADY(historyPK_TREADY),
+    .S1_TDATA(eventPK_TDATA),
+    .S1_TVALID(eventPK_TVALID),
+    .S1_TLAST(eventPK_TLAST),
+    .S1_TREADY(eventPK_TREADY),
+    .M_TDATA(mpsEventPK_TDATA),
+    .M_TVALID(mpsEventPK_TVALID),
+    .M_TLAST(mpsEventPK_TLAST),
+    .M_TUSER(),
+    .M_TREADY(mpsEventPK_TREADY));
+
+// Summary, spectrum, capture, event and history packets share stream 1,
+// events and history taking priority.
+wire [7:0] auxPK_TDATA;
+wire auxPK_TVALID, auxPK_TLAST, auxPK_TREADY;
+fastStreamMux #(.DEBUG("false"))
+  eventStreamMux (
+    .clk(acqClk),
+    .S0_TDATA(bulkPK_TDATA),
+    .S0_TVALID(bulkPK_TVALID),
+    .S0_TLAST(bulkPK_TLAST),
+    .S0_TREADY(bulkPK_TREADY),
+    .S1_TDATA(mpsEventPK_TDATA),
+    .S1_TVALID(mpsEventPK_TVALID),
+    .S1_TLAST(mpsEventPK_TLAST),
+    .S1_TREADY(mpsEventPK_TREADY),
+    .M_TDATA(auxPK_TDATA),
+    .M_TVALID(auxPK_TVALID),
+    .M_TLAST(auxPK_TLAST),
+    .M_TUSER(),
+    .M_TREADY(auxPK_TREADY));
+
+// Merge ADC data (stream 0) and summary/spectrum/capture/event/history
+// (stream 1) packets
+wire [7:0] PK_TDATA;
+wire PK_TVALID, PK_TLAST, PK_TUSER, PK_TREADY;
+fastStreamMux #(.DEBUG("false"))
+  fastStreamMux (
+    .clk(acqClk),
+    .S0_TDATA(fifoPK_TDATA),
+    .S0_TVALID(fifoPK_TVALID),
+    .S0_TLAST(fifoPK_TLAST),
+    .S0_TREADY(fifoPK_TREADY),
+    .S1_TDATA(auxPK_TDATA),
+    .S1_TVALID(auxPK_TVALID),
+    .S1_TLAST(auxPK_TLAST),
+    .S1_TREADY(auxPK_TREADY),
+    .M_TDATA(PK_TDATA),
+    .M_TVALID(PK_TVALID),
+    .M_TLAST(PK_TLAST),
+    .M_TUSER(PK_TUSER),
+    .M_TREADY(PK_TREADY));
 
 ///////////////////////////////////////////////////////////////////////////////
 // Event generator side of acquisition control
@@ -684,16 +908,24 @@ mpsLocal #(
     .sysGPIO_OUT(GPIO_OUT),
     .sysStatus(GPIO_IN[GPIO_IDX_MPS_CSR]),
     .sysData(GPIO_IN[GPIO_IDX_MPS_DATA]),
+    .sysHistoryCsrStrobe(GPIO_STROBES[GPIO_IDX_MPS_HISTORY_CSR]),
+    .sysHistoryStatus(GPIO_IN[GPIO_IDX_MPS_HISTORY_CSR]),
     .evrClk(evrRxClk),
     .evrClearMPSstrobe(evrRxClearMPSstrobe),
     .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
     .acqLimitExcursions(acqLimitExcursions),
-    .acqLimitExcursionsTVALID(acqStrobe),
+    .acqLimitExcursionsTVALID(acqLimitExcursionsTVALID),
     .acqTimestamp(acqTimestamp),
     .mpsInputStates_a(~{PMOD1_5, PMOD1_1, PMOD1_4, PMOD1_0}),
+    .acqMPStripped(acqMPStripped),
     .mgtTxClk(evgClk),
     .mpsTxChars(mpsTxChars),
-    .mpsTxCharIsK(mpsTxCharIsK));
+    .mpsTxCharIsK(mpsTxCharIsK),
+    .M_TVALID(historyPK_TVALID),
+    .M_TLAST(historyPK_TLAST),
+    .M_TDATA(historyPK_TDATA),
+    .M_TREADY(historyPK_TREADY));
 
 ///////////////////////////////////////////////////////////////////////////////
 // Delay data from PHY
@@ -756,6 +988,7 @@ bd bd_i (
     .phy_reset_n(RGMII_PHY_RESET_n),
     .fastTx_tdata(PK_TDATA),
     .fastTx_tlast(PK_TLAST),
+    .fastTx_tuser(PK_TUSER),
     .fastTx_tready(PK_TREADY),
     .fastTx_tvalid(PK_TVALID),
 
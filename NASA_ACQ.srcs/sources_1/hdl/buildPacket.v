@@ -40,12 +40,14 @@ module buildPacket #(
     input  wire        sysActiveBitmapStrobe,
     input  wire        sysByteCountStrobe,
     input  wire        sysThresholdStrobe,
+    input  wire        sysEncodingStrobe,
     input  wire        sysLimitExcursionStrobe,
     input  wire [31:0] sysGPIO_OUT,
     output wire [31:0] sysStatus,
     output wire [31:0] sysActiveRbk,
     output wire [31:0] sysByteCountRbk,
     output wire [31:0] sysThresholdRbk,
+    output wire [31:0] sysEncodingRbk,
     output wire [31:0] sysLimitExcursions,
     output wire [31:0] sysSequenceNumber,
     input  wire        sysTimeValid,
@@ -54,6 +56,7 @@ module buildPacket #(
     input  wire                                               acqStrobe,
     input  wire [(ADC_CHIP_COUNT*ADC_PER_CHIP*ADC_WIDTH)-1:0] acqData,
     output wire         [(4*ADC_CHIP_COUNT*ADC_PER_CHIP)-1:0]acqLimitExcursions,
+    output wire                                               acqLimitExcursionsTVALID,
 
     input  wire [31:0] acqSeconds,
     input  wire [31:0] acqTicks,
@@ -67,9 +70,29 @@ module buildPacket #(
 
 localparam LIMIT_EXCURSION_WIDTH = 4 * ADC_CHIP_COUNT * ADC_PER_CHIP;
 wire [LIMIT_EXCURSION_WIDTH-1:0] packetLimitExcursions;
+wire [31:0] packetSize;
 wire       rawPacketTVALID, rawPacketTLAST, rawPacketTREADY;
 wire [7:0] rawPacketTDATA;
 
+//
+// Compare readings with limits
+//
+detectLimitExcursions #(
+    .ADC_CHIP_COUNT(ADC_CHIP_COUNT),
+    .ADC_PER_CHIP(ADC_PER_CHIP),
+    .ADC_WIDTH(ADC_WIDTH),
+    .DEBUG(DEBUG))
+  detectLimitExcursions (
+    .sysClk(sysClk),
+    .sysThresholdStrobe(sysThresholdStrobe),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .sysThresholdRbk(sysThresholdRbk),
+    .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
+    .acqData(acqData),
+    .acqLimitExcursions(acqLimitExcursions),
+    .acqLimitExcursionsTVALID(acqLimitExcursionsTVALID));
+
 //
 // Instantiate the core packet builder
 //
@@ -83,18 +106,19 @@ buildPacketCore #(
     .sysClk(sysClk),
     .sysActiveBitmapStrobe(sysActiveBitmapStrobe),
     .sysByteCountStrobe(sysByteCountStrobe),
-    .sysThresholdStrobe(sysThresholdStrobe),
+    .sysEncodingStrobe(sysEncodingStrobe),
     .sysGPIO_OUT(sysGPIO_OUT),
     .sysStatus(sysStatus),
     .sysActiveRbk(sysActiveRbk),
     .sysByteCountRbk(sysByteCountRbk),
-    .sysThresholdRbk(sysThresholdRbk),
+    .sysEncodingRbk(sysEncodingRbk),
     .sysSequenceNumber(sysSequenceNumber),
     .sysTimeValid(sysTimeValid),
     .acqClk(acqClk),
     .acqStrobe(acqStrobe),
     .acqData(acqData),
     .acqLimitExcursions(acqLimitExcursions),
+    .acqLimitExcursionsTVALID(acqLimitExcursionsTVALID),
     .acqSeconds(acqSeconds),
     .acqTicks(acqTicks),
     .acqClkLocked(acqClkLocked),
@@ -103,6 +127,7 @@ buildPacketCore #(
     .M_TLAST(rawPacketTLAST),
     .M_TDATA(rawPacketTDATA),
     .packetLimitExcursions(packetLimitExcursions),
+    .packetSize(packetSize),
     .M_TREADY(rawPacketTREADY));
 
 //
@@ -110,6 +135,7 @@ buildPacketCore #(
 //
 mergeLimitExcursions #(
     .BITMAPS_WIDTH(LIMIT_EXCURSION_WIDTH),
+    .PACKET_CAPACITY(UDP_PACKET_CAPACITY),
     .DEBUG(DEBUG_MERGE_LIMITS))
   mergeLimitExcursions (
     .clk(acqClk),
@@ -118,6 +144,7 @@ mergeLimitExcursions #(
     .S_TDATA(rawPacketTDATA),
     .S_TREADY(rawPacketTREADY),
     .packetLimitExcursions(packetLimitExcursions),
+    .packetSize(packetSize),
     .M_TVALID(M_TVALID),
     .M_TLAST(M_TLAST),
     .M_TDATA(M_TDATA),
@@ -136,7 +163,7 @@ reportLimitExcursions #(
     .sysStatus(sysLimitExcursions),
     .acqClk(acqClk),
     .acqLimitExcursions(acqLimitExcursions),
-    .acqLimitExcursionsTVALID(acqStrobe));
+    .acqLimitExcursionsTVALID(acqLimitExcursionsTVALID));
 endmodule
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -155,20 +182,21 @@ module buildPacketCore #(
     input  wire        sysClk,
     input  wire        sysActiveBitmapStrobe,
     input  wire        sysByteCountStrobe,
-    input  wire        sysThresholdStrobe,
+    input  wire        sysEncodingStrobe,
     input  wire [31:0] sysGPIO_OUT,
     output wire [31:0] sysStatus,
     output wire [31:0] sysActiveRbk,
     output wire [31:0] sysByteCountRbk,
-    output reg  [31:0] sysThresholdRbk,
+    output wire [31:0] sysEncodingRbk,
     output wire [31:0] sysSequenceNumber,
     input  wire        sysTimeValid,
 
                          input  wire                          acqClk,
     (*MARK_DEBUG=DEBUG*) input  wire                          acqStrobe,
     input  wire [(ADC_CHIP_COUNT*ADC_PER_CHIP*ADC_WIDTH)-1:0] acqData,
-    (*MARK_DEBUG=DEBUG*) output wire [(4*ADC_CHIP_COUNT*ADC_PER_CHIP)-1:0]
+    (*MARK_DEBUG=DEBUG*) input  wire [(4*ADC_CHIP_COUNT*ADC_PER_CHIP)-1:0]
                                                              acqLimitExcursions,
+    (*MARK_DEBUG=DEBUG*) input  wire                          acqLimitExcursionsTVALID,
 
     (*MARK_DEBUG=DEBUG*) input  wire [31:0] acqSeconds,
     (*MARK_DEBUG=DEBUG*) input  wire [31:0] acqTicks,
@@ -180,16 +208,59 @@ module buildPacketCore #(
     (*MARK_DEBUG=DEBUG*) output reg  [7:0] M_TDATA,
     (*MARK_DEBUG=DEBUG*) output reg [(4*ADC_CHIP_COUNT*ADC_PER_CHIP)-1:0]
                                            packetLimitExcursions = 0,
+    (*MARK_DEBUG=DEBUG*) output reg [31:0] packetSize = 0,
     (*MARK_DEBUG=DEBUG*) input  wire       M_TREADY);
 
 localparam BYTES_PER_ADC = (ADC_WIDTH + 7) / 8;
 
 localparam ADC_COUNT = ADC_CHIP_COUNT * ADC_PER_CHIP;
-localparam ADC_SHIFT_COUNT = ADC_COUNT * BYTES_PER_ADC;
-localparam ADC_SHIFT_COUNTER_LOAD = ADC_SHIFT_COUNT - 1;
+localparam ADC_SHIFT_COUNTER_LOAD = ADC_COUNT - 1;
 localparam ADC_SHIFT_COUNTER_WIDTH = $clog2(ADC_SHIFT_COUNTER_LOAD+1) + 1;
 localparam ADC_SEL_WIDTH = $clog2(ADC_COUNT);
 
+/*
+ * Per-channel sample encodings.
+ * ENCODE_24    -- Full width, big-endian.
+ * ENCODE_16    -- Most significant 16 bits, rounded and saturated.
+ * ENCODE_DELTA -- Single signed byte difference from previous reading
+ *                 or, if that won't fit or this is the first reading in
+ *                 the packet, DELTA_ESCAPE followed by the full width value.
+ * When any channel is not ENCODE_24 the header flags it and the encodings
+ * (2 bits per channel, most significant channel first) follow the limit
+ * excursion bitmaps.  Otherwise the packet layout is unchanged.
+ */
+localparam [1:0] ENCODE_24    = 2'd0,
+                 ENCODE_16    = 2'd1,
+                 ENCODE_DELTA = 2'd2;
+localparam [7:0] DELTA_ESCAPE = 8'h80;
+localparam ENCODING_WIDTH = 2 * ADC_COUNT;
+localparam ENCODING_BYTE_COUNT = (ENCODING_WIDTH + 7) / 8;
+localparam ENCODING_SHIFT_COUNTER_LOAD = ENCODING_BYTE_COUNT - 1;
+localparam ENCODING_SHIFT_COUNTER_WIDTH =
+                                   $clog2(ENCODING_SHIFT_COUNTER_LOAD+1) + 1;
+localparam SAMPLE_BYTES_WIDTH = $clog2((ADC_COUNT * (BYTES_PER_ADC+1)) + 1);
+
+/*
+ * Optional timing block.
+ * When enabled the header flags it and four big-endian words follow the
+ * limit excursion bitmaps, ahead of any encoding map:
+ *   Ticks of the first sample in the packet (full acqTicks value).
+ *   Sample period in acqClk ticks, 24.8 fixed point, measured over the
+ *   most recent 256 sample intervals.
+ *   PPS phase -- acqTicks of the first sample following the most recent
+ *   seconds rollover.
+ *   { periodValid, phaseValid, index of first sample since that rollover }.
+ * The host can then compute the time of sample n in the packet as
+ *   seconds + (phase + (index + n) * period) / acqClk rate
+ * without relying on the nominal sample rate.
+ */
+localparam TIMING_BYTE_COUNT = 4 * 4;
+localparam TIMING_SHIFT_REG_WIDTH = TIMING_BYTE_COUNT * 8;
+localparam TIMING_SHIFT_COUNTER_LOAD = TIMING_BYTE_COUNT - 1;
+localparam TIMING_SHIFT_COUNTER_WIDTH = $clog2(TIMING_SHIFT_COUNTER_LOAD+1) + 1;
+localparam LOG2_PERIOD_INTERVALS = 8;
+localparam SAMPLE_INDEX_WIDTH = 30;
+
 localparam HEADER_BYTE_COUNT = 8 * 4;
 localparam HEADER_SHIFT_COUNTER_LOAD = HEADER_BYTE_COUNT - 1;
 localparam HEADER_SHIFT_COUNTER_WIDTH = $clog2(HEADER_SHIFT_COUNTER_LOAD+1) + 1;
@@ -197,8 +268,15 @@ localparam HEADER_SHIFT_COUNTER_WIDTH = $clog2(HEADER_SHIFT_COUNTER_LOAD+1) + 1;
 localparam BYTECOUNT_WIDTH = $clog2(UDP_PACKET_CAPACITY-HEADER_BYTE_COUNT+1);
 localparam BYTECOUNTER_WIDTH = BYTECOUNT_WIDTH + 1;
 
+// Largest ADC byte count, including any encoding map and timing block,
+// that fits with header and limit excursion bitmaps
+localparam BITMAP_BYTE_COUNT = (4 * ADC_COUNT + 7) / 8;
+localparam BYTECOUNT_LIMIT = UDP_PACKET_CAPACITY - HEADER_BYTE_COUNT -
+                                                              BITMAP_BYTE_COUNT;
+
 // Support for forwarding values from one clock domain to another
-localparam FORWARD_DATA_WIDTH = 1 + BYTECOUNT_WIDTH + ADC_COUNT;
+localparam FORWARD_DATA_WIDTH = 1 + ENCODING_WIDTH + 1 + BYTECOUNT_WIDTH +
+                                                                     ADC_COUNT;
 reg sysForwardToggle = 0, acqForwardToggle = 0;
 (*ASYNC_REG="true"*) reg sysAcqForwardToggle_m = 0, acqSysForwardToggle_m = 0;
 reg sysAcqForwardToggle = 0, acqSysForwardToggle = 0;
@@ -211,29 +289,38 @@ reg [ADC_COUNT-1:0] sysActiveChannels = ~0;
 reg [BYTECOUNT_WIDTH-1:0] sysByteCount = 1400;
 reg sysSubscriberPresent = 0;
 reg sysIsCalibrated = 0;
+reg sysTimingEnabled = 0;
+reg [ENCODING_WIDTH-1:0] sysEncodings = 0;
+reg [ADC_SEL_WIDTH-1:0] sysEncodingRbkADCsel = 0;
 
 wire [ADC_SEL_WIDTH-1:0] sysADCsel = sysGPIO_OUT[ADC_WIDTH+:ADC_SEL_WIDTH];
-reg signed [ADC_WIDTH-1:0] sysThresholdLOLO [0:ADC_COUNT-1];
-reg signed [ADC_WIDTH-1:0] sysThresholdLO   [0:ADC_COUNT-1];
-reg signed [ADC_WIDTH-1:0] sysThresholdHI   [0:ADC_COUNT-1];
-reg signed [ADC_WIDTH-1:0] sysThresholdHIHI [0:ADC_COUNT-1];
-// Two-level multiplexer to make it easier to meet timing
-reg [(4*ADC_WIDTH)-1:0] sysThresholdRbkMux0;
-reg [ADC_SEL_WIDTH-1:0] sysThresholdRbkADCsel;
-reg               [1:0] sysThresholdRbkSel;
 
 always @(posedge sysClk) begin
     if (sysActiveBitmapStrobe) begin
         sysActiveChannels <= sysGPIO_OUT[0+:ADC_COUNT];
     end
     if (sysByteCountStrobe) begin
-        if (sysGPIO_OUT[16]) sysByteCount <= sysGPIO_OUT[0+:BYTECOUNT_WIDTH];
+        if (sysGPIO_OUT[16]) begin
+            // Clamp rather than wrap requests that would overflow a packet
+            if (sysGPIO_OUT[15:0] > BYTECOUNT_LIMIT) begin
+                sysByteCount <= BYTECOUNT_LIMIT;
+            end
+            else begin
+                sysByteCount <= sysGPIO_OUT[0+:BYTECOUNT_WIDTH];
+            end
+        end
         if (sysGPIO_OUT[24]) begin
             sysIsCalibrated <= 0;
         end
         else if (sysGPIO_OUT[25]) begin
             sysIsCalibrated <= 1;
         end
+        if (sysGPIO_OUT[26]) begin
+            sysTimingEnabled <= 0;
+        end
+        else if (sysGPIO_OUT[27]) begin
+            sysTimingEnabled <= 1;
+        end
         if (sysGPIO_OUT[30]) begin
             sysSubscriberPresent <= 0;
         end
@@ -241,16 +328,10 @@ always @(posedge sysClk) begin
             sysSubscriberPresent <= 1;
         end
     end
-    if (sysThresholdStrobe) begin
-        sysThresholdRbkADCsel <= sysADCsel;
-        sysThresholdRbkSel <= sysGPIO_OUT[31:30];
-        if (sysGPIO_OUT[29]) begin
-            case (sysGPIO_OUT[31:30])
-            2'b00:  sysThresholdLOLO[sysADCsel] <= sysGPIO_OUT[ADC_WIDTH-1:0];
-            2'b01:  sysThresholdLO  [sysADCsel] <= sysGPIO_OUT[ADC_WIDTH-1:0];
-            2'b10:  sysThresholdHI  [sysADCsel] <= sysGPIO_OUT[ADC_WIDTH-1:0];
-            2'b11:  sysThresholdHIHI[sysADCsel] <= sysGPIO_OUT[ADC_WIDTH-1:0];
-            endcase
+    if (sysEncodingStrobe) begin
+        sysEncodingRbkADCsel <= sysADCsel;
+        if (sysGPIO_OUT[31]) begin
+            sysEncodings[sysADCsel*2+:2] <= sysGPIO_OUT[1:0];
         end
     end
 
@@ -258,20 +339,11 @@ always @(posedge sysClk) begin
     sysAcqForwardToggle_m <= acqForwardToggle;
     sysAcqForwardToggle   <= sysAcqForwardToggle_m;
     if (sysForwardToggle == sysAcqForwardToggle) begin
-        sysForwardData <= {sysSubscriberPresent,sysByteCount,sysActiveChannels};
+        sysForwardData <= {sysTimingEnabled, sysEncodings,
+                           sysSubscriberPresent, sysByteCount,
+                           sysActiveChannels};
         sysForwardToggle <= !sysForwardToggle;
     end
-
-    // Threshold readback
-    sysThresholdRbkMux0 <= { sysThresholdHIHI[sysThresholdRbkADCsel],
-                             sysThresholdHI  [sysThresholdRbkADCsel],
-                             sysThresholdLO  [sysThresholdRbkADCsel],
-                             sysThresholdLOLO[sysThresholdRbkADCsel] };
-    sysThresholdRbk <= {
-               sysThresholdRbkSel,
-               {32-2-ADC_SEL_WIDTH-ADC_WIDTH{1'b0}},
-               sysThresholdRbkADCsel,
-               sysThresholdRbkMux0[(sysThresholdRbkSel*ADC_WIDTH)+:ADC_WIDTH] };
 end
 
 // Some in acqClk domain, but race condition to system clock domain unimportant.
@@ -282,10 +354,15 @@ assign sysStatus = { acqEnableAcquisition,
                      acquisitionActive,
                      sysSubscriberPresent,
                      sysIsCalibrated,
-                     24'b0,
+                     sysTimingEnabled,
+                     23'b0,
                      sendOverrun, adcOverrun, !sysTimeValid, !acqClkLocked };
 assign sysActiveRbk = sysActiveChannels;
 assign sysByteCountRbk = { {32-BYTECOUNT_WIDTH{1'b0}}, sysByteCount};
+assign sysEncodingRbk = { {32-ADC_WIDTH-ADC_SEL_WIDTH{1'b0}},
+                          sysEncodingRbkADCsel,
+                          {ADC_WIDTH-2{1'b0}},
+                          sysEncodings[sysEncodingRbkADCsel*2+:2] };
 
 ///////////////////////////////////////////////////////////////////////////////
 // Acquisition clock (acqClk) domain
@@ -307,6 +384,76 @@ wire       [ADC_COUNT-1:0] acqActiveChannels = acqForwardData[0+:ADC_COUNT];
 wire [BYTECOUNT_WIDTH-1:0] acqByteCount =
                                      acqForwardData[ADC_COUNT+:BYTECOUNT_WIDTH];
 wire acqSubscriberPresent = acqForwardData[ADC_COUNT+BYTECOUNT_WIDTH];
+wire [ENCODING_WIDTH-1:0] acqEncodings =
+                         acqForwardData[ADC_COUNT+BYTECOUNT_WIDTH+1+:ENCODING_WIDTH];
+wire acqTimed = acqForwardData[ADC_COUNT+BYTECOUNT_WIDTH+1+ENCODING_WIDTH];
+
+/*
+ * Sample timing measurements.
+ * These run whether or not acquisition is active so that values are
+ * available for the first packet.  The period accumulator counts acqClk
+ * ticks across 2^LOG2_PERIOD_INTERVALS sample intervals, which yields the
+ * period with that many fraction bits.  It saturates rather than wraps
+ * at very low sample rates and is then reported as invalid.
+ */
+reg                           periodRunning = 0, periodValid = 0;
+reg [LOG2_PERIOD_INTERVALS-1:0] periodIntervals = 0;
+reg                    [31:0] periodTicks = 0, samplePeriod = 0;
+reg                           strobeSeen = 0, phaseValid = 0;
+reg                    [31:0] strobeSeconds = 0, ppsPhase = 0;
+reg  [SAMPLE_INDEX_WIDTH-1:0] sampleIndex = 0;
+wire                          newSecond = (acqSeconds != strobeSeconds);
+wire                   [31:0] ppsPhaseNext = newSecond ? acqTicks : ppsPhase;
+wire                          phaseValidNext = newSecond ? strobeSeen :
+                                                           phaseValid;
+wire [SAMPLE_INDEX_WIDTH-1:0] sampleIndexNext = newSecond ? 0 :
+                                                            sampleIndex + 1;
+wire periodDone = periodRunning &&
+                  (periodIntervals == {LOG2_PERIOD_INTERVALS{1'b1}});
+always @(posedge acqClk) begin
+    if (acqStrobe) begin
+        strobeSeen <= 1;
+        strobeSeconds <= acqSeconds;
+        ppsPhase <= ppsPhaseNext;
+        phaseValid <= phaseValidNext;
+        sampleIndex <= sampleIndexNext;
+        periodRunning <= 1;
+        periodIntervals <= periodRunning ? periodIntervals + 1 : 0;
+        if (!periodRunning || periodDone) begin
+            periodTicks <= 1;
+        end
+        else if (periodTicks != ~32'b0) begin
+            periodTicks <= periodTicks + 1;
+        end
+        if (periodDone) begin
+            samplePeriod <= periodTicks;
+            periodValid <= (periodTicks != ~32'b0);
+        end
+    end
+    else if (periodTicks != ~32'b0) begin
+        periodTicks <= periodTicks + 1;
+    end
+end
+
+// Values derived from forwarded configuration, stable while acquiring
+reg acqEncoded = 0;
+reg [SAMPLE_BYTES_WIDTH-1:0] acqWorstCaseSampleBytes = 0;
+always @(posedge acqClk) begin: worstCase
+    integer c;
+    reg [SAMPLE_BYTES_WIDTH-1:0] sum;
+    sum = 0;
+    for (c = 0 ; c < ADC_COUNT ; c = c + 1) begin
+        if (acqActiveChannels[c]) begin
+            case (acqEncodings[c*2+:2])
+            ENCODE_16:    sum = sum + 2;
+            ENCODE_DELTA: sum = sum + BYTES_PER_ADC + 1;
+            default:      sum = sum + BYTES_PER_ADC;
+            endcase
+        end
+    end
+    acqWorstCaseSampleBytes <= sum;
+    acqEncoded <= (acqEncodings != 0);
+end
 
 // State machine counters
 
@@ -318,20 +465,32 @@ wire headerShiftCounterDone = headerShiftCounter[HEADER_SHIFT_COUNTER_WIDTH-1];
 (*MARK_DEBUG=DEBUG*) reg [ADC_SHIFT_COUNTER_WIDTH-1:0] adcShiftCounter;
 wire adcShiftCounterDone = adcShiftCounter[ADC_SHIFT_COUNTER_WIDTH-1];
 
-// Packet byte count
+// ADC bytes, including any encoding map and timing block, in this packet so far
 (*MARK_DEBUG=DEBUG*) reg [BYTECOUNTER_WIDTH-1:0] byteCounter;
-wire byteCounterDone = byteCounter[BYTECOUNTER_WIDTH-1];
 
-// Count bytes in a single ADC reading
-localparam ADC_BYTE_COUNTER_LOAD = BYTES_PER_ADC - 2;
-localparam ADC_BYTE_COUNTER_WIDTH = $clog2(ADC_BYTE_COUNTER_LOAD+1) + 1;
-reg [ADC_BYTE_COUNTER_WIDTH-1:0] adcByteCounter;
-wire adcByteCounterDone = adcByteCounter[ADC_BYTE_COUNTER_WIDTH-1];
+// Encoding map shift register count
+reg [ENCODING_SHIFT_COUNTER_WIDTH-1:0] encodingShiftCounter = ~0;
+wire encodingShiftCounterDone =
+                          encodingShiftCounter[ENCODING_SHIFT_COUNTER_WIDTH-1];
+reg [ENCODING_WIDTH-1:0] encodingMapShiftReg;
+
+// Timing block shift register count
+reg [TIMING_SHIFT_COUNTER_WIDTH-1:0] timingShiftCounter = ~0;
+wire timingShiftCounterDone = timingShiftCounter[TIMING_SHIFT_COUNTER_WIDTH-1];
+reg [TIMING_SHIFT_REG_WIDTH-1:0] timingShiftReg;
+
+// Bytes of the current ADC still to be sent
+reg [1:0] adcBytesRemaining = 0;
+reg [23:0] adcByteShiftReg;
 
 // State machine controls
 reg inPacket = 0;
 reg awaitAcqStrobe = 0;
 reg sendChecksumLo = 0;
+reg firstSampleInPacket = 0;
+reg lastSampleInPacket = 0;
+reg lastActiveChannel = 0;
+reg packetDone = 0;
 
 // Packet header
 localparam HEADER_SHIFT_REG_WIDTH = HEADER_BYTE_COUNT * 8;
@@ -340,72 +499,114 @@ reg [63:0] sequenceNumber = 1;
 // C code knows that there are clock-domain race conditions:
 assign sysSequenceNumber = sequenceNumber[31:0];
 
-// Threshold detection
-(*MARK_DEBUG=DEBUG*)wire [ADC_COUNT-1:0] belowLOLO, belowLO, aboveHI, aboveHIHI;
-assign acqLimitExcursions = { belowLOLO, belowLO, aboveHI, aboveHIHI };
-
-// ADC readings -- switch to big-endian
+// ADC readings, current and previous, consumed one channel at a time
 localparam ADC_SHIFT_REG_WIDTH = ADC_CHIP_COUNT*ADC_PER_CHIP*ADC_WIDTH;
-wire [ADC_SHIFT_REG_WIDTH-1:0] adcDataShiftLoad;
 reg  [ADC_SHIFT_REG_WIDTH-1:0] adcDataShiftReg;
+reg  [ADC_SHIFT_REG_WIDTH-1:0] adcPreviousShiftReg;
+reg       [ENCODING_WIDTH-1:0] encodingShiftReg;
+reg            [ADC_COUNT-1:0] activeChannelShiftReg;
 
-genvar i;
-generate
-for (i = 0 ; i < ADC_COUNT ; i = i + 1) begin : perADC
-    (*MARK_DEBUG=DEBUG*) wire signed [ADC_WIDTH-1:0] v =
-                                              acqData[(i*ADC_WIDTH)+:ADC_WIDTH];
-    (*MARK_DEBUG=DEBUG*) wire signed [ADC_WIDTH-1:0] LOLO = sysThresholdLOLO[i];
-    (*MARK_DEBUG=DEBUG*) wire signed [ADC_WIDTH-1:0] LO   = sysThresholdLO  [i];
-    (*MARK_DEBUG=DEBUG*) wire signed [ADC_WIDTH-1:0] HI   = sysThresholdHI  [i];
-    (*MARK_DEBUG=DEBUG*) wire signed [ADC_WIDTH-1:0] HIHI = sysThresholdHIHI[i];
-
-    assign adcDataShiftLoad[(i*ADC_WIDTH)+ 0+:8] = acqData[(i*ADC_WIDTH)+16+:8];
-    assign adcDataShiftLoad[(i*ADC_WIDTH)+ 8+:8] = acqData[(i*ADC_WIDTH)+ 8+:8];
-    assign adcDataShiftLoad[(i*ADC_WIDTH)+16+:8] = acqData[(i*ADC_WIDTH)+ 0+:8];
-
-    assign belowLOLO[i] = (v <= LOLO);
-    assign belowLO  [i] = (v <= LO);
-    assign aboveHI  [i] = (v >= HI);
-    assign aboveHIHI[i] = (v >= HIHI);
-end
-endgenerate
+/*
+ * Encode the ADC at the bottom of the shift register.
+ * Result is sent most significant byte first.
+ */
+wire signed [ADC_WIDTH-1:0] adcValue = adcDataShiftReg[0+:ADC_WIDTH];
+wire signed [ADC_WIDTH-1:0] adcPrevious = adcPreviousShiftReg[0+:ADC_WIDTH];
+wire signed   [ADC_WIDTH:0] adcDelta = adcValue - adcPrevious;
+wire signed   [ADC_WIDTH:0] adcRounded = adcValue + 128;
+wire                  [1:0] adcEncoding = encodingShiftReg[1:0];
+wire adcDeltaFits = !firstSampleInPacket && (adcDelta >= -127)
+                                         && (adcDelta <=  127);
+wire [15:0] adc16 = adcRounded[ADC_WIDTH] != adcRounded[ADC_WIDTH-1] ?
+                    16'h7FFF : adcRounded[ADC_WIDTH-1-:16];
+wire [31:0] adcEncoded =
+          (adcEncoding == ENCODE_16) ? { adc16, 16'bx } :
+          (adcEncoding == ENCODE_DELTA) ?
+                (adcDeltaFits ? { adcDelta[7:0], 24'bx } :
+                                { DELTA_ESCAPE, adcValue }) :
+                                { adcValue, 8'bx };
+wire [2:0] adcEncodedCount =
+          (adcEncoding == ENCODE_16) ? 2 :
+          (adcEncoding == ENCODE_DELTA) ? (adcDeltaFits ? 1 : 4) :
+                                          BYTES_PER_ADC;
+wire adcActive = activeChannelShiftReg[0];
+wire adcLastActive = (activeChannelShiftReg[ADC_COUNT-1:1] == 0);
 
 /*
- * The '- 8' arises from the fact that the pscdrvByteCount does not include
- * the first 8 bytes of the header (4-byte magic word and 4-byte size).
- * The '+ 16' arises from the fact that the HEADER_BYTE_COUNT does not
- * take into account the 4 4-byte limit excursion bitmaps.
+ * A packet ends with the sample after which another worst-case
+ * sample might not fit.  With all channels ENCODE_24 this is the
+ * sample that fills a byte count that is a multiple of the sample size.
  */
-wire [31:0] pscdrvByteCount = {1'b0, acqByteCount} + HEADER_BYTE_COUNT - 8 + 16;
+wire [BYTECOUNTER_WIDTH-1:0] byteCounterStart =
+                                   (acqEncoded ? ENCODING_BYTE_COUNT : 0) +
+                                   (acqTimed ? TIMING_BYTE_COUNT : 0);
+wire [BYTECOUNTER_WIDTH-1:0] sampleStartByteCount = inPacket ?
+                                                byteCounter : byteCounterStart;
+wire isLastSample = (sampleStartByteCount + (2 * acqWorstCaseSampleBytes)) >
+                                                                   acqByteCount;
 
-// Active channels
-reg [ADC_COUNT-1:0] activeChannelShiftReg;
+/*
+ * The size of the packet isn't known until the end when encodings are
+ * in use, so mergeLimitExcursions replaces the header size field with
+ * packetSize.  The '- 8' arises from the fact that the PSCDRV byte
+ * count does not include the first 8 bytes of the header (4-byte magic
+ * word and 4-byte size).  The '+ BITMAP_BYTE_COUNT' arises from the
+ * fact that the HEADER_BYTE_COUNT does not take into account the
+ * limit excursion bitmaps.
+ */
+wire [31:0] packetSizeNext = {1'b0, byteCounter} + 1 +
+                                   HEADER_BYTE_COUNT - 8 + BITMAP_BYTE_COUNT;
 
 always @(posedge acqClk) begin
     if (acquisitionActive) begin
         if (M_TVALID && !M_TREADY) begin
             sendOverrun <= 1;
         end
+        /*
+         * Limit excursions arrive a few clocks after the acquisition strobe,
+         * well before the last byte of the sample has been sent.
+         */
+        if (acqLimitExcursionsTVALID && inPacket) begin
+            packetLimitExcursions <= packetLimitExcursions |
+                                                             acqLimitExcursions;
+        end
         if (awaitAcqStrobe) begin
             if (acqStrobe) begin
-                adcDataShiftReg <= adcDataShiftLoad;
+                adcDataShiftReg <= acqData;
                 adcShiftCounter <= ADC_SHIFT_COUNTER_LOAD;
                 activeChannelShiftReg <= acqActiveChannels;
-                adcByteCounter <= ADC_BYTE_COUNTER_LOAD;
-                packetLimitExcursions <= packetLimitExcursions |
-                                                             acqLimitExcursions;
+                encodingShiftReg <= acqEncodings;
+                lastSampleInPacket <= isLastSample;
                 awaitAcqStrobe <= 0;
                 inPacket <= 1;
                 if (!inPacket) begin
                     sendChecksumLo <= 1;
+                    firstSampleInPacket <= 1;
+                    packetDone <= 0;
                     headerShiftCounter <= HEADER_SHIFT_COUNTER_LOAD;
-                    byteCounter <= acqByteCount - 2;
+                    if (acqEncoded) begin
+                        encodingShiftCounter <= ENCODING_SHIFT_COUNTER_LOAD;
+                    end
+                    encodingMapShiftReg <= acqEncodings;
+                    if (acqTimed) begin
+                        timingShiftCounter <= TIMING_SHIFT_COUNTER_LOAD;
+                    end
+                    timingShiftReg <= { acqTicks,
+                                        samplePeriod,
+                                        ppsPhaseNext,
+                                        periodValid,
+                                        phaseValidNext,
+                                        sampleIndexNext };
+                    byteCounter <= byteCounterStart;
                     sequenceNumber <= sequenceNumber + 1;
                     /* PSCDRV packet header with additional fields */
                     headerShiftReg <= {
                           "P", "S", "N", "B",
-                          pscdrvByteCount,
-                          { {27{1'b0}},
+                          32'b0, /* Size -- filled in by mergeLimitExcursions */
+                          { 8'd0, /* Packet type -- ADC data */
+                            {17{1'b0}},
+                            acqTimed,
+                            acqEncoded,
                             !sysIsCalibrated,
                             sendOverrun, adcOverrun,
                             !acqTimeValid, !acqClkLocked },
@@ -428,41 +629,72 @@ always @(posedge acqClk) begin
                 headerShiftReg <= {headerShiftReg[0+:HEADER_SHIFT_REG_WIDTH-8],
                                                                          8'bx };
             end
-            else if (!adcShiftCounterDone) begin
-                adcShiftCounter <= adcShiftCounter - 1;
-                M_TDATA <= adcDataShiftReg[7:0];
-                M_TVALID <= activeChannelShiftReg[0];
-                adcDataShiftReg <= { 8'bx,
-                                    adcDataShiftReg[8+:ADC_SHIFT_REG_WIDTH-8] };
-                if (adcByteCounterDone) begin
-                    adcByteCounter <= ADC_BYTE_COUNTER_LOAD;
-                        // Shift in 1's from the top to ensure that the
-                        // byteCounter is updated in case of a mismatch
-                        // between the bit map and the byte count.
-                        // We don't want to risk getting stuck here
-                        // because some client failed to abide by
-                        // proper operating procedure.
-                        activeChannelShiftReg <= { 1'b1,
-                                         activeChannelShiftReg[ADC_COUNT-1:1] };
+            else if (!timingShiftCounterDone) begin
+                timingShiftCounter <= timingShiftCounter - 1;
+                M_TDATA <= timingShiftReg[TIMING_SHIFT_REG_WIDTH-1-:8];
+                M_TVALID <= 1;
+                timingShiftReg <= {timingShiftReg[0+:TIMING_SHIFT_REG_WIDTH-8],
+                                                                         8'bx };
+            end
+            else if (!encodingShiftCounterDone) begin
+                encodingShiftCounter <= encodingShiftCounter - 1;
+                M_TDATA <= encodingMapShiftReg[ENCODING_WIDTH-1-:8];
+                M_TVALID <= 1;
+                encodingMapShiftReg <= {encodingMapShiftReg[0+:ENCODING_WIDTH-8],
+                                                                         8'bx };
+            end
+            else if (adcBytesRemaining != 0) begin
+                adcBytesRemaining <= adcBytesRemaining - 1;
+                M_TDATA <= adcByteShiftReg[23:16];
+                M_TVALID <= 1;
+                adcByteShiftReg <= { adcByteShiftReg[15:0], 8'bx };
+                byteCounter <= byteCounter + 1;
+                packetSize <= packetSizeNext;
+                if (lastSampleInPacket && lastActiveChannel
+                 && (adcBytesRemaining == 1)) begin
+                    M_TLAST <= 1;
+                    packetDone <= 1;
                 end
                 else begin
-                    adcByteCounter <= adcByteCounter - 1;
-                end
-                if (activeChannelShiftReg[0]) begin
-                    byteCounter <= byteCounter - 1;
+                    M_TLAST <= 0;
                 end
-                if (byteCounterDone) begin
-                    M_TLAST <= 1;
+            end
+            else if (!adcShiftCounterDone) begin
+                adcShiftCounter <= adcShiftCounter - 1;
+                M_TDATA <= adcEncoded[31:24];
+                M_TVALID <= adcActive;
+                adcByteShiftReg <= adcEncoded[23:0];
+                adcBytesRemaining <= adcActive ? adcEncodedCount - 1 : 0;
+                lastActiveChannel <= adcLastActive;
+                M_TLAST <= 0;
+                if (adcActive) begin
+                    byteCounter <= byteCounter + 1;
+                    packetSize <= packetSizeNext;
+                    if (lastSampleInPacket && adcLastActive
+                     && (adcEncodedCount == 1)) begin
+                        M_TLAST <= 1;
+                        packetDone <= 1;
+                    end
                 end
+                adcDataShiftReg <= { {ADC_WIDTH{1'bx}},
+                             adcDataShiftReg[ADC_WIDTH+:ADC_SHIFT_REG_WIDTH-ADC_WIDTH] };
+                adcPreviousShiftReg <= { adcValue,
+                         adcPreviousShiftReg[ADC_WIDTH+:ADC_SHIFT_REG_WIDTH-ADC_WIDTH] };
+                encodingShiftReg <= { 2'bx,
+                                      encodingShiftReg[2+:ENCODING_WIDTH-2] };
+                activeChannelShiftReg <= { 1'b0,
+                                         activeChannelShiftReg[ADC_COUNT-1:1] };
             end
             else begin
                 M_TVALID <= 0;
                 M_TLAST <= 0;
-                if (M_TLAST) begin
+                firstSampleInPacket <= 0;
+                if (packetDone) begin
                     inPacket <= 0;
                     packetLimitExcursions <= 0;
                     acquisitionActive <= (acqEnableAcquisition &&
-                                          acqSubscriberPresent);
+                                          acqSubscriberPresent &&
+                                          (acqActiveChannels != 0));
                 end
                 awaitAcqStrobe <= 1;
             end
@@ -472,7 +704,8 @@ always @(posedge acqClk) begin
         sequenceNumber <= {acqSeconds, 32'b0};
         awaitAcqStrobe <= 1;
         packetLimitExcursions <= 0;
-        if (acqEnableAcquisition && acqSubscriberPresent) begin
+        if (acqEnableAcquisition && acqSubscriberPresent
+         && (acqActiveChannels != 0)) begin
             adcOverrun <= 0;
             sendOverrun <= 0;
             acquisitionActive <= 1;
@@ -0,0 +1,448 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Pre/post-trigger capture of full-resolution ADC readings.
+ * Readings are written, one channel per clock, to a circular buffer
+ * SAMPLE_COUNT samples deep.  Once armed the buffer is filled with enough
+ * samples to satisfy the pre-trigger count then recording continues until
+ * a trigger arrives and the requested number of post-trigger samples has
+ * been written.  The buffer is then frozen and its contents streamed out
+ * as a burst of PSNB packets spaced PACKET_GAP clocks apart.
+ *
+ * Trigger sources:
+ *   Rising edge of any local MPS trip (same limit excursions as mpsLocal)
+ *   EVR trigger event
+ *   Software
+ *
+ * CSR write:
+ *   Bit 31 -- Arm.  When waiting for a trigger this forces a trigger.
+ *   Bit 30 -- Send the frozen buffer again
+ *   Bit 29 -- Enable EVR trigger
+ *   Bit 28 -- Enable MPS trip trigger
+ *   Bits (SAMPLE_ADDRESS_WIDTH-1):0 -- Number of samples following the
+ *                                      trigger sample, at most SAMPLE_COUNT-2
+ * Bits 29:0 are used only when arming from the idle state.
+ *
+ * CSR read:
+ *   Bits 31:29 -- State (0 idle, 1 fill, 2 await trigger, 3 post trigger,
+ *                 4 send)
+ *   Bits 28:26 -- Trigger cause (software, EVR, MPS)
+ *   Bit 25     -- Buffer holds a frozen capture
+ *   Bits (SAMPLE_ADDRESS_WIDTH-1):0 -- Post-trigger sample count
+ *
+ * Capture packet layout:
+ *   Bytes  0-3   "PSNB"
+ *   Bytes  4-7   Size (bytes following this field)
+ *   Bytes  8-11  Status: bits 31:24 packet type (2), bits 2:0 trigger cause
+ *   Bytes 12-15  Offset of first sample in packet from trigger sample (signed)
+ *   Bytes 16-19  Capture number
+ *   Bytes 20-23  Packet number within capture
+ *   Bytes 24-31  Timestamp (seconds, nanoseconds) of trigger sample
+ *   Then, for each sample, the readings from each channel in order, each
+ *   ADC_BYTE_COUNT bytes, big-endian.
+ */
+`default_nettype none
+module captureADC #(
+    parameter ADC_CHIP_COUNT      = 4,
+    parameter ADC_PER_CHIP        = 8,
+    parameter ADC_WIDTH           = 24,
+    parameter SAMPLE_COUNT        = 2048,
+    parameter UDP_PACKET_CAPACITY = 1472,
+    parameter PACKET_GAP          = 12500,
+    parameter DEBUG               = "false"
+    ) (
+    input  wire        sysClk,
+    input  wire        sysCsrStrobe,
+    input  wire [31:0] sysGPIO_OUT,
+    output wire [31:0] sysStatus,
+
+    input  wire evrClk,
+    input  wire evrTriggerStrobe,
+
+    input  wire                                               acqClk,
+    input  wire                                               acqStrobe,
+    input  wire [(ADC_CHIP_COUNT*ADC_PER_CHIP*ADC_WIDTH)-1:0] acqData,
+    input  wire                                        [31:0] acqSeconds,
+    input  wire                                        [31:0] acqTicks,
+    input  wire                                               acqMPStripped,
+
+    (*MARK_DEBUG=DEBUG*) output reg        M_TVALID = 0,
+    (*MARK_DEBUG=DEBUG*) output reg        M_TLAST = 0,
+    (*MARK_DEBUG=DEBUG*) output reg  [7:0] M_TDATA = 0,
+    (*MARK_DEBUG=DEBUG*) input  wire       M_TREADY);
+
+localparam ADC_COUNT = ADC_CHIP_COUNT * ADC_PER_CHIP;
+localparam ADC_BYTE_COUNT = (ADC_WIDTH + 7) / 8;
+localparam CHANNEL_ADDRESS_WIDTH = $clog2(ADC_COUNT);
+localparam SAMPLE_ADDRESS_WIDTH = $clog2(SAMPLE_COUNT);
+localparam HEADER_BYTE_COUNT = 32;
+localparam SAMPLE_BYTE_COUNT = ADC_COUNT * ADC_BYTE_COUNT;
+localparam SAMPLES_PER_PACKET = (UDP_PACKET_CAPACITY - HEADER_BYTE_COUNT) /
+                                                             SAMPLE_BYTE_COUNT;
+localparam CAUSE_WIDTH = 3;
+
+//
+// Simple dual-port RAM
+//
+reg [ADC_WIDTH-1:0] dpram [0:(1<<(SAMPLE_ADDRESS_WIDTH+
+                                  CHANNEL_ADDRESS_WIDTH))-1];
+
+///////////////////////////////////////////////////////////////////////////////
+// System clock domain
+reg sysArmToggle = 0, sysResendToggle = 0;
+reg [1:0] sysTriggerEnables = 0;
+reg [SAMPLE_ADDRESS_WIDTH-1:0] sysPostTriggerCount = 0;
+
+always @(posedge sysClk) begin
+    if (sysCsrStrobe) begin
+        if (sysGPIO_OUT[31]) begin
+            sysArmToggle <= !sysArmToggle;
+            sysTriggerEnables <= sysGPIO_OUT[29:28];
+            sysPostTriggerCount <= sysGPIO_OUT[0+:SAMPLE_ADDRESS_WIDTH];
+        end
+        if (sysGPIO_OUT[30]) begin
+            sysResendToggle <= !sysResendToggle;
+        end
+    end
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Event receiver clock domain
+// Stretch event strobe to ensure it's seen in the acquisition clock domain.
+reg [4:0] evrEventStretch = 0;
+wire evrTrigger = evrEventStretch[4];
+always @(posedge evrClk) begin
+    if (evrTriggerStrobe) begin
+        evrEventStretch <= ~0;
+    end
+    else if (evrTrigger) begin
+        evrEventStretch <= evrEventStretch - 1;
+    end
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Acquisition clock domain
+(*ASYNC_REG="true"*) reg acqArmToggle_m = 0, acqResendToggle_m = 0;
+(*ASYNC_REG="true"*) reg acqEVRtrigger_m = 0;
+(*MARK_DEBUG=DEBUG*) reg acqArmToggle = 0, acqArmToggle_d = 0;
+(*MARK_DEBUG=DEBUG*) reg acqResendToggle = 0, acqResendToggle_d = 0;
+reg acqEVRtrigger_d0 = 0, acqEVRtrigger_d1 = 0;
+reg acqMPStripped_d = 0;
+wire acqArm = (acqArmToggle != acqArmToggle_d);
+wire acqResend = (acqResendToggle != acqResendToggle_d);
+wire acqEVRtrigger = acqEVRtrigger_d0 && !acqEVRtrigger_d1;
+wire acqMPStrip = acqMPStripped && !acqMPStripped_d;
+
+always @(posedge acqClk) begin
+    acqArmToggle_m    <= sysArmToggle;
+    acqArmToggle      <= acqArmToggle_m;
+    acqArmToggle_d    <= acqArmToggle;
+    acqResendToggle_m <= sysResendToggle;
+    acqResendToggle   <= acqResendToggle_m;
+    acqResendToggle_d <= acqResendToggle;
+    acqEVRtrigger_m   <= evrTrigger;
+    acqEVRtrigger_d0  <= acqEVRtrigger_m;
+    acqEVRtrigger_d1  <= acqEVRtrigger_d0;
+    acqMPStripped_d   <= acqMPStripped;
+end
+
+//
+// Write readings to buffer
+//
+localparam CHANNEL_COUNTER_LOAD = ADC_COUNT - 2;
+localparam CHANNEL_COUNTER_WIDTH = $clog2(CHANNEL_COUNTER_LOAD+1) + 1;
+
+localparam ST_IDLE          = 3'd0,
+           ST_FILL          = 3'd1,
+           ST_AWAIT_TRIGGER = 3'd2,
+           ST_POST_TRIGGER  = 3'd3,
+           ST_SEND          = 3'd4;
+(*MARK_DEBUG=DEBUG*) reg [2:0] acqState = ST_IDLE;
+wire acqRecording = (acqState == ST_FILL)
+                 || (acqState == ST_AWAIT_TRIGGER)
+                 || (acqState == ST_POST_TRIGGER);
+
+reg [(ADC_COUNT*ADC_WIDTH)-1:0] writeShift;
+(*MARK_DEBUG=DEBUG*) reg writeActive = 0;
+reg [CHANNEL_COUNTER_WIDTH-1:0] writeCounter = CHANNEL_COUNTER_LOAD;
+wire writeCounterDone = writeCounter[CHANNEL_COUNTER_WIDTH-1];
+reg [CHANNEL_ADDRESS_WIDTH-1:0] writeChannel = 0;
+reg [SAMPLE_ADDRESS_WIDTH-1:0] writeSample = 0;
+reg sampleDone = 0;
+reg [31:0] sampleSeconds = 0, sampleTicks = 0;
+
+always @(posedge acqClk) begin
+    if (acqStrobe && acqRecording) begin
+        writeShift <= acqData;
+        writeActive <= 1;
+        writeCounter <= CHANNEL_COUNTER_LOAD;
+        writeChannel <= 0;
+        sampleSeconds <= acqSeconds;
+        sampleTicks <= acqTicks;
+        sampleDone <= 0;
+    end
+    else if (writeActive) begin
+        dpram[{writeSample, writeChannel}] <= writeShift[0+:ADC_WIDTH];
+        writeShift <= writeShift >> ADC_WIDTH;
+        writeChannel <= writeChannel + 1;
+        if (writeCounterDone) begin
+            writeActive <= 0;
+            writeSample <= writeSample + 1;
+            sampleDone <= 1;
+        end
+        else begin
+            writeCounter <= writeCounter - 1;
+        end
+    end
+    else begin
+        sampleDone <= 0;
+    end
+end
+
+//
+// Trigger state machine
+//
+localparam SAMPLE_COUNTER_WIDTH = SAMPLE_ADDRESS_WIDTH + 1;
+localparam POST_TRIGGER_LIMIT = SAMPLE_COUNT - 2;
+
+wire [SAMPLE_ADDRESS_WIDTH-1:0] postTriggerRequest =
+                             (sysPostTriggerCount > POST_TRIGGER_LIMIT) ?
+                             POST_TRIGGER_LIMIT : sysPostTriggerCount;
+reg [SAMPLE_ADDRESS_WIDTH-1:0] postTriggerCount = 0;
+reg [1:0] triggerEnables = 0;
+reg [SAMPLE_COUNTER_WIDTH-1:0] sampleCounter = 0;
+wire sampleCounterDone = sampleCounter[SAMPLE_COUNTER_WIDTH-1];
+(*MARK_DEBUG=DEBUG*) reg [CAUSE_WIDTH-1:0] pendingCause = 0;
+(*MARK_DEBUG=DEBUG*) reg [CAUSE_WIDTH-1:0] triggerCause = 0;
+reg [31:0] triggerSeconds = 0, triggerTicks = 0;
+reg captureValid = 0;
+reg [31:0] captureCount = 0;
+reg [SAMPLE_ADDRESS_WIDTH-1:0] readStart = 0;
+reg sendStart = 0;
+(*MARK_DEBUG=DEBUG*) reg txActive = 0;
+
+always @(posedge acqClk) begin
+    case (acqState)
+    ST_IDLE: begin
+        pendingCause <= 0;
+        if (acqArm) begin
+            triggerEnables <= sysTriggerEnables;
+            postTriggerCount <= postTriggerRequest;
+            sampleCounter <= (SAMPLE_COUNT - 3) - postTriggerRequest;
+            captureValid <= 0;
+            acqState <= ST_FILL;
+        end
+        else if (acqResend && captureValid) begin
+            sendStart <= 1;
+            acqState <= ST_SEND;
+        end
+    end
+    ST_FILL: begin
+        if (sampleDone) begin
+            if (sampleCounterDone) begin
+                acqState <= ST_AWAIT_TRIGGER;
+            end
+            else begin
+                sampleCounter <= sampleCounter - 1;
+            end
+        end
+    end
+    ST_AWAIT_TRIGGER: begin
+        if (sampleDone && (pendingCause != 0)) begin
+            triggerCause <= pendingCause;
+            triggerSeconds <= sampleSeconds;
+            triggerTicks <= sampleTicks;
+            sampleCounter <= postTriggerCount - 2;
+            if (postTriggerCount == 0) begin
+                captureValid <= 1;
+                captureCount <= captureCount + 1;
+                readStart <= writeSample;
+                sendStart <= 1;
+                acqState <= ST_SEND;
+            end
+            else begin
+                acqState <= ST_POST_TRIGGER;
+            end
+        end
+        else begin
+            if (acqArm) pendingCause[2] <= 1;
+            if (acqEVRtrigger && triggerEnables[1]) pendingCause[1] <= 1;
+            if (acqMPStrip && triggerEnables[0]) pendingCause[0] <= 1;
+        end
+    end
+    ST_POST_TRIGGER: begin
+        if (sampleDone) begin
+            if (sampleCounterDone) begin
+                captureValid <= 1;
+                captureCount <= captureCount + 1;
+                readStart <= writeSample;
+                sendStart <= 1;
+                acqState <= ST_SEND;
+            end
+            else begin
+                sampleCounter <= sampleCounter - 1;
+            end
+        end
+    end
+    ST_SEND: begin
+        sendStart <= 0;
+        if (!sendStart && !txActive) begin
+            acqState <= ST_IDLE;
+        end
+    end
+    default: acqState <= ST_IDLE;
+    endcase
+end
+
+// Some values in acquisition clock domain, but races unimportant
+assign sysStatus = { acqState, triggerCause, captureValid,
+                     {25-SAMPLE_ADDRESS_WIDTH{1'b0}}, postTriggerCount };
+
+//
+// Send frozen buffer
+//
+localparam HEADER_SHIFT_REG_WIDTH = HEADER_BYTE_COUNT * 8;
+localparam HEADER_COUNTER_LOAD = HEADER_BYTE_COUNT - 2;
+localparam READING_COUNTER_LOAD = ADC_BYTE_COUNT - 2;
+localparam BYTE_COUNTER_WIDTH = $clog2(HEADER_COUNTER_LOAD+1) + 1;
+localparam GAP_COUNTER_LOAD = PACKET_GAP - 2;
+localparam GAP_COUNTER_WIDTH = $clog2(GAP_COUNTER_LOAD+1) + 1;
+
+localparam TX_IDLE = 2'd0,
+           TX_GAP  = 2'd1,
+           TX_SEND = 2'd2,
+           TX_LOAD = 2'd3;
+(*MARK_DEBUG=DEBUG*) reg [1:0] txState = TX_IDLE;
+reg [HEADER_SHIFT_REG_WIDTH-1:0] txShift = 0;
+reg [BYTE_COUNTER_WIDTH-1:0] txByteCounter = HEADER_COUNTER_LOAD;
+wire txByteCounterDone = txByteCounter[BYTE_COUNTER_WIDTH-1];
+reg [GAP_COUNTER_WIDTH-1:0] txGapCounter = GAP_COUNTER_LOAD;
+wire txGapCounterDone = txGapCounter[GAP_COUNTER_WIDTH-1];
+reg [SAMPLE_COUNTER_WIDTH-1:0] txSamplesRemaining = 0;
+reg [SAMPLE_COUNTER_WIDTH-1:0] txPacketSamplesRemaining = 0;
+wire [SAMPLE_COUNTER_WIDTH-1:0] txPacketSampleCount =
+                                 (txSamplesRemaining > SAMPLES_PER_PACKET) ?
+                                 SAMPLES_PER_PACKET : txSamplesRemaining;
+wire [31:0] txPacketSize = (HEADER_BYTE_COUNT - 8) +
+                           (txPacketSampleCount * SAMPLE_BYTE_COUNT);
+reg [SAMPLE_ADDRESS_WIDTH-1:0] readSample = 0;
+reg [CHANNEL_ADDRESS_WIDTH-1:0] readChannel = 0;
+reg [ADC_WIDTH-1:0] dpramQ = 0;
+reg signed [31:0] txOffset = 0;
+reg [31:0] txPacketIndex = 0;
+reg txLastChunk = 0;
+
+always @(posedge acqClk) begin
+    dpramQ <= dpram[{readSample, readChannel}];
+    if (M_TVALID && M_TREADY) begin
+        M_TVALID <= 0;
+        M_TLAST <= 0;
+    end
+    case (txState)
+    TX_IDLE: begin
+        if (sendStart) begin
+            txActive <= 1;
+            txSamplesRemaining <= SAMPLE_COUNT;
+            txOffset <= postTriggerCount - (SAMPLE_COUNT - 1);
+            txPacketIndex <= 0;
+            readSample <= readStart;
+            readChannel <= 0;
+            txGapCounter <= {GAP_COUNTER_WIDTH{1'b1}};
+            txState <= TX_GAP;
+        end
+        else begin
+            txActive <= 0;
+        end
+    end
+    TX_GAP: begin
+        if (txGapCounterDone) begin
+            if (txSamplesRemaining == 0) begin
+                txState <= TX_IDLE;
+            end
+            else begin
+                txShift <= {
+                      "P", "S", "N", "B",
+                      txPacketSize,
+                      { 8'd2, /* Packet type */
+                        {32-8-CAUSE_WIDTH{1'b0}},
+                        triggerCause },
+                      txOffset,
+                      captureCount,
+                      txPacketIndex,
+                      triggerSeconds,
+                      {triggerTicks[0+:29], 3'b000} }; /* nanoseconds */
+                txByteCounter <= HEADER_COUNTER_LOAD;
+                txLastChunk <= 0;
+                txPacketSamplesRemaining <= txPacketSampleCount;
+                txSamplesRemaining <= txSamplesRemaining - txPacketSampleCount;
+                txOffset <= txOffset + txPacketSampleCount;
+                txPacketIndex <= txPacketIndex + 1;
+                txState <= TX_SEND;
+            end
+        end
+        else begin
+            txGapCounter <= txGapCounter - 1;
+        end
+    end
+    TX_SEND: begin
+        if (!M_TVALID || M_TREADY) begin
+            M_TVALID <= 1;
+            M_TDATA <= txShift[HEADER_SHIFT_REG_WIDTH-1-:8];
+            txShift <= txShift << 8;
+            txByteCounter <= txByteCounter - 1;
+            if (txByteCounterDone) begin
+                if (txLastChunk) begin
+                    M_TLAST <= 1;
+                    txGapCounter <= GAP_COUNTER_LOAD;
+                    txState <= TX_GAP;
+                end
+                else begin
+                    txState <= TX_LOAD;
+                end
+            end
+        end
+    end
+    TX_LOAD: begin
+        txShift <= { {(ADC_BYTE_COUNT*8)-ADC_WIDTH{dpramQ[ADC_WIDTH-1]}},
+                     dpramQ,
+                     {HEADER_SHIFT_REG_WIDTH-(ADC_BYTE_COUNT*8){1'b0}} };
+        txByteCounter <= READING_COUNTER_LOAD;
+        if (readChannel == (ADC_COUNT - 1)) begin
+            readChannel <= 0;
+            readSample <= readSample + 1;
+            txPacketSamplesRemaining <= txPacketSamplesRemaining - 1;
+            txLastChunk <= (txPacketSamplesRemaining == 1);
+        end
+        else begin
+            readChannel <= readChannel + 1;
+        end
+        txState <= TX_SEND;
+    end
+    default: txState <= TX_IDLE;
+    endcase
+end
+
+endmodule
+`default_nettype wire
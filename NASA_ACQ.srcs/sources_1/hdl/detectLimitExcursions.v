@@ -0,0 +1,299 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Compare ADC readings with per-channel limits.
+ * Each channel has LOLO, LO, HI and HIHI thresholds, a hysteresis band
+ * and a debounce count.  A reading enters the HI excursion region when it
+ * is at or above the HI threshold and leaves when it is below the HI
+ * threshold less the hysteresis band.  The HIHI level works the same way
+ * and LO and LOLO are the mirror image.  A change of state takes effect
+ * only once the debounce count of consecutive readings have called for it.
+ * With a hysteresis band of 0 and a debounce count of 0 or 1 each reading
+ * is simply compared with the thresholds.
+ *
+ * Readings are processed LANES channels per clock so that the comparators
+ * are shared between channels.  The excursion bitmaps are valid while
+ * acqLimitExcursionsTVALID is asserted, ADC_COUNT/LANES+3 clocks after
+ * the acquisition strobe.  There must be more clocks than that between
+ * acquisition strobes.
+ *
+ * CSR write:
+ *   Bits 31:30 -- Threshold level (0 LOLO, 1 LO, 2 HI, 3 HIHI)
+ *                 or setting (0 hysteresis band, 1 debounce count)
+ *   Bit 29     -- Write threshold
+ *   Bits (ADC_WIDTH+ADC_SEL_WIDTH-1):ADC_WIDTH -- Channel
+ *   Bits (ADC_WIDTH-1):0 -- Threshold (signed)
+ *   When bit 29 is clear:
+ *     Bit ADC_WIDTH-1 -- Access setting rather than threshold
+ *     Bit ADC_WIDTH-2 -- Write setting
+ *     Bits (ADC_WIDTH-3):0 -- Setting (unsigned)
+ * Every write selects the value to be read back.
+ * CSR read:
+ *   Bits 31:30 and channel as written
+ *   Bit ADC_WIDTH-1 set and bits (ADC_WIDTH-3):0 setting value when
+ *   reading back a setting, otherwise bits (ADC_WIDTH-1):0 threshold.
+ */
+`default_nettype none
+module detectLimitExcursions #(
+    parameter ADC_CHIP_COUNT = 4,
+    parameter ADC_PER_CHIP   = 8,
+    parameter ADC_WIDTH      = 24,
+    parameter LOG2_LANES     = 2,
+    parameter DEBUG          = "false"
+    ) (
+    input  wire        sysClk,
+    input  wire        sysThresholdStrobe,
+    input  wire [31:0] sysGPIO_OUT,
+    output reg  [31:0] sysThresholdRbk,
+
+                         input  wire acqClk,
+    (*MARK_DEBUG=DEBUG*) input  wire acqStrobe,
+    input  wire [(ADC_CHIP_COUNT*ADC_PER_CHIP*ADC_WIDTH)-1:0] acqData,
+    (*MARK_DEBUG=DEBUG*) output wire [(4*ADC_CHIP_COUNT*ADC_PER_CHIP)-1:0]
+                                                        acqLimitExcursions,
+    (*MARK_DEBUG=DEBUG*) output reg  acqLimitExcursionsTVALID = 0);
+
+localparam ADC_COUNT = ADC_CHIP_COUNT * ADC_PER_CHIP;
+localparam ADC_SEL_WIDTH = $clog2(ADC_COUNT);
+localparam LANES = 1 << LOG2_LANES;
+localparam STEPS = ADC_COUNT / LANES;
+localparam STEP_WIDTH = ADC_SEL_WIDTH - LOG2_LANES;
+localparam HYSTERESIS_WIDTH = ADC_WIDTH - 2;
+localparam DEBOUNCE_WIDTH = 8;
+localparam SETTINGS_WIDTH = (4 * ADC_WIDTH) + HYSTERESIS_WIDTH + DEBOUNCE_WIDTH;
+
+///////////////////////////////////////////////////////////////////////////////
+// System clock (sysClk) domain
+
+wire       [ADC_SEL_WIDTH-1:0] sysADCsel = sysGPIO_OUT[ADC_WIDTH+:ADC_SEL_WIDTH];
+wire          [LOG2_LANES-1:0] sysLane = sysADCsel[0+:LOG2_LANES];
+wire          [STEP_WIDTH-1:0] sysStep = sysADCsel[LOG2_LANES+:STEP_WIDTH];
+wire                     [1:0] sysSel = sysGPIO_OUT[31:30];
+wire sysWriteThreshold = sysThresholdStrobe && sysGPIO_OUT[29];
+wire sysSetting = !sysGPIO_OUT[29] && sysGPIO_OUT[ADC_WIDTH-1];
+wire sysWriteSetting = sysThresholdStrobe && sysSetting &&
+                                                     sysGPIO_OUT[ADC_WIDTH-2];
+
+// Two-level multiplexer to make it easier to meet timing
+reg       [ADC_SEL_WIDTH-1:0] sysRbkADCsel = 0;
+reg                     [1:0] sysRbkSel = 0;
+reg                           sysRbkSetting = 0;
+wire         [STEP_WIDTH-1:0] sysRbkStep = sysRbkADCsel[LOG2_LANES+:STEP_WIDTH];
+wire [(LANES*SETTINGS_WIDTH)-1:0] sysRbkLanes;
+wire     [SETTINGS_WIDTH-1:0] sysRbkMux0 =
+                 sysRbkLanes[sysRbkADCsel[0+:LOG2_LANES]*SETTINGS_WIDTH+:
+                                                             SETTINGS_WIDTH];
+wire     [HYSTERESIS_WIDTH-1:0] sysRbkHysteresis =
+                                 sysRbkMux0[DEBOUNCE_WIDTH+:HYSTERESIS_WIDTH];
+wire       [DEBOUNCE_WIDTH-1:0] sysRbkDebounce = sysRbkMux0[0+:DEBOUNCE_WIDTH];
+wire          [ADC_WIDTH-1:0] sysRbkThreshold =
+              sysRbkMux0[HYSTERESIS_WIDTH+DEBOUNCE_WIDTH+(sysRbkSel*ADC_WIDTH)+:
+                                                                   ADC_WIDTH];
+wire        [ADC_WIDTH-3:0] sysRbkSettingValue = sysRbkSel[0] ?
+                 {{ADC_WIDTH-2-DEBOUNCE_WIDTH{1'b0}}, sysRbkDebounce} :
+                 sysRbkHysteresis;
+
+always @(posedge sysClk) begin
+    if (sysThresholdStrobe) begin
+        sysRbkADCsel <= sysADCsel;
+        sysRbkSel <= sysSel;
+        sysRbkSetting <= sysSetting;
+    end
+    sysThresholdRbk <= {
+               sysRbkSel,
+               {32-2-ADC_SEL_WIDTH-ADC_WIDTH{1'b0}},
+               sysRbkADCsel,
+               sysRbkSetting ? { 2'b10, sysRbkSettingValue } :
+                               sysRbkThreshold };
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Acquisition clock (acqClk) domain
+
+// Step through channels, LANES at a time
+reg [(ADC_COUNT*ADC_WIDTH)-1:0] dataShift;
+reg                             stepActive = 0;
+reg            [STEP_WIDTH-1:0] step = 0;
+reg                             p1Valid = 0, p1Last = 0;
+reg                             p2Valid = 0, p2Last = 0;
+reg            [STEP_WIDTH-1:0] p1Step = 0, p2Step = 0;
+
+always @(posedge acqClk) begin
+    if (acqStrobe) begin
+        dataShift <= acqData;
+        step <= 0;
+        stepActive <= 1;
+    end
+    else if (stepActive) begin
+        dataShift <= dataShift >> (LANES * ADC_WIDTH);
+        step <= step + 1;
+        if (step == (STEPS - 1)) begin
+            stepActive <= 0;
+        end
+    end
+    p1Valid <= stepActive && !acqStrobe;
+    p1Last <= (step == (STEPS - 1));
+    p1Step <= step;
+    p2Valid <= p1Valid;
+    p2Last <= p1Last;
+    p2Step <= p1Step;
+    acqLimitExcursionsTVALID <= p2Valid && p2Last;
+end
+
+genvar l, c;
+generate
+for (l = 0 ; l < LANES ; l = l + 1) begin : lane
+    // Settings, written in system clock domain, read in both domains
+    reg signed [ADC_WIDTH-1:0] thresholdLOLO [0:STEPS-1];
+    reg signed [ADC_WIDTH-1:0] thresholdLO   [0:STEPS-1];
+    reg signed [ADC_WIDTH-1:0] thresholdHI   [0:STEPS-1];
+    reg signed [ADC_WIDTH-1:0] thresholdHIHI [0:STEPS-1];
+    reg [HYSTERESIS_WIDTH-1:0] hysteresis [0:STEPS-1];
+    reg   [DEBOUNCE_WIDTH-1:0] debounce [0:STEPS-1];
+    reg   [SETTINGS_WIDTH-1:0] rbk;
+    assign sysRbkLanes[l*SETTINGS_WIDTH+:SETTINGS_WIDTH] = rbk;
+
+    always @(posedge sysClk) begin
+        if (sysWriteThreshold && (sysLane == l)) begin
+            case (sysSel)
+            2'b00: thresholdLOLO[sysStep] <= sysGPIO_OUT[ADC_WIDTH-1:0];
+            2'b01: thresholdLO  [sysStep] <= sysGPIO_OUT[ADC_WIDTH-1:0];
+            2'b10: thresholdHI  [sysStep] <= sysGPIO_OUT[ADC_WIDTH-1:0];
+            2'b11: thresholdHIHI[sysStep] <= sysGPIO_OUT[ADC_WIDTH-1:0];
+            endcase
+        end
+        if (sysWriteSetting && (sysLane == l)) begin
+            if (sysSel[0]) begin
+                debounce[sysStep] <= sysGPIO_OUT[DEBOUNCE_WIDTH-1:0];
+            end
+            else begin
+                hysteresis[sysStep] <= sysGPIO_OUT[HYSTERESIS_WIDTH-1:0];
+            end
+        end
+        rbk <= { thresholdHIHI[sysRbkStep], thresholdHI[sysRbkStep],
+                 thresholdLO[sysRbkStep], thresholdLOLO[sysRbkStep],
+                 hysteresis[sysRbkStep], debounce[sysRbkStep] };
+    end
+
+    // Excursion state and debounce counts of LOLO, LO, HI, HIHI
+    reg [STEPS-1:0] stateLOLO = 0, stateLO = 0, stateHI = 0, stateHIHI = 0;
+    reg [(4*DEBOUNCE_WIDTH)-1:0] counts [0:STEPS-1];
+    integer s;
+    initial begin
+        for (s = 0 ; s < STEPS ; s = s + 1) begin
+            hysteresis[s] = 0;
+            debounce[s] = 0;
+            counts[s] = 0;
+        end
+    end
+
+    // Stage 1 -- fetch settings and state
+    reg signed      [ADC_WIDTH-1:0] p1Value, p1LOLO, p1LO, p1HI, p1HIHI;
+    reg      [HYSTERESIS_WIDTH-1:0] p1Hysteresis;
+    reg        [DEBOUNCE_WIDTH-1:0] p1Debounce;
+    reg                       [3:0] p1State;
+    reg [(4*DEBOUNCE_WIDTH)-1:0] p1Count;
+
+    // Stage 2 -- compare with thresholds, widened so hysteresis can't wrap
+    wire signed [ADC_WIDTH:0] xValue = {p1Value[ADC_WIDTH-1], p1Value};
+    wire signed [ADC_WIDTH:0] xHysteresis =
+                  {{ADC_WIDTH+1-HYSTERESIS_WIDTH{1'b0}}, p1Hysteresis};
+    wire signed [ADC_WIDTH:0] xLOLO = {p1LOLO[ADC_WIDTH-1], p1LOLO};
+    wire signed [ADC_WIDTH:0] xLO   = {p1LO  [ADC_WIDTH-1], p1LO};
+    wire signed [ADC_WIDTH:0] xHI   = {p1HI  [ADC_WIDTH-1], p1HI};
+    wire signed [ADC_WIDTH:0] xHIHI = {p1HIHI[ADC_WIDTH-1], p1HIHI};
+    wire signed [ADC_WIDTH:0] limitLOLO = p1State[3] ? xLOLO + xHysteresis :
+                                                       xLOLO;
+    wire signed [ADC_WIDTH:0] limitLO   = p1State[2] ? xLO   + xHysteresis :
+                                                       xLO;
+    wire signed [ADC_WIDTH:0] limitHI   = p1State[1] ? xHI   - xHysteresis :
+                                                       xHI;
+    wire signed [ADC_WIDTH:0] limitHIHI = p1State[0] ? xHIHI - xHysteresis :
+                                                       xHIHI;
+    reg                       [3:0] p2Target, p2State;
+    reg        [DEBOUNCE_WIDTH-1:0] p2Debounce;
+    reg [(4*DEBOUNCE_WIDTH)-1:0] p2Count;
+
+    always @(posedge acqClk) begin: lanePipeline
+        integer k;
+        reg [DEBOUNCE_WIDTH:0] nextCount;
+        reg [(4*DEBOUNCE_WIDTH)-1:0] newCounts;
+        reg [3:0] newState;
+        p1Value <= dataShift[l*ADC_WIDTH+:ADC_WIDTH];
+        p1LOLO <= thresholdLOLO[step];
+        p1LO <= thresholdLO[step];
+        p1HI <= thresholdHI[step];
+        p1HIHI <= thresholdHIHI[step];
+        p1Hysteresis <= hysteresis[step];
+        p1Debounce <= debounce[step];
+        p1State <= { stateLOLO[step], stateLO[step],
+                     stateHI[step], stateHIHI[step] };
+        p1Count <= counts[step];
+
+        p2Target <= { xValue <= limitLOLO,
+                      xValue <= limitLO,
+                      xValue >= limitHI,
+                      xValue >= limitHIHI };
+        p2State <= p1State;
+        p2Debounce <= p1Debounce;
+        p2Count <= p1Count;
+
+        // Stage 3 -- debounce and update state
+        for (k = 0 ; k < 4 ; k = k + 1) begin
+            nextCount = p2Count[k*DEBOUNCE_WIDTH+:DEBOUNCE_WIDTH] + 1;
+            newState[k] = p2State[k];
+            if (p2Target[k] == p2State[k]) begin
+                newCounts[k*DEBOUNCE_WIDTH+:DEBOUNCE_WIDTH] = 0;
+            end
+            else if (nextCount >= p2Debounce) begin
+                newState[k] = p2Target[k];
+                newCounts[k*DEBOUNCE_WIDTH+:DEBOUNCE_WIDTH] = 0;
+            end
+            else begin
+                newCounts[k*DEBOUNCE_WIDTH+:DEBOUNCE_WIDTH] =
+                                              nextCount[0+:DEBOUNCE_WIDTH];
+            end
+        end
+        if (p2Valid) begin
+            counts[p2Step] <= newCounts;
+            stateLOLO[p2Step] <= newState[3];
+            stateLO[p2Step] <= newState[2];
+            stateHI[p2Step] <= newState[1];
+            stateHIHI[p2Step] <= newState[0];
+        end
+    end
+end
+
+// Excursion bitmaps, LOLO, LO, HI, HIHI with most significant channel first
+for (c = 0 ; c < ADC_COUNT ; c = c + 1) begin : perADC
+    assign acqLimitExcursions[(3*ADC_COUNT)+c] = lane[c%LANES].stateLOLO[c/LANES];
+    assign acqLimitExcursions[(2*ADC_COUNT)+c] = lane[c%LANES].stateLO  [c/LANES];
+    assign acqLimitExcursions[(1*ADC_COUNT)+c] = lane[c%LANES].stateHI  [c/LANES];
+    assign acqLimitExcursions[(0*ADC_COUNT)+c] = lane[c%LANES].stateHIHI[c/LANES];
+end
+endgenerate
+
+endmodule
+`default_nettype wire
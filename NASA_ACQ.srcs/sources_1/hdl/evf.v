@@ -25,7 +25,14 @@
 /*
  * Event fanout
  * Very limited capability.
- * Good only for forwarding time to downstream acquisition nodes.
+ * Good only for forwarding time, the distributed bus and the distributed
+ * buffer to downstream acquisition nodes.
+ * The upper byte of the comma character and of every second character
+ * after it carries the distributed bus, that of the other characters the
+ * distributed buffer (see tinyEVG).  Commas are sent every four characters
+ * so that downstream receivers see the same arrangement.  The bus is
+ * resynchronized.  Buffer frames are stored and forwarded whole through
+ * a FIFO so that the transmitter never runs out of bytes in mid-frame.
  */
 `default_nettype none
 module evf #(
@@ -40,13 +47,21 @@ module evf #(
     (*MARK_DEBUG=DEBUG*) output wire  [1:0] txCharIsK);
 
 localparam EVCODE_NOP = 8'h00;
+localparam K28_0 = 8'h1C;
+localparam K28_1 = 8'h3C;
 localparam K28_5 = 8'hBC;
 
+localparam B_IDLE   = 2'd0,
+           B_DATA   = 2'd1,
+           B_CHK_HI = 2'd2,
+           B_CHK_LO = 2'd3;
+
 /*
  * Send alignment comma on four cycle boundaries
+ * Slot 0 is the comma, slots 0 and 2 the distributed bus,
+ * slots 1 and 3 the distributed buffer.
  */
-reg [2:0] commaCounter = 0;
-wire commaCounterDone = commaCounter[2];
+reg [1:0] txSlot = 0;
 
 /*
  * FIFO write side
@@ -62,6 +77,22 @@ wire       fifoEMPTY;
 reg  [7:0] txCode;
 reg        txCodeIsK;
 
+/*
+ * Distributed bus and buffer
+ */
+(*MARK_DEBUG=DEBUG*) reg [8:0] bufIN;
+(*MARK_DEBUG=DEBUG*) reg       bufWREN = 0;
+wire [8:0] bufOUT;
+wire       bufEMPTY;
+reg  [7:0] rxBus = 0;
+reg        rxPhaseValid = 0, rxPhase = 0;
+reg  [1:0] rxBufferState = B_IDLE;
+reg        rxFrameToggle = 0;
+reg  [7:0] txUpper = 0;
+reg        txUpperIsK = 0;
+reg  [1:0] txBufferState = B_IDLE;
+reg [11:0] txFramesReady = 0;
+
 (*ASYNC_REG="TRUE"*) reg rxReady_m = 0;
 reg rxReady = 0;
 reg fifoRST = 1;
@@ -77,23 +108,129 @@ always @(posedge rxClk) begin
     else begin
         fifoWREN <= 0;
     end
-end
 
-always @(posedge txClk) begin
     /*
-     * FIFO read side
+     * Distributed bus and buffer write side
+     * Write buffer bytes from frame start to frame end and note each
+     * frame end.  A restarted frame is forwarded as is.
      */
-    if (commaCounterDone) begin
-        commaCounter <= 0;
+    if (rxCharIsK[0] && (rxChars[7:0] == K28_5)) begin
+        rxPhaseValid <= 1;
+        rxPhase <= 0;
+        rxBus <= rxChars[15:8];
     end
     else begin
-        commaCounter <= commaCounter + 1;
+        rxPhase <= !rxPhase;
+        if (rxPhaseValid && rxPhase) begin
+            rxBus <= rxChars[15:8];
+        end
+    end
+    bufIN <= { rxCharIsK[1], rxChars[15:8] };
+    bufWREN <= 0;
+    if (!rxLinkUp) begin
+        rxPhaseValid <= 0;
+        rxBufferState <= B_IDLE;
+    end
+    else if (rxPhaseValid && !rxPhase
+          && !(rxCharIsK[0] && (rxChars[7:0] == K28_5))) begin
+        if (rxCharIsK[1] && (rxChars[15:8] == K28_0)) begin
+            bufWREN <= 1;
+            rxBufferState <= B_DATA;
+        end
+        else begin
+            case (rxBufferState)
+            B_DATA: begin
+                bufWREN <= 1;
+                if (rxCharIsK[1] && (rxChars[15:8] == K28_1)) begin
+                    rxBufferState <= B_CHK_HI;
+                end
+            end
+            B_CHK_HI: begin
+                bufWREN <= 1;
+                rxBufferState <= B_CHK_LO;
+            end
+            B_CHK_LO: begin
+                bufWREN <= 1;
+                rxFrameToggle <= !rxFrameToggle;
+                rxBufferState <= B_IDLE;
+            end
+            default: ;
+            endcase
+        end
     end
+end
+
+/*
+ * Distributed bus and buffer read side
+ * Start sending a buffer frame only once it is complete.
+ */
+(*ASYNC_REG="TRUE"*) reg [7:0] txBus_m;
+(*ASYNC_REG="TRUE"*) reg       txFrameToggle_m = 0, txLinkUp_m = 0;
+reg [7:0] txBus;
+reg       txFrameToggle = 0, txFrameToggle_d = 0, txLinkUp = 0;
+wire txFrameReady = (txBufferState != B_IDLE) || (txFramesReady != 0);
+wire bufRDEN = txSlot[0] && txFrameReady && !bufEMPTY;
+wire txFrameDone = bufRDEN && (txBufferState == B_CHK_LO) &&
+                   !(bufOUT[8] && (bufOUT[7:0] == K28_0));
+always @(posedge txClk) begin
+    txBus_m <= rxBus;
+    txBus   <= txBus_m;
+    txFrameToggle_m <= rxFrameToggle;
+    txFrameToggle   <= txFrameToggle_m;
+    txFrameToggle_d <= txFrameToggle;
+    txLinkUp_m <= rxLinkUp;
+    txLinkUp   <= txLinkUp_m;
+    if (!txLinkUp) begin
+        txFramesReady <= 0;
+    end
+    else if ((txFrameToggle != txFrameToggle_d) && !txFrameDone) begin
+        txFramesReady <= txFramesReady + 1;
+    end
+    else if ((txFrameToggle == txFrameToggle_d) && txFrameDone) begin
+        txFramesReady <= txFramesReady - 1;
+    end
+    if (!txSlot[0]) begin
+        txUpper <= txBus;
+        txUpperIsK <= 0;
+    end
+    else if (bufRDEN) begin
+        txUpper <= bufOUT[7:0];
+        txUpperIsK <= bufOUT[8];
+        if (bufOUT[8] && (bufOUT[7:0] == K28_0)) begin
+            txBufferState <= B_DATA;
+        end
+        else begin
+            case (txBufferState)
+            B_DATA: begin
+                if (bufOUT[8] && (bufOUT[7:0] == K28_1)) begin
+                    txBufferState <= B_CHK_HI;
+                end
+            end
+            B_CHK_HI: txBufferState <= B_CHK_LO;
+            B_CHK_LO: txBufferState <= B_IDLE;
+            default: ;
+            endcase
+        end
+    end
+    else begin
+        // Nothing to send, or FIFO reset by loss of link in mid-frame,
+        // in which case the downstream receiver discards the frame.
+        txUpper <= txBus;
+        txUpperIsK <= 0;
+        txBufferState <= B_IDLE;
+    end
+end
+
+always @(posedge txClk) begin
+    /*
+     * FIFO read side
+     */
+    txSlot <= txSlot + 1;
     if (!fifoEMPTY) begin
         txCode <= fifoOUT;
         txCodeIsK <= 0;
     end
-    else if (commaCounterDone) begin
+    else if (txSlot == 0) begin
         txCode <= K28_5;
         txCodeIsK <= 1;
     end
@@ -102,8 +239,8 @@ always @(posedge txClk) begin
         txCodeIsK <= 0;
     end
 end
-assign txChars = { 8'h00, txCode };
-assign txCharIsK = { 1'b0, txCodeIsK };
+assign txChars = { txUpper, txCode };
+assign txCharIsK = { txUpperIsK, txCodeIsK };
 
 /*
  * Instantiate the event code clock-crossing FIFO
@@ -133,5 +270,34 @@ FIFO_DUALCLOCK_MACRO  #(
       .WRCLK(rxClk),     // 1-bit input write clock
       .WREN(fifoWREN)    // 1-bit input write enable
    );
+
+/*
+ * Instantiate the distributed buffer clock-crossing FIFO
+ * Deep enough for a full length frame.
+ */
+FIFO_DUALCLOCK_MACRO  #(
+      .ALMOST_EMPTY_OFFSET(9'h080), // Sets the almost empty threshold
+      .ALMOST_FULL_OFFSET(9'h080),  // Sets almost full threshold
+      .DATA_WIDTH(9),   // Valid values are 1-72 (37-72 only valid when FIFO_SIZE="36Kb")
+      .DEVICE("7SERIES"),  // Target device: "7SERIES"
+      .FIFO_SIZE ("36Kb"), // Target BRAM: "18Kb" or "36Kb"
+      .FIRST_WORD_FALL_THROUGH ("TRUE") // Sets the FIFO FWFT to "TRUE" or "FALSE"
+ ) bufferFIFO (
+      .ALMOSTEMPTY(),    // 1-bit output almost empty
+      .ALMOSTFULL(),     // 1-bit output almost full
+      .DO(bufOUT),       // Output data, width defined by DATA_WIDTH parameter
+      .EMPTY(bufEMPTY),  // 1-bit output empty
+      .FULL(),           // 1-bit output full
+      .RDCOUNT(),        // Output read count, width determined by FIFO depth
+      .RDERR(),          // 1-bit output read error
+      .WRCOUNT(),        // Output write count, width determined by FIFO depth
+      .WRERR(),          // 1-bit output write error
+      .DI(bufIN),        // Input data, width defined by DATA_WIDTH parameter
+      .RDCLK(txClk),     // 1-bit input read clock
+      .RDEN(bufRDEN),    // 1-bit input read enable
+      .RST(!rxLinkUp),   // 1-bit input reset
+      .WRCLK(rxClk),     // 1-bit input write clock
+      .WREN(bufWREN)     // 1-bit input write enable
+   );
 endmodule
 `default_nettype wire
@@ -0,0 +1,360 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Report ADC limit excursions as a stream of time-stamped events.
+ * Each time the limit excursion bitmaps for a sample arrive from the packet
+ * builder they are compared with those of the previous sample.  Every bit
+ * that has changed is queued as an event giving the channel, the level,
+ * whether the reading entered or left the excursion region, and the time
+ * stamp of the acquisition strobe of the sample.  Queued events are sent
+ * as PSNB packets as soon as all the events from a sample have been queued,
+ * with at least PACKET_GAP clocks between packets.  The packet type field
+ * (most significant byte of the status word) is 4 to distinguish event
+ * packets from other packets.
+ *
+ * Event packet layout:
+ *   Bytes  0-3   "PSNB"
+ *   Bytes  4-7   Size (bytes following this field)
+ *   Bytes  8-11  Status: bits 31:24 packet type (4),
+ *                bit 1 events lost because the queue was full,
+ *                bit 0 samples not examined because the previous sample
+ *                was still being examined,
+ *                in both cases since the preceding event packet
+ *   Bytes 12-15  Number of events in packet
+ *   Bytes 16-23  Sequence number
+ *   Bytes 24-31  Timestamp (seconds, nanoseconds) at which packet was sent
+ *   Then, for each event in the order in which the events were queued:
+ *                Timestamp (seconds, nanoseconds) of sample
+ *                Bits 15:8 -- ADC channel
+ *                Bit 7     -- 1 entering, 0 leaving, the excursion region
+ *                Bits 1:0  -- Level (0 LOLO, 1 LO, 2 HI, 3 HIHI)
+ * All values are big-endian.
+ *
+ * The first sample after the monitor is enabled reports channels that
+ * are already beyond a threshold as entering so the host starts with a
+ * complete picture.  The sample following a sample that was not examined
+ * reports the net change since the last sample that was examined.
+ *
+ * CSR write:
+ *   Bit 31    -- Enable
+ *   Bits 3:0  -- Level enables, bit n enables events for level n
+ * CSR read:
+ *   Bit 31    -- Enabled
+ *   Bit 30    -- Events have been lost since acquisition was enabled
+ *   Bit 29    -- Samples have been skipped since acquisition was enabled
+ *   Bits 15:8 -- LOG2_QUEUE_DEPTH
+ *   Bits 3:0  -- Level enables
+ *
+ * Bitmaps are examined one bit per clock so there must be more than
+ * 4*ADC_COUNT clocks between samples for every sample to be examined.
+ */
+`default_nettype none
+module excursionEvents #(
+    parameter ADC_CHIP_COUNT      = 4,
+    parameter ADC_PER_CHIP        = 8,
+    parameter LOG2_QUEUE_DEPTH    = 9,
+    parameter UDP_PACKET_CAPACITY = 1472,
+    parameter PACKET_GAP          = 12500,
+    parameter DEBUG               = "false"
+    ) (
+    input  wire        sysClk,
+    input  wire        sysCsrStrobe,
+    input  wire [31:0] sysGPIO_OUT,
+    output wire [31:0] sysStatus,
+
+    input  wire                                         acqClk,
+    input  wire                                         acqStrobe,
+    input  wire [(4*ADC_CHIP_COUNT*ADC_PER_CHIP)-1:0]   acqLimitExcursions,
+    input  wire                                         acqLimitExcursionsTVALID,
+    input  wire                                  [31:0] acqSeconds,
+    input  wire                                  [31:0] acqTicks,
+    input  wire                                         acqEnableAcquisition,
+
+    (*MARK_DEBUG=DEBUG*) output reg        M_TVALID = 0,
+    (*MARK_DEBUG=DEBUG*) output reg        M_TLAST = 0,
+    (*MARK_DEBUG=DEBUG*) output reg  [7:0] M_TDATA = 0,
+    (*MARK_DEBUG=DEBUG*) input  wire       M_TREADY);
+
+localparam ADC_COUNT = ADC_CHIP_COUNT * ADC_PER_CHIP;
+localparam BITMAPS_WIDTH = 4 * ADC_COUNT;
+localparam CHANNEL_ADDRESS_WIDTH = $clog2(ADC_COUNT);
+localparam QUEUE_DEPTH = 1 << LOG2_QUEUE_DEPTH;
+localparam QUEUE_COUNT_WIDTH = LOG2_QUEUE_DEPTH + 1;
+localparam EVENT_WIDTH = 32 + 32 + 1 + 2 + CHANNEL_ADDRESS_WIDTH;
+localparam EVENT_BYTE_COUNT = 12;
+localparam HEADER_BYTE_COUNT = 32;
+localparam EVENTS_PER_PACKET_LIMIT = (UDP_PACKET_CAPACITY - HEADER_BYTE_COUNT)
+                                                           / EVENT_BYTE_COUNT;
+localparam EVENTS_PER_PACKET = (EVENTS_PER_PACKET_LIMIT < QUEUE_DEPTH) ?
+                                         EVENTS_PER_PACKET_LIMIT : QUEUE_DEPTH;
+localparam [7:0] LOG2_QUEUE_DEPTH_8 = LOG2_QUEUE_DEPTH;
+
+///////////////////////////////////////////////////////////////////////////////
+// System clock domain
+reg       sysEnable = 0;
+/* Used in acquisition clock domain, a change affects only a single event */
+reg [3:0] sysLevelEnables = 0;
+
+always @(posedge sysClk) begin
+    if (sysCsrStrobe) begin
+        sysEnable <= sysGPIO_OUT[31];
+        sysLevelEnables <= sysGPIO_OUT[3:0];
+    end
+end
+
+//////////////////////////////////////////////////////////////////////////////
+// Acquisition clock domain
+
+(*ASYNC_REG="true"*) reg acqEnable_m = 0;
+(*MARK_DEBUG=DEBUG*) reg acqEnable = 0;
+(*MARK_DEBUG=DEBUG*) reg acqLost = 0, acqLostSticky = 0;
+(*MARK_DEBUG=DEBUG*) reg acqSkipped = 0, acqSkippedSticky = 0;
+
+always @(posedge acqClk) begin
+    acqEnable_m <= sysEnable;
+    acqEnable   <= acqEnable_m;
+end
+wire acqActive = acqEnable && acqEnableAcquisition;
+
+(*ASYNC_REG="true"*) reg sysLost_m = 0, sysSkipped_m = 0;
+reg sysLost = 0, sysSkipped = 0;
+always @(posedge sysClk) begin
+    sysLost_m    <= acqLostSticky;
+    sysLost      <= sysLost_m;
+    sysSkipped_m <= acqSkippedSticky;
+    sysSkipped   <= sysSkipped_m;
+end
+assign sysStatus = { sysEnable, sysLost, sysSkipped,
+                     13'b0,
+                     LOG2_QUEUE_DEPTH_8,
+                     4'b0,
+                     sysLevelEnables };
+
+//
+// Event queue
+//
+reg [EVENT_WIDTH-1:0] queue [0:QUEUE_DEPTH-1];
+reg [QUEUE_COUNT_WIDTH-1:0] queueWritePointer = 0, queueReadPointer = 0;
+wire [QUEUE_COUNT_WIDTH-1:0] queueCount = queueWritePointer - queueReadPointer;
+wire queueFull = queueCount[LOG2_QUEUE_DEPTH];
+reg [EVENT_WIDTH-1:0] queueQ;
+always @(posedge acqClk) begin
+    queueQ <= queue[queueReadPointer[0+:LOG2_QUEUE_DEPTH]];
+end
+
+//
+// Examine bitmaps, least significant bit first.
+// The bitmaps are HIHI, HI, LO, LOLO from least to most significant.
+//
+localparam SCAN_COUNTER_LOAD = BITMAPS_WIDTH - 2;
+localparam SCAN_COUNTER_WIDTH = $clog2(SCAN_COUNTER_LOAD+1) + 1;
+reg [SCAN_COUNTER_WIDTH-1:0] scanCounter = SCAN_COUNTER_LOAD;
+wire scanCounterDone = scanCounter[SCAN_COUNTER_WIDTH-1];
+(*MARK_DEBUG=DEBUG*) reg scanActive = 0;
+reg [BITMAPS_WIDTH-1:0] previous = 0, scanChanged = 0, scanEntered = 0;
+reg [CHANNEL_ADDRESS_WIDTH-1:0] scanChannel = 0;
+reg [1:0] scanLevel = 0;
+reg [31:0] sampleSeconds = 0, sampleTicks = 0;
+reg [31:0] scanSeconds = 0, scanTicks = 0;
+wire txStart;
+
+always @(posedge acqClk) begin
+    if (acqStrobe) begin
+        sampleSeconds <= acqSeconds;
+        sampleTicks <= acqTicks;
+    end
+    if (txStart) begin
+        acqLost <= 0;
+        acqSkipped <= 0;
+    end
+    if (!acqActive) begin
+        previous <= 0;
+        scanActive <= 0;
+        acqLostSticky <= 0;
+        acqSkippedSticky <= 0;
+    end
+    else begin
+        if (acqLimitExcursionsTVALID) begin
+            if (scanActive) begin
+                acqSkipped <= 1;
+                acqSkippedSticky <= 1;
+            end
+            else begin
+                previous <= acqLimitExcursions;
+                scanChanged <= acqLimitExcursions ^ previous;
+                scanEntered <= acqLimitExcursions;
+                scanSeconds <= sampleSeconds;
+                scanTicks <= sampleTicks;
+                scanChannel <= 0;
+                scanLevel <= 3;
+                scanCounter <= SCAN_COUNTER_LOAD;
+                scanActive <= 1;
+            end
+        end
+        if (scanActive) begin
+            if (scanChanged[0] && sysLevelEnables[scanLevel]) begin
+                if (queueFull) begin
+                    acqLost <= 1;
+                    acqLostSticky <= 1;
+                end
+                else begin
+                    queue[queueWritePointer[0+:LOG2_QUEUE_DEPTH]] <= {
+                                     scanSeconds, scanTicks, scanEntered[0],
+                                     scanLevel, scanChannel };
+                    queueWritePointer <= queueWritePointer + 1;
+                end
+            end
+            scanChanged <= scanChanged >> 1;
+            scanEntered <= scanEntered >> 1;
+            if (scanChannel == (ADC_COUNT - 1)) begin
+                scanChannel <= 0;
+                scanLevel <= scanLevel - 1;
+            end
+            else begin
+                scanChannel <= scanChannel + 1;
+            end
+            scanCounter <= scanCounter - 1;
+            if (scanCounterDone) begin
+                scanActive <= 0;
+            end
+        end
+    end
+end
+
+//
+// Send events
+//
+localparam HEADER_SHIFT_REG_WIDTH = HEADER_BYTE_COUNT * 8;
+localparam HEADER_COUNTER_LOAD = HEADER_BYTE_COUNT - 2;
+localparam EVENT_COUNTER_LOAD = EVENT_BYTE_COUNT - 2;
+localparam BYTE_COUNTER_WIDTH = $clog2(HEADER_COUNTER_LOAD+1) + 1;
+localparam GAP_COUNTER_LOAD = PACKET_GAP - 2;
+localparam GAP_COUNTER_WIDTH = $clog2(GAP_COUNTER_LOAD+1) + 1;
+
+localparam TX_IDLE = 2'd0,
+           TX_GAP  = 2'd1,
+           TX_SEND = 2'd2,
+           TX_LOAD = 2'd3;
+(*MARK_DEBUG=DEBUG*) reg [1:0] txState = TX_IDLE;
+reg [HEADER_SHIFT_REG_WIDTH-1:0] txShift = 0;
+reg [BYTE_COUNTER_WIDTH-1:0] txByteCounter = HEADER_COUNTER_LOAD;
+wire txByteCounterDone = txByteCounter[BYTE_COUNTER_WIDTH-1];
+reg [GAP_COUNTER_WIDTH-1:0] txGapCounter = GAP_COUNTER_LOAD;
+wire txGapCounterDone = txGapCounter[GAP_COUNTER_WIDTH-1];
+reg [QUEUE_COUNT_WIDTH-1:0] txEventsRemaining = 0;
+reg txLastChunk = 0;
+reg [63:0] sequenceNumber = 0;
+
+// Send once all events from a sample have been queued
+assign txStart = (txState == TX_IDLE) && (queueCount != 0) && !scanActive;
+wire [QUEUE_COUNT_WIDTH-1:0] txEventCount =
+             (queueCount > EVENTS_PER_PACKET) ? EVENTS_PER_PACKET : queueCount;
+wire [31:0] txPacketSize = HEADER_BYTE_COUNT - 8 +
+                                          (txEventCount * EVENT_BYTE_COUNT);
+
+wire               [31:0] eventSeconds = queueQ[EVENT_WIDTH-1-:32];
+wire               [31:0] eventTicks = queueQ[EVENT_WIDTH-33-:32];
+wire                      eventEntered = queueQ[CHANNEL_ADDRESS_WIDTH+2];
+wire                [1:0] eventLevel = queueQ[CHANNEL_ADDRESS_WIDTH+:2];
+wire [CHANNEL_ADDRESS_WIDTH-1:0] eventChannel =
+                                          queueQ[0+:CHANNEL_ADDRESS_WIDTH];
+
+always @(posedge acqClk) begin
+    if (M_TVALID && M_TREADY) begin
+        M_TVALID <= 0;
+        M_TLAST <= 0;
+    end
+    case (txState)
+    TX_IDLE: begin
+        if (!acqActive) begin
+            sequenceNumber <= {acqSeconds, 32'b0};
+        end
+        if (txStart) begin
+            sequenceNumber <= sequenceNumber + 1;
+            txShift <= {
+                      "P", "S", "N", "B",
+                      txPacketSize,
+                      { 8'd4, /* Packet type */
+                        {22{1'b0}},
+                        acqLost,
+                        acqSkipped },
+                      {{32-QUEUE_COUNT_WIDTH{1'b0}}, txEventCount},
+                      sequenceNumber[63:32],
+                      sequenceNumber[31:0],
+                      acqSeconds,
+                      {acqTicks[0+:29], 3'b000} }; /* nanoseconds */
+            txByteCounter <= HEADER_COUNTER_LOAD;
+            txEventsRemaining <= txEventCount;
+            txLastChunk <= 0;
+            txState <= TX_SEND;
+        end
+    end
+    TX_GAP: begin
+        if (txGapCounterDone) begin
+            txState <= TX_IDLE;
+        end
+        else begin
+            txGapCounter <= txGapCounter - 1;
+        end
+    end
+    TX_SEND: begin
+        if (!M_TVALID || M_TREADY) begin
+            M_TVALID <= 1;
+            M_TDATA <= txShift[HEADER_SHIFT_REG_WIDTH-1-:8];
+            txShift <= txShift << 8;
+            txByteCounter <= txByteCounter - 1;
+            if (txByteCounterDone) begin
+                if (txLastChunk) begin
+                    M_TLAST <= 1;
+                    txGapCounter <= GAP_COUNTER_LOAD;
+                    txState <= TX_GAP;
+                end
+                else begin
+                    txState <= TX_LOAD;
+                end
+            end
+        end
+    end
+    TX_LOAD: begin
+        txShift <= { eventSeconds,
+                     {eventTicks[0+:29], 3'b000}, /* nanoseconds */
+                     16'b0,
+                     {8-CHANNEL_ADDRESS_WIDTH{1'b0}}, eventChannel,
+                     eventEntered,
+                     5'b0,
+                     eventLevel,
+                     {HEADER_SHIFT_REG_WIDTH-(EVENT_BYTE_COUNT*8){1'b0}} };
+        txByteCounter <= EVENT_COUNTER_LOAD;
+        queueReadPointer <= queueReadPointer + 1;
+        txEventsRemaining <= txEventsRemaining - 1;
+        txLastChunk <= (txEventsRemaining == 1);
+        txState <= TX_SEND;
+    end
+    default: txState <= TX_IDLE;
+    endcase
+end
+
+endmodule
+`default_nettype wire
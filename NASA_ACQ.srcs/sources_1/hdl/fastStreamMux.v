@@ -0,0 +1,81 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Merge two packet streams.
+ * Arbitration takes place only between packets.  Stream 1 has priority
+ * over stream 0.  Ahead of the fast data transmitter stream 1 carries the
+ * low-rate summary, spectrum, capture, limit excursion event and MPS trip
+ * history packets, which are infrequent and whose sources have little or
+ * no elastic buffering, and stream 0 the full-rate ADC data.
+ * M_TUSER identifies the stream from which the current packet came.
+ */
+`default_nettype none
+module fastStreamMux #(
+    parameter DEBUG = "false"
+    ) (
+    input  wire       clk,
+
+    input  wire [7:0] S0_TDATA,
+    input  wire       S0_TVALID,
+    input  wire       S0_TLAST,
+    output wire       S0_TREADY,
+
+    input  wire [7:0] S1_TDATA,
+    input  wire       S1_TVALID,
+    input  wire       S1_TLAST,
+    output wire       S1_TREADY,
+
+    output wire [7:0] M_TDATA,
+    output wire       M_TVALID,
+    output wire       M_TLAST,
+    output wire       M_TUSER,
+    input  wire       M_TREADY);
+
+(*MARK_DEBUG=DEBUG*) reg locked = 0;
+(*MARK_DEBUG=DEBUG*) reg select = 0;
+
+// Choose stream between packets, hold choice from the time that
+// the first byte is presented until the last byte is accepted.
+wire selectNext = locked ? select : S1_TVALID;
+
+always @(posedge clk) begin
+    if (M_TVALID && M_TREADY && M_TLAST) begin
+        locked <= 0;
+    end
+    else if (M_TVALID) begin
+        locked <= 1;
+    end
+    select <= selectNext;
+end
+
+assign M_TDATA   = selectNext ? S1_TDATA  : S0_TDATA;
+assign M_TVALID  = selectNext ? S1_TVALID : S0_TVALID;
+assign M_TLAST   = selectNext ? S1_TLAST  : S0_TLAST;
+assign M_TUSER   = selectNext;
+assign S0_TREADY = !selectNext && M_TREADY;
+assign S1_TREADY =  selectNext && M_TREADY;
+
+endmodule
+`default_nettype wire
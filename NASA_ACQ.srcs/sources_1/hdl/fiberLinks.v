@@ -43,6 +43,23 @@
  *
  *  3-8 (QSFP1-3:4, QSFP2-1:4), Event generator and event fanout nodes
  *          MPS status in, event stream out.
+ *
+ * Distributed buffer:
+ * The event generator broadcasts a buffer of up to 2048 bytes that is
+ * received by the event receiver of every node, directly or through
+ * event fanout nodes.
+ * EVG buffer write:
+ *   Bit 31 -- Send bytes 0 through address
+ *   Bits 26:16 -- Address
+ *   Bits 7:0 -- Byte to store at address (when bit 31 is 0)
+ * EVG buffer read:
+ *   Bit 31 -- Send in progress, buffer writes ignored
+ *   Bits 7:0 -- Log2 of buffer capacity
+ * EVR buffer data write:
+ *   Bits 10:0 -- Address of byte to read
+ * EVR buffer data read:
+ *   Bits 7:0 -- Byte from most recent good buffer
+ * EVR buffer status read: see tinyEVR
  */
 `default_nettype none
 module fiberLinks #(
@@ -53,6 +70,7 @@ module fiberLinks #(
     parameter EVR_ACQ_START_CODE = 1,
     parameter EVR_ACQ_STOP_CODE  = 1,
     parameter EVR_MPS_CLEAR_CODE = 1,
+    parameter EVR_CAPTURE_CODE   = 1,
     parameter DEBUG_MGT          = "false",
     parameter DEBUG_EVR          = "false",
     parameter DEBUG_EVF          = "false",
@@ -68,11 +86,20 @@ module fiberLinks #(
 
                          input  wire                       sysMPSmergeStrobe,
                          output wire                [31:0] sysMPSmergeStatus,
+                         input  wire                       sysMPSmergeDataStrobe,
+                         output wire                [31:0] sysMPSmergeData,
+
+                         input  wire                       sysEVGbufferStrobe,
+                         output wire                [31:0] sysEVGbufferStatus,
+                         input  wire                       sysEVRbufferStrobe,
+                         output wire                [31:0] sysEVRbufferData,
+                         output wire                [31:0] sysEVRbufferStatus,
 
                          output wire                       evrRxClk,
                          output wire                       evrRxStartACQstrobe,
                          output wire                       evrRxStopACQstrobe,
                          output wire                       evrRxClearMPSstrobe,
+                         output wire                       evrRxCaptureStrobe,
                          output wire                       evfRxClk,
     (*MARK_DEBUG=DEBUG*) input  wire                       sysEVGsetTimeStrobe,
     (*MARK_DEBUG=DEBUG*) output wire                [31:0] sysEVGstatus,
@@ -101,6 +128,7 @@ module fiberLinks #(
     output wire [MGT_COUNT-1:0] txN);
 
 localparam MGT_BYTE_COUNT = (MGT_DATA_WIDTH + 7) / 8;
+localparam DISTRIBUTED_BUFFER_ADDRESS_WIDTH = 11;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Forward reference to MGT receivers
@@ -108,11 +136,13 @@ wire [63:0] evrRxTimestamp;
 wire                  [MGT_COUNT-1:0] mgtRxClks;
 wire [(MGT_COUNT*MGT_DATA_WIDTH)-1:0] mgtRxChars;
 wire                  [MGT_COUNT-1:0] mgtRxCharIsK;
+wire                  [MGT_COUNT-1:0] mgtRxUpperIsK;
 wire                  [MGT_COUNT-1:0] mgtRxLinkUp;
 
 assign                    evrRxClk = mgtRxClks[0];
 wire                      evrRxLinkUp = mgtRxLinkUp[0];
 wire                      evrRxCharIsK = mgtRxCharIsK[0];
+wire                      evrRxUpperIsK = mgtRxUpperIsK[0];
 wire [MGT_DATA_WIDTH-1:0] evrRxChars =
                                    mgtRxChars[0*MGT_DATA_WIDTH+:MGT_DATA_WIDTH];
 wire                      evrTimestampValid;
@@ -120,6 +150,7 @@ wire                      evrTimestampValid;
 assign                    evfRxClk = mgtRxClks[1];
 wire                      evfRxLinkUp = mgtRxLinkUp[1];
 wire                      evfRxCharIsK = mgtRxCharIsK[1];
+wire                      evfRxUpperIsK = mgtRxUpperIsK[1];
 wire [MGT_DATA_WIDTH-1:0] evfRxChars =
                                    mgtRxChars[1*MGT_DATA_WIDTH+:MGT_DATA_WIDTH];
 
@@ -133,21 +164,35 @@ assign sysLinkStatus = { evrTimestampValid,
 wire [TIMESTAMP_WIDTH-1:0] evrTimestamp;
 wire                       evrPPSstrobe;
 wire               [126:1] evrStrobes;
+reg [DISTRIBUTED_BUFFER_ADDRESS_WIDTH-1:0] sysEVRbufferAddress = 0;
+wire                                 [7:0] sysEVRbufferByte;
+always @(posedge sysClk) begin
+    if (sysEVRbufferStrobe) begin
+        sysEVRbufferAddress <= sysGPIO_OUT[0+:DISTRIBUTED_BUFFER_ADDRESS_WIDTH];
+    end
+end
+assign sysEVRbufferData = { 24'b0, sysEVRbufferByte };
 tinyEVR #(
     .TIMESTAMP_WIDTH(TIMESTAMP_WIDTH),
+    .DISTRIBUTED_BUFFER_ADDRESS_WIDTH(DISTRIBUTED_BUFFER_ADDRESS_WIDTH),
     .DEBUG(DEBUG_EVR))
   tinyEVR_i (
     .evrRxClk(evrRxClk),
     .evrRxWord(evrRxChars & {MGT_DATA_WIDTH{evrRxLinkUp}}),
-    .evrCharIsK({1'b0, evrRxCharIsK}),
+    .evrCharIsK({evrRxUpperIsK, evrRxCharIsK}),
     .ppsMarker(evrPPSstrobe),
     .timestampValid(evrTimestampValid),
     .timestamp(evrTimestamp),
     .distributedDataBus(),
-    .evStrobe(evrStrobes));
+    .evStrobe(evrStrobes),
+    .sysClk(sysClk),
+    .sysBufferAddress(sysEVRbufferAddress),
+    .sysBufferData(sysEVRbufferByte),
+    .sysBufferStatus(sysEVRbufferStatus));
 assign evrRxStartACQstrobe = evrStrobes[EVR_ACQ_START_CODE];
 assign evrRxStopACQstrobe  = evrStrobes[EVR_ACQ_STOP_CODE];
 assign evrRxClearMPSstrobe = evrStrobes[EVR_MPS_CLEAR_CODE];
+assign evrRxCaptureStrobe  = evrStrobes[EVR_CAPTURE_CODE];
 
 // Stretch PPS strobe to marker sure to be seen in other clock domains
 localparam PPS_STRETCH_COUNTER_WIDTH = 5;
@@ -201,10 +246,11 @@ end
 reg mgtIsEVG;
 wire [MGT_DATA_WIDTH-1:0] mpfTxChars;
 wire                      mpfTxCharIsK;
+wire [MPS_OUTPUT_COUNT-1:0] mpfTripped;
 wire [MGT_DATA_WIDTH-1:0] evfTxChars;
-wire                      evfTxCharIsK;
+wire [MGT_BYTE_COUNT-1:0] evfTxCharIsK;
 wire [MGT_DATA_WIDTH-1:0] evsTxChars;
-wire                      evsTxCharIsK;
+wire [MGT_BYTE_COUNT-1:0] evsTxCharIsK;
 wire [MGT_DATA_WIDTH-1:0] evgTxChars;
 wire [MGT_BYTE_COUNT-1:0] evgTxCharIsK;
 always @(posedge mgtTxClk) begin
@@ -213,7 +259,7 @@ always @(posedge mgtTxClk) begin
 end
 assign evsTxChars =   mgtIsEVG ? evgTxChars   : evfTxChars;
 assign evsTxCharIsK = mgtIsEVG ? evgTxCharIsK : evfTxCharIsK;
-assign mpsTrippedOutputs = isEVG ? mpfTxChars[8+:MPS_OUTPUT_COUNT]
+assign mpsTrippedOutputs = isEVG ? mpfTripped
                                  : {MPS_OUTPUT_COUNT{1'b1}};
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -238,6 +284,7 @@ mgtWrapper #(
     .mgtRxLinkUp(mgtRxLinkUp),
     .mgtRxChars(mgtRxChars),
     .mgtRxCharIsK(mgtRxCharIsK),
+    .mgtRxUpperIsK(mgtRxUpperIsK),
     .mgtTxClk(mgtTxClk),
     .mgtIsEVG(mgtIsEVG),
     .mpsTxChars(mpsTxChars),
@@ -249,7 +296,7 @@ mgtWrapper #(
 
 ///////////////////////////////////////////////////////////////////////////////
 // Minimal event generator
-// Heartbeat and PPS events only.
+// Heartbeat and PPS events and distributed buffer only.
 reg sysEVG_PPStoggle = 0;
 reg secondsValid = 0;
 assign sysEVGstatus = {sysEVG_PPStoggle, {28{1'b0}},
@@ -299,7 +346,12 @@ always @(posedge mgtTxClk) begin
         sysEVG_PPStoggle <= !sysEVG_PPStoggle;
     end
 end
-tinyEVG #(.DEBUG(DEBUG_EVG))
+wire sysEVGbufferBusy;
+assign sysEVGbufferStatus = { sysEVGbufferBusy, 31'b0 } |
+                                            DISTRIBUTED_BUFFER_ADDRESS_WIDTH;
+tinyEVG #(
+    .DISTRIBUTED_BUFFER_ADDRESS_WIDTH(DISTRIBUTED_BUFFER_ADDRESS_WIDTH),
+    .DEBUG(DEBUG_EVG))
   tinyEVG (
     .evgTxClk(mgtTxClk),
     .evgTxWord(evgTxChars),
@@ -312,24 +364,23 @@ tinyEVG #(.DEBUG(DEBUG_EVG))
     .seconds(sysSeconds),
     .distributedBus(8'h00),
     .sysClk(sysClk),
-    .sysWriteStrobe(1'b0),
-    .sysAddress(11'h000),
-    .sysData(8'h00),
-    .sysSendStrobe(1'b0),
-    .sysBusy());
+    .sysWriteStrobe(sysEVGbufferStrobe && !sysGPIO_OUT[31]),
+    .sysAddress(sysGPIO_OUT[16+:DISTRIBUTED_BUFFER_ADDRESS_WIDTH]),
+    .sysData(sysGPIO_OUT[7:0]),
+    .sysSendStrobe(sysEVGbufferStrobe && sysGPIO_OUT[31]),
+    .sysBusy(sysEVGbufferBusy));
 
 ///////////////////////////////////////////////////////////////////////////////
 // Minimal event fanout
-wire pad;
 evf #(.DEBUG(DEBUG_EVF))
   evf_i (
     .rxClk(evfRxClk),
     .rxLinkUp(evfRxLinkUp && !isEVG),
     .rxChars(evfRxChars),
-    .rxCharIsK({1'b0, evfRxCharIsK}),
+    .rxCharIsK({evfRxUpperIsK, evfRxCharIsK}),
     .txClk(mgtTxClk),
     .txChars(evfTxChars),
-    .txCharIsK({pad, evfTxCharIsK}));
+    .txCharIsK(evfTxCharIsK));
 
 ///////////////////////////////////////////////////////////////////////////////
 // Merge MPS uplinks
@@ -343,11 +394,18 @@ mpsMerge #(
     .sysGPIO_OUT(sysGPIO_OUT),
     .sysStatus(sysMPSmergeStatus),
     .sysIsEVG(isEVG),
+    .sysDataStrobe(sysMPSmergeDataStrobe),
+    .sysData(sysMPSmergeData),
+    .acqClk(acqClk),
+    .acqTicks(acqTimestamp[0+:32]),
+    .mgtRxClks(mgtRxClks),
     .mgtRxChars(mgtRxChars),
+    .mgtRxCharIsK(mgtRxCharIsK),
     .mgtRxLinkUp(mgtRxLinkUp),
     .mgtTxClk(mgtTxClk),
     .mpfTxChars(mpfTxChars),
-    .mpfTxCharIsK(mpfTxCharIsK));
+    .mpfTxCharIsK(mpfTxCharIsK),
+    .mpfTripped(mpfTripped));
 
 endmodule
 `default_nettype wire
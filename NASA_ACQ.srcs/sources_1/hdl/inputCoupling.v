@@ -23,24 +23,62 @@
  */
 
 /*
- * AC/DC coupling
+ * AC/DC coupling and per-channel filtering.
+ *
+ * Each channel passes through a cascade of SECTION_COUNT biquad sections
+ * computed by a single multiply/accumulate unit time-shared across all
+ * channels.  At power-up the first section of every channel is a
+ * first-order highpass with a time constant of 2^15 samples (the AC
+ * coupling previously provided by a per-channel iirHighpass) and the
+ * remaining sections pass their input unchanged.
+ * All channels, DC coupled or not, reach limit detection and MPS about
+ * CHANNEL_COUNT*(1+(5*SECTION_COUNT))+13 clocks after arriving here,
+ * which is 365 clocks with the default parameters.
+ *
+ * Section transfer function:
+ *                b0 + b1*z^-1 + b2*z^-2
+ *        H(z) = ------------------------
+ *                1  + a1*z^-1 + a2*z^-2
+ *
+ * Coupling CSR write:
+ *   Bits (CHANNEL_COUNT-1):0 -- DC couple channel (bypass filters).
+ *                               Also clears the overrun flag.
+ * Filter coefficient writes:
+ *   Bit 31 set -- Set coefficient address
+ *      Bits 15:8 -- Channel
+ *      Bits  7:4 -- Section
+ *      Bits  2:0 -- Coefficient index, 0 through 4 for b0, b1, b2, -a1, -a2
+ *   Bit 31 clear -- Write coefficient and advance to next index, moving on
+ *                   to index 0 of the following section after index 4.
+ *      Bits (COEFFICIENT_WIDTH-1):0 -- Coefficient, signed, unity is
+ *                                      2^(COEFFICIENT_WIDTH-2).
+ * Filter status read:
+ *   Bit 31     -- Computation overrun
+ *   Bits 23:16 -- SECTION_COUNT
+ *   Bits 15:8  -- COEFFICIENT_WIDTH
+ *   Bits  7:0  -- GUARD_BITS
  */
 `default_nettype none
 module inputCoupling #(
-    parameter CHANNEL_COUNT = 1,
-    parameter DATA_WIDTH    = 24,
-    parameter DEBUG         = "false"
+    parameter CHANNEL_COUNT     = 32,
+    parameter DATA_WIDTH        = 24,
+    parameter SECTION_COUNT     = 2,
+    parameter COEFFICIENT_WIDTH = 25,
+    parameter GUARD_BITS        = 16,
+    parameter DEBUG             = "false"
     ) (
     input  wire        sysClk,
     input  wire        sysCsrStrobe,
+    input  wire        sysFilterStrobe,
     input  wire [31:0] sysGPIO_OUT,
     output wire [31:0] sysStatus,
+    output wire [31:0] sysFilterStatus,
 
     input  wire                                         clk,
     input  wire signed [(CHANNEL_COUNT*DATA_WIDTH)-1:0] inTDATA,
     input  wire                                         inTVALID,
     output wire signed [(CHANNEL_COUNT*DATA_WIDTH)-1:0] outTDATA,
-    output wire                                         outTVALID);
+    output reg                                          outTVALID = 0);
 
 ///////////////////////////////////////////////////////////////////////////////
 // System clock domain
@@ -62,6 +100,8 @@ assign sysStatus = sysCoupling;
 (*ASYNC_REG="true"*) reg couplingToggle_m = 0;
 (*MARK_DEBUG=DEBUG*) reg couplingToggle = 0, couplingToggle_d = 0;
 (*MARK_DEBUG=DEBUG*) reg [CHANNEL_COUNT-1:0] dcCoupled;
+(*MARK_DEBUG=DEBUG*) reg overrun = 0;
+wire overrunStrobe;
 
 always @(posedge clk) begin
     couplingToggle_m <= sysCouplingToggle;
@@ -69,7 +109,48 @@ always @(posedge clk) begin
     couplingToggle_d <= couplingToggle;
     if (couplingToggle != couplingToggle_d) begin
         dcCoupled <= sysCoupling;
+        overrun <= 0;
     end
+    else if (overrunStrobe) begin
+        overrun <= 1;
+    end
+end
+
+(*ASYNC_REG="true"*) reg sysOverrun_m = 0;
+reg sysOverrun = 0;
+always @(posedge sysClk) begin
+    sysOverrun_m <= overrun;
+    sysOverrun   <= sysOverrun_m;
+end
+localparam [7:0] SECTION_COUNT_8     = SECTION_COUNT;
+localparam [7:0] COEFFICIENT_WIDTH_8 = COEFFICIENT_WIDTH;
+localparam [7:0] GUARD_BITS_8        = GUARD_BITS;
+assign sysFilterStatus = { sysOverrun, 7'b0, SECTION_COUNT_8,
+                           COEFFICIENT_WIDTH_8, GUARD_BITS_8 };
+
+wire [(CHANNEL_COUNT*DATA_WIDTH)-1:0] filteredTDATA;
+wire                                  filteredTVALID;
+
+inputCouplingFilter #(
+    .CHANNEL_COUNT(CHANNEL_COUNT),
+    .DATA_WIDTH(DATA_WIDTH),
+    .SECTION_COUNT(SECTION_COUNT),
+    .COEFFICIENT_WIDTH(COEFFICIENT_WIDTH),
+    .GUARD_BITS(GUARD_BITS),
+    .DEBUG(DEBUG))
+  inputCouplingFilter_i (
+    .sysClk(sysClk),
+    .sysCoefficientStrobe(sysFilterStrobe),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .clk(clk),
+    .overrunStrobe(overrunStrobe),
+    .S_TDATA(inTDATA),
+    .S_TVALID(inTVALID),
+    .M_TDATA(filteredTDATA),
+    .M_TVALID(filteredTVALID));
+
+always @(posedge clk) begin
+    outTVALID <= filteredTVALID;
 end
 
 genvar i;
@@ -78,36 +159,323 @@ for (i = 0 ; i < CHANNEL_COUNT ; i = i + 1) begin : inputCoupler
     (*MARK_DEBUG=DEBUG*) wire signed [DATA_WIDTH-1:0] inData =
                                               inTDATA[i*DATA_WIDTH+:DATA_WIDTH];
     (*MARK_DEBUG=DEBUG*) reg  signed [DATA_WIDTH-1:0] dcData;
-    (*MARK_DEBUG=DEBUG*) wire signed [DATA_WIDTH-1:0] acData;
-    (*MARK_DEBUG=DEBUG*) wire                         acDataValid;
+    (*MARK_DEBUG=DEBUG*) wire signed [DATA_WIDTH-1:0] acData =
+                                        filteredTDATA[i*DATA_WIDTH+:DATA_WIDTH];
     (*MARK_DEBUG=DEBUG*) reg  signed [DATA_WIDTH-1:0] outData;
-    (*MARK_DEBUG=DEBUG*) reg  signed                  outValid = 0;
-
-    iirHighpass #(
-        .TDATA_WIDTH(DATA_WIDTH),
-        .LOG2_ALPHA(15))
-      iirHigPass_i (
-        .clk(clk),
-        .S_TDATA(inData),
-        .S_TVALID(inTVALID),
-        .M_TDATA(acData),
-        .M_TVALID(acDataValid));
+
     always @(posedge clk) begin
         if (inTVALID) begin
             dcData <= inData;
         end
-        if (acDataValid) begin
+        if (filteredTVALID) begin
             outData <= dcCoupled[i] ? dcData : acData;
-            outValid <= 1;
+        end
+    end
+    assign outTDATA[i*DATA_WIDTH+:DATA_WIDTH] = outData;
+end
+endgenerate
+endmodule
+
+/*
+ * Biquad cascade shared by all channels.
+ * Sections are Direct Form I.  The input to and output from each section
+ * are kept to GUARD_BITS below the input LSB with HEADROOM_BITS above the
+ * input MSB.  Each channel has a history word holding the three most recent
+ * values at every point in the cascade so the output history of one
+ * section is the input history of the next.
+ *
+ * A new sample is first shifted into the history of the cascade input,
+ * one channel per clock.  Then every section is computed for every channel
+ * in turn, five clocks per channel.  A sample therefore requires about
+ * CHANNEL_COUNT*(1+(5*SECTION_COUNT))+12 clocks.  This must be less than the
+ * input sample interval.  Samples arriving early are dropped and flagged.
+ * CHANNEL_COUNT must be at least 2.
+ */
+module inputCouplingFilter #(
+    parameter CHANNEL_COUNT     = 32,
+    parameter DATA_WIDTH        = 24,
+    parameter SECTION_COUNT     = 2,
+    parameter COEFFICIENT_WIDTH = 25,
+    parameter GUARD_BITS        = 16,
+    parameter HEADROOM_BITS     = 2,
+    parameter DEBUG             = "false"
+    ) (
+    input  wire        sysClk,
+    input  wire        sysCoefficientStrobe,
+    input  wire [31:0] sysGPIO_OUT,
+
+    input  wire                                  clk,
+    output reg                                   overrunStrobe = 0,
+    input  wire [(CHANNEL_COUNT*DATA_WIDTH)-1:0] S_TDATA,
+    input  wire                                  S_TVALID,
+    output reg  [(CHANNEL_COUNT*DATA_WIDTH)-1:0] M_TDATA = 0,
+    output reg                                   M_TVALID = 0);
+
+localparam CHANNEL_ADDRESS_WIDTH = $clog2(CHANNEL_COUNT);
+localparam SECTION_ADDRESS_WIDTH = $clog2(SECTION_COUNT + 1);
+localparam HISTORY_ADDRESS_WIDTH = CHANNEL_ADDRESS_WIDTH +
+                                   SECTION_ADDRESS_WIDTH;
+localparam COEFFICIENT_ADDRESS_WIDTH = HISTORY_ADDRESS_WIDTH + 3;
+localparam STATE_WIDTH           = HEADROOM_BITS + DATA_WIDTH + GUARD_BITS;
+localparam HISTORY_WIDTH         = 3 * STATE_WIDTH;
+localparam PRODUCT_WIDTH         = STATE_WIDTH + COEFFICIENT_WIDTH;
+localparam ACCUMULATOR_WIDTH     = PRODUCT_WIDTH + 3;
+localparam COEFFICIENT_FRACTION  = COEFFICIENT_WIDTH - 2;
+localparam integer UNITY         = 1 << COEFFICIENT_FRACTION;
+localparam integer HIGHPASS_POLE = UNITY - (UNITY >> 15);
+localparam DRAIN_COUNT           = 6;
+
+///////////////////////////////////////////////////////////////////////////////
+// Coefficients are written in system clock domain
+reg signed [COEFFICIENT_WIDTH-1:0] coefficients
+                                        [0:(1<<COEFFICIENT_ADDRESS_WIDTH)-1];
+integer c;
+initial begin
+    for (c = 0 ; c < (1 << COEFFICIENT_ADDRESS_WIDTH) ; c = c + 1) begin
+        case (c % 8)
+        0: coefficients[c] = UNITY;
+        1: coefficients[c] = (((c / 8) % (1 << SECTION_ADDRESS_WIDTH)) == 0) ?
+                                                                  -UNITY : 0;
+        3: coefficients[c] = (((c / 8) % (1 << SECTION_ADDRESS_WIDTH)) == 0) ?
+                                                           HIGHPASS_POLE : 0;
+        default: coefficients[c] = 0;
+        endcase
+    end
+end
+
+reg [CHANNEL_ADDRESS_WIDTH-1:0] sysChannel = 0;
+reg [SECTION_ADDRESS_WIDTH-1:0] sysSection = 0;
+reg                       [2:0] sysIndex = 0;
+always @(posedge sysClk) begin
+    if (sysCoefficientStrobe) begin
+        if (sysGPIO_OUT[31]) begin
+            sysChannel <= sysGPIO_OUT[8+:CHANNEL_ADDRESS_WIDTH];
+            sysSection <= sysGPIO_OUT[4+:SECTION_ADDRESS_WIDTH];
+            sysIndex   <= sysGPIO_OUT[0+:3];
         end
         else begin
-            outValid <= 0;
+            coefficients[{sysChannel, sysSection, sysIndex}] <=
+                                             sysGPIO_OUT[0+:COEFFICIENT_WIDTH];
+            if (sysIndex == 4) begin
+                sysIndex <= 0;
+                sysSection <= sysSection + 1;
+            end
+            else begin
+                sysIndex <= sysIndex + 1;
+            end
         end
     end
-    assign outTDATA[i*DATA_WIDTH+:DATA_WIDTH] = outData;
-    if (i == 0) begin
-        assign outTVALID = outValid;
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Everything else is in the processing clock domain
+// History words hold the newest value in the least significant bits.
+reg [HISTORY_WIDTH-1:0] history [0:(1<<HISTORY_ADDRESS_WIDTH)-1];
+integer h;
+initial begin
+    for (h = 0 ; h < (1 << HISTORY_ADDRESS_WIDTH) ; h = h + 1) begin
+        history[h] = 0;
     end
 end
-endgenerate
+reg [HISTORY_WIDTH-1:0] historyQ;
+
+//
+// Sequencing
+//
+reg [(CHANNEL_COUNT*DATA_WIDTH)-1:0] inShift;
+(*MARK_DEBUG=DEBUG*) reg intakeActive = 0;
+reg [CHANNEL_ADDRESS_WIDTH-1:0] intakeChannel = 0;
+reg intakeWrite = 0;
+reg [CHANNEL_ADDRESS_WIDTH-1:0] intakeWriteChannel = 0;
+reg [DATA_WIDTH-1:0] intakeData;
+(*MARK_DEBUG=DEBUG*) reg computeActive = 0;
+reg                       [2:0] tick = 0;
+reg [CHANNEL_ADDRESS_WIDTH-1:0] channel = 0;
+reg [SECTION_ADDRESS_WIDTH-1:0] section = 0;
+reg [$clog2(DRAIN_COUNT+1)-1:0] drainCounter = 0;
+wire busy = intakeActive || intakeWrite || computeActive ||
+                                                        (drainCounter != 0);
+
+always @(posedge clk) begin
+    overrunStrobe <= S_TVALID && busy;
+    intakeWrite <= intakeActive;
+    intakeWriteChannel <= intakeChannel;
+    intakeData <= inShift[0+:DATA_WIDTH];
+    if (S_TVALID && !busy) begin
+        inShift <= S_TDATA;
+        intakeActive <= 1;
+        intakeChannel <= 0;
+    end
+    else if (intakeActive) begin
+        inShift <= inShift >> DATA_WIDTH;
+        intakeChannel <= intakeChannel + 1;
+        if (intakeChannel == (CHANNEL_COUNT - 1)) begin
+            intakeActive <= 0;
+            computeActive <= 1;
+            tick <= 0;
+            channel <= 0;
+            section <= 0;
+        end
+    end
+    if (computeActive) begin
+        if (tick == 4) begin
+            tick <= 0;
+            if (channel == (CHANNEL_COUNT - 1)) begin
+                channel <= 0;
+                if (section == (SECTION_COUNT - 1)) begin
+                    computeActive <= 0;
+                    drainCounter <= DRAIN_COUNT;
+                end
+                else begin
+                    section <= section + 1;
+                end
+            end
+            else begin
+                channel <= channel + 1;
+            end
+        end
+        else begin
+            tick <= tick + 1;
+        end
+    end
+    else if (drainCounter != 0) begin
+        drainCounter <= drainCounter - 1;
+    end
+end
+
+//
+// Read the input history of the section on the first clock for a channel
+// and the output history of the section on the second.
+//
+wire [SECTION_ADDRESS_WIDTH-1:0] readSection = (tick == 0) ? section :
+                                                             section + 1;
+wire [HISTORY_ADDRESS_WIDTH-1:0] readAddress = intakeActive ?
+                     { intakeChannel, {SECTION_ADDRESS_WIDTH{1'b0}} } :
+                     { channel, readSection };
+
+//
+// Multiply/accumulate pipeline
+//
+reg d1Valid = 0, d2Valid = 0, d3Valid = 0;
+reg [2:0] d1Tick = 0, d2Tick = 0, d3Tick = 0;
+reg [CHANNEL_ADDRESS_WIDTH-1:0] d1Channel = 0, d2Channel = 0;
+reg [SECTION_ADDRESS_WIDTH-1:0] d1Section = 0, d2Section = 0;
+reg [STATE_WIDTH-1:0] holdX0, holdX1, holdX2;
+reg [(5*STATE_WIDTH)-1:0] operandShift;
+reg signed [COEFFICIENT_WIDTH-1:0] coefficientQ;
+reg signed [PRODUCT_WIDTH-1:0] product;
+reg signed [ACCUMULATOR_WIDTH-1:0] accumulator;
+reg productValid = 0, productFirst = 0, productLast = 0;
+reg accumulatorLast = 0;
+
+// Output history of the section follows its operands through the pipeline
+reg [STATE_WIDTH-1:0] y1A, y2A, y1B, y2B;
+reg [CHANNEL_ADDRESS_WIDTH-1:0] channelA, channelB;
+reg [SECTION_ADDRESS_WIDTH-1:0] sectionA, sectionB;
+wire [SECTION_ADDRESS_WIDTH-1:0] writeSection = sectionB + 1;
+
+// Round to nearest and saturate to state width
+wire signed [ACCUMULATOR_WIDTH-1:0] rounded = (accumulator +
+                 (1 << (COEFFICIENT_FRACTION - 1))) >>> COEFFICIENT_FRACTION;
+wire [ACCUMULATOR_WIDTH-STATE_WIDTH:0] roundedSignBits =
+                                     rounded[ACCUMULATOR_WIDTH-1:STATE_WIDTH-1];
+wire roundedOverflow = !(&roundedSignBits) && (|roundedSignBits);
+wire [STATE_WIDTH-1:0] sectionOut = roundedOverflow ?
+                           { rounded[ACCUMULATOR_WIDTH-1],
+                             {STATE_WIDTH-1{!rounded[ACCUMULATOR_WIDTH-1]}} } :
+                           rounded[STATE_WIDTH-1:0];
+
+// Round to nearest and saturate to output width
+wire signed [STATE_WIDTH:0] outRounded = ($signed({sectionOut[STATE_WIDTH-1],
+                     sectionOut}) + (1 << (GUARD_BITS - 1))) >>> GUARD_BITS;
+wire [STATE_WIDTH-DATA_WIDTH+1:0] outSignBits =
+                                         outRounded[STATE_WIDTH:DATA_WIDTH-1];
+wire outOverflow = !(&outSignBits) && (|outSignBits);
+wire [DATA_WIDTH-1:0] outData = outOverflow ?
+                                { outRounded[STATE_WIDTH],
+                                  {DATA_WIDTH-1{!outRounded[STATE_WIDTH]}} } :
+                                outRounded[DATA_WIDTH-1:0];
+reg [(CHANNEL_COUNT*DATA_WIDTH)-1:0] outShift;
+
+always @(posedge clk) begin
+    historyQ <= history[readAddress];
+    if (intakeWrite) begin
+        history[{intakeWriteChannel, {SECTION_ADDRESS_WIDTH{1'b0}}}] <=
+                        { historyQ[0+:2*STATE_WIDTH],
+                          {HEADROOM_BITS{intakeData[DATA_WIDTH-1]}},
+                          intakeData, {GUARD_BITS{1'b0}} };
+    end
+    else if (accumulatorLast) begin
+        history[{channelB, writeSection}] <= { y2B, y1B, sectionOut };
+    end
+
+    d1Valid <= computeActive;
+    d1Tick <= tick;
+    d1Channel <= channel;
+    d1Section <= section;
+    d2Valid <= d1Valid;
+    d2Tick <= d1Tick;
+    d2Channel <= d1Channel;
+    d2Section <= d1Section;
+    d3Valid <= d2Valid;
+    d3Tick <= d2Tick;
+
+    // Input history arrives the clock after it is read, output history
+    // the clock after that.
+    if (d1Valid && (d1Tick == 0)) begin
+        holdX0 <= historyQ[0*STATE_WIDTH+:STATE_WIDTH];
+        holdX1 <= historyQ[1*STATE_WIDTH+:STATE_WIDTH];
+        holdX2 <= historyQ[2*STATE_WIDTH+:STATE_WIDTH];
+    end
+    if (d2Valid && (d2Tick == 0)) begin
+        operandShift <= { historyQ[1*STATE_WIDTH+:STATE_WIDTH],
+                          historyQ[0*STATE_WIDTH+:STATE_WIDTH],
+                          holdX2, holdX1, holdX0 };
+        y1A <= historyQ[0*STATE_WIDTH+:STATE_WIDTH];
+        y2A <= historyQ[1*STATE_WIDTH+:STATE_WIDTH];
+        channelA <= d2Channel;
+        sectionA <= d2Section;
+    end
+    else begin
+        operandShift <= operandShift >> STATE_WIDTH;
+    end
+    coefficientQ <= coefficients[{d2Channel, d2Section, d2Tick}];
+
+    // Multiply
+    product <= $signed(operandShift[0+:STATE_WIDTH]) * coefficientQ;
+    productValid <= d3Valid;
+    productFirst <= (d3Tick == 0);
+    productLast <= (d3Tick == 4);
+
+    // Accumulate
+    if (productValid) begin
+        accumulator <= productFirst ? product : accumulator + product;
+        if (productFirst) begin
+            y1B <= y1A;
+            y2B <= y2A;
+            channelB <= channelA;
+            sectionB <= sectionA;
+        end
+    end
+    accumulatorLast <= productValid && productLast;
+
+    // Assemble output
+    if (accumulatorLast && (sectionB == (SECTION_COUNT - 1))) begin
+        outShift <= { outData,
+                      outShift[DATA_WIDTH+:(CHANNEL_COUNT-1)*DATA_WIDTH] };
+        if (channelB == (CHANNEL_COUNT - 1)) begin
+            M_TDATA <= { outData,
+                         outShift[DATA_WIDTH+:(CHANNEL_COUNT-1)*DATA_WIDTH] };
+            M_TVALID <= 1;
+        end
+        else begin
+            M_TVALID <= 0;
+        end
+    end
+    else begin
+        M_TVALID <= 0;
+    end
+end
+
 endmodule
+`default_nettype wire
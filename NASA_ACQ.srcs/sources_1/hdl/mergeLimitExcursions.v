@@ -24,11 +24,13 @@
 
 /*
  * Merge ADC limit excursion bitmaps into outgoing packet stream
+ * and fill in the header size field now that the size is known.
  */
 `default_nettype none
 module mergeLimitExcursions #(
-    parameter BITMAPS_WIDTH = 4 * 32,
-    parameter DEBUG       = "false"
+    parameter BITMAPS_WIDTH   = 4 * 32,
+    parameter PACKET_CAPACITY = 1472,
+    parameter DEBUG           = "false"
     ) (
     input  wire                     clk,
 
@@ -37,6 +39,7 @@ module mergeLimitExcursions #(
     (*MARK_DEBUG=DEBUG*) input  wire               [7:0] S_TDATA,
     (*MARK_DEBUG=DEBUG*) output wire                     S_TREADY,
     (*MARK_DEBUG=DEBUG*) input  wire [BITMAPS_WIDTH-1:0] packetLimitExcursions,
+    (*MARK_DEBUG=DEBUG*) input  wire              [31:0] packetSize,
 
     (*MARK_DEBUG=DEBUG*) output reg        M_TVALID = 0,
     (*MARK_DEBUG=DEBUG*) output reg        M_TLAST = 0,
@@ -59,6 +62,13 @@ reg [BITMAP_COUNTER_WIDTH-1:0] bitmapCount = BITMAP_COUNTER_LOAD;
 (*MARK_DEBUG=DEBUG*) wire bitmapCountDone = bitmapCount[BITMAP_COUNTER_WIDTH-1];
 reg [BITMAPS_WIDTH-1:0] bitmaps;
 
+// Header size field is bytes 4 through 7
+localparam SIZE_FIELD_FIRST = HEADER_COUNTER_LOAD - 4;
+localparam SIZE_FIELD_LAST  = HEADER_COUNTER_LOAD - 7;
+reg [31:0] sizeField;
+wire inSizeField = (headerCount <= SIZE_FIELD_FIRST)
+                && (headerCount >= SIZE_FIELD_LAST);
+
 localparam [2:0] ST_AWAIT_DATA   = 3'd0,
                  ST_SEND_HEADER  = 3'd1,
                  ST_SEND_BITMAPS = 3'd2,
@@ -68,7 +78,9 @@ localparam [2:0] ST_AWAIT_DATA   = 3'd0,
 (*MARK_DEBUG=DEBUG*) reg fifoRESETn = 1;
 
 // Buffer the packet
-// Need space for just a single packet.
+// Need space for just a single packet, less the bitmaps that are merged here.
+// Depth follows the packet capacity so jumbo frame builds get a deep enough
+// FIFO without a separate IP customization.
 (*MARK_DEBUG=DEBUG*) wire       fifoInTREADY;
 (*MARK_DEBUG=DEBUG*) wire       fifoOutTVALID;
 (*MARK_DEBUG=DEBUG*) wire       fifoOutTLAST;
@@ -76,21 +88,20 @@ localparam [2:0] ST_AWAIT_DATA   = 3'd0,
 (*MARK_DEBUG=DEBUG*) reg        fifoOutTREADY = 0;
 (*MARK_DEBUG=DEBUG*) wire       fifoOverflow;
 
-buildPacketMergeBitmapsFIFO buildPacketMergeBitmapsFIFO (
-  .wr_rst_busy(),                            // output wire wr_rst_busy
-  .rd_rst_busy(),                            // output wire rd_rst_busy
-  .s_aclk(clk),                              // input wire s_aclk
-  .s_aresetn(fifoRESETn),                    // input wire s_aresetn
-  .s_axis_tvalid(S_TVALID),                  // input wire s_axis_tvalid
-  .s_axis_tready(fifoInTREADY),              // output wire s_axis_tready
-  .s_axis_tdata(S_TDATA),                    // input wire [7 : 0] s_axis_tdata
-  .s_axis_tlast(S_TLAST),                    // input wire s_axis_tlast
-  .m_axis_tvalid(fifoOutTVALID),             // output wire m_axis_tvalid
-  .m_axis_tready(fifoOutTREADY && M_TREADY), // input wire m_axis_tready
-  .m_axis_tdata(fifoOutTDATA),               // output wire [7 : 0] m_axis_tdata
-  .m_axis_tlast(fifoOutTLAST),               // output wire m_axis_tlast
-  .axis_overflow(fifoOverflow));             // output wire axis_overflow
-
+mergeLimitExcursionsFIFO #(
+    .ADDRESS_WIDTH($clog2(PACKET_CAPACITY - BITMAP_BYTE_COUNT + 1)))
+  buildPacketMergeBitmapsFIFO (
+    .clk(clk),
+    .s_aresetn(fifoRESETn),
+    .s_axis_tvalid(S_TVALID),
+    .s_axis_tready(fifoInTREADY),
+    .s_axis_tdata(S_TDATA),
+    .s_axis_tlast(S_TLAST),
+    .m_axis_tvalid(fifoOutTVALID),
+    .m_axis_tready(fifoOutTREADY && M_TREADY),
+    .m_axis_tdata(fifoOutTDATA),
+    .m_axis_tlast(fifoOutTLAST),
+    .axis_overflow(fifoOverflow));
 
 always @(posedge clk) begin
     if (fifoOverflow) begin
@@ -100,9 +111,11 @@ always @(posedge clk) begin
     else begin
         case (state)
         ST_AWAIT_DATA: begin
+            fifoRESETn <= 1;
             M_TLAST <= 0;
             M_TVALID <= 0;
             bitmaps <= packetLimitExcursions;
+            sizeField <= packetSize;
             headerCount <= HEADER_COUNTER_LOAD;
             bitmapCount <= BITMAP_COUNTER_LOAD;
             if (S_TREADY && S_TLAST) begin
@@ -112,9 +125,17 @@ always @(posedge clk) begin
         end
         ST_SEND_HEADER: begin
             M_TVALID <= 1;
-            M_TDATA <= fifoOutTDATA;
+            if (inSizeField) begin
+                M_TDATA <= sizeField[31:24];
+            end
+            else begin
+                M_TDATA <= fifoOutTDATA;
+            end
             if (M_TREADY) begin
                 headerCount <= headerCount - 1;
+                if (inSizeField) begin
+                    sizeField <= { sizeField[23:0], 8'bx };
+                end
                 if (headerCountDone) begin
                     fifoOutTREADY <= 0;
                     state <= ST_SEND_BITMAPS;
@@ -156,5 +177,59 @@ always @(posedge clk) begin
         endcase
     end
 end
+endmodule
+
+/*
+ * Single clock first-word-fall-through FIFO.
+ * Block RAM read is registered so the write pointer seen by the
+ * read side is delayed one cycle to cover the read latency.
+ */
+module mergeLimitExcursionsFIFO #(
+    parameter ADDRESS_WIDTH = 11
+    ) (
+    input  wire       clk,
+    input  wire       s_aresetn,
+    input  wire       s_axis_tvalid,
+    output wire       s_axis_tready,
+    input  wire [7:0] s_axis_tdata,
+    input  wire       s_axis_tlast,
+    output wire       m_axis_tvalid,
+    input  wire       m_axis_tready,
+    output wire [7:0] m_axis_tdata,
+    output wire       m_axis_tlast,
+    output reg        axis_overflow = 0);
+
+reg [ADDRESS_WIDTH-1:0] head = 0, head_d = 0, tail = 0;
+wire [ADDRESS_WIDTH-1:0] tailNext = tail + (m_axis_tvalid && m_axis_tready);
+wire full = ((head + 1'b1) == tail);
+reg [8:0] dpram [0:(1<<ADDRESS_WIDTH)-1];
+reg [8:0] dpramQ;
+
+assign s_axis_tready = !full;
+assign m_axis_tvalid = (head_d != tail);
+assign m_axis_tdata = dpramQ[7:0];
+assign m_axis_tlast = dpramQ[8];
+
+always @(posedge clk) begin
+    if (s_axis_tvalid && !full) begin
+        dpram[head] <= {s_axis_tlast, s_axis_tdata};
+    end
+    dpramQ <= dpram[tailNext];
+    if (s_aresetn == 0) begin
+        head <= 0;
+        head_d <= 0;
+        tail <= 0;
+        axis_overflow <= 0;
+    end
+    else begin
+        axis_overflow <= s_axis_tvalid && full;
+        if (s_axis_tvalid && !full) begin
+            head <= head + 1;
+        end
+        head_d <= head;
+        tail <= tailNext;
+    end
+end
+
 endmodule
 `default_nettype wire
@@ -24,6 +24,8 @@
 
 /*
  * Wrap wizard-generated Multi-Gigabit Transceivers
+ * The K flag of the upper byte is carried only for the event streams,
+ * whose distributed buffer uses K characters in that byte.
  */
 `default_nettype none
 module mgtWrapper #(
@@ -48,6 +50,7 @@ module mgtWrapper #(
     (*MARK_DEBUG=DEBUG*)output wire                [MGT_COUNT-1:0] mgtRxLinkUp,
     (*MARK_DEBUG=DEBUG*)output wire[(MGT_COUNT*MGT_DATA_WIDTH)-1:0]mgtRxChars,
     (*MARK_DEBUG=DEBUG*)output wire                [MGT_COUNT-1:0] mgtRxCharIsK,
+    (*MARK_DEBUG=DEBUG*)output wire                [MGT_COUNT-1:0] mgtRxUpperIsK,
                         output wire                               mgtTxClk,
     (*MARK_DEBUG=DEBUG*)input  wire                               mgtIsEVG,
     (*MARK_DEBUG=DEBUG*)input  wire          [MGT_DATA_WIDTH-1:0] mpsTxChars,
@@ -55,7 +58,7 @@ module mgtWrapper #(
     (*MARK_DEBUG=DEBUG*)input  wire          [MGT_DATA_WIDTH-1:0] mpfTxChars,
     (*MARK_DEBUG=DEBUG*)input  wire                               mpfTxCharIsK,
     (*MARK_DEBUG=DEBUG*)input  wire          [MGT_DATA_WIDTH-1:0] evsTxChars,
-    (*MARK_DEBUG=DEBUG*)input  wire                               evsTxCharIsK);
+    (*MARK_DEBUG=DEBUG*)input  wire      [(MGT_DATA_WIDTH/8)-1:0] evsTxCharIsK);
 
 localparam MGT_STATUS_WIDTH = 4;
 localparam MGT_SEL_WIDTH = $clog2(MGT_COUNT);
@@ -167,6 +170,7 @@ for (i = 0 ; i < MGT_COUNT ; i = i + 1) begin : perLane
         .mgtRxNotInTable(mgtRxNotInTable[i]),
         .rxChars(mgtRxChars[(i*MGT_DATA_WIDTH)+:MGT_DATA_WIDTH]),
         .rxCharIsK(mgtRxCharIsK[i]),
+        .rxUpperIsK(mgtRxUpperIsK[i]),
         .rxLinkUp(mgtRxLinkUp[i]));
 
     /*
@@ -349,7 +353,7 @@ mgtShared mgtShared_i (
     .gt0_txoutclkfabric_out         (), // output wire gt0_txoutclkfabric_out
     .gt0_txoutclkpcs_out            (), // output wire gt0_txoutclkpcs_out
     //------------------- Transmit Ports - TX Gearbox Ports --------------------
-    .gt0_txcharisk_in               ({1'b0,evsTxCharIsK}), // input wire [1:0] gt0_txcharisk_in
+    .gt0_txcharisk_in               (evsTxCharIsK), // input wire [1:0] gt0_txcharisk_in
     //----------- Transmit Ports - TX Initialization and Reset Ports -----------
     .gt0_txresetdone_out            (mgtStatus[6][3]), // output wire gt0_txresetdone_out
 
@@ -421,7 +425,7 @@ mgtShared mgtShared_i (
     .gt1_txoutclkfabric_out         (), // output wire gt1_txoutclkfabric_out
     .gt1_txoutclkpcs_out            (), // output wire gt1_txoutclkpcs_out
     //------------------- Transmit Ports - TX Gearbox Ports --------------------
-    .gt1_txcharisk_in               ({1'b0,evsTxCharIsK}), // input wire [1:0] gt1_txcharisk_in
+    .gt1_txcharisk_in               (evsTxCharIsK), // input wire [1:0] gt1_txcharisk_in
     //----------- Transmit Ports - TX Initialization and Reset Ports -----------
     .gt1_txresetdone_out            (mgtStatus[4][3]), // output wire gt1_txresetdone_out
 
@@ -493,7 +497,7 @@ mgtShared mgtShared_i (
     .gt2_txoutclkfabric_out         (), // output wire gt2_txoutclkfabric_out
     .gt2_txoutclkpcs_out            (), // output wire gt2_txoutclkpcs_out
     //------------------- Transmit Ports - TX Gearbox Ports --------------------
-    .gt2_txcharisk_in               ({1'b0,evsTxCharIsK}), // input wire [1:0] gt2_txcharisk_in
+    .gt2_txcharisk_in               (evsTxCharIsK), // input wire [1:0] gt2_txcharisk_in
     //----------- Transmit Ports - TX Initialization and Reset Ports -----------
     .gt2_txresetdone_out            (mgtStatus[5][3]), // output wire gt2_txresetdone_out
 
@@ -565,7 +569,7 @@ mgtShared mgtShared_i (
     .gt3_txoutclkfabric_out         (), // output wire gt3_txoutclkfabric_out
     .gt3_txoutclkpcs_out            (), // output wire gt3_txoutclkpcs_out
     //------------------- Transmit Ports - TX Gearbox Ports --------------------
-    .gt3_txcharisk_in               ({1'b0,evsTxCharIsK}), // input wire [1:0] gt3_txcharisk_in
+    .gt3_txcharisk_in               (evsTxCharIsK), // input wire [1:0] gt3_txcharisk_in
     //----------- Transmit Ports - TX Initialization and Reset Ports -----------
     .gt3_txresetdone_out            (mgtStatus[7][3]), // output wire gt3_txresetdone_out
 
@@ -637,7 +641,7 @@ mgtShared mgtShared_i (
     .gt4_txoutclkfabric_out         (), // output wire gt4_txoutclkfabric_out
     .gt4_txoutclkpcs_out            (), // output wire gt4_txoutclkpcs_out
     //------------------- Transmit Ports - TX Gearbox Ports --------------------
-    .gt4_txcharisk_in               ({1'b0,evsTxCharIsK}), // input wire [1:0] gt4_txcharisk_in
+    .gt4_txcharisk_in               (evsTxCharIsK), // input wire [1:0] gt4_txcharisk_in
     //----------- Transmit Ports - TX Initialization and Reset Ports -----------
     .gt4_txresetdone_out            (mgtStatus[2][3]), // output wire gt4_txresetdone_out
 
@@ -782,7 +786,7 @@ mgtShared mgtShared_i (
     .gt6_txoutclkfabric_out         (), // output wire gt6_txoutclkfabric_out
     .gt6_txoutclkpcs_out            (), // output wire gt6_txoutclkpcs_out
     //------------------- Transmit Ports - TX Gearbox Ports --------------------
-    .gt6_txcharisk_in               ({1'b0, mgtIsEVG ? evsTxCharIsK : mpfTxCharIsK}), // input wire [1:0] gt6_txcharisk_in
+    .gt6_txcharisk_in               (mgtIsEVG ? evsTxCharIsK : {1'b0, mpfTxCharIsK}), // input wire [1:0] gt6_txcharisk_in
     //----------- Transmit Ports - TX Initialization and Reset Ports -----------
     .gt6_txresetdone_out            (mgtStatus[1][3]), // output wire gt6_txresetdone_out
 
@@ -854,7 +858,7 @@ mgtShared mgtShared_i (
     .gt7_txoutclkfabric_out         (), // output wire gt7_txoutclkfabric_out
     .gt7_txoutclkpcs_out            (), // output wire gt7_txoutclkpcs_out
     //------------------- Transmit Ports - TX Gearbox Ports --------------------
-    .gt7_txcharisk_in               ({1'b0,evsTxCharIsK}), // input wire [1:0] gt7_txcharisk_in
+    .gt7_txcharisk_in               (evsTxCharIsK), // input wire [1:0] gt7_txcharisk_in
     //----------- Transmit Ports - TX Initialization and Reset Ports -----------
     .gt7_txresetdone_out            (mgtStatus[3][3]), // output wire gt7_txresetdone_out
 
@@ -887,6 +891,7 @@ module mgtLinkStatus #(
     (*MARK_DEBUG=DEBUG*) input  wire  [MGT_BYTE_COUNT-1:0] mgtRxNotInTable,
     (*MARK_DEBUG=DEBUG*) output reg   [MGT_DATA_WIDTH-1:0] rxChars,
     (*MARK_DEBUG=DEBUG*) output reg                        rxCharIsK,
+    (*MARK_DEBUG=DEBUG*) output reg                        rxUpperIsK,
     (*MARK_DEBUG=DEBUG*) output wire                       rxLinkUp);
 
 localparam COMMAS_REQUIRED = 50;
@@ -905,6 +910,7 @@ assign rxLinkUp = nullsNeeded[NULL_COUNTER_WIDTH-1];
 always @(posedge clk) begin
     rxChars <= mgtData;
     rxCharIsK <= mgtDataIsK[0];
+    rxUpperIsK <= mgtDataIsK[MGT_BYTE_COUNT-1];
     if ((mgtRxNotInTable != 0)
      || (mgtDataIsK[0] && (mgtData[7:0] != 8'hBC))) begin
         nullsNeeded <= NULL_COUNTER_LOAD;
@@ -24,6 +24,35 @@
 
 /*
  * Local Machine Protection System operations
+ *
+ * CSR write:
+ *   Bit 31 -- Low-latency framing of transmitted MPS characters
+ *   Bits 11:8 -- Register select
+ *   Bits (MPS_SEL_WIDTH-1):0 -- Output select
+ * In low-latency framing the lower byte of non-comma characters is a
+ * CRC-8 of the trip bitmap in the upper byte and the upper byte of comma
+ * characters is a first-fault source ID of 0 (see mpsMerge).  Characters
+ * are built from the second synchronizer stage in either framing.  When
+ * ACQ_MGT_SAME_CLOCK is "true" the trip state is not resynchronized at all.
+ *
+ * Trip latency instrumentation:
+ * The first trip after all outputs have been clear is followed through
+ * the node.  Register 14, readable with any output selected, holds the
+ * latency, in acquisition clocks, from the acquisition strobe of the
+ * sample whose limit excursions caused the trip to the trip being
+ * asserted (bits 15:0) and to the trip first being sent in an MGT
+ * character (bits 31:16).  The latter is time stamped once the MGT
+ * transmit state has been synchronized back into the acquisition clock
+ * domain, so includes two or three clocks of synchronizer delay.
+ * Latencies saturate at 65535.  Register 15 holds the acquisition
+ * timestamp ticks of the sample so the stamps recorded by an upstream
+ * mpsMerge can be compared with it.  A trip caused only by a discrete
+ * input is reported against the most recent sample.
+ *
+ * Trip history:
+ * Trip, fault and clear events of every output are recorded with their
+ * fault bitmaps and time stamps by mpsTripHistory and sent as PSNB
+ * packets on request.  See mpsTripHistory for the CSR and packet layout.
  */
 `default_nettype none
 module mpsLocal #(
@@ -31,6 +60,8 @@ module mpsLocal #(
     parameter MPS_INPUT_COUNT  = -1,
     parameter ADC_COUNT        = -1,
     parameter TIMESTAMP_WIDTH  = -1,
+    parameter ACQ_MGT_SAME_CLOCK = "false",
+    parameter LOG2_HISTORY_DEPTH = 4,
     parameter DEBUG            = "false"
     ) (
     input  wire        sysClk,
@@ -39,28 +70,46 @@ module mpsLocal #(
     input  wire [31:0] sysGPIO_OUT,
     output wire [31:0] sysStatus,
     output reg  [31:0] sysData,
+    input  wire        sysHistoryCsrStrobe,
+    output wire [31:0] sysHistoryStatus,
   
     input  wire evrClk,
     input  wire evrClearMPSstrobe,
 
     input  wire                       acqClk,
+    input  wire                       acqStrobe,
     input  wire   [(4*ADC_COUNT)-1:0] acqLimitExcursions,
     input  wire                       acqLimitExcursionsTVALID,
     input  wire [TIMESTAMP_WIDTH-1:0] acqTimestamp,
     input  wire [MPS_INPUT_COUNT-1:0] mpsInputStates_a,
+    output wire                       acqMPStripped,
 
     input  wire                       mgtTxClk,
     output reg                 [15:0] mpsTxChars = 0,
-    output reg                        mpsTxCharIsK = 0);
+    output reg                        mpsTxCharIsK = 0,
+
+    output wire       M_TVALID,
+    output wire       M_TLAST,
+    output wire [7:0] M_TDATA,
+    input  wire       M_TREADY);
 
 localparam MPS_SEL_WIDTH = $clog2(MPS_OUTPUT_COUNT);
 localparam REG_SEL_WIDTH = 4;
 
+localparam LATENCY_WIDTH = 16;
+localparam HISTORY_RECORD_WIDTH = 2 + MPS_INPUT_COUNT + (4 * ADC_COUNT);
+
 reg [MPS_SEL_WIDTH-1:0] sysMPSsel = 0;
 reg [REG_SEL_WIDTH-1:0] sysREGsel = 0;
+reg                     sysLowLatency = 0;
 
 wire [(MPS_OUTPUT_COUNT*32)-1:0] acqPerChannelData;
 wire      [MPS_OUTPUT_COUNT-1:0] acqPerChannelTripped;
+wire      [MPS_OUTPUT_COUNT-1:0] acqHistoryStrobes;
+wire [(MPS_OUTPUT_COUNT*HISTORY_RECORD_WIDTH)-1:0] acqHistoryRecords;
+assign acqMPStripped = |acqPerChannelTripped;
+reg          [LATENCY_WIDTH-1:0] acqTripLatency = 0, acqTxLatency = 0;
+reg                       [31:0] acqTripSampleTicks = 0;
 
 ///////////////////////////////////////////////////////////////////////////////
 // System clock domain
@@ -68,11 +117,14 @@ always @(posedge sysClk) begin
     if (sysCsrStrobe) begin
         sysMPSsel <= sysGPIO_OUT[0+:MPS_SEL_WIDTH];
         sysREGsel <= sysGPIO_OUT[8+:REG_SEL_WIDTH];
+        sysLowLatency <= sysGPIO_OUT[31];
     end
-    sysData <= acqPerChannelData[sysMPSsel*32+:32];
+    sysData <= (sysREGsel == 14) ? { acqTxLatency, acqTripLatency } :
+               (sysREGsel == 15) ? acqTripSampleTicks :
+                                   acqPerChannelData[sysMPSsel*32+:32];
 end
-assign sysStatus = { {24-REG_SEL_WIDTH{1'b0}}, sysREGsel,
-                      {8-REG_SEL_WIDTH{1'b0}}, sysMPSsel };
+assign sysStatus = { sysLowLatency, {23-REG_SEL_WIDTH{1'b0}}, sysREGsel,
+                      {8-MPS_SEL_WIDTH{1'b0}}, sysMPSsel };
 
 ///////////////////////////////////////////////////////////////////////////////
 // Event receiver clock domain
@@ -95,9 +147,52 @@ reg acqClear_d0 = 0, acqClear_d1 = 0, acqClearTrip = 0;
 
 reg [(4*ADC_COUNT)-1:0] acqLimitExcursionsLatched = 0;
 
+// Free-running clock counts of the latest sample and the one whose
+// limit excursions are in effect.
+reg [31:0] acqClockCount = 0;
+reg [31:0] acqSampleCount = 0, acqSampleCountLatched = 0;
+reg [31:0] acqSampleTicks = 0, acqSampleTicksLatched = 0;
+reg [31:0] acqTripSampleCount = 0;
+reg        acqMPStripped_d = 0;
+(*ASYNC_REG="true"*) reg acqTxTripped_m = 0;
+reg acqTxTripped = 0, acqTxTripped_d = 0;
+reg mgtTxTripped = 0;
+
+function [LATENCY_WIDTH-1:0] latency;
+    input [31:0] clockCount;
+    input [31:0] sampleCount;
+    reg   [31:0] diff;
+    begin
+    diff = clockCount - sampleCount;
+    latency = (diff[31:LATENCY_WIDTH] != 0) ? {LATENCY_WIDTH{1'b1}} :
+                                              diff[0+:LATENCY_WIDTH];
+    end
+endfunction
+
 always @(posedge acqClk) begin
+    acqClockCount <= acqClockCount + 1;
+    if (acqStrobe) begin
+        acqSampleCount <= acqClockCount;
+        acqSampleTicks <= acqTimestamp[0+:32];
+    end
     if (acqLimitExcursionsTVALID) begin
         acqLimitExcursionsLatched <= acqLimitExcursions;
+        acqSampleCountLatched <= acqSampleCount;
+        acqSampleTicksLatched <= acqSampleTicks;
+    end
+
+    acqMPStripped_d <= acqMPStripped;
+    if (acqMPStripped && !acqMPStripped_d) begin
+        // Trip was asserted on the previous clock
+        acqTripLatency <= latency(acqClockCount - 1, acqSampleCountLatched);
+        acqTripSampleCount <= acqSampleCountLatched;
+        acqTripSampleTicks <= acqSampleTicksLatched;
+    end
+    acqTxTripped_m <= mgtTxTripped;
+    acqTxTripped   <= acqTxTripped_m;
+    acqTxTripped_d <= acqTxTripped;
+    if (acqTxTripped && !acqTxTripped_d) begin
+        acqTxLatency <= latency(acqClockCount, acqTripSampleCount);
     end
 
     acqClear_m  <= evrClear;
@@ -127,27 +222,85 @@ for (i = 0 ; i < MPS_OUTPUT_COUNT ; i = i + 1) begin : mpsChan
         .mpsInputs_a(mpsInputStates_a),
         .acqLimitExcursions(acqLimitExcursionsLatched),
         .acqTripped(acqPerChannelTripped[i]),
-        .acqClearTrip(acqClearTrip));
+        .acqClearTrip(acqClearTrip),
+        .acqHistoryStrobe(acqHistoryStrobes[i]),
+        .acqHistoryRecord(acqHistoryRecords[i*HISTORY_RECORD_WIDTH+:
+                                                   HISTORY_RECORD_WIDTH]));
 end
 endgenerate
 
+// Record trip history
+mpsTripHistory #(
+    .MPS_OUTPUT_COUNT(MPS_OUTPUT_COUNT),
+    .MPS_INPUT_COUNT(MPS_INPUT_COUNT),
+    .ADC_COUNT(ADC_COUNT),
+    .LOG2_HISTORY_DEPTH(LOG2_HISTORY_DEPTH),
+    .DEBUG(DEBUG))
+  mpsTripHistory_i (
+    .sysClk(sysClk),
+    .sysCsrStrobe(sysHistoryCsrStrobe),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .sysStatus(sysHistoryStatus),
+    .acqClk(acqClk),
+    .acqSeconds(acqTimestamp[32+:32]),
+    .acqTicks(acqTimestamp[0+:32]),
+    .acqEventStrobes(acqHistoryStrobes),
+    .acqEventRecords(acqHistoryRecords),
+    .M_TVALID(M_TVALID),
+    .M_TLAST(M_TLAST),
+    .M_TDATA(M_TDATA),
+    .M_TREADY(M_TREADY));
+
 ///////////////////////////////////////////////////////////////////////////////
 // MGT transmit clock domain
 reg [2:0] mpsTxPhase = 0;
 (*ASYNC_REG="true"*)  reg [MPS_OUTPUT_COUNT-1:0] mpsTripped_m;
 reg [MPS_OUTPUT_COUNT-1:0] mpsTripped;
+(*ASYNC_REG="true"*) reg mgtLowLatency_m = 0;
+reg                      mgtLowLatency = 0;
+
+function [7:0] crc8;
+    input [7:0] d;
+    integer b;
+    begin
+    crc8 = d;
+    for (b = 0 ; b < 8 ; b = b + 1) begin
+        crc8 = crc8[7] ? ((crc8 << 1) ^ 8'h07) : (crc8 << 1);
+    end
+    end
+endfunction
+
+wire [MPS_OUTPUT_COUNT-1:0] mgtTripped;
+generate
+if (ACQ_MGT_SAME_CLOCK == "true") begin
+    assign mgtTripped = acqPerChannelTripped;
+end
+else begin
+    assign mgtTripped = mpsTripped;
+end
+endgenerate
+wire [7:0] txTripped = { {8-MPS_OUTPUT_COUNT{1'b0}}, mgtTripped };
+
+// Comma characters don't carry the trip bitmap in low-latency framing
+// so hold off a comma when the bitmap has just changed.
+reg  [7:0] txSent = 0;
+wire sendComma = mpsTxPhase[2] && !(mgtLowLatency && (txTripped != txSent));
+
 always @(posedge mgtTxClk) begin
+    mgtLowLatency_m <= sysLowLatency;
+    mgtLowLatency   <= mgtLowLatency_m;
     mpsTripped_m <= acqPerChannelTripped;
     mpsTripped   <= mpsTripped_m;
-    mpsTxChars[8+:MPS_OUTPUT_COUNT] <= mpsTripped;
-    if (mpsTxPhase[2]) begin
+    mgtTxTripped <= |mgtTripped;
+    if (sendComma) begin
         mpsTxPhase <= 1;
-        mpsTxChars[0+:8] <= 8'hBC;
+        mpsTxChars <= { mgtLowLatency ? 8'h00 : txTripped, 8'hBC };
         mpsTxCharIsK <= 1;
     end
     else begin
-        mpsTxPhase <= mpsTxPhase + 1;
-        mpsTxChars[0+:8] <= 8'h00;
+        if (!mpsTxPhase[2]) mpsTxPhase <= mpsTxPhase + 1;
+        txSent <= txTripped;
+        mpsTxChars <= { txTripped, mgtLowLatency ? crc8(txTripped) : 8'h00 };
         mpsTxCharIsK <= 0;
     end
 end
@@ -172,7 +325,9 @@ module mpsLocalChannel #(
     input  wire  [MPS_INPUT_COUNT-1:0] mpsInputs_a,
     input  wire    [(4*ADC_COUNT)-1:0] acqLimitExcursions,
     output reg                         acqTripped = 0,
-    input  wire                        acqClearTrip);
+    input  wire                        acqClearTrip,
+    output reg                         acqHistoryStrobe = 0,
+    output reg [1+MPS_INPUT_COUNT+(4*ADC_COUNT):0] acqHistoryRecord = 0);
 
 reg [ADC_COUNT-1:0] importantHIHI = 0, firstFaultHIHI = 0;
 reg [ADC_COUNT-1:0] importantHI   = 0, firstFaultHI   = 0;
@@ -182,6 +337,7 @@ reg [MPS_INPUT_COUNT-1:0] importantDiscrete = 0, firstFaultDiscrete = 0;
 reg [MPS_INPUT_COUNT-1:0] discreteGoodState = 0;
 reg [TIMESTAMP_WIDTH-1:0] whenFaulted = 0;
 reg [MPS_INPUT_COUNT-1:0] mpsInputs = 0, discrete = 0;
+reg trip_d = 0;
 
 /*
  * Registers to and from processor
@@ -248,9 +404,16 @@ always @(posedge acqClk) begin
     mpsInputs_m <= mpsInputs_a;
     mpsInputs   <= mpsInputs_m;
     discrete    <= mpsInputs ^ discreteGoodState;
+    trip_d      <= trip;
 
+    // History record: fault asserted, latched, then the fault bitmaps
+    acqHistoryStrobe <= 0;
+    acqHistoryRecord <= { trip, trip && (acqClearTrip || !acqTripped),
+                          faultsDiscrete,
+                          faultsHIHI, faultsHI, faultsLO, faultsLOLO };
     if (acqClearTrip && !trip) begin
         acqTripped <= 0;
+        if (acqTripped) acqHistoryStrobe <= 1;
     end
     else if (trip && (acqClearTrip || !acqTripped)) begin
         firstFaultHIHI     <= faultsHIHI;
@@ -260,6 +423,10 @@ always @(posedge acqClk) begin
         firstFaultDiscrete <= faultsDiscrete;
         whenFaulted        <= acqTimestamp;
         acqTripped <= 1;
+        acqHistoryStrobe <= 1;
+    end
+    else if (trip && !trip_d) begin
+        acqHistoryStrobe <= 1;
     end
 end
 endmodule
@@ -24,80 +24,440 @@
 
 /*
  * Merge and forward MPS System trip status from multiple receivers.
+ *
+ * Each MGT character carries the trip bitmap in its upper byte.  The lower
+ * byte of every fifth character is a K28.5 comma and is otherwise 0.
+ * In low-latency mode the lower byte of non-comma characters is instead a
+ * CRC-8 (x^8+x^2+x+1) of the upper byte and the upper byte of comma
+ * characters is the first-fault source ID described below.  The trip
+ * bitmaps of received characters with a bad CRC, and of comma characters,
+ * are ignored and the previous good bitmap used in their place.
+ * Transmitters postpone a comma by one character when the trip bitmap
+ * has just changed so that no change waits for a comma to pass.
+ * BAD_CRC_LIMIT consecutive bad characters are treated as a link down.
+ * The CRC of an all-clear bitmap is 0 so an untripped low-latency
+ * transmitter still meets the link status checks.
+ * Both ends of every link must use the same framing.
+ *
+ * Only register outputs cross into the transmit clock domain, each
+ * through a two-stage synchronizer.  In standard framing the contribution
+ * of each link to the merged trip state is registered in its receive
+ * clock domain first, so that the link-down forcing cannot be separated
+ * from the trip bits.  In low-latency framing the received characters
+ * cross directly and are checked in the transmit clock domain, where a
+ * character caught changing just fails its CRC.
+ * Links are merged by a tree of MERGE_FANIN-input OR gates whose first
+ * level is combinatorial and whose further levels are registered.
+ * Transmitted characters are built from the output of the tree.
+ * With up to MERGE_FANIN links a change in the received characters is
+ * sent three transmit clocks later in low-latency framing and one receive
+ * clock plus three transmit clocks later in standard framing.  Each
+ * further level of the tree adds one transmit clock.
+ *
+ * When a link first contributes to the merged trip state the lowest
+ * numbered link then contributing is recorded as the first-fault link
+ * along with the source ID that link reported.  The source ID sent
+ * upstream is the first-fault link number plus one, or 0 when there is
+ * no fault.  Local MPS nodes send 0, so the event generator can follow
+ * the path to the chassis that tripped.  The first fault is re-armed once
+ * no link contributes and the merged trip state has cleared.
+ * Per-link fault and link-down counts are also kept.
+ *
+ * CSR write:
+ *   Bit 31 -- Low-latency framing on uplinks and merged output
+ *   Bits 15:0 -- Important links 15:0
+ * Data write:
+ *   Bit 31 -- Set importance of selected link to bit 30
+ *   Bits 15:8 -- Link select
+ *   Bits 1:0 -- Register select
+ * Data read:
+ *   0 -- Ticks at which a trip was first seen on the receivers
+ *   1 -- Ticks at which a trip was first sent in the merged character
+ *   2 -- Bits 15:8 first-fault source ID, bits 7:0 first-fault link plus 1
+ *   3 -- Selected link down count (31:16) and fault count (15:0)
+ *
+ * Trip latency instrumentation:
+ * The acquisition timestamp ticks are recorded when a trip is first seen
+ * on the receivers and when it is first sent in the merged MGT character.
+ * Both are recorded once the state has been synchronized into the
+ * acquisition clock domain.  The acquisition timestamps of all nodes
+ * are aligned by the event system, so these can be compared with the
+ * sample ticks recorded by mpsLocal in the node that tripped.
  */
 `default_nettype none
 module mpsMerge #(
     parameter MGT_COUNT        = -1,
     parameter MGT_DATA_WIDTH   = -1,
-    parameter MPS_OUTPUT_COUNT = -1
+    parameter MPS_OUTPUT_COUNT = -1,
+    parameter MERGE_FANIN      = 8,
+    parameter BAD_CRC_LIMIT    = 4
     ) (
     input  wire        sysClk,
     input  wire        sysCsrStrobe,
     input  wire [31:0] sysGPIO_OUT,
     output wire [31:0] sysStatus,
     input  wire        sysIsEVG,
+    input  wire        sysDataStrobe,
+    output reg  [31:0] sysData,
 
+    input  wire        acqClk,
+    input  wire [31:0] acqTicks,
+
+    input  wire                  [MGT_COUNT-1:0] mgtRxClks,
     input  wire [(MGT_COUNT*MGT_DATA_WIDTH)-1:0] mgtRxChars,
+    input  wire                  [MGT_COUNT-1:0] mgtRxCharIsK,
     input  wire                  [MGT_COUNT-1:0] mgtRxLinkUp,
 
-    input  wire                     mgtTxClk,
-    output reg [MGT_DATA_WIDTH-1:0] mpfTxChars,
-    output reg                      mpfTxCharIsK);
+    input  wire                       mgtTxClk,
+    output reg   [MGT_DATA_WIDTH-1:0] mpfTxChars,
+    output reg                        mpfTxCharIsK,
+    output reg [MPS_OUTPUT_COUNT-1:0] mpfTripped = 0);
+
+localparam BAD_COUNTER_WIDTH = $clog2(BAD_CRC_LIMIT + 1);
+localparam LINK_SEL_WIDTH = $clog2(MGT_COUNT);
+localparam COUNTER_WIDTH = 16;
+
+function [7:0] crc8;
+    input [7:0] d;
+    integer b;
+    begin
+    crc8 = d;
+    for (b = 0 ; b < 8 ; b = b + 1) begin
+        crc8 = crc8[7] ? ((crc8 << 1) ^ 8'h07) : (crc8 << 1);
+    end
+    end
+endfunction
+
+// OR groups of MERGE_FANIN bitmaps
+function [(MGT_COUNT*MPS_OUTPUT_COUNT)-1:0] reduce;
+    input [(MGT_COUNT*MPS_OUTPUT_COUNT)-1:0] in;
+    input integer inCount;
+    integer k;
+    begin
+    reduce = 0;
+    for (k = 0 ; k < MGT_COUNT ; k = k + 1) begin
+        if (k < inCount) begin
+            reduce[(k/MERGE_FANIN)*MPS_OUTPUT_COUNT+:MPS_OUTPUT_COUNT] =
+                   reduce[(k/MERGE_FANIN)*MPS_OUTPUT_COUNT+:MPS_OUTPUT_COUNT] |
+                   in[k*MPS_OUTPUT_COUNT+:MPS_OUTPUT_COUNT];
+        end
+    end
+    end
+endfunction
+
+// Number of nodes in a level of the merge tree
+function integer levelNodes;
+    input integer level;
+    integer l;
+    begin
+    levelNodes = MGT_COUNT;
+    for (l = 0 ; l <= level ; l = l + 1) begin
+        levelNodes = (levelNodes + MERGE_FANIN - 1) / MERGE_FANIN;
+    end
+    end
+endfunction
+
+function integer treeLevels;
+    input integer dummy;
+    begin
+    for (treeLevels = 1 ; levelNodes(treeLevels - 1) > 1 ;
+                                             treeLevels = treeLevels + 1) ;
+    end
+endfunction
+localparam TREE_LEVELS = treeLevels(0);
+localparam LOW_LINKS = (MGT_COUNT < 16) ? MGT_COUNT : 16;
 
 ///////////////////////////////////////////////////////////////////////////////
 // System clock domain
 reg [MGT_COUNT-1:0] linkImportant = 0;
+reg                 sysLowLatency = 0;
+reg   [LINK_SEL_WIDTH-1:0] sysLinkSel = 0;
+reg                  [1:0] sysRegSel = 0;
+wire [MGT_COUNT-1:0] linkAllowed = {{MGT_COUNT-2{1'b1}}, sysIsEVG, 1'b0};
 
 always @(posedge sysClk) begin
     if (sysCsrStrobe) begin
-        linkImportant <= sysGPIO_OUT[0+:MGT_COUNT] &
-                         {{MGT_COUNT-2{1'b1}}, sysIsEVG, 1'b0};
+        linkImportant[0+:LOW_LINKS] <= sysGPIO_OUT[0+:LOW_LINKS] &
+                                       linkAllowed[0+:LOW_LINKS];
+        sysLowLatency <= sysGPIO_OUT[31];
+    end
+    else if (sysDataStrobe && sysGPIO_OUT[31]) begin
+        linkImportant[sysGPIO_OUT[8+:LINK_SEL_WIDTH]] <= sysGPIO_OUT[30] &&
+                                 linkAllowed[sysGPIO_OUT[8+:LINK_SEL_WIDTH]];
+    end
+    if (sysDataStrobe) begin
+        sysLinkSel <= sysGPIO_OUT[8+:LINK_SEL_WIDTH];
+        sysRegSel <= sysGPIO_OUT[0+:2];
     end
 end
 
 ///////////////////////////////////////////////////////////////////////////////
-// Combinatorial merge
-// "To iterate is human, to recurse, divine." -- Attributed to L Peter Deutsch
+// Receiver clock domains
+// In standard framing the contribution of each link to the merged trip
+// state is formed here so that the link-down forcing and the trip bits
+// cross into the transmit clock domain as a single register.  In
+// low-latency framing the register holds the contribution from the last
+// good character and is used only for instrumentation.
+// Source IDs are accompanied by a toggle that changes with them.
+wire [(MGT_COUNT*MPS_OUTPUT_COUNT)-1:0] linkTripped_a;
+wire                 [(MGT_COUNT*8)-1:0] rxSources;
+wire                   [MGT_COUNT-1:0] rxSourceToggles;
 
+genvar i;
+generate
+for (i = 0 ; i < MGT_COUNT ; i = i + 1) begin : rxCheck
+    (*ASYNC_REG="true"*) reg rxLowLatency_m = 0, rxImportant_m = 0;
+    reg                        rxLowLatency = 0, rxImportant = 0;
+    reg                  [7:0] rxSource = 0;
+    reg                        rxSourceToggle = 0;
+    reg [MPS_OUTPUT_COUNT-1:0] rxContribution = 0;
+    wire                 [7:0] rxTrips = mgtRxChars[(i*MGT_DATA_WIDTH)+8+:8];
+    wire                 [7:0] rxCRC   = mgtRxChars[(i*MGT_DATA_WIDTH)+0+:8];
+    wire rxUse = !rxLowLatency || !mgtRxLinkUp[i] ||
+                             (!mgtRxCharIsK[i] && (rxCRC == crc8(rxTrips)));
+    wire [7:0] rxNewSource = rxLowLatency ? rxTrips : 8'h00;
+
+    always @(posedge mgtRxClks[i]) begin
+        rxLowLatency_m <= sysLowLatency;
+        rxLowLatency   <= rxLowLatency_m;
+        rxImportant_m  <= linkImportant[i];
+        rxImportant    <= rxImportant_m;
+        if (mgtRxCharIsK[i] && (rxNewSource != rxSource)) begin
+            rxSource <= rxNewSource;
+            rxSourceToggle <= !rxSourceToggle;
+        end
+        if (rxUse) begin
+            rxContribution <= {MPS_OUTPUT_COUNT{rxImportant}} &
+                              (rxTrips[0+:MPS_OUTPUT_COUNT] |
+                               {MPS_OUTPUT_COUNT{!mgtRxLinkUp[i]}});
+        end
+    end
+    assign linkTripped_a[i*MPS_OUTPUT_COUNT+:MPS_OUTPUT_COUNT] =
+                                                               rxContribution;
+    assign rxSources[i*8+:8] = rxSource;
+    assign rxSourceToggles[i] = rxSourceToggle;
+end
+endgenerate
+
+// Combinatorial merge, for instrumentation only
+// "To iterate is human, to recurse, divine." -- Attributed to L Peter Deutsch
 function [MPS_OUTPUT_COUNT-1:0] merge;
-    input            [MPS_OUTPUT_COUNT-1:0] linkImportant;
-    input                   [MGT_COUNT-1:0] mgtRxLinkUp;
-    input  [(MGT_COUNT*MGT_DATA_WIDTH)-1:0] mgtRxChars;
-    input                             [7:0] i;
-    merge = (i == 0) ? 0 :
-             (({MPS_OUTPUT_COUNT{linkImportant[i]}} &
-                       (mgtRxChars[(i*MGT_DATA_WIDTH)+8+:MPS_OUTPUT_COUNT] |
-                                     {MPS_OUTPUT_COUNT{!mgtRxLinkUp[i]}})) |
-                            merge(linkImportant, mgtRxLinkUp, mgtRxChars, i-1));
+    input [(MGT_COUNT*MPS_OUTPUT_COUNT)-1:0] linkTripped_a;
+    input                              [7:0] i;
+    merge = linkTripped_a[(i*MPS_OUTPUT_COUNT)+:MPS_OUTPUT_COUNT] |
+                                  ((i == 0) ? 0 : merge(linkTripped_a, i-1));
 endfunction
-
-wire [MPS_OUTPUT_COUNT-1:0] mpsTripped_a =
-                     merge(linkImportant, mgtRxLinkUp, mgtRxChars, MGT_COUNT-1);
+wire [MPS_OUTPUT_COUNT-1:0] mpsTripped_a = merge(linkTripped_a, MGT_COUNT-1);
 
 ///////////////////////////////////////////////////////////////////////////////
 // MGT transmit clock domain
+(*ASYNC_REG="true"*) reg [MGT_COUNT-1:0] mgtImportant_m = 0;
+(*ASYNC_REG="true"*) reg                 mgtLowLatency_m = 0;
+reg                      [MGT_COUNT-1:0] mgtImportant = 0;
+reg                                      mgtLowLatency = 0;
+always @(posedge mgtTxClk) begin
+    mgtImportant_m  <= linkImportant;
+    mgtImportant    <= mgtImportant_m;
+    mgtLowLatency_m <= sysLowLatency;
+    mgtLowLatency   <= mgtLowLatency_m;
+end
+
+// Per-link synchronizers.  Standard framing contributions come from the
+// receiver clock domain registers.  In low-latency framing the received
+// characters and link status are synchronized directly and checked here.
+// A character caught changing fails its CRC and, like any other bad
+// character, is replaced by the last good bitmap.
+wire [(MGT_COUNT*MPS_OUTPUT_COUNT)-1:0] linkTripped;
+wire                   [MGT_COUNT-1:0] linkUp;
+generate
+for (i = 0 ; i < MGT_COUNT ; i = i + 1) begin : txCheck
+    (*ASYNC_REG="true"*) reg [MPS_OUTPUT_COUNT-1:0] txStandard_m = 0;
+    (*ASYNC_REG="true"*) reg   [MGT_DATA_WIDTH-1:0] txChars_m = 0;
+    (*ASYNC_REG="true"*) reg                        txCharIsK_m = 0;
+    (*ASYNC_REG="true"*) reg                        txLinkUp_m = 0;
+    reg  [MPS_OUTPUT_COUNT-1:0] txStandard = 0;
+    reg    [MGT_DATA_WIDTH-1:0] txChars = 0;
+    reg                         txCharIsK = 0, txLinkUp = 0;
+    reg  [MPS_OUTPUT_COUNT-1:0] txHeld = 0;
+    reg [BAD_COUNTER_WIDTH-1:0] txBadCount = 0;
+    wire                  [7:0] txTrips = txChars[8+:8];
+    wire                  [7:0] txCRC   = txChars[0+:8];
+    wire txGood = !txCharIsK && (txCRC == crc8(txTrips));
+    wire txUp = txLinkUp &&
+                      !(mgtLowLatency && (txBadCount == BAD_CRC_LIMIT));
+    wire [MPS_OUTPUT_COUNT-1:0] txLowLatency =
+                    {MPS_OUTPUT_COUNT{mgtImportant[i]}} &
+                    ((txGood ? txTrips[0+:MPS_OUTPUT_COUNT] : txHeld) |
+                     {MPS_OUTPUT_COUNT{!txUp}});
+
+    always @(posedge mgtTxClk) begin
+        txStandard_m <= linkTripped_a[i*MPS_OUTPUT_COUNT+:MPS_OUTPUT_COUNT];
+        txStandard   <= txStandard_m;
+        txChars_m    <= mgtRxChars[i*MGT_DATA_WIDTH+:MGT_DATA_WIDTH];
+        txChars      <= txChars_m;
+        txCharIsK_m  <= mgtRxCharIsK[i];
+        txCharIsK    <= txCharIsK_m;
+        txLinkUp_m   <= mgtRxLinkUp[i];
+        txLinkUp     <= txLinkUp_m;
+        if (txGood) begin
+            txHeld <= txTrips[0+:MPS_OUTPUT_COUNT];
+            txBadCount <= 0;
+        end
+        else if (!txCharIsK && (txBadCount != BAD_CRC_LIMIT)) begin
+            txBadCount <= txBadCount + 1;
+        end
+    end
+    assign linkTripped[i*MPS_OUTPUT_COUNT+:MPS_OUTPUT_COUNT] =
+                                     mgtLowLatency ? txLowLatency : txStandard;
+    assign linkUp[i] = txUp;
+end
+endgenerate
+
+// Merge tree.  First level is combinatorial, the rest registered.
+wire [(MGT_COUNT*MPS_OUTPUT_COUNT)-1:0] mergeTree =
+                                              reduce(linkTripped, MGT_COUNT);
+wire [MPS_OUTPUT_COUNT-1:0] mgtTripped;
+genvar l;
+generate
+for (l = 1 ; l < TREE_LEVELS ; l = l + 1) begin : level
+    reg  [(MGT_COUNT*MPS_OUTPUT_COUNT)-1:0] q = 0;
+    wire [(MGT_COUNT*MPS_OUTPUT_COUNT)-1:0] in;
+    if (l == 1) begin
+        assign in = mergeTree;
+    end
+    else begin
+        assign in = level[l-1].q;
+    end
+    always @(posedge mgtTxClk) begin
+        q <= reduce(in, levelNodes(l - 1));
+    end
+end
+if (TREE_LEVELS == 1) begin
+    assign mgtTripped = mergeTree[0+:MPS_OUTPUT_COUNT];
+end
+else begin
+    assign mgtTripped = level[TREE_LEVELS-1].q[0+:MPS_OUTPUT_COUNT];
+end
+endgenerate
+
+// Per-link state for first fault and counters
+(*ASYNC_REG="true"*) reg [MGT_COUNT-1:0] linkSourceToggle_m = 0;
+reg [MGT_COUNT-1:0] linkFaulted = 0, linkFaulted_d = 0;
+reg [MGT_COUNT-1:0] linkGood = 0, linkGood_d = 0;
+reg [MGT_COUNT-1:0] linkSourceToggle = 0, linkSourceToggle_d = 0;
+reg [(MGT_COUNT*8)-1:0] linkSources = 0;
+reg [(MGT_COUNT*COUNTER_WIDTH)-1:0] linkFaultCounts = 0, linkDownCounts = 0;
+reg                                 firstFaultArmed = 1;
+reg                           [7:0] firstFaultLink = 0, firstFaultSource = 0;
+
+// Lowest numbered link faulted, plus one, or 0 if none
+function [7:0] lowestLink;
+    input [MGT_COUNT-1:0] faulted;
+    integer k;
+    begin
+    lowestLink = 0;
+    for (k = MGT_COUNT - 1 ; k >= 0 ; k = k - 1) begin
+        if (faulted[k]) lowestLink = k + 1;
+    end
+    end
+endfunction
+
+always @(posedge mgtTxClk) begin: linkState
+    integer k;
+    linkGood   <= linkUp;
+    linkGood_d <= linkGood;
+    linkSourceToggle_m <= rxSourceToggles;
+    linkSourceToggle   <= linkSourceToggle_m;
+    linkSourceToggle_d <= linkSourceToggle;
+    for (k = 0 ; k < MGT_COUNT ; k = k + 1) begin
+        linkFaulted[k] <= |linkTripped[k*MPS_OUTPUT_COUNT+:MPS_OUTPUT_COUNT];
+        linkFaulted_d[k] <= linkFaulted[k];
+        // Source ID is stable by the time its toggle has been synchronized
+        if (linkSourceToggle[k] != linkSourceToggle_d[k]) begin
+            linkSources[k*8+:8] <= rxSources[k*8+:8];
+        end
+        if (linkFaulted[k] && !linkFaulted_d[k]) begin
+            linkFaultCounts[k*COUNTER_WIDTH+:COUNTER_WIDTH] <=
+                          linkFaultCounts[k*COUNTER_WIDTH+:COUNTER_WIDTH] + 1;
+        end
+        if (!linkGood[k] && linkGood_d[k]) begin
+            linkDownCounts[k*COUNTER_WIDTH+:COUNTER_WIDTH] <=
+                           linkDownCounts[k*COUNTER_WIDTH+:COUNTER_WIDTH] + 1;
+        end
+    end
+    if (firstFaultArmed) begin
+        if (linkFaulted != 0) begin
+            firstFaultArmed <= 0;
+            firstFaultLink <= lowestLink(linkFaulted);
+            firstFaultSource <= linkSources[(lowestLink(linkFaulted)-1)*8+:8];
+        end
+    end
+    else if ((linkFaulted == 0) && (mpfTripped == 0)) begin
+        firstFaultArmed <= 1;
+    end
+end
+
+// Transmit characters
 reg [2:0] mpfTxPhase = 0;
-(*ASYNC_REG="true"*)  reg [MPS_OUTPUT_COUNT-1:0] mpsTripped_m;
-reg [MPS_OUTPUT_COUNT-1:0] mpsTripped;
+wire [7:0] txTripped = { {8-MPS_OUTPUT_COUNT{1'b0}}, mgtTripped };
+wire [7:0] txSource = firstFaultArmed ? 8'h00 : firstFaultLink;
+
+// Comma characters don't carry the trip bitmap in low-latency framing
+// so hold off a comma when the bitmap has just changed.
+reg  [7:0] txSent = 0;
+wire sendComma = mpfTxPhase[2] && !(mgtLowLatency && (txTripped != txSent));
+
 always @(posedge mgtTxClk) begin
-    mpsTripped_m <= mpsTripped_a;
-    mpsTripped   <= mpsTripped_m;
-    mpfTxChars[8+:MPS_OUTPUT_COUNT] <= mpsTripped;
-    if (mpfTxPhase[2]) begin
+    mpfTripped <= mgtTripped;
+    if (sendComma) begin
         mpfTxPhase <= 1;
-        mpfTxChars[0+:8] <= 8'hBC;
+        mpfTxChars <= { mgtLowLatency ? txSource : txTripped, 8'hBC };
         mpfTxCharIsK <= 1;
     end
     else begin
-        mpfTxPhase <= mpfTxPhase + 1;
-        mpfTxChars[0+:8] <= 8'h00;
+        if (!mpfTxPhase[2]) mpfTxPhase <= mpfTxPhase + 1;
+        txSent <= txTripped;
+        mpfTxChars <= { txTripped, mgtLowLatency ? crc8(txTripped) : 8'h00 };
         mpfTxCharIsK <= 0;
     end
 end
 
+///////////////////////////////////////////////////////////////////////////////
+// Acquisition clock domain
+(*ASYNC_REG="true"*) reg acqRxTripped_m = 0, acqTxTripped_m = 0;
+reg acqRxTripped = 0, acqRxTripped_d = 0;
+reg acqTxTripped = 0, acqTxTripped_d = 0;
+reg [31:0] acqRxTicks = 0, acqTxTicks = 0;
+always @(posedge acqClk) begin
+    acqRxTripped_m <= |mpsTripped_a;
+    acqRxTripped   <= acqRxTripped_m;
+    acqRxTripped_d <= acqRxTripped;
+    if (acqRxTripped && !acqRxTripped_d) begin
+        acqRxTicks <= acqTicks;
+    end
+    acqTxTripped_m <= |mpfTripped;
+    acqTxTripped   <= acqTxTripped_m;
+    acqTxTripped_d <= acqTxTripped;
+    if (acqTxTripped && !acqTxTripped_d) begin
+        acqTxTicks <= acqTicks;
+    end
+end
+
 ///////////////////////////////////////////////////////////////////////////////
 // System clock domain
-assign sysStatus = { {16-MPS_OUTPUT_COUNT{1'b0}}, mpsTripped_a,
-                     {16-MGT_COUNT{1'b0}}, linkImportant };
+// Recorded values are stable by the time they are read, but counts
+// may be caught changing so should be read twice.
+always @(posedge sysClk) begin
+    case (sysRegSel)
+    2'd0: sysData <= acqRxTicks;
+    2'd1: sysData <= acqTxTicks;
+    2'd2: sysData <= { 16'b0, firstFaultSource, firstFaultLink };
+    2'd3: sysData <= {
+                  linkDownCounts[sysLinkSel*COUNTER_WIDTH+:COUNTER_WIDTH],
+                  linkFaultCounts[sysLinkSel*COUNTER_WIDTH+:COUNTER_WIDTH] };
+    endcase
+end
+assign sysStatus = { sysLowLatency, {15-MPS_OUTPUT_COUNT{1'b0}}, mpfTripped,
+                     {16-LOW_LINKS{1'b0}}, linkImportant[0+:LOW_LINKS] };
 endmodule
 `default_nettype wire
@@ -0,0 +1,365 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Record MPS trip history and send it on request as PSNB packets.
+ * Each MPS output keeps a ring of the last 2**LOG2_HISTORY_DEPTH events
+ * in block RAM.  An event is recorded when the output trips or is
+ * re-latched by a clear request with a fault still present, when a fault
+ * is asserted while the output is already tripped, and when the trip is
+ * cleared.  Each event holds the fault bitmaps at the time of the event
+ * and the acquisition time stamp of the clock on which it was recorded,
+ * which for a trip is the same as the first-fault time stamp.
+ * The history is not affected by clearing the trips.
+ *
+ * Events from different outputs are written one per clock.  Events are
+ * held off while the history of their output is being sent so each packet
+ * is a consistent snapshot.  An event arriving for an output whose previous
+ * event is still waiting to be written is lost.
+ *
+ * A send request produces one packet per MPS output, in output order,
+ * with at least PACKET_GAP clocks between packets.  Entries are oldest
+ * first.  With ADC_COUNT and MPS_INPUT_COUNT no more than 32 and 16 a
+ * packet with 2**LOG2_HISTORY_DEPTH entries must fit UDP_PACKET_CAPACITY.
+ * The packet type field (most significant byte of the status word) is 5.
+ *
+ * History packet layout:
+ *   Bytes  0-3   "PSNB"
+ *   Bytes  4-7   Size (bytes following this field)
+ *   Bytes  8-11  Status: bits 31:24 packet type (5),
+ *                bits 15:8 MPS output,
+ *                bit 0 events have been lost since the history was cleared
+ *   Bytes 12-15  Number of entries in packet
+ *   Bytes 16-23  Sequence number
+ *   Bytes 24-31  Timestamp (seconds, nanoseconds) at which packet was sent
+ *   Then, for each entry:
+ *     Bytes  0-7   Timestamp (seconds, nanoseconds) of event
+ *     Bytes  8-11  Bit 31    -- 1 fault asserted, 0 trip cleared
+ *                  Bit 30    -- Output latched (first fault) by this event
+ *                  Bits 15:0 -- Discrete input faults
+ *     Bytes 12-15  HIHI faults
+ *     Bytes 16-19  HI faults
+ *     Bytes 20-23  LO faults
+ *     Bytes 24-27  LOLO faults
+ * All values are big-endian.
+ *
+ * CSR write:
+ *   Bit 31    -- Send history (ignored while a send is in progress)
+ *   Bit 30    -- Clear history
+ * CSR read:
+ *   Bit 31    -- Send in progress
+ *   Bit 30    -- Events have been lost since the history was cleared
+ *   Bits 15:8 -- LOG2_HISTORY_DEPTH
+ *
+ * Event records from mpsLocalChannel are
+ *   { fault asserted, latched, discrete, HIHI, HI, LO, LOLO }.
+ */
+`default_nettype none
+module mpsTripHistory #(
+    parameter MPS_OUTPUT_COUNT    = -1,
+    parameter MPS_INPUT_COUNT     = -1,
+    parameter ADC_COUNT           = -1,
+    parameter LOG2_HISTORY_DEPTH  = 4,
+    parameter PACKET_GAP          = 12500,
+    parameter DEBUG               = "false"
+    ) (
+    input  wire        sysClk,
+    input  wire        sysCsrStrobe,
+    input  wire [31:0] sysGPIO_OUT,
+    output wire [31:0] sysStatus,
+
+    input  wire                                      acqClk,
+    input  wire                               [31:0] acqSeconds,
+    input  wire                               [31:0] acqTicks,
+    input  wire               [MPS_OUTPUT_COUNT-1:0] acqEventStrobes,
+    input  wire [(MPS_OUTPUT_COUNT*
+                 (2+MPS_INPUT_COUNT+(4*ADC_COUNT)))-1:0] acqEventRecords,
+
+    (*MARK_DEBUG=DEBUG*) output reg        M_TVALID = 0,
+    (*MARK_DEBUG=DEBUG*) output reg        M_TLAST = 0,
+    (*MARK_DEBUG=DEBUG*) output reg  [7:0] M_TDATA = 0,
+    (*MARK_DEBUG=DEBUG*) input  wire       M_TREADY);
+
+localparam RECORD_WIDTH = 2 + MPS_INPUT_COUNT + (4 * ADC_COUNT);
+localparam ENTRY_WIDTH = 64 + RECORD_WIDTH;
+localparam MPS_SEL_WIDTH = $clog2(MPS_OUTPUT_COUNT);
+localparam HISTORY_DEPTH = 1 << LOG2_HISTORY_DEPTH;
+localparam HISTORY_COUNT_WIDTH = LOG2_HISTORY_DEPTH + 1;
+localparam ENTRY_BYTE_COUNT = 28;
+localparam HEADER_BYTE_COUNT = 32;
+localparam [7:0] LOG2_HISTORY_DEPTH_8 = LOG2_HISTORY_DEPTH;
+
+///////////////////////////////////////////////////////////////////////////////
+// System clock domain
+reg sysSendToggle = 0, sysClearToggle = 0;
+(*ASYNC_REG="true"*) reg sysDoneToggle_m = 0, sysLost_m = 0;
+reg sysDoneToggle = 0, sysLost = 0;
+wire sysBusy = (sysSendToggle != sysDoneToggle);
+wire acqDoneToggle;
+wire acqLostAny;
+
+always @(posedge sysClk) begin
+    sysDoneToggle_m <= acqDoneToggle;
+    sysDoneToggle   <= sysDoneToggle_m;
+    sysLost_m <= acqLostAny;
+    sysLost   <= sysLost_m;
+    if (sysCsrStrobe) begin
+        if (sysGPIO_OUT[31] && !sysBusy) begin
+            sysSendToggle <= !sysSendToggle;
+        end
+        if (sysGPIO_OUT[30]) begin
+            sysClearToggle <= !sysClearToggle;
+        end
+    end
+end
+assign sysStatus = { sysBusy, sysLost,
+                     14'b0,
+                     LOG2_HISTORY_DEPTH_8,
+                     8'b0 };
+
+//////////////////////////////////////////////////////////////////////////////
+// Acquisition clock domain
+(*ASYNC_REG="true"*) reg acqSendToggle_m = 0, acqClearToggle_m = 0;
+reg acqSendToggle = 0, acqClearToggle = 0, acqClearToggle_d = 0;
+wire acqClear = (acqClearToggle != acqClearToggle_d);
+always @(posedge acqClk) begin
+    acqSendToggle_m  <= sysSendToggle;
+    acqSendToggle    <= acqSendToggle_m;
+    acqClearToggle_m <= sysClearToggle;
+    acqClearToggle   <= acqClearToggle_m;
+    acqClearToggle_d <= acqClearToggle;
+end
+
+//
+// History memory, one ring per output
+//
+reg [ENTRY_WIDTH-1:0] history [0:(MPS_OUTPUT_COUNT*HISTORY_DEPTH)-1];
+reg [(MPS_OUTPUT_COUNT*LOG2_HISTORY_DEPTH)-1:0] writeIndices = 0;
+reg [(MPS_OUTPUT_COUNT*HISTORY_COUNT_WIDTH)-1:0] historyCounts = 0;
+reg                       [MPS_OUTPUT_COUNT-1:0] lost = 0;
+assign acqLostAny = |lost;
+
+// Time stamp of the clock on which channels record their events
+reg [31:0] eventSeconds = 0, eventTicks = 0;
+
+// Events waiting to be written
+reg               [MPS_OUTPUT_COUNT-1:0] pending = 0;
+reg [(MPS_OUTPUT_COUNT*ENTRY_WIDTH)-1:0] pendingEntries = 0;
+
+// Transmitter state used by the writer
+localparam TX_IDLE  = 3'd0,
+           TX_START = 3'd1,
+           TX_SEND  = 3'd2,
+           TX_LOAD  = 3'd3,
+           TX_GAP   = 3'd4;
+(*MARK_DEBUG=DEBUG*) reg [2:0] txState = TX_IDLE;
+reg [MPS_SEL_WIDTH-1:0] txChannel = 0;
+wire txActive = (txState == TX_START) || (txState == TX_SEND)
+                                      || (txState == TX_LOAD);
+
+always @(posedge acqClk) begin: writer
+    integer c;
+    reg writeNow, written;
+    reg [MPS_SEL_WIDTH+LOG2_HISTORY_DEPTH-1:0] writeAddress;
+    reg                     [ENTRY_WIDTH-1:0] writeEntry;
+    eventSeconds <= acqSeconds;
+    eventTicks <= acqTicks;
+    written = 0;
+    writeAddress = 0;
+    writeEntry = 0;
+    for (c = 0 ; c < MPS_OUTPUT_COUNT ; c = c + 1) begin
+        // Write at most one pending event, lowest output first
+        writeNow = !written && pending[c] && !(txActive && (txChannel == c));
+        if (writeNow) begin
+            written = 1;
+            writeAddress = { c[MPS_SEL_WIDTH-1:0],
+                    writeIndices[c*LOG2_HISTORY_DEPTH+:LOG2_HISTORY_DEPTH] };
+            writeEntry = pendingEntries[c*ENTRY_WIDTH+:ENTRY_WIDTH];
+            writeIndices[c*LOG2_HISTORY_DEPTH+:LOG2_HISTORY_DEPTH] <=
+                 writeIndices[c*LOG2_HISTORY_DEPTH+:LOG2_HISTORY_DEPTH] + 1;
+            if (!historyCounts[c*HISTORY_COUNT_WIDTH+LOG2_HISTORY_DEPTH]) begin
+                historyCounts[c*HISTORY_COUNT_WIDTH+:HISTORY_COUNT_WIDTH] <=
+                  historyCounts[c*HISTORY_COUNT_WIDTH+:HISTORY_COUNT_WIDTH] + 1;
+            end
+            pending[c] <= 0;
+        end
+        if (acqEventStrobes[c]) begin
+            if (pending[c] && !writeNow) begin
+                lost[c] <= 1;
+            end
+            else begin
+                pending[c] <= 1;
+                pendingEntries[c*ENTRY_WIDTH+:ENTRY_WIDTH] <= {
+                                eventSeconds, eventTicks,
+                                acqEventRecords[c*RECORD_WIDTH+:RECORD_WIDTH] };
+            end
+        end
+    end
+    if (written) begin
+        history[writeAddress] <= writeEntry;
+    end
+    if (acqClear) begin
+        historyCounts <= 0;
+        lost <= 0;
+    end
+end
+
+//
+// Send history
+//
+localparam HEADER_SHIFT_REG_WIDTH = HEADER_BYTE_COUNT * 8;
+localparam HEADER_COUNTER_LOAD = HEADER_BYTE_COUNT - 2;
+localparam ENTRY_COUNTER_LOAD = ENTRY_BYTE_COUNT - 2;
+localparam BYTE_COUNTER_WIDTH = $clog2(HEADER_COUNTER_LOAD+1) + 1;
+localparam GAP_COUNTER_LOAD = PACKET_GAP - 2;
+localparam GAP_COUNTER_WIDTH = $clog2(GAP_COUNTER_LOAD+1) + 1;
+
+reg [HEADER_SHIFT_REG_WIDTH-1:0] txShift = 0;
+reg [BYTE_COUNTER_WIDTH-1:0] txByteCounter = HEADER_COUNTER_LOAD;
+wire txByteCounterDone = txByteCounter[BYTE_COUNTER_WIDTH-1];
+reg [GAP_COUNTER_WIDTH-1:0] txGapCounter = GAP_COUNTER_LOAD;
+wire txGapCounterDone = txGapCounter[GAP_COUNTER_WIDTH-1];
+reg [HISTORY_COUNT_WIDTH-1:0] txEntriesRemaining = 0;
+reg [LOG2_HISTORY_DEPTH-1:0] txReadIndex = 0;
+reg txLastChunk = 0;
+reg txDoneToggle = 0;
+assign acqDoneToggle = txDoneToggle;
+reg [63:0] sequenceNumber = 0;
+
+reg [ENTRY_WIDTH-1:0] historyQ;
+always @(posedge acqClk) begin
+    historyQ <= history[{txChannel, txReadIndex}];
+end
+
+wire [HISTORY_COUNT_WIDTH-1:0] txEntryCount =
+              historyCounts[txChannel*HISTORY_COUNT_WIDTH+:HISTORY_COUNT_WIDTH];
+wire [LOG2_HISTORY_DEPTH-1:0] txWriteIndex =
+                writeIndices[txChannel*LOG2_HISTORY_DEPTH+:LOG2_HISTORY_DEPTH];
+wire [31:0] txPacketSize = HEADER_BYTE_COUNT - 8 +
+                                           (txEntryCount * ENTRY_BYTE_COUNT);
+
+wire           [31:0] entrySeconds = historyQ[ENTRY_WIDTH-1-:32];
+wire           [31:0] entryTicks = historyQ[ENTRY_WIDTH-33-:32];
+wire                  entryFault = historyQ[RECORD_WIDTH-1];
+wire                  entryLatched = historyQ[RECORD_WIDTH-2];
+wire [MPS_INPUT_COUNT-1:0] entryDiscrete =
+                                   historyQ[4*ADC_COUNT+:MPS_INPUT_COUNT];
+wire [ADC_COUNT-1:0] entryHIHI = historyQ[3*ADC_COUNT+:ADC_COUNT];
+wire [ADC_COUNT-1:0] entryHI   = historyQ[2*ADC_COUNT+:ADC_COUNT];
+wire [ADC_COUNT-1:0] entryLO   = historyQ[1*ADC_COUNT+:ADC_COUNT];
+wire [ADC_COUNT-1:0] entryLOLO = historyQ[0*ADC_COUNT+:ADC_COUNT];
+
+always @(posedge acqClk) begin
+    if (M_TVALID && M_TREADY) begin
+        M_TVALID <= 0;
+        M_TLAST <= 0;
+    end
+    case (txState)
+    TX_IDLE: begin
+        if (acqClear) begin
+            sequenceNumber <= {acqSeconds, 32'b0};
+        end
+        if (acqSendToggle != txDoneToggle) begin
+            txChannel <= 0;
+            txState <= TX_START;
+        end
+    end
+    TX_START: begin
+        sequenceNumber <= sequenceNumber + 1;
+        txShift <= {
+                  "P", "S", "N", "B",
+                  txPacketSize,
+                  { 8'd5, /* Packet type */
+                    8'b0,
+                    {8-MPS_SEL_WIDTH{1'b0}}, txChannel,
+                    7'b0,
+                    lost[txChannel] },
+                  {{32-HISTORY_COUNT_WIDTH{1'b0}}, txEntryCount},
+                  sequenceNumber[63:32],
+                  sequenceNumber[31:0],
+                  acqSeconds,
+                  {acqTicks[0+:29], 3'b000} }; /* nanoseconds */
+        txByteCounter <= HEADER_COUNTER_LOAD;
+        txEntriesRemaining <= txEntryCount;
+        txReadIndex <= txWriteIndex - txEntryCount[0+:LOG2_HISTORY_DEPTH];
+        txLastChunk <= (txEntryCount == 0);
+        txState <= TX_SEND;
+    end
+    TX_SEND: begin
+        if (!M_TVALID || M_TREADY) begin
+            M_TVALID <= 1;
+            M_TDATA <= txShift[HEADER_SHIFT_REG_WIDTH-1-:8];
+            txShift <= txShift << 8;
+            txByteCounter <= txByteCounter - 1;
+            if (txByteCounterDone) begin
+                if (txLastChunk) begin
+                    M_TLAST <= 1;
+                    txGapCounter <= GAP_COUNTER_LOAD;
+                    txState <= TX_GAP;
+                end
+                else begin
+                    txState <= TX_LOAD;
+                end
+            end
+        end
+    end
+    TX_LOAD: begin
+        txShift <= { entrySeconds,
+                     {entryTicks[0+:29], 3'b000}, /* nanoseconds */
+                     entryFault,
+                     entryLatched,
+                     14'b0,
+                     {16-MPS_INPUT_COUNT{1'b0}}, entryDiscrete,
+                     {32-ADC_COUNT{1'b0}}, entryHIHI,
+                     {32-ADC_COUNT{1'b0}}, entryHI,
+                     {32-ADC_COUNT{1'b0}}, entryLO,
+                     {32-ADC_COUNT{1'b0}}, entryLOLO,
+                     {HEADER_SHIFT_REG_WIDTH-(ENTRY_BYTE_COUNT*8){1'b0}} };
+        txByteCounter <= ENTRY_COUNTER_LOAD;
+        txReadIndex <= txReadIndex + 1;
+        txEntriesRemaining <= txEntriesRemaining - 1;
+        txLastChunk <= (txEntriesRemaining == 1);
+        txState <= TX_SEND;
+    end
+    TX_GAP: begin
+        if (txGapCounterDone) begin
+            if (txChannel == (MPS_OUTPUT_COUNT - 1)) begin
+                txDoneToggle <= acqSendToggle;
+                txState <= TX_IDLE;
+            end
+            else begin
+                txChannel <= txChannel + 1;
+                txState <= TX_START;
+            end
+        end
+        else begin
+            txGapCounter <= txGapCounter - 1;
+        end
+    end
+    default: txState <= TX_IDLE;
+    endcase
+end
+
+endmodule
+`default_nettype wire
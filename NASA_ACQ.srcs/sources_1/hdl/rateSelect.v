@@ -0,0 +1,393 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Reduce acquisition sample rate.
+ * Three cascaded decimating FIR stages -- divide by 5, divide by 5,
+ * divide by 2 -- each of which can be bypassed to provide overall
+ * rate reductions of 1, 2, 5, 10, 25 or 50.
+ *
+ * Each stage uses a single multiplier time-shared across all channels.
+ * A stage requires CHANNEL_COUNT*TAP_COUNT+4 clocks to produce an
+ * output sample so this must be less than DECIMATION input sample intervals.
+ * Any stage may be enabled on its own so each must keep up with the full
+ * input rate.  With 32 channels and the AD7768 at its maximum rate (about
+ * 488 clocks per sample at 125 MHz) the divide by 5 stages need 1604 of
+ * 2440 clocks and the divide by 2 stage 772 of 976.
+ *
+ * Rate select CSR write:
+ *   Bit 0 -- Enable first divide by 5 stage
+ *   Bit 1 -- Enable second divide by 5 stage
+ *   Bit 2 -- Enable divide by 2 stage
+ * Coefficient writes (both divide by 5 stages share a coefficient set):
+ *   Bits 30:24 -- Tap index
+ *   Bits (COEFFICIENT_WIDTH-1):0 -- Coefficient, signed, unity gain is
+ *                                   2^(COEFFICIENT_WIDTH-1).
+ * All stages are bypassed at power-up so coefficients must be written
+ * before a stage is enabled.
+ * Filter phases are reset while acquisition is disabled so all nodes
+ * emit decimated samples with the same timestamps.
+ */
+`default_nettype none
+module rateSelect #(
+    parameter CHANNEL_COUNT     = 32,
+    parameter DATA_WIDTH        = 24,
+    parameter COEFFICIENT_WIDTH = 18,
+    parameter TAP_COUNT_5       = 50,
+    parameter TAP_COUNT_2       = 24,
+    parameter DEBUG             = "false"
+    ) (
+    input  wire        sysClk,
+    input  wire        sysRateStrobe,
+    input  wire        sysFilterStrobe5,
+    input  wire        sysFilterStrobe2,
+    input  wire [31:0] sysGPIO_OUT,
+    output wire [31:0] sysStatus,
+
+    input  wire                                  acqClk,
+    input  wire                                  acqEnabled,
+    input  wire [(CHANNEL_COUNT*DATA_WIDTH)-1:0] S_TDATA,
+    input  wire                                  S_TVALID,
+    output wire [(CHANNEL_COUNT*DATA_WIDTH)-1:0] M_TDATA,
+    output wire                                  M_TVALID);
+
+localparam STAGE_COUNT = 3;
+
+///////////////////////////////////////////////////////////////////////////////
+// System clock domain
+reg [STAGE_COUNT-1:0] sysStageEnables = 0;
+reg                   sysRateToggle = 0;
+
+always @(posedge sysClk) begin
+    if (sysRateStrobe) begin
+        sysStageEnables <= sysGPIO_OUT[STAGE_COUNT-1:0];
+        sysRateToggle <= !sysRateToggle;
+    end
+end
+
+//////////////////////////////////////////////////////////////////////////////
+// Acquisition clock domain
+
+(*ASYNC_REG="true"*) reg acqRateToggle_m = 0;
+(*MARK_DEBUG=DEBUG*) reg acqRateToggle = 0, acqRateToggle_d = 0;
+(*MARK_DEBUG=DEBUG*) reg [STAGE_COUNT-1:0] acqStageEnables = 0;
+(*MARK_DEBUG=DEBUG*) reg acqOverrun = 0;
+wire [STAGE_COUNT-1:0] acqStageOverrun;
+
+always @(posedge acqClk) begin
+    acqRateToggle_m <= sysRateToggle;
+    acqRateToggle   <= acqRateToggle_m;
+    acqRateToggle_d <= acqRateToggle;
+    if (acqRateToggle != acqRateToggle_d) begin
+        acqStageEnables <= sysStageEnables;
+        acqOverrun <= 0;
+    end
+    else if (|acqStageOverrun) begin
+        acqOverrun <= 1;
+    end
+end
+
+(*ASYNC_REG="true"*) reg sysOverrun_m = 0;
+reg sysOverrun = 0;
+always @(posedge sysClk) begin
+    sysOverrun_m <= acqOverrun;
+    sysOverrun   <= sysOverrun_m;
+end
+assign sysStatus = { sysOverrun, {32-1-STAGE_COUNT{1'b0}}, sysStageEnables };
+
+//
+// Stage cascade.
+// Disabled stages pass their input straight through.
+//
+wire [(CHANNEL_COUNT*DATA_WIDTH)-1:0] stageTDATA [0:STAGE_COUNT];
+wire                                  stageTVALID[0:STAGE_COUNT];
+assign stageTDATA[0] = S_TDATA;
+assign stageTVALID[0] = S_TVALID;
+
+genvar i;
+generate
+for (i = 0 ; i < STAGE_COUNT ; i = i + 1) begin : stage
+    localparam DECIMATION = (i == STAGE_COUNT - 1) ? 2 : 5;
+    localparam TAP_COUNT = (i == STAGE_COUNT - 1) ? TAP_COUNT_2 : TAP_COUNT_5;
+    wire enabled = acqEnabled && acqStageEnables[i];
+    wire [(CHANNEL_COUNT*DATA_WIDTH)-1:0] firTDATA;
+    wire                                  firTVALID;
+
+    rateSelectStage #(
+        .CHANNEL_COUNT(CHANNEL_COUNT),
+        .DATA_WIDTH(DATA_WIDTH),
+        .COEFFICIENT_WIDTH(COEFFICIENT_WIDTH),
+        .DECIMATION(DECIMATION),
+        .TAP_COUNT(TAP_COUNT),
+        .DEBUG(DEBUG))
+      rateSelectStage_i (
+        .sysClk(sysClk),
+        .sysCoefficientStrobe((i == STAGE_COUNT - 1) ? sysFilterStrobe2 :
+                                                       sysFilterStrobe5),
+        .sysGPIO_OUT(sysGPIO_OUT),
+        .clk(acqClk),
+        .enabled(enabled),
+        .overrun(acqStageOverrun[i]),
+        .S_TDATA(stageTDATA[i]),
+        .S_TVALID(stageTVALID[i]),
+        .M_TDATA(firTDATA),
+        .M_TVALID(firTVALID));
+
+    assign stageTDATA[i+1]  = acqStageEnables[i] ? firTDATA  : stageTDATA[i];
+    assign stageTVALID[i+1] = acqStageEnables[i] ? firTVALID : stageTVALID[i];
+end
+endgenerate
+
+assign M_TDATA  = stageTDATA[STAGE_COUNT];
+assign M_TVALID = stageTVALID[STAGE_COUNT];
+
+endmodule
+
+/*
+ * Single decimating FIR stage.
+ * Incoming samples are written, one channel per clock, to a per-channel
+ * circular history buffer.  Every DECIMATION input samples a single
+ * multiply/accumulate unit steps through each channel's history to
+ * compute the next output sample for that channel.
+ */
+module rateSelectStage #(
+    parameter CHANNEL_COUNT     = 32,
+    parameter DATA_WIDTH        = 24,
+    parameter COEFFICIENT_WIDTH = 18,
+    parameter DECIMATION        = 5,
+    parameter TAP_COUNT         = 50,
+    parameter DEBUG             = "false"
+    ) (
+    input  wire        sysClk,
+    input  wire        sysCoefficientStrobe,
+    input  wire [31:0] sysGPIO_OUT,
+
+    input  wire                                  clk,
+    input  wire                                  enabled,
+    output reg                                   overrun = 0,
+    input  wire [(CHANNEL_COUNT*DATA_WIDTH)-1:0] S_TDATA,
+    input  wire                                  S_TVALID,
+    output reg  [(CHANNEL_COUNT*DATA_WIDTH)-1:0] M_TDATA = 0,
+    output reg                                   M_TVALID = 0);
+
+localparam CHANNEL_ADDRESS_WIDTH = $clog2(CHANNEL_COUNT);
+localparam HISTORY_ADDRESS_WIDTH = $clog2(TAP_COUNT + DECIMATION);
+localparam TAP_ADDRESS_WIDTH     = $clog2(TAP_COUNT);
+localparam PRODUCT_WIDTH         = DATA_WIDTH + COEFFICIENT_WIDTH;
+localparam ACCUMULATOR_WIDTH     = PRODUCT_WIDTH + TAP_ADDRESS_WIDTH;
+localparam HISTORY_CAPACITY      = 1 << (CHANNEL_ADDRESS_WIDTH +
+                                         HISTORY_ADDRESS_WIDTH);
+
+///////////////////////////////////////////////////////////////////////////////
+// Coefficients are written in system clock domain
+reg signed [COEFFICIENT_WIDTH-1:0] coefficients [0:(1<<TAP_ADDRESS_WIDTH)-1];
+integer c;
+initial begin
+    for (c = 0 ; c < (1 << TAP_ADDRESS_WIDTH) ; c = c + 1) begin
+        coefficients[c] = 0;
+    end
+end
+
+always @(posedge sysClk) begin
+    if (sysCoefficientStrobe) begin
+        coefficients[sysGPIO_OUT[24+:TAP_ADDRESS_WIDTH]] <=
+                                    sysGPIO_OUT[0+:COEFFICIENT_WIDTH];
+    end
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Everything else is in the processing clock domain
+reg signed [DATA_WIDTH-1:0] history [0:HISTORY_CAPACITY-1];
+integer h;
+initial begin
+    for (h = 0 ; h < HISTORY_CAPACITY ; h = h + 1) begin
+        history[h] = 0;
+    end
+end
+
+//
+// Write incoming samples to history buffer.
+//
+localparam CHANNEL_COUNTER_LOAD = CHANNEL_COUNT - 2;
+localparam CHANNEL_COUNTER_WIDTH = $clog2(CHANNEL_COUNTER_LOAD+1) + 1;
+localparam PHASE_COUNTER_LOAD = DECIMATION - 2;
+localparam PHASE_COUNTER_WIDTH = $clog2(PHASE_COUNTER_LOAD+1) + 1;
+
+reg [(CHANNEL_COUNT*DATA_WIDTH)-1:0] inShift;
+(*MARK_DEBUG=DEBUG*) reg writeActive = 0;
+reg [CHANNEL_COUNTER_WIDTH-1:0] writeCounter = CHANNEL_COUNTER_LOAD;
+wire writeCounterDone = writeCounter[CHANNEL_COUNTER_WIDTH-1];
+reg [CHANNEL_ADDRESS_WIDTH-1:0] writeChannel = 0;
+reg [HISTORY_ADDRESS_WIDTH-1:0] writeSlot = 0;
+(*MARK_DEBUG=DEBUG*)
+reg [PHASE_COUNTER_WIDTH-1:0] phaseCounter = PHASE_COUNTER_LOAD;
+wire phaseCounterDone = phaseCounter[PHASE_COUNTER_WIDTH-1];
+reg computeStart = 0;
+
+always @(posedge clk) begin
+    if (!enabled) begin
+        writeActive <= 0;
+        phaseCounter <= PHASE_COUNTER_LOAD;
+        computeStart <= 0;
+    end
+    else if (S_TVALID) begin
+        inShift <= S_TDATA;
+        writeActive <= 1;
+        writeCounter <= CHANNEL_COUNTER_LOAD;
+        writeChannel <= 0;
+        computeStart <= 0;
+    end
+    else if (writeActive) begin
+        history[{writeChannel, writeSlot}] <= inShift[0+:DATA_WIDTH];
+        inShift <= inShift >> DATA_WIDTH;
+        writeChannel <= writeChannel + 1;
+        if (writeCounterDone) begin
+            writeActive <= 0;
+            writeSlot <= writeSlot + 1;
+            if (phaseCounterDone) begin
+                phaseCounter <= PHASE_COUNTER_LOAD;
+                computeStart <= 1;
+            end
+            else begin
+                phaseCounter <= phaseCounter - 1;
+            end
+        end
+        else begin
+            writeCounter <= writeCounter - 1;
+        end
+    end
+    else begin
+        computeStart <= 0;
+    end
+end
+
+//
+// Multiply/accumulate
+//
+localparam TAP_COUNTER_LOAD = TAP_COUNT - 2;
+localparam TAP_COUNTER_WIDTH = $clog2(TAP_COUNTER_LOAD+1) + 1;
+
+(*MARK_DEBUG=DEBUG*) reg computeActive = 0;
+reg [TAP_COUNTER_WIDTH-1:0] tapCounter = TAP_COUNTER_LOAD;
+wire tapCounterDone = tapCounter[TAP_COUNTER_WIDTH-1];
+reg [CHANNEL_COUNTER_WIDTH-1:0] computeCounter = CHANNEL_COUNTER_LOAD;
+wire computeCounterDone = computeCounter[CHANNEL_COUNTER_WIDTH-1];
+reg [CHANNEL_ADDRESS_WIDTH-1:0] computeChannel = 0;
+reg [TAP_ADDRESS_WIDTH-1:0] tap = 0;
+reg [HISTORY_ADDRESS_WIDTH-1:0] newestSlot = 0;
+wire [HISTORY_ADDRESS_WIDTH-1:0] readSlot = newestSlot - tap;
+
+reg signed [DATA_WIDTH-1:0] historyQ;
+reg signed [COEFFICIENT_WIDTH-1:0] coefficientQ;
+reg signed [PRODUCT_WIDTH-1:0] product;
+reg signed [ACCUMULATOR_WIDTH-1:0] accumulator;
+reg readValid = 0, readFirst = 0, readLast = 0, readLastChannel = 0;
+reg productValid = 0, productFirst = 0, productLast = 0;
+reg productLastChannel = 0;
+reg accumulatorLast = 0, accumulatorLastChannel = 0;
+
+// Round to nearest and saturate
+localparam ROUNDING_SHIFT = COEFFICIENT_WIDTH - 1;
+wire signed [ACCUMULATOR_WIDTH-1:0] rounded = (accumulator +
+                       (1 << (ROUNDING_SHIFT - 1))) >>> ROUNDING_SHIFT;
+wire [ACCUMULATOR_WIDTH-DATA_WIDTH:0] roundedSignBits =
+                       rounded[ACCUMULATOR_WIDTH-1:DATA_WIDTH-1];
+wire roundedOverflow = !(&roundedSignBits) && (|roundedSignBits);
+wire [DATA_WIDTH-1:0] outData = roundedOverflow ?
+                         { rounded[ACCUMULATOR_WIDTH-1],
+                           {DATA_WIDTH-1{!rounded[ACCUMULATOR_WIDTH-1]}} } :
+                         rounded[DATA_WIDTH-1:0];
+reg [(CHANNEL_COUNT*DATA_WIDTH)-1:0] outShift;
+
+always @(posedge clk) begin
+    if (computeStart) begin
+        if (computeActive) overrun <= 1;
+        computeActive <= 1;
+        computeCounter <= CHANNEL_COUNTER_LOAD;
+        computeChannel <= 0;
+        tapCounter <= TAP_COUNTER_LOAD;
+        tap <= 0;
+        newestSlot <= writeSlot - 1;
+    end
+    else if (computeActive) begin
+        if (tapCounterDone) begin
+            tapCounter <= TAP_COUNTER_LOAD;
+            tap <= 0;
+            computeChannel <= computeChannel + 1;
+            if (computeCounterDone) begin
+                computeActive <= 0;
+            end
+            else begin
+                computeCounter <= computeCounter - 1;
+            end
+        end
+        else begin
+            tapCounter <= tapCounter - 1;
+            tap <= tap + 1;
+        end
+    end
+    if (S_TVALID && writeActive) overrun <= 1;
+    if (!enabled) overrun <= 0;
+
+    // Read history and coefficients
+    historyQ <= history[{computeChannel, readSlot}];
+    coefficientQ <= coefficients[tap];
+    readValid <= computeActive;
+    readFirst <= (tap == 0);
+    readLast <= tapCounterDone;
+    readLastChannel <= computeCounterDone;
+
+    // Multiply
+    product <= historyQ * coefficientQ;
+    productValid <= readValid;
+    productFirst <= readFirst;
+    productLast <= readValid && readLast;
+    productLastChannel <= readLastChannel;
+
+    // Accumulate
+    if (productValid) begin
+        accumulator <= productFirst ? product : accumulator + product;
+    end
+    accumulatorLast <= productLast;
+    accumulatorLastChannel <= productLastChannel;
+
+    // Assemble output
+    if (accumulatorLast) begin
+        outShift <= { outData, outShift[DATA_WIDTH+:(CHANNEL_COUNT-1)*DATA_WIDTH] };
+        if (accumulatorLastChannel) begin
+            M_TDATA <= { outData,
+                          outShift[DATA_WIDTH+:(CHANNEL_COUNT-1)*DATA_WIDTH] };
+            M_TVALID <= 1;
+        end
+        else begin
+            M_TVALID <= 0;
+        end
+    end
+    else begin
+        M_TVALID <= 0;
+    end
+end
+
+endmodule
+`default_nettype wire
@@ -0,0 +1,682 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Averaged power spectra of selected ADC channels.
+ * Readings from up to four channels are multiplied by a window function
+ * and collected into frames of FFT_SIZE samples.  While one frame is being
+ * collected the previous frame of each channel is transformed by a single
+ * radix-2 butterfly engine time-shared across the selected channels.  The
+ * power (squared magnitude) of each of the first FFT_SIZE/2 frequency bins
+ * is summed over all frames in an averaging interval.  The interval ends at
+ * the first frame to start processing after the seconds count of the
+ * timestamp changes, at which time the sums are sent as a burst of PSNB
+ * packets spaced PACKET_GAP clocks apart.  If the previous burst is still
+ * being sent the interval is extended.
+ *
+ * Fixed-point arithmetic:
+ *   Windowed readings have GUARD_BITS fraction bits.
+ *   Each butterfly stage scales its results by 1/2 so bin values are the
+ *   DFT divided by FFT_SIZE.
+ *   Powers are unsigned squared magnitudes of bin values, so a full-scale
+ *   sinusoid with a rectangular window produces a power of about
+ *   2^(2*(ADC_WIDTH+GUARD_BITS)-4) in its bin.
+ *
+ * Spectrum packet layout:
+ *   Bytes  0-3   "PSNB"
+ *   Bytes  4-7   Size (bytes following this field)
+ *   Bytes  8-11  Status: bits 31:24 packet type (3), bits 15:8 ADC channel,
+ *                bit 0 one or more frames were dropped in this interval
+ *   Bytes 12-15  Number of frames in averaging interval
+ *   Bytes 16-19  Spectrum number
+ *   Bytes 20-23  Bits 31:16 index of first bin in packet,
+ *                bits 15:0 number of bins in packet
+ *   Bytes 24-31  Timestamp (seconds, nanoseconds) of first sample of
+ *                averaging interval
+ *   Then, for each bin, the sum of powers (64 bit, unsigned, saturating).
+ * All values are big-endian.  Each selected channel is sent as
+ * FFT_SIZE/2/BINS_PER_PACKET consecutive packets.
+ *
+ * CSR write:
+ *   Bit 31 -- Enable
+ *   Bits (8*m)+(CHANNEL_ADDRESS_WIDTH-1):(8*m) -- Channel for monitor m
+ * CSR read:
+ *   Bit 31     -- Enabled
+ *   Bit 30     -- A frame has been dropped since acquisition was enabled
+ *   Bits 15:8  -- MONITOR_COUNT
+ *   Bits  7:0  -- LOG2_FFT_SIZE
+ * The channel selection must not be changed while the monitor is enabled.
+ *
+ * Table writes:
+ *   Bit 31     -- Table select, 0 for window, 1 for cosine
+ *   Bits 29:18 -- Index (0 through FFT_SIZE-1)
+ *   Bits 17:0  -- Value.  Window values are unsigned with unity of 2^18.
+ *                 Cosine values are cos(2*pi*Index/FFT_SIZE), signed with
+ *                 unity of 2^16.
+ * The tables are cleared at power-up so must be written before the
+ * monitor is enabled.
+ *
+ * Collecting a sample takes MONITOR_COUNT+3 clocks.  Transforming a frame
+ * takes MONITOR_COUNT*LOG2_FFT_SIZE*(FFT_SIZE+STAGE_GAP) clocks, which must
+ * be less than FFT_SIZE acquisition strobe intervals.  Frames arriving
+ * while the engine is busy are dropped and flagged.
+ */
+`default_nettype none
+module spectrumADC #(
+    parameter ADC_CHIP_COUNT      = 4,
+    parameter ADC_PER_CHIP        = 8,
+    parameter ADC_WIDTH           = 24,
+    parameter MONITOR_COUNT       = 4,
+    parameter LOG2_FFT_SIZE       = 10,
+    parameter UDP_PACKET_CAPACITY = 1472,
+    parameter PACKET_GAP          = 12500,
+    parameter DEBUG               = "false"
+    ) (
+    input  wire        sysClk,
+    input  wire        sysCsrStrobe,
+    input  wire        sysTableStrobe,
+    input  wire [31:0] sysGPIO_OUT,
+    output wire [31:0] sysStatus,
+
+    input  wire                                               acqClk,
+    input  wire                                               acqStrobe,
+    input  wire [(ADC_CHIP_COUNT*ADC_PER_CHIP*ADC_WIDTH)-1:0] acqData,
+    input  wire                                        [31:0] acqSeconds,
+    input  wire                                        [31:0] acqTicks,
+    input  wire                                               acqEnableAcquisition,
+
+    (*MARK_DEBUG=DEBUG*) output reg        M_TVALID = 0,
+    (*MARK_DEBUG=DEBUG*) output reg        M_TLAST = 0,
+    (*MARK_DEBUG=DEBUG*) output reg  [7:0] M_TDATA = 0,
+    (*MARK_DEBUG=DEBUG*) input  wire       M_TREADY);
+
+localparam ADC_COUNT = ADC_CHIP_COUNT * ADC_PER_CHIP;
+localparam CHANNEL_ADDRESS_WIDTH = $clog2(ADC_COUNT);
+localparam MONITOR_ADDRESS_WIDTH = (MONITOR_COUNT > 1) ?
+                                                  $clog2(MONITOR_COUNT) : 1;
+localparam FFT_SIZE = 1 << LOG2_FFT_SIZE;
+localparam BIN_COUNT = FFT_SIZE / 2;
+localparam BIN_ADDRESS_WIDTH = LOG2_FFT_SIZE - 1;
+localparam STAGE_ADDRESS_WIDTH = $clog2(LOG2_FFT_SIZE);
+localparam STAGE_GAP = 8;
+localparam WINDOW_WIDTH = 18;
+localparam COSINE_WIDTH = 18;
+localparam COSINE_FRACTION = COSINE_WIDTH - 2;
+localparam GUARD_BITS = 4;
+localparam SAMPLE_WIDTH = ADC_WIDTH + GUARD_BITS;
+localparam PRODUCT_WIDTH = SAMPLE_WIDTH + COSINE_WIDTH;
+localparam BUTTERFLY_WIDTH = PRODUCT_WIDTH - COSINE_FRACTION + 2;
+localparam POWER_WIDTH = 2 * SAMPLE_WIDTH;
+localparam SUM_WIDTH = 64;
+localparam HEADER_BYTE_COUNT = 32;
+localparam BIN_BYTE_COUNT = SUM_WIDTH / 8;
+localparam PACKET_BIN_LIMIT = (UDP_PACKET_CAPACITY - HEADER_BYTE_COUNT) /
+                                                              BIN_BYTE_COUNT;
+localparam PACKET_BIN_POW2 = 1 << ($clog2(PACKET_BIN_LIMIT + 1) - 1);
+localparam BINS_PER_PACKET = (PACKET_BIN_POW2 > BIN_COUNT) ? BIN_COUNT :
+                                                             PACKET_BIN_POW2;
+localparam PACKET_SIZE = (HEADER_BYTE_COUNT - 8) +
+                         (BINS_PER_PACKET * BIN_BYTE_COUNT);
+
+///////////////////////////////////////////////////////////////////////////////
+// System clock domain
+reg                         sysEnable = 0;
+reg [(8*MONITOR_COUNT)-1:0] sysChannels = 0;
+
+// Tables are written in system clock domain
+reg        [WINDOW_WIDTH-1:0] windowTable [0:FFT_SIZE-1];
+reg signed [COSINE_WIDTH-1:0] cosineTable [0:FFT_SIZE-1];
+integer t;
+initial begin
+    for (t = 0 ; t < FFT_SIZE ; t = t + 1) begin
+        windowTable[t] = 0;
+        cosineTable[t] = 0;
+    end
+end
+
+always @(posedge sysClk) begin
+    if (sysCsrStrobe) begin
+        sysEnable <= sysGPIO_OUT[31];
+        sysChannels <= sysGPIO_OUT[0+:8*MONITOR_COUNT];
+    end
+    if (sysTableStrobe) begin
+        if (sysGPIO_OUT[31]) begin
+            cosineTable[sysGPIO_OUT[18+:LOG2_FFT_SIZE]] <=
+                                           sysGPIO_OUT[0+:COSINE_WIDTH];
+        end
+        else begin
+            windowTable[sysGPIO_OUT[18+:LOG2_FFT_SIZE]] <=
+                                           sysGPIO_OUT[0+:WINDOW_WIDTH];
+        end
+    end
+end
+
+//////////////////////////////////////////////////////////////////////////////
+// Acquisition clock domain
+
+(*ASYNC_REG="true"*) reg acqEnable_m = 0;
+(*MARK_DEBUG=DEBUG*) reg acqEnable = 0;
+(*MARK_DEBUG=DEBUG*) reg acqDroppedSticky = 0;
+(*MARK_DEBUG=DEBUG*) reg txActive = 0;
+
+always @(posedge acqClk) begin
+    acqEnable_m <= sysEnable;
+    acqEnable   <= acqEnable_m;
+end
+wire acqActive = acqEnable && acqEnableAcquisition;
+
+(*ASYNC_REG="true"*) reg sysDropped_m = 0;
+reg sysDropped = 0;
+always @(posedge sysClk) begin
+    sysDropped_m <= acqDroppedSticky;
+    sysDropped   <= sysDropped_m;
+end
+localparam [7:0] MONITOR_COUNT_8 = MONITOR_COUNT;
+localparam [7:0] LOG2_FFT_SIZE_8 = LOG2_FFT_SIZE;
+assign sysStatus = { sysEnable, sysDropped, 14'b0,
+                     MONITOR_COUNT_8, LOG2_FFT_SIZE_8 };
+
+//
+// Frame buffer -- two banks, one being filled while the other is processed.
+// Work buffer -- two banks, each butterfly stage reads one and writes the
+//                other.  The first stage reads the frame buffer.
+// Accumulators -- sums of powers for the current averaging interval.
+// Results -- sums of powers for the completed averaging interval.
+//
+reg signed [SAMPLE_WIDTH-1:0] frame [0:(1<<(1+MONITOR_ADDRESS_WIDTH+
+                                                       LOG2_FFT_SIZE))-1];
+reg [(2*SAMPLE_WIDTH)-1:0] work [0:(2*FFT_SIZE)-1];
+reg [SUM_WIDTH-1:0] accumulators [0:(1<<(MONITOR_ADDRESS_WIDTH+
+                                                   BIN_ADDRESS_WIDTH))-1];
+reg [SUM_WIDTH-1:0] results [0:(1<<(MONITOR_ADDRESS_WIDTH+
+                                                   BIN_ADDRESS_WIDTH))-1];
+
+//
+// Collect windowed readings from selected channels.
+// The channel selection is known to be stable while the monitor is enabled.
+//
+reg [(ADC_COUNT*ADC_WIDTH)-1:0] collectData;
+(*MARK_DEBUG=DEBUG*) reg collectActive = 0;
+reg [MONITOR_ADDRESS_WIDTH-1:0] collectMonitor = 0;
+reg [LOG2_FFT_SIZE-1:0] collectSample = 0;
+reg collectBank = 0;
+reg [31:0] collectSeconds = 0, collectTicks = 0;
+wire [CHANNEL_ADDRESS_WIDTH-1:0] collectChannel =
+                          sysChannels[collectMonitor*8+:CHANNEL_ADDRESS_WIDTH];
+reg [WINDOW_WIDTH-1:0] windowQ = 0;
+
+// Pipeline stages
+reg                             c1Valid = 0;
+reg [MONITOR_ADDRESS_WIDTH-1:0] c1Monitor = 0;
+reg         [LOG2_FFT_SIZE-1:0] c1Sample = 0;
+reg signed      [ADC_WIDTH-1:0] c1Value = 0;
+reg                             c2Valid = 0;
+reg [MONITOR_ADDRESS_WIDTH-1:0] c2Monitor = 0;
+reg         [LOG2_FFT_SIZE-1:0] c2Sample = 0;
+reg signed [ADC_WIDTH+WINDOW_WIDTH:0] c2Product = 0;
+reg frameComplete = 0;
+wire signed [ADC_WIDTH+WINDOW_WIDTH:0] windowed = (c2Product +
+          (1 << (WINDOW_WIDTH - GUARD_BITS - 1))) >>> (WINDOW_WIDTH - GUARD_BITS);
+
+always @(posedge acqClk) begin
+    windowQ <= windowTable[collectSample];
+    if (!acqActive) begin
+        collectActive <= 0;
+        collectSample <= 0;
+    end
+    else if (acqStrobe) begin
+        collectData <= acqData;
+        collectActive <= 1;
+        collectMonitor <= 0;
+        if (collectSample == 0) begin
+            collectSeconds <= acqSeconds;
+            collectTicks <= acqTicks;
+        end
+    end
+    else if (collectActive) begin
+        collectMonitor <= collectMonitor + 1;
+        if (collectMonitor == (MONITOR_COUNT - 1)) begin
+            collectActive <= 0;
+            collectSample <= collectSample + 1;
+        end
+    end
+
+    // Fetch reading
+    c1Valid <= collectActive && acqActive;
+    c1Monitor <= collectMonitor;
+    c1Sample <= collectSample;
+    c1Value <= collectData[collectChannel*ADC_WIDTH+:ADC_WIDTH];
+
+    // Apply window
+    c2Valid <= c1Valid;
+    c2Monitor <= c1Monitor;
+    c2Sample <= c1Sample;
+    c2Product <= c1Value * $signed({1'b0, windowQ});
+
+    // Save windowed reading
+    if (c2Valid) begin
+        frame[{collectBank, c2Monitor, c2Sample}] <= windowed[SAMPLE_WIDTH-1:0];
+    end
+    frameComplete <= c2Valid && (c2Monitor == (MONITOR_COUNT - 1))
+                             && (c2Sample == (FFT_SIZE - 1));
+end
+
+//
+// Averaging interval control
+//
+(*MARK_DEBUG=DEBUG*) reg engineActive = 0;
+reg engineStart = 0, engineDone = 0;
+reg engineBank = 0, engineFirst = 0, engineSave = 0;
+reg averageFirst = 1, averageDropped = 0;
+(*MARK_DEBUG=DEBUG*) reg publishPending = 0;
+reg [31:0] acqSeconds_d = 0;
+reg [31:0] averageCount = 0, averageSeconds = 0, averageTicks = 0;
+reg [31:0] publishCount = 0, publishSeconds = 0, publishTicks = 0;
+reg publishDropped = 0;
+wire saveFrame = publishPending && !txActive;
+
+always @(posedge acqClk) begin
+    acqSeconds_d <= acqSeconds;
+    engineStart <= 0;
+    if (frameComplete) begin
+        if (engineActive) begin
+            averageDropped <= 1;
+            acqDroppedSticky <= 1;
+        end
+        else begin
+            engineStart <= 1;
+            engineBank <= collectBank;
+            collectBank <= !collectBank;
+            engineFirst <= averageFirst;
+            engineSave <= saveFrame;
+            averageFirst <= saveFrame;
+            if (averageFirst) begin
+                averageSeconds <= collectSeconds;
+                averageTicks <= collectTicks;
+            end
+            if (saveFrame) begin
+                publishCount <= averageFirst ? 1 : averageCount + 1;
+                publishSeconds <= averageFirst ? collectSeconds :
+                                                 averageSeconds;
+                publishTicks <= averageFirst ? collectTicks : averageTicks;
+                publishDropped <= averageDropped;
+                averageDropped <= 0;
+            end
+            averageCount <= averageFirst ? 1 : averageCount + 1;
+        end
+    end
+    if (!acqActive) begin
+        averageFirst <= 1;
+        averageDropped <= 0;
+        acqDroppedSticky <= 0;
+        publishPending <= 0;
+    end
+    else if (acqSeconds != acqSeconds_d) begin
+        publishPending <= 1;
+    end
+    else if (frameComplete && !engineActive && saveFrame) begin
+        publishPending <= 0;
+    end
+end
+
+//
+// Transform engine sequencing.
+// Each butterfly takes two clocks, one for each operand.  A gap between
+// stages lets the results of one stage be written before the next begins.
+//
+localparam GAP_WIDTH = $clog2(STAGE_GAP + 1);
+reg                     enginePhase = 0;
+reg [BIN_ADDRESS_WIDTH-1:0] engineButterfly = 0;
+reg [STAGE_ADDRESS_WIDTH-1:0] engineStage = 0;
+reg [MONITOR_ADDRESS_WIDTH-1:0] engineMonitor = 0;
+reg [GAP_WIDTH-1:0] engineGap = 0;
+reg engineLast = 0;
+wire engineIssue = engineActive && (engineGap == 0);
+
+always @(posedge acqClk) begin
+    engineDone <= 0;
+    if (engineStart) begin
+        engineActive <= 1;
+        enginePhase <= 0;
+        engineButterfly <= 0;
+        engineStage <= 0;
+        engineMonitor <= 0;
+        engineGap <= 0;
+        engineLast <= 0;
+    end
+    else if (engineActive) begin
+        if (engineGap != 0) begin
+            engineGap <= engineGap - 1;
+            if ((engineGap == 1) && engineLast) begin
+                engineActive <= 0;
+                engineDone <= 1;
+            end
+        end
+        else begin
+            enginePhase <= !enginePhase;
+            if (enginePhase) begin
+                engineButterfly <= engineButterfly + 1;
+                if (engineButterfly == (BIN_COUNT - 1)) begin
+                    engineGap <= STAGE_GAP;
+                    if (engineStage == (LOG2_FFT_SIZE - 1)) begin
+                        engineStage <= 0;
+                        engineMonitor <= engineMonitor + 1;
+                        engineLast <= (engineMonitor == (MONITOR_COUNT - 1));
+                    end
+                    else begin
+                        engineStage <= engineStage + 1;
+                    end
+                end
+            end
+        end
+    end
+end
+
+//
+// Decimation in time with bit-reversed input order.
+// Stage s combines pairs of elements 2^s apart.
+//
+function [LOG2_FFT_SIZE-1:0] bitReverse;
+    input [LOG2_FFT_SIZE-1:0] v;
+    integer i;
+    begin
+    for (i = 0 ; i < LOG2_FFT_SIZE ; i = i + 1) begin
+        bitReverse[i] = v[LOG2_FFT_SIZE-1-i];
+    end
+    end
+endfunction
+
+wire [LOG2_FFT_SIZE-1:0] butterflyIndex = {1'b0, engineButterfly};
+wire [LOG2_FFT_SIZE-1:0] spanMask = (1 << engineStage) - 1;
+wire [LOG2_FFT_SIZE-1:0] indexI = ((butterflyIndex & ~spanMask) << 1) |
+                                   (butterflyIndex & spanMask);
+wire [LOG2_FFT_SIZE-1:0] indexJ = indexI | (spanMask + 1);
+wire [LOG2_FFT_SIZE-1:0] twiddleIndex = (butterflyIndex & spanMask) <<
+                                        (LOG2_FFT_SIZE - 1 - engineStage);
+wire [LOG2_FFT_SIZE-1:0] readIndex = enginePhase ? indexJ : indexI;
+
+// Read cosine on first clock, negative sine (cosine a quarter cycle
+// later) on second.
+wire [LOG2_FFT_SIZE-1:0] cosineIndex = enginePhase ?
+                                       twiddleIndex + (FFT_SIZE / 4) :
+                                       twiddleIndex;
+
+// Memory reads
+reg signed [SAMPLE_WIDTH-1:0] frameQ = 0;
+reg [(2*SAMPLE_WIDTH)-1:0] workQ = 0;
+reg signed [COSINE_WIDTH-1:0] cosineQ = 0;
+
+// Operand fetch
+reg                             d1Valid = 0, d1Phase = 0;
+reg   [STAGE_ADDRESS_WIDTH-1:0] d1Stage = 0;
+reg [MONITOR_ADDRESS_WIDTH-1:0] d1Monitor = 0;
+reg         [LOG2_FFT_SIZE-1:0] d1IndexI = 0, d1IndexJ = 0;
+wire signed [SAMPLE_WIDTH-1:0] sourceRe = (d1Stage == 0) ? frameQ :
+                                         workQ[SAMPLE_WIDTH+:SAMPLE_WIDTH];
+wire signed [SAMPLE_WIDTH-1:0] sourceIm = (d1Stage == 0) ?
+                                         {SAMPLE_WIDTH{1'b0}} :
+                                         workQ[0+:SAMPLE_WIDTH];
+reg signed [SAMPLE_WIDTH-1:0] xiRe = 0, xiIm = 0;
+reg signed [COSINE_WIDTH-1:0] wRe = 0;
+
+// Twiddle multiplication
+reg                             bValid = 0;
+reg   [STAGE_ADDRESS_WIDTH-1:0] bStage = 0;
+reg [MONITOR_ADDRESS_WIDTH-1:0] bMonitor = 0;
+reg         [LOG2_FFT_SIZE-1:0] bIndexI = 0, bIndexJ = 0;
+reg signed [PRODUCT_WIDTH-1:0] pRR = 0, pII = 0, pRI = 0, pIR = 0;
+wire signed [PRODUCT_WIDTH:0] tReSum = pRR - pII +
+                                       (1 << (COSINE_FRACTION - 1));
+wire signed [PRODUCT_WIDTH:0] tImSum = pRI + pIR +
+                                       (1 << (COSINE_FRACTION - 1));
+wire signed [BUTTERFLY_WIDTH-2:0] tRe = tReSum >>> COSINE_FRACTION;
+wire signed [BUTTERFLY_WIDTH-2:0] tIm = tImSum >>> COSINE_FRACTION;
+
+// Butterfly, rounding and halving
+wire [BUTTERFLY_WIDTH-1:0] sumIRe = xiRe + tRe + 1;
+wire [BUTTERFLY_WIDTH-1:0] sumIIm = xiIm + tIm + 1;
+wire [BUTTERFLY_WIDTH-1:0] sumJRe = xiRe - tRe + 1;
+wire [BUTTERFLY_WIDTH-1:0] sumJIm = xiIm - tIm + 1;
+
+function [SAMPLE_WIDTH-1:0] halveAndSaturate;
+    input [BUTTERFLY_WIDTH-1:0] sum;
+    reg [BUTTERFLY_WIDTH-2:0] half;
+    begin
+    half = sum[BUTTERFLY_WIDTH-1:1];
+    if ((half[BUTTERFLY_WIDTH-2:SAMPLE_WIDTH-1] == 0)
+     || (&half[BUTTERFLY_WIDTH-2:SAMPLE_WIDTH-1])) begin
+        halveAndSaturate = half[SAMPLE_WIDTH-1:0];
+    end
+    else begin
+        halveAndSaturate = { half[BUTTERFLY_WIDTH-2],
+                             {SAMPLE_WIDTH-1{!half[BUTTERFLY_WIDTH-2]}} };
+    end
+    end
+endfunction
+
+// Results
+reg                             yValid = 0;
+reg   [STAGE_ADDRESS_WIDTH-1:0] yStage = 0;
+reg [MONITOR_ADDRESS_WIDTH-1:0] yMonitor = 0;
+reg         [LOG2_FFT_SIZE-1:0] yIndexI = 0, yIndexJ = 0;
+reg    [(2*SAMPLE_WIDTH)-1:0] yI = 0, yJ = 0;
+wire signed [SAMPLE_WIDTH-1:0] yIRe = yI[SAMPLE_WIDTH+:SAMPLE_WIDTH];
+wire signed [SAMPLE_WIDTH-1:0] yIIm = yI[0+:SAMPLE_WIDTH];
+reg                             zValid = 0, zBank = 0;
+reg         [LOG2_FFT_SIZE-1:0] zIndexJ = 0;
+reg    [(2*SAMPLE_WIDTH)-1:0] zJ = 0;
+
+// Power accumulation -- last stage only
+reg powerValid = 0;
+reg [MONITOR_ADDRESS_WIDTH+BIN_ADDRESS_WIDTH-1:0] powerAddress = 0;
+reg [POWER_WIDTH-1:0] power = 0;
+reg [SUM_WIDTH-1:0] accumulatorQ = 0;
+wire [SUM_WIDTH:0] accumulatorSum = accumulatorQ + power;
+wire [SUM_WIDTH-1:0] accumulatorNext = engineFirst ? power :
+                                       accumulatorSum[SUM_WIDTH] ?
+                                       {SUM_WIDTH{1'b1}} :
+                                       accumulatorSum[SUM_WIDTH-1:0];
+
+always @(posedge acqClk) begin
+    frameQ <= frame[{engineBank, engineMonitor, bitReverse(readIndex)}];
+    workQ <= work[{!engineStage[0], readIndex}];
+    cosineQ <= cosineTable[cosineIndex];
+
+    d1Valid <= engineIssue;
+    d1Phase <= enginePhase;
+    d1Stage <= engineStage;
+    d1Monitor <= engineMonitor;
+    d1IndexI <= indexI;
+    d1IndexJ <= indexJ;
+
+    // First operand and real part of twiddle factor
+    if (d1Valid && !d1Phase) begin
+        xiRe <= sourceRe;
+        xiIm <= sourceIm;
+        wRe <= cosineQ;
+    end
+
+    // Second operand multiplied by twiddle factor
+    bValid <= d1Valid && d1Phase;
+    bStage <= d1Stage;
+    bMonitor <= d1Monitor;
+    bIndexI <= d1IndexI;
+    bIndexJ <= d1IndexJ;
+    pRR <= sourceRe * wRe;
+    pII <= sourceIm * cosineQ;
+    pRI <= sourceRe * cosineQ;
+    pIR <= sourceIm * wRe;
+
+    // Butterfly
+    yValid <= bValid;
+    yStage <= bStage;
+    yMonitor <= bMonitor;
+    yIndexI <= bIndexI;
+    yIndexJ <= bIndexJ;
+    yI <= { halveAndSaturate(sumIRe), halveAndSaturate(sumIIm) };
+    yJ <= { halveAndSaturate(sumJRe), halveAndSaturate(sumJIm) };
+
+    // Write results of all but last stage, one operand per clock
+    zValid <= yValid && (yStage != (LOG2_FFT_SIZE - 1));
+    zBank <= yStage[0];
+    zIndexJ <= yIndexJ;
+    zJ <= yJ;
+    if (yValid && (yStage != (LOG2_FFT_SIZE - 1))) begin
+        work[{yStage[0], yIndexI}] <= yI;
+    end
+    else if (zValid) begin
+        work[{zBank, zIndexJ}] <= zJ;
+    end
+
+    // Last stage produces bins 0 through FFT_SIZE/2-1 in its first operand
+    powerValid <= yValid && (yStage == (LOG2_FFT_SIZE - 1));
+    powerAddress <= { yMonitor, yIndexI[0+:BIN_ADDRESS_WIDTH] };
+    power <= (yIRe * yIRe) + (yIIm * yIIm);
+    accumulatorQ <= accumulators[{ yMonitor, yIndexI[0+:BIN_ADDRESS_WIDTH] }];
+    if (powerValid) begin
+        accumulators[powerAddress] <= accumulatorNext;
+        if (engineSave) begin
+            results[powerAddress] <= accumulatorNext;
+        end
+    end
+end
+
+//
+// Send spectra
+//
+localparam HEADER_SHIFT_REG_WIDTH = HEADER_BYTE_COUNT * 8;
+localparam HEADER_COUNTER_LOAD = HEADER_BYTE_COUNT - 2;
+localparam BIN_COUNTER_LOAD = BIN_BYTE_COUNT - 2;
+localparam BYTE_COUNTER_WIDTH = $clog2(HEADER_COUNTER_LOAD+1) + 1;
+localparam GAP_COUNTER_LOAD = PACKET_GAP - 2;
+localparam GAP_COUNTER_WIDTH = $clog2(GAP_COUNTER_LOAD+1) + 1;
+localparam [15:0] BINS_PER_PACKET_16 = BINS_PER_PACKET;
+
+localparam TX_IDLE = 2'd0,
+           TX_GAP  = 2'd1,
+           TX_SEND = 2'd2,
+           TX_LOAD = 2'd3;
+(*MARK_DEBUG=DEBUG*) reg [1:0] txState = TX_IDLE;
+reg [HEADER_SHIFT_REG_WIDTH-1:0] txShift = 0;
+reg [BYTE_COUNTER_WIDTH-1:0] txByteCounter = HEADER_COUNTER_LOAD;
+wire txByteCounterDone = txByteCounter[BYTE_COUNTER_WIDTH-1];
+reg [GAP_COUNTER_WIDTH-1:0] txGapCounter = GAP_COUNTER_LOAD;
+wire txGapCounterDone = txGapCounter[GAP_COUNTER_WIDTH-1];
+reg [MONITOR_ADDRESS_WIDTH-1:0] txMonitor = 0;
+reg [BIN_ADDRESS_WIDTH-1:0] txBin = 0;
+reg [$clog2(BINS_PER_PACKET+1)-1:0] txBinsRemaining = 0;
+wire [CHANNEL_ADDRESS_WIDTH-1:0] txChannel =
+                               sysChannels[txMonitor*8+:CHANNEL_ADDRESS_WIDTH];
+reg txLastChunk = 0, txFinished = 0;
+reg [31:0] spectrumNumber = 0;
+reg [SUM_WIDTH-1:0] resultQ = 0;
+
+always @(posedge acqClk) begin
+    resultQ <= results[{txMonitor, txBin}];
+    if (M_TVALID && M_TREADY) begin
+        M_TVALID <= 0;
+        M_TLAST <= 0;
+    end
+    case (txState)
+    TX_IDLE: begin
+        if (engineDone && engineSave) begin
+            txActive <= 1;
+            spectrumNumber <= spectrumNumber + 1;
+            txMonitor <= 0;
+            txBin <= 0;
+            txFinished <= 0;
+            txGapCounter <= {GAP_COUNTER_WIDTH{1'b1}};
+            txState <= TX_GAP;
+        end
+        else begin
+            txActive <= 0;
+        end
+    end
+    TX_GAP: begin
+        if (txGapCounterDone) begin
+            if (txFinished) begin
+                txState <= TX_IDLE;
+            end
+            else begin
+                txShift <= {
+                      "P", "S", "N", "B",
+                      PACKET_SIZE[31:0],
+                      { 8'd3, /* Packet type */
+                        8'd0,
+                        {8-CHANNEL_ADDRESS_WIDTH{1'b0}}, txChannel,
+                        7'd0,
+                        publishDropped },
+                      publishCount,
+                      spectrumNumber,
+                      { {16-BIN_ADDRESS_WIDTH{1'b0}}, txBin },
+                      BINS_PER_PACKET_16,
+                      publishSeconds,
+                      {publishTicks[0+:29], 3'b000} }; /* nanoseconds */
+                txByteCounter <= HEADER_COUNTER_LOAD;
+                txLastChunk <= 0;
+                txBinsRemaining <= BINS_PER_PACKET;
+                txState <= TX_SEND;
+            end
+        end
+        else begin
+            txGapCounter <= txGapCounter - 1;
+        end
+    end
+    TX_SEND: begin
+        if (!M_TVALID || M_TREADY) begin
+            M_TVALID <= 1;
+            M_TDATA <= txShift[HEADER_SHIFT_REG_WIDTH-1-:8];
+            txShift <= txShift << 8;
+            txByteCounter <= txByteCounter - 1;
+            if (txByteCounterDone) begin
+                if (txLastChunk) begin
+                    M_TLAST <= 1;
+                    txGapCounter <= GAP_COUNTER_LOAD;
+                    txState <= TX_GAP;
+                end
+                else begin
+                    txState <= TX_LOAD;
+                end
+            end
+        end
+    end
+    TX_LOAD: begin
+        txShift <= { resultQ,
+                     {HEADER_SHIFT_REG_WIDTH-SUM_WIDTH{1'b0}} };
+        txByteCounter <= BIN_COUNTER_LOAD;
+        txBin <= txBin + 1;
+        txBinsRemaining <= txBinsRemaining - 1;
+        txLastChunk <= (txBinsRemaining == 1);
+        if (txBin == (BIN_COUNT - 1)) begin
+            txMonitor <= txMonitor + 1;
+            txFinished <= (txMonitor == (MONITOR_COUNT - 1));
+        end
+        txState <= TX_SEND;
+    end
+    default: txState <= TX_IDLE;
+    endcase
+end
+
+endmodule
+`default_nettype wire
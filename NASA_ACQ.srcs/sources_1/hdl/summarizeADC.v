@@ -0,0 +1,346 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Produce a low-rate summary of ADC readings.
+ * For every channel accumulate the minimum, maximum, sum and sum of squares
+ * of the readings over a window of consecutive samples then send the results
+ * as a single PSNB packet.  The packet type field (most significant byte of
+ * the status word) is 1 to distinguish summary packets from ADC data packets.
+ *
+ * Summary packet layout:
+ *   Bytes  0-3   "PSNB"
+ *   Bytes  4-7   Size (bytes following this field)
+ *   Bytes  8-11  Status: bits 31:24 packet type (1), bit 0 previous window
+ *                dropped because the preceding packet was still being sent
+ *   Bytes 12-15  Number of samples in window
+ *   Bytes 16-23  Sequence number
+ *   Bytes 24-31  Timestamp (seconds, nanoseconds) of first sample in window
+ *   Then, for each channel in order:
+ *                Minimum (32 bit, signed)
+ *                Maximum (32 bit, signed)
+ *                Sum (64 bit, signed)
+ *                Sum of squares (64 bit, unsigned)
+ * All values are big-endian.
+ *
+ * CSR write:
+ *   Bit 31 -- Enable
+ *   Bits (WINDOW_WIDTH-1):0 -- Number of samples in window, less one
+ * CSR read:
+ *   Bit 31 -- Enabled
+ *   Bit 30 -- A window has been dropped since acquisition was enabled
+ *   Bits (WINDOW_WIDTH-1):0 -- Number of samples in window, less one
+ * The window length must not be changed while the summary is enabled.
+ *
+ * Accumulation is time-multiplexed, one channel per clock, so there must
+ * be more than ADC_COUNT+3 clocks between acquisition strobes.
+ */
+`default_nettype none
+module summarizeADC #(
+    parameter ADC_CHIP_COUNT = 4,
+    parameter ADC_PER_CHIP   = 8,
+    parameter ADC_WIDTH      = 24,
+    parameter WINDOW_WIDTH   = 16,
+    parameter DEBUG          = "false"
+    ) (
+    input  wire        sysClk,
+    input  wire        sysCsrStrobe,
+    input  wire [31:0] sysGPIO_OUT,
+    output wire [31:0] sysStatus,
+
+    input  wire                                               acqClk,
+    input  wire                                               acqStrobe,
+    input  wire [(ADC_CHIP_COUNT*ADC_PER_CHIP*ADC_WIDTH)-1:0] acqData,
+    input  wire                                        [31:0] acqSeconds,
+    input  wire                                        [31:0] acqTicks,
+    input  wire                                               acqEnableAcquisition,
+
+    (*MARK_DEBUG=DEBUG*) output reg        M_TVALID = 0,
+    (*MARK_DEBUG=DEBUG*) output reg        M_TLAST = 0,
+    (*MARK_DEBUG=DEBUG*) output reg  [7:0] M_TDATA = 0,
+    (*MARK_DEBUG=DEBUG*) input  wire       M_TREADY);
+
+localparam ADC_COUNT = ADC_CHIP_COUNT * ADC_PER_CHIP;
+localparam CHANNEL_ADDRESS_WIDTH = $clog2(ADC_COUNT);
+localparam SUM_WIDTH = ADC_WIDTH + WINDOW_WIDTH;
+localparam SQUARE_WIDTH = 2 * ADC_WIDTH;
+localparam SUM_SQUARES_WIDTH = SQUARE_WIDTH + WINDOW_WIDTH;
+localparam ACCUMULATOR_WIDTH = (2 * ADC_WIDTH) + SUM_WIDTH + SUM_SQUARES_WIDTH;
+localparam CHANNEL_BYTE_COUNT = 24;
+localparam HEADER_BYTE_COUNT = 32;
+localparam PACKET_SIZE = HEADER_BYTE_COUNT + (ADC_COUNT * CHANNEL_BYTE_COUNT) - 8;
+
+///////////////////////////////////////////////////////////////////////////////
+// System clock domain
+reg                    sysEnable = 0;
+reg [WINDOW_WIDTH-1:0] sysWindowLength = 0;
+
+always @(posedge sysClk) begin
+    if (sysCsrStrobe) begin
+        sysEnable <= sysGPIO_OUT[31];
+        sysWindowLength <= sysGPIO_OUT[0+:WINDOW_WIDTH];
+    end
+end
+
+//////////////////////////////////////////////////////////////////////////////
+// Acquisition clock domain
+
+(*ASYNC_REG="true"*) reg acqEnable_m = 0;
+(*MARK_DEBUG=DEBUG*) reg acqEnable = 0;
+(*MARK_DEBUG=DEBUG*) reg acqDropped = 0, acqDroppedSticky = 0;
+(*MARK_DEBUG=DEBUG*) reg acqTxBusy = 0;
+
+always @(posedge acqClk) begin
+    acqEnable_m <= sysEnable;
+    acqEnable   <= acqEnable_m;
+end
+wire acqActive = acqEnable && acqEnableAcquisition;
+
+(*ASYNC_REG="true"*) reg sysDropped_m = 0;
+reg sysDropped = 0;
+always @(posedge sysClk) begin
+    sysDropped_m <= acqDroppedSticky;
+    sysDropped   <= sysDropped_m;
+end
+assign sysStatus = { sysEnable, sysDropped,
+                     {32-2-WINDOW_WIDTH{1'b0}}, sysWindowLength };
+
+//
+// Window and channel sequencing.
+// The window length is known to be stable while the summary is disabled.
+//
+localparam WINDOW_COUNTER_WIDTH = WINDOW_WIDTH + 1;
+localparam CHANNEL_COUNTER_LOAD = ADC_COUNT - 2;
+localparam CHANNEL_COUNTER_WIDTH = $clog2(CHANNEL_COUNTER_LOAD+1) + 1;
+
+wire [WINDOW_COUNTER_WIDTH-1:0] windowCounterLoad = {1'b0, sysWindowLength} - 1;
+reg [WINDOW_COUNTER_WIDTH-1:0] windowCounter = 0;
+wire windowCounterDone = windowCounter[WINDOW_COUNTER_WIDTH-1];
+reg windowFirst = 1;
+reg [31:0] windowSeconds = 0, windowTicks = 0;
+
+reg [(ADC_COUNT*ADC_WIDTH)-1:0] adcShift;
+(*MARK_DEBUG=DEBUG*) reg processActive = 0;
+reg [CHANNEL_COUNTER_WIDTH-1:0] channelCounter = CHANNEL_COUNTER_LOAD;
+wire channelCounterDone = channelCounter[CHANNEL_COUNTER_WIDTH-1];
+reg [CHANNEL_ADDRESS_WIDTH-1:0] processChannel = 0;
+reg sampleFirst = 0, sampleSave = 0;
+
+// Pipeline stages
+reg                             p0Valid = 0, p0First = 0, p0Save = 0;
+reg                             p0Last = 0;
+reg [CHANNEL_ADDRESS_WIDTH-1:0] p0Channel = 0;
+reg signed      [ADC_WIDTH-1:0] p0Value = 0;
+reg                             p1Valid = 0, p1First = 0, p1Save = 0;
+reg                             p1Last = 0;
+reg [CHANNEL_ADDRESS_WIDTH-1:0] p1Channel = 0;
+reg signed      [ADC_WIDTH-1:0] p1Value = 0;
+reg          [SQUARE_WIDTH-1:0] p1Square = 0;
+reg     [ACCUMULATOR_WIDTH-1:0] accQ = 0;
+reg                             emitStart = 0;
+
+// Accumulators and completed window results
+reg [ACCUMULATOR_WIDTH-1:0] accumulators [0:(1<<CHANNEL_ADDRESS_WIDTH)-1];
+reg [ACCUMULATOR_WIDTH-1:0] results      [0:(1<<CHANNEL_ADDRESS_WIDTH)-1];
+
+wire signed         [ADC_WIDTH-1:0] accMin = accQ[ACCUMULATOR_WIDTH-1-:ADC_WIDTH];
+wire signed         [ADC_WIDTH-1:0] accMax = accQ[SUM_WIDTH+SUM_SQUARES_WIDTH+:
+                                                                    ADC_WIDTH];
+wire signed         [SUM_WIDTH-1:0] accSum = accQ[SUM_SQUARES_WIDTH+:SUM_WIDTH];
+wire        [SUM_SQUARES_WIDTH-1:0] accSumSquares = accQ[0+:SUM_SQUARES_WIDTH];
+wire signed         [SUM_WIDTH-1:0] p1ValueExtended = {
+                        {SUM_WIDTH-ADC_WIDTH{p1Value[ADC_WIDTH-1]}}, p1Value };
+wire        [SUM_SQUARES_WIDTH-1:0] p1SquareExtended = {
+                        {SUM_SQUARES_WIDTH-SQUARE_WIDTH{1'b0}}, p1Square };
+wire [ACCUMULATOR_WIDTH-1:0] accNext = p1First ?
+                      { p1Value, p1Value, p1ValueExtended, p1SquareExtended } :
+                      { (p1Value < accMin) ? p1Value : accMin,
+                        (p1Value > accMax) ? p1Value : accMax,
+                        accSum + p1ValueExtended,
+                        accSumSquares + p1SquareExtended };
+
+always @(posedge acqClk) begin
+    if (!acqActive) begin
+        processActive <= 0;
+        acqDroppedSticky <= 0;
+        windowFirst <= 1;
+        windowCounter <= windowCounterLoad;
+    end
+    else if (acqStrobe) begin
+        adcShift <= acqData;
+        processActive <= 1;
+        channelCounter <= CHANNEL_COUNTER_LOAD;
+        processChannel <= 0;
+        sampleFirst <= windowFirst;
+        sampleSave <= windowCounterDone && !acqTxBusy;
+        if (windowCounterDone && acqTxBusy) begin
+            acqDropped <= 1;
+            acqDroppedSticky <= 1;
+        end
+        if (windowFirst) begin
+            windowSeconds <= acqSeconds;
+            windowTicks <= acqTicks;
+        end
+        windowFirst <= windowCounterDone;
+        windowCounter <= windowCounterDone ? windowCounterLoad :
+                                             windowCounter - 1;
+    end
+    else if (processActive) begin
+        adcShift <= adcShift >> ADC_WIDTH;
+        processChannel <= processChannel + 1;
+        if (channelCounterDone) begin
+            processActive <= 0;
+        end
+        else begin
+            channelCounter <= channelCounter - 1;
+        end
+    end
+
+    // Fetch reading
+    p0Valid <= processActive && acqActive;
+    p0First <= sampleFirst;
+    p0Save <= sampleSave;
+    p0Last <= channelCounterDone;
+    p0Channel <= processChannel;
+    p0Value <= adcShift[0+:ADC_WIDTH];
+
+    // Read accumulator and square reading
+    accQ <= accumulators[p0Channel];
+    p1Square <= p0Value * p0Value;
+    p1Valid <= p0Valid;
+    p1First <= p0First;
+    p1Save <= p0Save;
+    p1Last <= p0Last;
+    p1Channel <= p0Channel;
+    p1Value <= p0Value;
+
+    // Update accumulator and, at end of window, save results
+    if (p1Valid) begin
+        accumulators[p1Channel] <= accNext;
+        if (p1Save) begin
+            results[p1Channel] <= accNext;
+        end
+    end
+    emitStart <= p1Valid && p1Save && p1Last;
+    if (emitStart) begin
+        acqDropped <= 0;
+    end
+end
+
+//
+// Send summary packet
+//
+localparam HEADER_SHIFT_REG_WIDTH = HEADER_BYTE_COUNT * 8;
+localparam HEADER_COUNTER_LOAD = HEADER_BYTE_COUNT - 2;
+localparam CHANNEL_BYTE_COUNTER_LOAD = CHANNEL_BYTE_COUNT - 2;
+localparam BYTE_COUNTER_WIDTH = $clog2(HEADER_COUNTER_LOAD+1) + 1;
+
+localparam TX_IDLE  = 2'd0,
+           TX_SEND  = 2'd1,
+           TX_FETCH = 2'd2;
+(*MARK_DEBUG=DEBUG*) reg [1:0] txState = TX_IDLE;
+reg [HEADER_SHIFT_REG_WIDTH-1:0] txShift = 0;
+reg [BYTE_COUNTER_WIDTH-1:0] txByteCounter = HEADER_COUNTER_LOAD;
+wire txByteCounterDone = txByteCounter[BYTE_COUNTER_WIDTH-1];
+reg [CHANNEL_ADDRESS_WIDTH-1:0] txChannel = 0;
+reg txLastChunk = 0;
+reg [63:0] sequenceNumber = 0;
+reg [ACCUMULATOR_WIDTH-1:0] resultQ = 0;
+
+wire signed         [ADC_WIDTH-1:0] resultMin = resultQ[ACCUMULATOR_WIDTH-1-:
+                                                                   ADC_WIDTH];
+wire signed         [ADC_WIDTH-1:0] resultMax = resultQ[SUM_WIDTH+
+                                          SUM_SQUARES_WIDTH+:ADC_WIDTH];
+wire signed         [SUM_WIDTH-1:0] resultSum = resultQ[SUM_SQUARES_WIDTH+:
+                                                                   SUM_WIDTH];
+wire        [SUM_SQUARES_WIDTH-1:0] resultSumSquares = resultQ[0+:
+                                                           SUM_SQUARES_WIDTH];
+
+always @(posedge acqClk) begin
+    resultQ <= results[txChannel];
+    if (M_TVALID && M_TREADY) begin
+        M_TVALID <= 0;
+        M_TLAST <= 0;
+    end
+    if (!acqActive && !acqTxBusy) begin
+        sequenceNumber <= {acqSeconds, 32'b0};
+    end
+    case (txState)
+    TX_IDLE: begin
+        acqTxBusy <= 0;
+        if (emitStart) begin
+            acqTxBusy <= 1;
+            sequenceNumber <= sequenceNumber + 1;
+            txShift <= {
+                      "P", "S", "N", "B",
+                      PACKET_SIZE[31:0],
+                      { 8'd1, /* Packet type */
+                        {23{1'b0}},
+                        acqDropped },
+                      {{32-WINDOW_WIDTH{1'b0}}, sysWindowLength} + 32'd1,
+                      sequenceNumber[63:32],
+                      sequenceNumber[31:0],
+                      windowSeconds,
+                      {windowTicks[0+:29], 3'b000} }; /* nanoseconds */
+            txByteCounter <= HEADER_COUNTER_LOAD;
+            txChannel <= 0;
+            txLastChunk <= 0;
+            txState <= TX_SEND;
+        end
+    end
+    TX_SEND: begin
+        if (!M_TVALID || M_TREADY) begin
+            M_TVALID <= 1;
+            M_TDATA <= txShift[HEADER_SHIFT_REG_WIDTH-1-:8];
+            txShift <= txShift << 8;
+            txByteCounter <= txByteCounter - 1;
+            if (txByteCounterDone) begin
+                if (txLastChunk) begin
+                    M_TLAST <= 1;
+                    txState <= TX_IDLE;
+                end
+                else begin
+                    txState <= TX_FETCH;
+                end
+            end
+        end
+    end
+    TX_FETCH: begin
+        txShift <= {
+              {{32-ADC_WIDTH{resultMin[ADC_WIDTH-1]}}, resultMin},
+              {{32-ADC_WIDTH{resultMax[ADC_WIDTH-1]}}, resultMax},
+              {{64-SUM_WIDTH{resultSum[SUM_WIDTH-1]}}, resultSum},
+              {{64-SUM_SQUARES_WIDTH{1'b0}}, resultSumSquares},
+              {HEADER_SHIFT_REG_WIDTH-(CHANNEL_BYTE_COUNT*8){1'b0}} };
+        txByteCounter <= CHANNEL_BYTE_COUNTER_LOAD;
+        txLastChunk <= (txChannel == ADC_COUNT - 1);
+        txChannel <= txChannel + 1;
+        txState <= TX_SEND;
+    end
+    default: txState <= TX_IDLE;
+    endcase
+end
+
+endmodule
+`default_nettype wire
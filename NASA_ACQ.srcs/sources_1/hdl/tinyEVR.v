@@ -24,11 +24,13 @@
 
 ////////////////////////////////////////////////////////////////////////////////
 // Very small subset of MRF event receiver
-// Provides time stamps, event strobes and some status markers.
+// Provides time stamps, event strobes, some status markers and
+// distributed buffer reception.
 module tinyEVR #(
     parameter EVSTROBE_COUNT   = 126,
     parameter DEBUG            = "false",
-    parameter TIMESTAMP_WIDTH  = 64
+    parameter TIMESTAMP_WIDTH  = 64,
+    parameter DISTRIBUTED_BUFFER_ADDRESS_WIDTH = 11
     ) (
     input  wire                       evrRxClk,
 
@@ -39,12 +41,20 @@ module tinyEVR #(
     output wire                       timestampValid,
     output wire [TIMESTAMP_WIDTH-1:0] timestamp,
     output wire                 [7:0] distributedDataBus,
-    output wire    [EVSTROBE_COUNT:1] evStrobe);
+    output wire    [EVSTROBE_COUNT:1] evStrobe,
+
+    // Distributed buffer
+    input  wire                                        sysClk,
+    input  wire [DISTRIBUTED_BUFFER_ADDRESS_WIDTH-1:0] sysBufferAddress,
+    output wire                                  [7:0] sysBufferData,
+    output wire                                 [31:0] sysBufferStatus);
 
 tinyEVRcommon #(.ACTION_RAM_WIDTH(0),
                 .EVSTROBE_COUNT(EVSTROBE_COUNT),
                 .DEBUG(DEBUG),
-                .TIMESTAMP_WIDTH(TIMESTAMP_WIDTH))
+                .TIMESTAMP_WIDTH(TIMESTAMP_WIDTH),
+                .DISTRIBUTED_BUFFER_ADDRESS_WIDTH(
+                                             DISTRIBUTED_BUFFER_ADDRESS_WIDTH))
   tinyEVRcommon (
     .evrRxClk(evrRxClk),
     .evrRxWord(evrRxWord),
@@ -54,10 +64,13 @@ tinyEVRcommon #(.ACTION_RAM_WIDTH(0),
     .timestamp(timestamp),
     .distributedDataBus(distributedDataBus),
     .action(evStrobe),
-    .sysClk(1'b0),
+    .sysClk(sysClk),
     .sysActionWriteEnable(1'b0),
     .sysActionAddress(8'h00),
-    .sysActionData(1'b0));
+    .sysActionData(1'b0),
+    .sysBufferAddress(sysBufferAddress),
+    .sysBufferData(sysBufferData),
+    .sysBufferStatus(sysBufferStatus));
 endmodule
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -100,18 +113,45 @@ tinyEVRcommon #(.ACTION_RAM_WIDTH(ACTION_WIDTH),
     .sysClk(sysClk),
     .sysActionWriteEnable(sysActionWriteEnable),
     .sysActionAddress(sysActionAddress),
-    .sysActionData(sysActionData));
+    .sysActionData(sysActionData),
+    .sysBufferAddress(1'b0),
+    .sysBufferData(),
+    .sysBufferStatus());
 endmodule
 
 ////////////////////////////////////////////////////////////////////////////////
 // Common implementation
+//
+// Distributed buffer reception:
+// Buffers are sent by tinyEVG in the upper byte of the characters that
+// are not distributed bus slots as a K28.0, the data bytes, a K28.1 and
+// the ones complement of the 16-bit sum of the data bytes, most
+// significant byte first.  The data bytes are reassembled from between
+// the interleaved distributed bus bytes into one bank of a two-bank RAM.
+// A buffer with a good checksum is published by making its bank the one
+// read by the processor, the next buffer being received into the other.
+// A buffer that is too long, restarted, or has a bad checksum or an
+// unexpected K character is discarded and counted.
+// sysBufferStatus:
+//   Bits 31:24 -- Count of good buffers received
+//   Bits 23:16 -- Count of bad buffers received
+//   Bits 15:0  -- Number of bytes in most recent good buffer
+// The processor should check that the good buffer count is unchanged
+// after reading a buffer since the bank being read changes when another
+// buffer arrives.  Buffers that finish while a status update is being
+// handed to the system clock domain are reported in the following update.
+// The length must fit in the status, so a DISTRIBUTED_BUFFER_ADDRESS_WIDTH
+// greater than 15 omits the distributed buffer just as 0 does.
 module tinyEVRcommon #(
     parameter ACTION_RAM_WIDTH = 0,
     parameter EVSTROBE_COUNT   = 126,
     parameter DEBUG            = "false",
     parameter TIMESTAMP_WIDTH  = 64,
+    parameter DISTRIBUTED_BUFFER_ADDRESS_WIDTH = 0,
     parameter ACT_MSB = ACTION_RAM_WIDTH?ACTION_RAM_WIDTH-1:EVSTROBE_COUNT,
-    parameter ACT_LSB = ACTION_RAM_WIDTH?0:1
+    parameter ACT_LSB = ACTION_RAM_WIDTH?0:1,
+    parameter BUF_MSB = DISTRIBUTED_BUFFER_ADDRESS_WIDTH ?
+                                      DISTRIBUTED_BUFFER_ADDRESS_WIDTH-1 : 0
     ) (
     input  wire                                            evrRxClk,
 
@@ -127,7 +167,11 @@ module tinyEVRcommon #(
     input                                             sysClk,
     input                                             sysActionWriteEnable,
     input                                       [7:0] sysActionAddress,
-    input [(ACTION_RAM_WIDTH?ACTION_RAM_WIDTH-1:0):0] sysActionData);
+    input [(ACTION_RAM_WIDTH?ACTION_RAM_WIDTH-1:0):0] sysActionData,
+
+    input                                 [BUF_MSB:0] sysBufferAddress,
+    output wire                                 [7:0] sysBufferData,
+    output wire                                [31:0] sysBufferStatus);
 
 localparam SECONDS_WIDTH = TIMESTAMP_WIDTH/2;
 localparam TICKS_WIDTH   = TIMESTAMP_WIDTH/2;
@@ -138,6 +182,8 @@ assign timestamp = {tsSeconds, tsTicks};
 localparam EVCODE_SHIFT_ZERO     = 8'h70;
 localparam EVCODE_SHIFT_ONE      = 8'h71;
 localparam EVCODE_SECONDS_MARKER = 8'h7D;
+localparam EVCODE_K28_0          = 8'h1C;
+localparam EVCODE_K28_1          = 8'h3C;
 localparam EVCODE_K28_5          = 8'hBC;
 
 (*mark_debug=DEBUG*) reg           [SECONDS_WIDTH-1:0] shiftReg;
@@ -237,4 +283,146 @@ else begin
 end
 endgenerate
 
+generate
+if ((DISTRIBUTED_BUFFER_ADDRESS_WIDTH > 0)
+ && (DISTRIBUTED_BUFFER_ADDRESS_WIDTH <= 15)) begin : distributedBuffer
+ //
+ // Distributed buffer reception
+ //
+ localparam B_IDLE   = 2'd0,
+            B_DATA   = 2'd1,
+            B_CHK_HI = 2'd2,
+            B_CHK_LO = 2'd3;
+ reg [7:0] bufferRAM [0:(2 << DISTRIBUTED_BUFFER_ADDRESS_WIDTH)-1];
+ (*mark_debug=DEBUG*) reg [1:0] bufferState = B_IDLE;
+ reg bufferBank = 0, goodBank = 0;
+ reg [DISTRIBUTED_BUFFER_ADDRESS_WIDTH:0] bufferCount = 0, goodLength = 0;
+ wire bufferFull = bufferCount[DISTRIBUTED_BUFFER_ADDRESS_WIDTH];
+ reg [15:0] bufferSum = 0;
+ reg  [7:0] bufferChkHi = 0;
+ reg  [7:0] goodCount = 0, badCount = 0;
+ reg statusChanged = 0;
+
+ // Status is handed to the system clock domain with a request/acknowledge
+ // handshake.  The copy being handed over is held until acknowledged and
+ // any changes in the meantime are merged into the next hand over.
+ reg statusReq = 0;
+ (*ASYNC_REG="true"*) reg statusAck_m = 0;
+ reg statusAck = 0;
+ reg [7:0] heldGoodCount = 0, heldBadCount = 0;
+ reg [DISTRIBUTED_BUFFER_ADDRESS_WIDTH:0] heldLength = 0;
+ reg heldBank = 0;
+ reg sysStatusAck = 0;
+
+ // Buffer bytes are in the upper byte of characters other than the
+ // K28.5 comma and the distributed bus slot that follows it.
+ wire bufferSlot = distributedBusPhaseValid && !distributedBusPhase &&
+                   !(evrCharIsK[0] && (evCode == EVCODE_K28_5));
+ wire [7:0] bufferByte = evrRxWord[15:8];
+ wire bufferIsK = evrCharIsK[1];
+
+ always @(posedge evrRxClk) begin
+    statusAck_m <= sysStatusAck;
+    statusAck   <= statusAck_m;
+    if ((statusAck == statusReq) && statusChanged) begin
+        heldGoodCount <= goodCount;
+        heldBadCount <= badCount;
+        heldLength <= goodLength;
+        heldBank <= goodBank;
+        statusChanged <= 0;
+        statusReq <= !statusReq;
+    end
+    if (bufferSlot) begin
+        if (bufferIsK && (bufferByte == EVCODE_K28_0)) begin
+            if (bufferState != B_IDLE) begin
+                badCount <= badCount + 1;
+                statusChanged <= 1;
+            end
+            bufferCount <= 0;
+            bufferSum <= 0;
+            bufferState <= B_DATA;
+        end
+        else begin
+            case (bufferState)
+            B_DATA: begin
+                if (bufferIsK) begin
+                    if (bufferByte == EVCODE_K28_1) begin
+                        bufferState <= B_CHK_HI;
+                    end
+                    else begin
+                        badCount <= badCount + 1;
+                        statusChanged <= 1;
+                        bufferState <= B_IDLE;
+                    end
+                end
+                else if (bufferFull) begin
+                    badCount <= badCount + 1;
+                    statusChanged <= 1;
+                    bufferState <= B_IDLE;
+                end
+                else begin
+                    bufferRAM[{bufferBank,
+                     bufferCount[0+:DISTRIBUTED_BUFFER_ADDRESS_WIDTH]}] <=
+                                                                  bufferByte;
+                    bufferCount <= bufferCount + 1;
+                    bufferSum <= bufferSum + bufferByte;
+                end
+            end
+            B_CHK_HI: begin
+                if (bufferIsK) begin
+                    badCount <= badCount + 1;
+                    statusChanged <= 1;
+                    bufferState <= B_IDLE;
+                end
+                else begin
+                    bufferChkHi <= bufferByte;
+                    bufferState <= B_CHK_LO;
+                end
+            end
+            B_CHK_LO: begin
+                if (!bufferIsK
+                 && ((bufferSum + {bufferChkHi, bufferByte}) == 16'hFFFF)) begin
+                    goodBank <= bufferBank;
+                    goodLength <= bufferCount;
+                    goodCount <= goodCount + 1;
+                    bufferBank <= !bufferBank;
+                end
+                else begin
+                    badCount <= badCount + 1;
+                end
+                statusChanged <= 1;
+                bufferState <= B_IDLE;
+            end
+            default: ;
+            endcase
+        end
+    end
+ end
+
+ // Held status is stable by the time the request has been synchronized
+ (*ASYNC_REG="true"*) reg sysStatusReq_m = 0;
+ reg sysStatusReq = 0;
+ reg sysBank = 0;
+ reg [31:0] sysStatus = 0;
+ reg  [7:0] sysBufferQ = 0;
+ wire [15:0] heldLength16 = heldLength;
+ always @(posedge sysClk) begin
+    sysStatusReq_m <= statusReq;
+    sysStatusReq   <= sysStatusReq_m;
+    if (sysStatusReq != sysStatusAck) begin
+        sysBank <= heldBank;
+        sysStatus <= { heldGoodCount, heldBadCount, heldLength16 };
+        sysStatusAck <= sysStatusReq;
+    end
+    sysBufferQ <= bufferRAM[{sysBank, sysBufferAddress}];
+ end
+ assign sysBufferData = sysBufferQ;
+ assign sysBufferStatus = sysStatus;
+end
+else begin
+ assign sysBufferData = 0;
+ assign sysBufferStatus = 0;
+end
+endgenerate
+
 endmodule
@@ -0,0 +1,586 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Test packet layout with jumbo frame capacity.
+ * Request a byte count beyond the packet capacity and confirm that it is
+ * clamped, then acquire several full-size packets and check the header,
+ * limit excursion bitmaps and every ADC byte against a model of the
+ * packet builder.  With ENCODED set, channels are split between the
+ * full width, 16 bit and delta encodings and readings are chosen to
+ * exercise 16 bit saturation and the delta escape.  With TIMED set the
+ * optional timing block is enabled and checked against sample times
+ * recorded as each reading is supplied.
+ */
+`timescale 1ns/1ns
+
+`default_nettype none
+module buildPacketLayout_tb;
+
+parameter ADC_CHIP_COUNT      = 4;
+parameter ADC_PER_CHIP        = 8;
+parameter ADC_WIDTH           = 24;
+parameter UDP_PACKET_CAPACITY = 8972;
+parameter ENCODED             = 0;
+parameter TIMED               = 0;
+parameter PACKET_COUNT        = 3;
+parameter SAMPLE_INTERVAL     = 200;
+parameter EXCURSION_SAMPLE    = 10;
+parameter EXCURSION_CHANNEL   = 5;
+parameter SATURATE_SAMPLE     = 11;
+parameter SATURATE_CHANNEL    = 9;
+parameter ESCAPE_SAMPLE       = 12;
+parameter ESCAPE_CHANNEL      = 20;
+parameter TICKS_PER_SECOND    = 30011;
+
+localparam ADC_COUNT         = ADC_CHIP_COUNT * ADC_PER_CHIP;
+localparam BYTES_PER_ADC     = (ADC_WIDTH + 7) / 8;
+localparam BYTES_PER_SAMPLE  = ADC_COUNT * BYTES_PER_ADC;
+localparam HEADER_BYTE_COUNT = 32;
+localparam BITMAP_BYTE_COUNT = (4 * ADC_COUNT) / 8;
+localparam ENCODING_BYTE_COUNT = (2 * ADC_COUNT) / 8;
+localparam TIMING_BYTE_COUNT = 16;
+localparam TIMING_OFFSET     = TIMED ? TIMING_BYTE_COUNT : 0;
+localparam PERIOD_INTERVALS  = 256;
+localparam BYTECOUNT_LIMIT   = UDP_PACKET_CAPACITY - HEADER_BYTE_COUNT -
+                                                              BITMAP_BYTE_COUNT;
+localparam ADC_BYTE_COUNT    = (BYTECOUNT_LIMIT / BYTES_PER_SAMPLE) *
+                                                               BYTES_PER_SAMPLE;
+localparam integer THRESHOLD_LOLO  = -8000000;
+localparam integer THRESHOLD_LO    = -7000000;
+localparam integer THRESHOLD_HI    =  7000000;
+localparam integer THRESHOLD_HIHI  =  8000000;
+localparam integer EXCURSION_VALUE =  7500000;
+localparam integer SATURATE_VALUE  =  (1 << (ADC_WIDTH - 1)) - 1;
+localparam integer ESCAPE_OFFSET   =  1000;
+
+localparam [1:0] ENCODE_24    = 2'd0,
+                 ENCODE_16    = 2'd1,
+                 ENCODE_DELTA = 2'd2;
+
+reg         sysClk = 0;
+reg         sysActiveBitmapStrobe = 0;
+reg         sysByteCountStrobe = 0;
+reg         sysThresholdStrobe = 0;
+reg         sysEncodingStrobe = 0;
+reg  [31:0] sysGPIO_OUT = {32{1'bx}};
+wire [31:0] sysStatus, sysActiveRbk, sysByteCountRbk, sysThresholdRbk;
+wire [31:0] sysEncodingRbk, sysLimitExcursions, sysSequenceNumber;
+
+reg                                 acqClk = 0;
+reg                                 acqStrobe = 0;
+reg  [(ADC_COUNT*ADC_WIDTH)-1:0]    acqData = 0;
+wire [(4*ADC_COUNT)-1:0]            acqLimitExcursions;
+wire                                acqLimitExcursionsTVALID;
+reg                                 acqEnableAcquisition = 0;
+reg                          [31:0] acqSeconds = 1000;
+reg                          [31:0] acqTicks = 0;
+
+wire       M_TVALID, M_TLAST;
+wire [7:0] M_TDATA;
+
+// Instantiate device under test
+buildPacket #(
+    .ADC_CHIP_COUNT(ADC_CHIP_COUNT),
+    .ADC_PER_CHIP(ADC_PER_CHIP),
+    .ADC_WIDTH(ADC_WIDTH),
+    .UDP_PACKET_CAPACITY(UDP_PACKET_CAPACITY))
+  buildPacket_i (
+    .sysClk(sysClk),
+    .sysActiveBitmapStrobe(sysActiveBitmapStrobe),
+    .sysByteCountStrobe(sysByteCountStrobe),
+    .sysThresholdStrobe(sysThresholdStrobe),
+    .sysEncodingStrobe(sysEncodingStrobe),
+    .sysLimitExcursionStrobe(1'b0),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .sysStatus(sysStatus),
+    .sysActiveRbk(sysActiveRbk),
+    .sysByteCountRbk(sysByteCountRbk),
+    .sysThresholdRbk(sysThresholdRbk),
+    .sysEncodingRbk(sysEncodingRbk),
+    .sysLimitExcursions(sysLimitExcursions),
+    .sysSequenceNumber(sysSequenceNumber),
+    .sysTimeValid(1'b1),
+    .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
+    .acqData(acqData),
+    .acqLimitExcursions(acqLimitExcursions),
+    .acqLimitExcursionsTVALID(acqLimitExcursionsTVALID),
+    .acqSeconds(acqSeconds),
+    .acqTicks(acqTicks),
+    .acqClkLocked(1'b1),
+    .acqEnableAcquisition(acqEnableAcquisition),
+    .M_TVALID(M_TVALID),
+    .M_TLAST(M_TLAST),
+    .M_TDATA(M_TDATA),
+    .M_TREADY(1'b1));
+
+// Generate clocks
+always begin #5 sysClk = !sysClk; end
+always begin #4 acqClk = !acqClk; end
+
+// Generate time stamps
+always @(posedge acqClk) begin
+    if (acqTicks == (TICKS_PER_SECOND - 1)) begin
+        acqTicks <= 0;
+        acqSeconds <= acqSeconds + 1;
+    end
+    else begin
+        acqTicks <= acqTicks + 1;
+    end
+end
+
+integer good = 1;
+reg fifoOverflowSeen = 0;
+always @(posedge acqClk) begin
+    if (buildPacket_i.mergeLimitExcursions.fifoOverflow) fifoOverflowSeen <= 1;
+end
+
+// Encoding of each channel
+function [1:0] encoding;
+    input integer channel;
+    begin
+    if (!ENCODED)                        encoding = ENCODE_24;
+    else if (channel < (ADC_COUNT / 4))  encoding = ENCODE_24;
+    else if (channel < (ADC_COUNT / 2))  encoding = ENCODE_16;
+    else                                 encoding = ENCODE_DELTA;
+    end
+endfunction
+
+integer adc;
+integer byteCountRequest;
+initial
+begin
+    $dumpfile("buildPacketLayout_tb.fst");
+    $dumpvars(0, buildPacketLayout_tb);
+
+    #100;
+    setThresholds();
+    for (adc = 0 ; adc < ADC_COUNT ; adc = adc + 1) begin
+        writeGPIO(4, (1 << 31) | (adc << ADC_WIDTH) | encoding(adc));
+    end
+    writeGPIO(4, (ADC_COUNT - 1) << ADC_WIDTH);
+    #20;
+    if (sysEncodingRbk[1:0] != encoding(ADC_COUNT - 1)) begin
+        $display("Encoding readback %x -- FAIL", sysEncodingRbk);
+        good = 0;
+    end
+
+    // Oversize request must be clamped to what fits in a packet
+    writeGPIO(2, (1 << 16) | (UDP_PACKET_CAPACITY + 100));
+    #20;
+    if (sysByteCountRbk != BYTECOUNT_LIMIT) begin
+        $display("Byte count readback %0d, expected %0d -- FAIL",
+                                               sysByteCountRbk, BYTECOUNT_LIMIT);
+        good = 0;
+    end
+    else begin
+        $display("Byte count clamped to %0d -- PASS", sysByteCountRbk);
+    end
+
+    // Largest whole number of full-width samples, or as much as will fit
+    // when encoded, then declare a subscriber present
+    byteCountRequest = (ENCODED || TIMED) ? BYTECOUNT_LIMIT : ADC_BYTE_COUNT;
+    writeGPIO(2, (1 << 31) | (TIMED << 27) | (1 << 16) | byteCountRequest);
+    #1000;
+    @(posedge acqClk) acqEnableAcquisition <= 1;
+
+    wait (packetCount == PACKET_COUNT);
+    #1000;
+    if (fifoOverflowSeen) begin
+        $display("Merge FIFO overflow -- FAIL");
+        good = 0;
+    end
+    if (sysStatus[3:2] != 0) begin
+        $display("Status %x shows overrun -- FAIL", sysStatus);
+        good = 0;
+    end
+    if (sysStatus[27] != TIMED) begin
+        $display("Status %x timing block enable -- FAIL", sysStatus);
+        good = 0;
+    end
+    if (TIMED && (periodValidCount == 0)) begin
+        $display("No packet with a valid sample period -- FAIL");
+        good = 0;
+    end
+    $display("%s", good ? "PASS" : "FAIL");
+    $finish;
+end
+
+//
+// Supply ADC readings.  Each reading encodes its sample and channel number.
+//
+integer sampleNumber = 0;
+always begin
+    repeat (SAMPLE_INTERVAL - 1) @(posedge acqClk);
+    acqStrobe <= 1;
+    acqData <= sampleData(sampleNumber);
+    @(posedge acqClk);
+    acqStrobe <= 0;
+    recordTiming(sampleNumber);
+    if (acqEnableAcquisition) sampleNumber = sampleNumber + 1;
+end
+
+//
+// Model of timing block measurements.  Called in the cycle in which
+// the packet builder sees the strobe so the time stamp is the one it sees.
+//
+localparam MAX_SAMPLES = 4096;
+reg [31:0] sampleTicks      [0:MAX_SAMPLES-1];
+reg [31:0] samplePhase      [0:MAX_SAMPLES-1];
+reg [31:0] sampleIndex      [0:MAX_SAMPLES-1];
+reg        samplePhaseValid [0:MAX_SAMPLES-1];
+reg        samplePeriodValid[0:MAX_SAMPLES-1];
+integer strobeCount = 0, modelIndex = 0;
+reg [31:0] modelSeconds, modelPhase = 0;
+reg modelPhaseValid = 0;
+task recordTiming;
+    input integer sample;
+    begin
+    strobeCount = strobeCount + 1;
+    if ((strobeCount == 1) || (acqSeconds != modelSeconds)) begin
+        modelPhase = acqTicks;
+        modelPhaseValid = (strobeCount > 1);
+        modelIndex = 0;
+    end
+    else begin
+        modelIndex = modelIndex + 1;
+    end
+    modelSeconds = acqSeconds;
+    sampleTicks[sample] = acqTicks;
+    samplePhase[sample] = modelPhase;
+    sampleIndex[sample] = modelIndex;
+    samplePhaseValid[sample] = modelPhaseValid;
+    samplePeriodValid[sample] = (strobeCount > (PERIOD_INTERVALS + 1));
+    end
+endtask
+
+function [(ADC_COUNT*ADC_WIDTH)-1:0] sampleData;
+    input integer sample;
+    integer c;
+    begin
+    for (c = 0 ; c < ADC_COUNT ; c = c + 1) begin
+        sampleData[c*ADC_WIDTH+:ADC_WIDTH] = expectedADC(sample, c);
+    end
+    end
+endfunction
+
+function [ADC_WIDTH-1:0] expectedADC;
+    input integer sample;
+    input integer channel;
+    begin
+    if ((sample == EXCURSION_SAMPLE) && (channel == EXCURSION_CHANNEL)) begin
+        expectedADC = EXCURSION_VALUE;
+    end
+    else if ((sample == SATURATE_SAMPLE) && (channel == SATURATE_CHANNEL)) begin
+        expectedADC = SATURATE_VALUE;
+    end
+    else if ((sample == ESCAPE_SAMPLE) && (channel == ESCAPE_CHANNEL)) begin
+        expectedADC = (sample * ADC_COUNT) + channel + ESCAPE_OFFSET;
+    end
+    else begin
+        expectedADC = (sample * ADC_COUNT) + channel;
+    end
+    end
+endfunction
+
+// Limit excursions, LOLO, LO, HI, HIHI with most significant channel first
+function [(4*ADC_COUNT)-1:0] excursions;
+    input integer sample;
+    integer c, v;
+    reg [ADC_WIDTH-1:0] r;
+    begin
+    excursions = 0;
+    for (c = 0 ; c < ADC_COUNT ; c = c + 1) begin
+        r = expectedADC(sample, c);
+        v = $signed(r);
+        excursions[3*ADC_COUNT+c] = (v <= THRESHOLD_LOLO);
+        excursions[2*ADC_COUNT+c] = (v <= THRESHOLD_LO);
+        excursions[1*ADC_COUNT+c] = (v >= THRESHOLD_HI);
+        excursions[0*ADC_COUNT+c] = (v >= THRESHOLD_HIHI);
+    end
+    end
+endfunction
+
+//
+// Model of packet contents following header and bitmaps
+//
+reg [7:0] expected [0:UDP_PACKET_CAPACITY-1];
+integer expectedCount;
+
+task appendByte;
+    input [7:0] b;
+    begin
+    expected[expectedCount] = b;
+    expectedCount = expectedCount + 1;
+    end
+endtask
+
+// Returns number of samples in the packet beginning with firstSample
+function integer buildExpected;
+    input integer firstSample;
+    integer c, s, v, p, d, worstCase, sampleStart, isLast;
+    reg [ADC_WIDTH-1:0] r;
+    reg [ADC_WIDTH:0] rounded;
+    begin
+    expectedCount = 0;
+    worstCase = 0;
+    for (c = 0 ; c < ADC_COUNT ; c = c + 1) begin
+        case (encoding(c))
+        ENCODE_16:    worstCase = worstCase + 2;
+        ENCODE_DELTA: worstCase = worstCase + BYTES_PER_ADC + 1;
+        default:      worstCase = worstCase + BYTES_PER_ADC;
+        endcase
+    end
+    if (ENCODED) begin
+        for (c = ADC_COUNT - 1 ; c >= 0 ; c = c - 4) begin
+            appendByte({encoding(c), encoding(c-1),
+                        encoding(c-2), encoding(c-3)});
+        end
+    end
+    s = firstSample;
+    isLast = 0;
+    while (!isLast) begin
+        sampleStart = expectedCount;
+        for (c = 0 ; c < ADC_COUNT ; c = c + 1) begin
+            r = expectedADC(s, c);
+            v = $signed(r);
+            case (encoding(c))
+            ENCODE_16: begin
+                rounded = {r[ADC_WIDTH-1], r} + 128;
+                if (rounded[ADC_WIDTH] != rounded[ADC_WIDTH-1]) begin
+                    appendByte(8'h7F);
+                    appendByte(8'hFF);
+                end
+                else begin
+                    appendByte(rounded[ADC_WIDTH-1-:8]);
+                    appendByte(rounded[ADC_WIDTH-9-:8]);
+                end
+            end
+            ENCODE_DELTA: begin
+                r = expectedADC(s - 1, c);
+                p = $signed(r);
+                d = v - p;
+                if ((s != firstSample) && (d >= -127) && (d <= 127)) begin
+                    appendByte(d);
+                end
+                else begin
+                    appendByte(8'h80);
+                    appendByte(v >> 16);
+                    appendByte(v >> 8);
+                    appendByte(v);
+                end
+            end
+            default: begin
+                appendByte(v >> 16);
+                appendByte(v >> 8);
+                appendByte(v);
+            end
+            endcase
+        end
+        isLast = (TIMING_OFFSET + sampleStart + (2 * worstCase)) >
+                                                               byteCountRequest;
+        s = s + 1;
+    end
+    buildExpected = s - firstSample;
+    end
+endfunction
+
+//
+// Capture and check packets
+//
+reg [7:0] packet [0:UDP_PACKET_CAPACITY-1];
+integer byteCount = 0;
+integer packetCount = 0;
+integer firstSample, previousFirstSample = -1, previousSampleCount;
+integer periodValidCount = 0;
+reg [31:0] sequenceNumber, previousSequenceNumber;
+
+always @(posedge acqClk) begin
+    if (M_TVALID) begin
+        if (byteCount < UDP_PACKET_CAPACITY) packet[byteCount] = M_TDATA;
+        byteCount = byteCount + 1;
+        if (M_TLAST) begin
+            checkPacket();
+            byteCount = 0;
+            packetCount = packetCount + 1;
+        end
+    end
+end
+
+function [31:0] packetWord;
+    input integer offset;
+    begin
+    packetWord = {packet[offset], packet[offset+1],
+                  packet[offset+2], packet[offset+3]};
+    end
+endfunction
+
+task checkPacket;
+    integer s, i, offset, errors, sampleCount;
+    reg [ADC_WIDTH-1:0] v;
+    reg [(4*ADC_COUNT)-1:0] bitmaps;
+    reg [127:0] timing;
+    begin
+    errors = 0;
+    if (packetWord(0) != "PSNB") begin
+        $display("Packet %0d bad magic %x", packetCount, packetWord(0));
+        errors = errors + 1;
+    end
+    if (packetWord(4) != byteCount - 8) begin
+        $display("Packet %0d size field %0d, expected %0d", packetCount,
+                                                 packetWord(4), byteCount - 8);
+        errors = errors + 1;
+    end
+    // Flags: timing block, encoded, not calibrated
+    if (packetWord(8) != ((TIMED << 6) | (ENCODED << 5) | (1 << 4))) begin
+        $display("Packet %0d status %x", packetCount, packetWord(8));
+        errors = errors + 1;
+    end
+    if (packetWord(12) != {ADC_COUNT{1'b1}}) begin
+        $display("Packet %0d active channels %x", packetCount, packetWord(12));
+        errors = errors + 1;
+    end
+    sequenceNumber = packetWord(20);
+    if ((packetCount > 0) && (sequenceNumber != previousSequenceNumber+1)) begin
+        $display("Packet %0d sequence number %0d follows %0d", packetCount,
+                                         sequenceNumber, previousSequenceNumber);
+        errors = errors + 1;
+    end
+    previousSequenceNumber = sequenceNumber;
+
+    // First reading of channel 0 identifies the first sample in this packet
+    offset = HEADER_BYTE_COUNT + BITMAP_BYTE_COUNT + TIMING_OFFSET +
+                                          (ENCODED ? ENCODING_BYTE_COUNT : 0);
+    v = {packet[offset], packet[offset+1], packet[offset+2]};
+    firstSample = v / ADC_COUNT;
+    if ((previousFirstSample >= 0)
+     && (firstSample != previousFirstSample + previousSampleCount)) begin
+        $display("Packet %0d starts with sample %0d, expected %0d", packetCount,
+                         firstSample, previousFirstSample + previousSampleCount);
+        errors = errors + 1;
+    end
+    sampleCount = buildExpected(firstSample);
+    previousFirstSample = firstSample;
+    previousSampleCount = sampleCount;
+
+    // Bitmaps
+    bitmaps = 0;
+    for (s = firstSample ; s < firstSample + sampleCount ; s = s + 1) begin
+        bitmaps = bitmaps | excursions(s);
+    end
+    for (i = 0 ; i < BITMAP_BYTE_COUNT ; i = i + 1) begin
+        if (packet[HEADER_BYTE_COUNT+i] !== bitmaps[(4*ADC_COUNT)-1-(i*8)-:8]) begin
+            $display("Packet %0d bitmap byte %0d is %x, expected %x",
+                              packetCount, i, packet[HEADER_BYTE_COUNT+i],
+                              bitmaps[(4*ADC_COUNT)-1-(i*8)-:8]);
+            errors = errors + 1;
+        end
+    end
+
+    // Timing block
+    if (TIMED) begin
+        offset = HEADER_BYTE_COUNT + BITMAP_BYTE_COUNT;
+        if (samplePeriodValid[firstSample]) periodValidCount = periodValidCount + 1;
+        timing = { sampleTicks[firstSample],
+                   samplePeriodValid[firstSample] ?
+                             SAMPLE_INTERVAL * PERIOD_INTERVALS : 32'd0,
+                   samplePhase[firstSample],
+                   samplePeriodValid[firstSample],
+                   samplePhaseValid[firstSample],
+                   sampleIndex[firstSample][29:0] };
+        if ({packetWord(offset), packetWord(offset+4),
+             packetWord(offset+8), packetWord(offset+12)} != timing) begin
+            $display("Packet %0d timing %x %x %x %x, expected %x", packetCount,
+                                packetWord(offset), packetWord(offset+4),
+                                packetWord(offset+8), packetWord(offset+12),
+                                timing);
+            errors = errors + 1;
+        end
+    end
+
+    // Encoding map and ADC readings
+    offset = HEADER_BYTE_COUNT + BITMAP_BYTE_COUNT + TIMING_OFFSET;
+    if (byteCount != offset + expectedCount) begin
+        $display("Packet %0d length %0d, expected %0d", packetCount, byteCount,
+                                                        offset + expectedCount);
+        errors = errors + 1;
+    end
+    for (i = 0 ; i < expectedCount ; i = i + 1) begin
+        if (packet[offset+i] !== expected[i]) begin
+            if (errors < 10) begin
+                $display("Packet %0d byte %0d got %x want %x", packetCount,
+                                        offset + i, packet[offset+i], expected[i]);
+            end
+            errors = errors + 1;
+        end
+    end
+    $display("Packet %0d: %0d bytes, samples %0d-%0d -- %s", packetCount,
+                     byteCount, firstSample, firstSample + sampleCount - 1,
+                     errors ? "FAIL" : "PASS");
+    if (errors) good = 0;
+    end
+endtask
+
+//
+// System clock domain register writes
+//
+task writeGPIO;
+    input integer sel;
+    input [31:0] value;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= value;
+        sysActiveBitmapStrobe <= (sel == 1);
+        sysByteCountStrobe <= (sel == 2);
+        sysThresholdStrobe <= (sel == 3);
+        sysEncodingStrobe <= (sel == 4);
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysActiveBitmapStrobe <= 0;
+        sysByteCountStrobe <= 0;
+        sysThresholdStrobe <= 0;
+        sysEncodingStrobe <= 0;
+    end
+    end
+endtask
+
+task setThresholds;
+    integer adc;
+    begin
+    for (adc = 0 ; adc < ADC_COUNT ; adc = adc + 1) begin
+        writeGPIO(3, (0 << 30) | (1 << 29) | (adc << ADC_WIDTH) |
+                                          (THRESHOLD_LOLO & ((1<<ADC_WIDTH)-1)));
+        writeGPIO(3, (1 << 30) | (1 << 29) | (adc << ADC_WIDTH) |
+                                          (THRESHOLD_LO   & ((1<<ADC_WIDTH)-1)));
+        writeGPIO(3, (2 << 30) | (1 << 29) | (adc << ADC_WIDTH) |
+                                          (THRESHOLD_HI   & ((1<<ADC_WIDTH)-1)));
+        writeGPIO(3, (3 << 30) | (1 << 29) | (adc << ADC_WIDTH) |
+                                          (THRESHOLD_HIHI & ((1<<ADC_WIDTH)-1)));
+    end
+    end
+endtask
+
+endmodule
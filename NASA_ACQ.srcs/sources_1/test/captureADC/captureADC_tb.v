@@ -0,0 +1,334 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Test pre/post-trigger ADC capture.
+ * Readings are a known function of sample number and channel so every
+ * reading in every capture packet can be checked.  Exercise each trigger
+ * source, the extremes of the post-trigger count and resending.
+ */
+`timescale 1ns/1ns
+
+`default_nettype none
+module captureADC_tb;
+
+parameter ADC_CHIP_COUNT      = 1;
+parameter ADC_PER_CHIP        = 4;
+parameter ADC_WIDTH           = 24;
+parameter SAMPLE_COUNT        = 64;
+parameter SAMPLES_PER_PACKET  = 5;
+parameter PACKET_GAP          = 50;
+parameter SAMPLE_INTERVAL     = 40;
+parameter TICKS_PER_SAMPLE    = 100;
+parameter SECONDS             = 4321;
+
+localparam CHANNEL_COUNT = ADC_CHIP_COUNT * ADC_PER_CHIP;
+localparam SAMPLE_BYTES  = CHANNEL_COUNT * 3;
+localparam UDP_PACKET_CAPACITY = 32 + (SAMPLES_PER_PACKET * SAMPLE_BYTES);
+localparam CAUSE_MPS = 1, CAUSE_EVR = 2, CAUSE_SOFTWARE = 4;
+
+reg         sysClk = 0;
+reg         sysCsrStrobe = 0;
+reg  [31:0] sysGPIO_OUT = {32{1'bx}};
+wire [31:0] sysStatus;
+
+reg         evrClk = 0;
+reg         evrTriggerStrobe = 0;
+
+reg                                  acqClk = 0;
+reg                                  acqStrobe = 0;
+reg  [(CHANNEL_COUNT*ADC_WIDTH)-1:0] acqData = 0;
+reg                           [31:0] acqTicks = 0;
+reg                                  acqMPStripped = 0;
+wire                                 M_TVALID, M_TLAST;
+wire                           [7:0] M_TDATA;
+reg                                  M_TREADY = 1;
+
+// Instantiate device under test
+captureADC #(
+    .ADC_CHIP_COUNT(ADC_CHIP_COUNT),
+    .ADC_PER_CHIP(ADC_PER_CHIP),
+    .ADC_WIDTH(ADC_WIDTH),
+    .SAMPLE_COUNT(SAMPLE_COUNT),
+    .UDP_PACKET_CAPACITY(UDP_PACKET_CAPACITY),
+    .PACKET_GAP(PACKET_GAP))
+  captureADC_i (
+    .sysClk(sysClk),
+    .sysCsrStrobe(sysCsrStrobe),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .sysStatus(sysStatus),
+    .evrClk(evrClk),
+    .evrTriggerStrobe(evrTriggerStrobe),
+    .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
+    .acqData(acqData),
+    .acqSeconds(SECONDS),
+    .acqTicks(acqTicks),
+    .acqMPStripped(acqMPStripped),
+    .M_TVALID(M_TVALID),
+    .M_TLAST(M_TLAST),
+    .M_TDATA(M_TDATA),
+    .M_TREADY(M_TREADY));
+
+// Generate clocks
+always begin #5 sysClk = !sysClk; end
+always begin #4 acqClk = !acqClk; end
+always begin #4.2 evrClk = !evrClk; end
+
+// Reading as a function of sample number and channel
+function [ADC_WIDTH-1:0] reading;
+    input integer n;
+    input integer ch;
+    begin
+    reading = (n * 40503) ^ (ch << 20) ^ (ch * 977);
+    end
+endfunction
+
+// Free-running sample stream
+integer sampleNumber = 0;
+integer ch;
+always begin
+    repeat (SAMPLE_INTERVAL - 1) @(posedge acqClk) ;
+    @(posedge acqClk) begin
+        for (ch = 0 ; ch < CHANNEL_COUNT ; ch = ch + 1) begin
+            acqData[ch*ADC_WIDTH+:ADC_WIDTH] <= reading(sampleNumber, ch);
+        end
+        acqTicks <= sampleNumber * TICKS_PER_SAMPLE;
+        acqStrobe <= 1;
+        sampleNumber = sampleNumber + 1;
+    end
+    @(posedge acqClk) acqStrobe <= 0;
+end
+
+integer good = 1;
+
+initial
+begin
+    $dumpfile("captureADC_tb.fst");
+    $dumpvars(0, captureADC_tb);
+
+    //         Post-trigger      Trigger source  Capture
+    runCapture(10,               CAUSE_SOFTWARE, 1);
+    runCapture(0,                CAUSE_MPS,      2);
+    runCapture(SAMPLE_COUNT - 2, CAUSE_EVR,      3);
+    runCapture(SAMPLE_COUNT - 1, CAUSE_SOFTWARE, 4);
+
+    // Send the last capture again
+    expectPost = SAMPLE_COUNT - 2;
+    startReceive(CAUSE_SOFTWARE, 4);
+    writeCSR(32'h40000000);
+    awaitState(4);
+    awaitState(0);
+    finishReceive;
+
+    #10 ;
+    $display("%s", good ? "PASS" : "FAIL");
+    $finish;
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Receive and check packets
+reg [7:0] rxBuf [0:UDP_PACKET_CAPACITY-1];
+integer rxCount = 0, packetCount = 0, sampleCount = 0;
+integer expectPost = 0, expectCause = 0, expectCapture = 0;
+integer triggerSample = -1, mismatches = 0;
+
+always @(posedge acqClk) begin
+    M_TREADY <= (($random & 7) != 0);
+    if (M_TVALID && M_TREADY) begin
+        if (rxCount < UDP_PACKET_CAPACITY) rxBuf[rxCount] = M_TDATA;
+        rxCount = rxCount + 1;
+        if (M_TLAST) begin
+            checkPacket;
+            rxCount = 0;
+        end
+    end
+end
+
+function [31:0] rx32;
+    input integer i;
+    begin
+    rx32 = { rxBuf[i+0], rxBuf[i+1], rxBuf[i+2], rxBuf[i+3] };
+    end
+endfunction
+
+task checkPacket;
+    integer n, i, c, offset, pre, first, trigger;
+    reg [31:0] ns;
+    reg [ADC_WIDTH-1:0] v;
+    begin
+    pre = SAMPLE_COUNT - 1 - expectPost;
+    n = (rxCount - 32) / SAMPLE_BYTES;
+    offset = $signed(rx32(12));
+    ns = rx32(28);
+    trigger = ns / (8 * TICKS_PER_SAMPLE);
+    if (triggerSample < 0) triggerSample = trigger;
+    if (((rxCount - 32) % SAMPLE_BYTES) != 0)
+        $display("Bad packet length %0d", rxCount);
+    if ((((rxCount - 32) % SAMPLE_BYTES) != 0)
+     || (n > SAMPLES_PER_PACKET)
+     || (rx32(0) != "PSNB")
+     || (rx32(4) != rxCount - 8)
+     || (rx32(8) != ((2 << 24) | expectCause))
+     || (offset != sampleCount - pre)
+     || (rx32(16) != expectCapture)
+     || (rx32(20) != packetCount)
+     || (rx32(24) != SECONDS)
+     || (trigger != triggerSample)
+     || ((ns % (8 * TICKS_PER_SAMPLE)) != 0)) begin
+        $display("Bad header %x %x %x %0d %0d %0d %0d %0d", rx32(0), rx32(4),
+                   rx32(8), offset, rx32(16), rx32(20), rx32(24), ns);
+        good = 0;
+    end
+    for (i = 0 ; i < n ; i = i + 1) begin
+        for (c = 0 ; c < CHANNEL_COUNT ; c = c + 1) begin
+            first = 32 + (i * SAMPLE_BYTES) + (c * 3);
+            v = { rxBuf[first], rxBuf[first+1], rxBuf[first+2] };
+            if (v != reading(trigger + offset + i, c)) begin
+                if (mismatches < 10) begin
+                    $display("Sample %0d channel %0d: %x, expected %x",
+                             trigger + offset + i, c, v,
+                             reading(trigger + offset + i, c));
+                end
+                mismatches = mismatches + 1;
+            end
+        end
+    end
+    sampleCount = sampleCount + n;
+    packetCount = packetCount + 1;
+    end
+endtask
+
+task startReceive;
+    input integer cause;
+    input integer capture;
+    begin
+    expectCause = cause;
+    expectCapture = capture;
+    packetCount = 0;
+    sampleCount = 0;
+    mismatches = 0;
+    triggerSample = -1;
+    end
+endtask
+
+task finishReceive;
+    begin
+    $display("Capture %0d, post-trigger %0d, cause %0d: "
+             "%0d packets, %0d samples, %0d mismatches",
+             expectCapture, expectPost, expectCause,
+             packetCount, sampleCount, mismatches);
+    if ((sampleCount != SAMPLE_COUNT)
+     || (packetCount != ((SAMPLE_COUNT + SAMPLES_PER_PACKET - 1) /
+                                                     SAMPLES_PER_PACKET))
+     || (mismatches != 0)
+     || (sysStatus[28:26] != expectCause)
+     || !sysStatus[25]) begin
+        good = 0;
+    end
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// Run a capture
+task runCapture;
+    input integer post;
+    input integer cause;
+    input integer capture;
+    begin
+    expectPost = (post > SAMPLE_COUNT - 2) ? SAMPLE_COUNT - 2 : post;
+    startReceive(cause, capture);
+    writeCSR(32'h80000000 | ((cause == CAUSE_EVR) ? 32'h20000000 : 0)
+                          | ((cause == CAUSE_MPS) ? 32'h10000000 : 0) | post);
+    awaitState(2);
+    if (sysStatus[25] || (sysStatus[15:0] != expectPost)) begin
+        $display("Bad status while awaiting trigger %x", sysStatus);
+        good = 0;
+    end
+    // Trigger sources that are not enabled must be ignored
+    if (cause != CAUSE_MPS) pulseMPS;
+    if (cause != CAUSE_EVR) pulseEVR;
+    repeat (3 * SAMPLE_INTERVAL) @(posedge acqClk) ;
+    if (sysStatus[31:29] != 2) begin
+        $display("Triggered by disabled source");
+        good = 0;
+    end
+    case (cause)
+    CAUSE_MPS:      pulseMPS;
+    CAUSE_EVR:      pulseEVR;
+    default:        writeCSR(32'h80000000);
+    endcase
+    awaitState(4);
+    awaitState(0);
+    finishReceive;
+    end
+endtask
+
+task pulseMPS;
+    begin
+    @(posedge acqClk) acqMPStripped <= 1;
+    repeat (10) @(posedge acqClk) ;
+    acqMPStripped <= 0;
+    end
+endtask
+
+task pulseEVR;
+    begin
+    @(posedge evrClk) evrTriggerStrobe <= 1;
+    @(posedge evrClk) evrTriggerStrobe <= 0;
+    end
+endtask
+
+task awaitState;
+    input integer state;
+    integer timeout;
+    begin
+    timeout = 0;
+    while ((sysStatus[31:29] != state) && (timeout < 1000000)) begin
+        @(posedge sysClk) timeout = timeout + 1;
+    end
+    if (sysStatus[31:29] != state) begin
+        $display("Timeout waiting for state %0d", state);
+        good = 0;
+    end
+    end
+endtask
+
+// Write control register
+task writeCSR;
+    input [31:0] value;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= value;
+        sysCsrStrobe <= 1;
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysCsrStrobe <= 0;
+    end
+    end
+endtask
+
+endmodule
+`default_nettype wire
@@ -0,0 +1,268 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Test ADC limit excursion detection.
+ * Each channel has its own hysteresis band and debounce count.  A random
+ * walk around the thresholds is applied to every channel and the excursion
+ * bitmaps are compared with a model after every sample.  Settings and
+ * thresholds are read back and checked.
+ */
+`timescale 1ns/1ns
+
+`default_nettype none
+module detectLimitExcursions_tb;
+
+parameter ADC_CHIP_COUNT = 1;
+parameter ADC_PER_CHIP   = 8;
+parameter ADC_WIDTH      = 24;
+parameter LOG2_LANES     = 2;
+parameter SAMPLE_COUNT   = 2000;
+parameter SAMPLE_INTERVAL = 20;
+
+localparam ADC_COUNT      = ADC_CHIP_COUNT * ADC_PER_CHIP;
+localparam THRESHOLD_LOLO = -4000;
+localparam THRESHOLD_LO   = -2000;
+localparam THRESHOLD_HI   =  2000;
+localparam THRESHOLD_HIHI =  4000;
+localparam LIMIT          =  5000;
+
+reg         sysClk = 0;
+reg         sysThresholdStrobe = 0;
+reg  [31:0] sysGPIO_OUT = {32{1'bx}};
+wire [31:0] sysThresholdRbk;
+
+reg                              acqClk = 0;
+reg                              acqStrobe = 0;
+reg  [(ADC_COUNT*ADC_WIDTH)-1:0] acqData = 0;
+wire       [(4*ADC_COUNT)-1:0]   acqLimitExcursions;
+wire                             acqLimitExcursionsTVALID;
+
+// Instantiate device under test
+detectLimitExcursions #(
+    .ADC_CHIP_COUNT(ADC_CHIP_COUNT),
+    .ADC_PER_CHIP(ADC_PER_CHIP),
+    .ADC_WIDTH(ADC_WIDTH),
+    .LOG2_LANES(LOG2_LANES))
+  detectLimitExcursions_i (
+    .sysClk(sysClk),
+    .sysThresholdStrobe(sysThresholdStrobe),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .sysThresholdRbk(sysThresholdRbk),
+    .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
+    .acqData(acqData),
+    .acqLimitExcursions(acqLimitExcursions),
+    .acqLimitExcursionsTVALID(acqLimitExcursionsTVALID));
+
+// Clocks
+always begin #5 sysClk = !sysClk; end
+always begin #4 acqClk = !acqClk; end
+
+// Model
+integer hysteresis [0:ADC_COUNT-1];
+integer debounce   [0:ADC_COUNT-1];
+integer value      [0:ADC_COUNT-1];
+reg     [3:0] state [0:ADC_COUNT-1];
+integer count      [0:(4*ADC_COUNT)-1];
+integer threshold  [0:3];
+integer errors = 0, transitions = 0, checks = 0;
+
+initial begin
+    threshold[0] = THRESHOLD_HIHI;
+    threshold[1] = THRESHOLD_HI;
+    threshold[2] = THRESHOLD_LO;
+    threshold[3] = THRESHOLD_LOLO;
+end
+
+// Apply one sample to the model, level 0 HIHI, 1 HI, 2 LO, 3 LOLO
+task modelSample;
+    integer c, k, limit;
+    reg target;
+    begin
+    for (c = 0 ; c < ADC_COUNT ; c = c + 1) begin
+        for (k = 0 ; k < 4 ; k = k + 1) begin
+            limit = threshold[k];
+            if (k < 2) begin
+                if (state[c][k]) limit = limit - hysteresis[c];
+                target = (value[c] >= limit);
+            end
+            else begin
+                if (state[c][k]) limit = limit + hysteresis[c];
+                target = (value[c] <= limit);
+            end
+            if (target == state[c][k]) begin
+                count[(k*ADC_COUNT)+c] = 0;
+            end
+            else if ((count[(k*ADC_COUNT)+c] + 1) >= debounce[c]) begin
+                state[c][k] = target;
+                count[(k*ADC_COUNT)+c] = 0;
+                transitions = transitions + 1;
+            end
+            else begin
+                count[(k*ADC_COUNT)+c] = count[(k*ADC_COUNT)+c] + 1;
+            end
+        end
+    end
+    end
+endtask
+
+// Check bitmaps when presented
+always @(posedge acqClk) begin: checkBitmaps
+    integer c, k;
+    if (acqLimitExcursionsTVALID) begin
+        checks = checks + 1;
+        for (c = 0 ; c < ADC_COUNT ; c = c + 1) begin
+            for (k = 0 ; k < 4 ; k = k + 1) begin
+                if (acqLimitExcursions[(k*ADC_COUNT)+c] !== state[c][k]) begin
+                    if (errors < 10) begin
+                        $display("Channel %0d level %0d: got %b, expect %b",
+                                      c, k, acqLimitExcursions[(k*ADC_COUNT)+c],
+                                      state[c][k]);
+                    end
+                    errors = errors + 1;
+                end
+            end
+        end
+    end
+end
+
+integer c, n, step, passed;
+initial
+begin
+    $dumpfile("detectLimitExcursions_tb.fst");
+    $dumpvars(0, detectLimitExcursions_tb);
+
+    for (c = 0 ; c < ADC_COUNT ; c = c + 1) begin
+        hysteresis[c] = (c == 0) ? 0 : ($random & 'h1FF);
+        debounce[c] = (c == 1) ? 0 : ($random & 'h3);
+        value[c] = 0;
+        state[c] = 0;
+        count[(0*ADC_COUNT)+c] = 0;
+        count[(1*ADC_COUNT)+c] = 0;
+        count[(2*ADC_COUNT)+c] = 0;
+        count[(3*ADC_COUNT)+c] = 0;
+        setThreshold(c, 3, THRESHOLD_LOLO);
+        setThreshold(c, 2, THRESHOLD_LO);
+        setThreshold(c, 1, THRESHOLD_HI);
+        setThreshold(c, 0, THRESHOLD_HIHI);
+        setSetting(c, 0, hysteresis[c]);
+        setSetting(c, 1, debounce[c]);
+    end
+    checkReadback();
+
+    #100 ;
+    for (n = 0 ; n < SAMPLE_COUNT ; n = n + 1) begin
+        for (c = 0 ; c < ADC_COUNT ; c = c + 1) begin
+            step = $random % 1500;
+            value[c] = value[c] + step;
+            if (value[c] >  LIMIT) value[c] =  LIMIT;
+            if (value[c] < -LIMIT) value[c] = -LIMIT;
+            acqData[c*ADC_WIDTH+:ADC_WIDTH] <= value[c];
+        end
+        modelSample();
+        @(posedge acqClk) acqStrobe <= 1;
+        @(posedge acqClk) acqStrobe <= 0;
+        repeat (SAMPLE_INTERVAL - 2) @(posedge acqClk) ;
+    end
+    #100 ;
+    passed = (errors == 0) && (checks == SAMPLE_COUNT);
+    $display("%0d samples, %0d checks, %0d transitions, %0d errors",
+                                SAMPLE_COUNT, checks, transitions, errors);
+    $display("%s", passed ? "PASS" : "FAIL");
+    $finish;
+end
+
+//
+// System clock domain register access
+//
+task writeCSR;
+    input [31:0] value;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= value;
+        sysThresholdStrobe <= 1;
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysThresholdStrobe <= 0;
+    end
+    end
+endtask
+
+// Level 0 LOLO, 1 LO, 2 HI, 3 HIHI as in the CSR
+task setThreshold;
+    input integer adc;
+    input integer level;
+    input integer limit;
+    begin
+    writeCSR((level << 30) | (1 << 29) | (adc << ADC_WIDTH) |
+                                          (limit & ((1<<ADC_WIDTH)-1)));
+    end
+endtask
+
+// Setting 0 hysteresis, 1 debounce
+task setSetting;
+    input integer adc;
+    input integer sel;
+    input integer setting;
+    begin
+    writeCSR((sel << 30) | (adc << ADC_WIDTH) | (3 << (ADC_WIDTH-2)) |
+                                          (setting & ((1<<(ADC_WIDTH-2))-1)));
+    end
+endtask
+
+task checkValue;
+    input [31:0] request;
+    input [31:0] expected;
+    begin
+    writeCSR(request);
+    repeat (4) @(posedge sysClk) ;
+    if (sysThresholdRbk !== expected) begin
+        $display("Readback %x: got %x, expect %x", request,
+                                                   sysThresholdRbk, expected);
+        errors = errors + 1;
+    end
+    end
+endtask
+
+task checkReadback;
+    integer adc;
+    reg [31:0] base;
+    begin
+    for (adc = 0 ; adc < ADC_COUNT ; adc = adc + 1) begin
+        base = adc << ADC_WIDTH;
+        checkValue(base | (0 << 30), base | (0 << 30) |
+                                 (THRESHOLD_LOLO & ((1<<ADC_WIDTH)-1)));
+        checkValue(base | (3 << 30), base | (3 << 30) |
+                                 (THRESHOLD_HIHI & ((1<<ADC_WIDTH)-1)));
+        checkValue(base | (0 << 30) | (1 << (ADC_WIDTH-1)),
+                   base | (0 << 30) | (1 << (ADC_WIDTH-1)) | hysteresis[adc]);
+        checkValue(base | (1 << 30) | (1 << (ADC_WIDTH-1)),
+                   base | (1 << 30) | (1 << (ADC_WIDTH-1)) | debounce[adc]);
+    end
+    end
+endtask
+
+endmodule
@@ -0,0 +1,357 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Test limit excursion event stream.
+ * Compare every event in every packet against a model that applies the
+ * same bitmaps.  The first test applies random back-pressure and a level
+ * mask, the second presents samples faster than they can be examined and
+ * checks that skipped samples are flagged and that the following sample
+ * reports the net change, the third stalls the output until the queue
+ * overflows and checks that lost events are flagged.
+ */
+`timescale 1ns/1ns
+
+`default_nettype none
+module excursionEvents_tb;
+
+parameter ADC_CHIP_COUNT   = 1;
+parameter ADC_PER_CHIP     = 8;
+parameter LOG2_QUEUE_DEPTH = 6;
+parameter EVENTS_PER_PACKET = 16;
+parameter PACKET_GAP       = 40;
+parameter TICKS_PER_SAMPLE = 1000;
+parameter SECONDS          = 1234;
+parameter BITMAP_LATENCY   = 11;
+
+localparam CHANNEL_COUNT = ADC_CHIP_COUNT * ADC_PER_CHIP;
+localparam BITMAPS_WIDTH = 4 * CHANNEL_COUNT;
+localparam PACKET_CAPACITY = 32 + (EVENTS_PER_PACKET * 12);
+localparam EXPECT_CAPACITY = 16384;
+
+reg         sysClk = 0;
+reg         sysCsrStrobe = 0;
+reg  [31:0] sysGPIO_OUT = {32{1'bx}};
+wire [31:0] sysStatus;
+
+reg                      acqClk = 0;
+reg                      acqStrobe = 0;
+reg  [BITMAPS_WIDTH-1:0] acqLimitExcursions = 0;
+reg                      acqLimitExcursionsTVALID = 0;
+reg               [31:0] acqTicks = 0;
+reg                      acqEnableAcquisition = 0;
+wire                     M_TVALID, M_TLAST;
+wire               [7:0] M_TDATA;
+reg                      M_TREADY = 1;
+
+// Instantiate device under test
+excursionEvents #(
+    .ADC_CHIP_COUNT(ADC_CHIP_COUNT),
+    .ADC_PER_CHIP(ADC_PER_CHIP),
+    .LOG2_QUEUE_DEPTH(LOG2_QUEUE_DEPTH),
+    .UDP_PACKET_CAPACITY(PACKET_CAPACITY),
+    .PACKET_GAP(PACKET_GAP))
+  excursionEvents_i (
+    .sysClk(sysClk),
+    .sysCsrStrobe(sysCsrStrobe),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .sysStatus(sysStatus),
+    .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
+    .acqLimitExcursions(acqLimitExcursions),
+    .acqLimitExcursionsTVALID(acqLimitExcursionsTVALID),
+    .acqSeconds(SECONDS),
+    .acqTicks(acqTicks),
+    .acqEnableAcquisition(acqEnableAcquisition),
+    .M_TVALID(M_TVALID),
+    .M_TLAST(M_TLAST),
+    .M_TDATA(M_TDATA),
+    .M_TREADY(M_TREADY));
+
+// Generate clocks
+always begin #5 sysClk = !sysClk; end
+always begin #4 acqClk = !acqClk; end
+
+integer good = 1;
+reg [3:0] levelEnables = 0;
+reg randomReady = 0, stallReady = 0, checkEvents = 1;
+
+initial
+begin
+    $dumpfile("excursionEvents_tb.fst");
+    $dumpvars(0, excursionEvents_tb);
+
+    //      Levels   Samples Interval Back-pressure Stall Expect
+    //                                                    skip lost
+    runTest(4'b1011, 300,    200,     1,            0,    0,   0);
+    runTest(4'b1111,  24,     20,     0,            0,    1,   0);
+    runTest(4'b1111, 200,     60,     0,            1,    0,   1);
+
+    #10 ;
+    $display("%s", good ? "PASS" : "FAIL");
+    $finish;
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Model
+// The device under test examines a sample only if it has finished examining
+// the previous one.  Sampling its state in the strobe cycle tells the model
+// which samples those are, everything else is modelled independently.
+reg [31:0] expectSeconds [0:EXPECT_CAPACITY-1];
+reg [31:0] expectNs      [0:EXPECT_CAPACITY-1];
+reg [31:0] expectEvent   [0:EXPECT_CAPACITY-1];
+integer expectHead = 0, expectTail = 0, skippedCount = 0;
+reg [BITMAPS_WIDTH-1:0] modelPrevious = 0;
+
+always @(posedge acqClk) begin
+    if (!excursionEvents_i.acqActive) begin
+        modelPrevious = 0;
+    end
+    else if (acqLimitExcursionsTVALID) begin
+        if (excursionEvents_i.scanActive) begin
+            skippedCount = skippedCount + 1;
+        end
+        else begin
+            modelSample(acqLimitExcursions);
+        end
+    end
+end
+
+task modelSample;
+    input [BITMAPS_WIDTH-1:0] bitmaps;
+    integer b, level, channel;
+    begin
+    for (b = 0 ; b < BITMAPS_WIDTH ; b = b + 1) begin
+        level = 3 - (b / CHANNEL_COUNT);
+        channel = b % CHANNEL_COUNT;
+        if ((bitmaps[b] != modelPrevious[b]) && levelEnables[level]) begin
+            expectSeconds[expectTail % EXPECT_CAPACITY] = SECONDS;
+            expectNs[expectTail % EXPECT_CAPACITY] =
+                                          excursionEvents_i.sampleTicks * 8;
+            expectEvent[expectTail % EXPECT_CAPACITY] = (channel << 8) |
+                                                        (bitmaps[b] << 7) |
+                                                        level;
+            expectTail = expectTail + 1;
+        end
+    end
+    modelPrevious = bitmaps;
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// Receive and check packets
+reg [7:0] rxBuf [0:PACKET_CAPACITY-1];
+integer rxCount = 0, packetCount = 0, eventCount = 0;
+integer lostPacketCount = 0, skippedPacketCount = 0;
+reg [63:0] expectSequence;
+
+always @(posedge acqClk) begin
+    M_TREADY <= stallReady ? 0 :
+                randomReady ? (($random & 3) != 0) : 1;
+    if (M_TVALID && M_TREADY) begin
+        if (rxCount < PACKET_CAPACITY) rxBuf[rxCount] = M_TDATA;
+        rxCount = rxCount + 1;
+        if (M_TLAST) begin
+            checkPacket;
+            rxCount = 0;
+        end
+    end
+end
+
+function [63:0] rx64;
+    input integer i;
+    begin
+    rx64 = { rxBuf[i+0], rxBuf[i+1], rxBuf[i+2], rxBuf[i+3],
+             rxBuf[i+4], rxBuf[i+5], rxBuf[i+6], rxBuf[i+7] };
+    end
+endfunction
+
+function [31:0] rx32;
+    input integer i;
+    begin
+    rx32 = { rxBuf[i+0], rxBuf[i+1], rxBuf[i+2], rxBuf[i+3] };
+    end
+endfunction
+
+task checkPacket;
+    integer n, e, base, mismatches;
+    reg [31:0] status;
+    begin
+    mismatches = 0;
+    status = rx32(8);
+    n = rx32(12);
+    if ((rxCount > PACKET_CAPACITY)
+     || (n == 0) || (n > EVENTS_PER_PACKET)
+     || (rxCount != 32 + (n * 12))
+     || (rx32(0) != "PSNB")
+     || (rx32(4) != rxCount - 8)
+     || (status[31:24] != 4)
+     || (status[23:2] != 0)
+     || (rx64(16) != expectSequence)
+     || (rx32(24) != SECONDS)) begin
+        $display("Bad header %x %x %x %x %x %x, length %0d", rx32(0), rx32(4),
+                                 status, rx32(12), rx64(16), rx32(24), rxCount);
+        good = 0;
+    end
+    else begin
+        if (status[1]) lostPacketCount = lostPacketCount + 1;
+        if (status[0]) skippedPacketCount = skippedPacketCount + 1;
+        for (e = 0 ; e < n ; e = e + 1) begin
+            base = 32 + (e * 12);
+            if (checkEvents
+             && ((expectHead == expectTail)
+              || (rx32(base) != expectSeconds[expectHead % EXPECT_CAPACITY])
+              || (rx32(base+4) != expectNs[expectHead % EXPECT_CAPACITY])
+              || (rx32(base+8) != expectEvent[expectHead % EXPECT_CAPACITY])))
+                                                                        begin
+                if (mismatches < 10) begin
+                    $display("Event %0d: %x %x %x, expected %x %x %x",
+                        expectHead, rx32(base), rx32(base+4), rx32(base+8),
+                        expectSeconds[expectHead % EXPECT_CAPACITY],
+                        expectNs[expectHead % EXPECT_CAPACITY],
+                        expectEvent[expectHead % EXPECT_CAPACITY]);
+                end
+                mismatches = mismatches + 1;
+            end
+            expectHead = expectHead + 1;
+            eventCount = eventCount + 1;
+        end
+        if (mismatches) good = 0;
+    end
+    expectSequence = expectSequence + 1;
+    packetCount = packetCount + 1;
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// Run a test
+task runTest;
+    input [3:0] levels;
+    input integer sampleCount;
+    input integer interval;
+    input backPressure;
+    input stall;
+    input expectSkipped;
+    input expectLost;
+    integer n;
+    begin
+    @(posedge acqClk) acqEnableAcquisition <= 0;
+    writeCSR(0);
+    repeat (4 * PACKET_CAPACITY) @(posedge acqClk) ;
+    levelEnables = levels;
+    randomReady = backPressure;
+    stallReady = stall;
+    checkEvents = !expectLost;
+    packetCount = 0;
+    eventCount = 0;
+    lostPacketCount = 0;
+    skippedPacketCount = 0;
+    skippedCount = 0;
+    expectHead = 0;
+    expectTail = 0;
+    expectSequence = {SECONDS, 32'b0} + 1;
+    writeCSR(32'h80000000 | levels);
+    repeat (10) @(posedge acqClk) ;
+    acqEnableAcquisition <= 1;
+    for (n = 0 ; n < sampleCount ; n = n + 1) begin
+        feedSample(n, interval);
+    end
+    stallReady = 0;
+    while (excursionEvents_i.queueCount != 0) @(posedge acqClk) ;
+    repeat (4 * PACKET_CAPACITY) @(posedge acqClk) ;
+    $display("Levels %b, interval %0d: %0d packets, %0d events, "
+             "%0d of %0d expected, %0d samples skipped",
+                  levels, interval, packetCount, eventCount,
+                  expectHead, expectTail, skippedCount);
+    if ((sysStatus[31] != 1) || (sysStatus[15:8] != LOG2_QUEUE_DEPTH)
+     || (sysStatus[3:0] != levels)) begin
+        $display("Bad status %x", sysStatus);
+        good = 0;
+    end
+    if (expectSkipped) begin
+        if ((skippedCount == 0) || (skippedPacketCount == 0)
+         || !sysStatus[29]) begin
+            $display("Skipped samples not reported -- FAIL");
+            good = 0;
+        end
+    end
+    else if ((skippedCount != 0) || (skippedPacketCount != 0)
+          || sysStatus[29]) begin
+        $display("Unexpected skipped samples -- FAIL");
+        good = 0;
+    end
+    if (expectLost) begin
+        if ((lostPacketCount == 0) || !sysStatus[30]
+         || (eventCount >= expectTail)) begin
+            $display("Lost events not reported -- FAIL");
+            good = 0;
+        end
+    end
+    else if ((lostPacketCount != 0) || sysStatus[30]
+          || (eventCount != expectTail)) begin
+        $display("Unexpected lost events -- FAIL");
+        good = 0;
+    end
+    end
+endtask
+
+// Present a sample, then its bitmaps with about one bit in sixteen changed
+task feedSample;
+    input integer n;
+    input integer interval;
+    begin
+    @(posedge acqClk) begin
+        acqTicks <= n * TICKS_PER_SAMPLE;
+        acqStrobe <= 1;
+    end
+    @(posedge acqClk) begin
+        acqStrobe <= 0;
+        acqTicks <= {32{1'bx}};
+    end
+    repeat (BITMAP_LATENCY - 1) @(posedge acqClk) ;
+    acqLimitExcursions <= acqLimitExcursions ^
+                                    ($random & $random & $random & $random);
+    acqLimitExcursionsTVALID <= 1;
+    @(posedge acqClk) acqLimitExcursionsTVALID <= 0;
+    repeat (interval - BITMAP_LATENCY - 2) @(posedge acqClk) ;
+    end
+endtask
+
+// Write control register
+task writeCSR;
+    input [31:0] value;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= value;
+        sysCsrStrobe <= 1;
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysCsrStrobe <= 0;
+    end
+    end
+endtask
+
+endmodule
+`default_nettype wire
@@ -0,0 +1,457 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Test input coupling and filtering.
+ * Compare every output sample against a bit-exact model of the biquad
+ * cascade and check attenuation of tones whose frequencies (normalized to
+ * the sample rate) are listed below.
+ *   Channel 0 -- Power-up coefficients (AC coupling highpass) driven by a
+ *                full-scale square wave to exercise saturation.
+ *   Channel 1 -- Notch filter.
+ *   Channel 2 -- Two cascaded second order lowpass sections.
+ *   Channel 3 -- DC coupled.
+ */
+`timescale 1ns/1ns
+
+`default_nettype none
+module inputCoupling_tb;
+
+parameter CHANNEL_COUNT     = 4;
+parameter DATA_WIDTH        = 24;
+parameter SECTION_COUNT     = 2;
+parameter COEFFICIENT_WIDTH = 25;
+parameter GUARD_BITS        = 16;
+parameter SAMPLE_INTERVAL   = 80;
+parameter SETTLING_COUNT    = 200;
+parameter MEASURE_COUNT     = 400;
+
+localparam HEADROOM_BITS   = 2;
+localparam STATE_WIDTH     = HEADROOM_BITS + DATA_WIDTH + GUARD_BITS;
+localparam COEFFICIENT_FRACTION = COEFFICIENT_WIDTH - 2;
+localparam EXPECT_CAPACITY = 16;
+localparam real PI         = 3.14159265358979;
+localparam real AMPLITUDE  = 4194304.0;
+localparam integer FULL_SCALE = (1 << (DATA_WIDTH - 1)) - 1;
+localparam integer UNITY   = 1 << COEFFICIENT_FRACTION;
+localparam real NOTCH_FREQUENCY = 0.05;
+localparam real LOWPASS_CUTOFF  = 0.02;
+
+reg         sysClk = 0;
+reg         sysCsrStrobe = 0;
+reg         sysFilterStrobe = 0;
+reg  [31:0] sysGPIO_OUT = {32{1'bx}};
+wire [31:0] sysStatus, sysFilterStatus;
+
+reg                                   clk = 0;
+reg  [(CHANNEL_COUNT*DATA_WIDTH)-1:0] inTDATA = 0;
+reg                                   inTVALID = 0;
+wire [(CHANNEL_COUNT*DATA_WIDTH)-1:0] outTDATA;
+wire                                  outTVALID;
+
+// Instantiate device under test
+inputCoupling #(
+    .CHANNEL_COUNT(CHANNEL_COUNT),
+    .DATA_WIDTH(DATA_WIDTH),
+    .SECTION_COUNT(SECTION_COUNT),
+    .COEFFICIENT_WIDTH(COEFFICIENT_WIDTH),
+    .GUARD_BITS(GUARD_BITS))
+  inputCoupling_i (
+    .sysClk(sysClk),
+    .sysCsrStrobe(sysCsrStrobe),
+    .sysFilterStrobe(sysFilterStrobe),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .sysStatus(sysStatus),
+    .sysFilterStatus(sysFilterStatus),
+    .clk(clk),
+    .inTDATA(inTDATA),
+    .inTVALID(inTVALID),
+    .outTDATA(outTDATA),
+    .outTVALID(outTVALID));
+
+// Generate clocks
+always begin #5 sysClk = !sysClk; end
+always begin #4 clk = !clk; end
+
+// Test tones -- negative value indicates square wave
+real frequency [0:CHANNEL_COUNT-1];
+
+integer good = 1;
+integer c, s, k;
+initial
+begin
+    $dumpfile("inputCoupling_tb.fst");
+    $dumpvars(0, inputCoupling_tb);
+
+    repeat (4) @(posedge sysClk) ;
+    if ((sysFilterStatus[23:16] != SECTION_COUNT)
+     || (sysFilterStatus[15:8] != COEFFICIENT_WIDTH)
+     || (sysFilterStatus[7:0] != GUARD_BITS)) begin
+        $display("Filter status %x -- FAIL", sysFilterStatus);
+        good = 0;
+    end
+
+    // Model power-up coefficients
+    for (c = 0 ; c < CHANNEL_COUNT ; c = c + 1) begin
+        for (s = 0 ; s < SECTION_COUNT ; s = s + 1) begin
+            for (k = 0 ; k < 5 ; k = k + 1) begin
+                modelCoefficients[(((c*SECTION_COUNT)+s)*5)+k] =
+                    (k == 0) ? UNITY :
+                    ((k == 1) && (s == 0)) ? -UNITY :
+                    ((k == 3) && (s == 0)) ? UNITY - (UNITY >> 15) : 0;
+            end
+        end
+    end
+    for (c = 0 ; c < CHANNEL_COUNT * (SECTION_COUNT + 1) * 3 ; c = c + 1) begin
+        modelHistory[c] = 0;
+    end
+
+    designNotch(1, 0, NOTCH_FREQUENCY, 0.95);
+    designLowpass(2, LOWPASS_CUTOFF);
+    writeCoupling(4'b1000);
+
+    //      Ch0   Ch1    Ch2     Ch3
+    runTest(-1.0, 0.05,  0.25,   0.1);
+    runTest(-1.0, 0.005, 0.002, -1.0);
+    checkOverrun;
+
+    #10 ;
+    $display("%s", good ? "PASS" : "FAIL");
+    $finish;
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Golden model
+reg signed [STATE_WIDTH-1:0] modelHistory
+                                  [0:(CHANNEL_COUNT*(SECTION_COUNT+1)*3)-1];
+reg signed [31:0] modelCoefficients [0:(CHANNEL_COUNT*SECTION_COUNT*5)-1];
+reg [CHANNEL_COUNT-1:0] modelCoupling = 0;
+reg [(CHANNEL_COUNT*DATA_WIDTH)-1:0] expected [0:EXPECT_CAPACITY-1];
+integer expectHead = 0, expectTail = 0;
+
+// Shift a value into the history at a point in the cascade
+task modelPush;
+    input integer ch, point;
+    input signed [STATE_WIDTH-1:0] v;
+    integer base;
+    begin
+    base = ((ch * (SECTION_COUNT + 1)) + point) * 3;
+    modelHistory[base+2] = modelHistory[base+1];
+    modelHistory[base+1] = modelHistory[base];
+    modelHistory[base] = v;
+    end
+endtask
+
+task modelSample;
+    input [(CHANNEL_COUNT*DATA_WIDTH)-1:0] x;
+    reg [(CHANNEL_COUNT*DATA_WIDTH)-1:0] v;
+    reg signed [DATA_WIDTH-1:0] xc;
+    reg signed [95:0] accumulator, rounded, stateMax, dataMax;
+    integer ch, sect, base, cBase, k;
+    begin
+    stateMax = (96'sd1 << (STATE_WIDTH - 1)) - 1;
+    dataMax = FULL_SCALE;
+    for (ch = 0 ; ch < CHANNEL_COUNT ; ch = ch + 1) begin
+        xc = x[ch*DATA_WIDTH+:DATA_WIDTH];
+        modelPush(ch, 0, $signed(xc) * (96'sd1 << GUARD_BITS));
+        for (sect = 0 ; sect < SECTION_COUNT ; sect = sect + 1) begin
+            base = ((ch * (SECTION_COUNT + 1)) + sect) * 3;
+            cBase = ((ch * SECTION_COUNT) + sect) * 5;
+            accumulator = 0;
+            for (k = 0 ; k < 3 ; k = k + 1) begin
+                accumulator = accumulator + (modelHistory[base+k] *
+                                             modelCoefficients[cBase+k]);
+            end
+            for (k = 0 ; k < 2 ; k = k + 1) begin
+                accumulator = accumulator + (modelHistory[base+3+k] *
+                                             modelCoefficients[cBase+3+k]);
+            end
+            rounded = (accumulator + (1 << (COEFFICIENT_FRACTION - 1))) >>>
+                                                       COEFFICIENT_FRACTION;
+            if (rounded > stateMax) rounded = stateMax;
+            if (rounded < -stateMax - 1) rounded = -stateMax - 1;
+            modelPush(ch, sect + 1, rounded[STATE_WIDTH-1:0]);
+        end
+        rounded = (rounded + (1 << (GUARD_BITS - 1))) >>> GUARD_BITS;
+        if (rounded > dataMax) rounded = dataMax;
+        if (rounded < -dataMax - 1) rounded = -dataMax - 1;
+        v[ch*DATA_WIDTH+:DATA_WIDTH] = modelCoupling[ch] ? xc :
+                                                   rounded[DATA_WIDTH-1:0];
+    end
+    expected[expectTail % EXPECT_CAPACITY] = v;
+    expectTail = expectTail + 1;
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// Check outputs
+integer outputCount = 0, mismatchCount = 0;
+real sumSquares [0:CHANNEL_COUNT-1];
+integer oc;
+always @(posedge clk) begin
+    if (outTVALID) begin
+        if (expectHead == expectTail) begin
+            if (mismatchCount < 10) $display("Unexpected output");
+            mismatchCount = mismatchCount + 1;
+        end
+        else begin
+            if (outTDATA !== expected[expectHead % EXPECT_CAPACITY]) begin
+                if (mismatchCount < 10) begin
+                    $display("Output %0d got %x want %x", outputCount,
+                            outTDATA, expected[expectHead % EXPECT_CAPACITY]);
+                end
+                mismatchCount = mismatchCount + 1;
+            end
+            expectHead = expectHead + 1;
+        end
+        if ((outputCount >= SETTLING_COUNT)
+         && (outputCount < (SETTLING_COUNT + MEASURE_COUNT))) begin
+            for (oc = 0 ; oc < CHANNEL_COUNT ; oc = oc + 1) begin
+                sumSquares[oc] = sumSquares[oc] +
+                        $itor($signed(outTDATA[oc*DATA_WIDTH+:DATA_WIDTH])) *
+                        $itor($signed(outTDATA[oc*DATA_WIDTH+:DATA_WIDTH]));
+            end
+        end
+        outputCount = outputCount + 1;
+    end
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Run a test with the specified tones
+task runTest;
+    input real f0, f1, f2, f3;
+    integer i, n;
+    real rms, dB, response;
+    reg ok;
+    begin
+    frequency[0] = f0;
+    frequency[1] = f1;
+    frequency[2] = f2;
+    frequency[3] = f3;
+    outputCount = 0;
+    mismatchCount = 0;
+    for (i = 0 ; i < CHANNEL_COUNT ; i = i + 1) sumSquares[i] = 0.0;
+    for (n = 0 ; n < SETTLING_COUNT + MEASURE_COUNT ; n = n + 1) begin
+        feedSample(n);
+    end
+    repeat (SAMPLE_INTERVAL) @(posedge clk) ;
+    $display("%0d outputs, %0d mismatches", outputCount, mismatchCount);
+    if ((outputCount != (SETTLING_COUNT + MEASURE_COUNT))
+     || (mismatchCount != 0)
+     || (expectHead != expectTail)) begin
+        good = 0;
+    end
+    if (sysFilterStatus[31]) begin
+        $display("Overrun -- FAIL");
+        good = 0;
+    end
+    for (i = 1 ; i < CHANNEL_COUNT - 1 ; i = i + 1) begin
+        if (frequency[i] >= 0) begin
+            rms = $sqrt(sumSquares[i] / MEASURE_COUNT);
+            dB = (rms > 0) ? 20.0 * $log10(rms / (AMPLITUDE / $sqrt(2.0))) :
+                             -200.0;
+            response = (i == 1) ?
+                ((frequency[i] == NOTCH_FREQUENCY) ? -1.0 : 1.0) :
+                ((frequency[i] > LOWPASS_CUTOFF) ? -1.0 : 1.0);
+            if (response > 0) begin
+                ok = (dB > -0.1) && (dB < 0.1);
+                $display("  Channel %0d %6.4f passband %8.3f dB -- %s", i,
+                              frequency[i], dB, ok ? "PASS" : "FAIL");
+            end
+            else begin
+                ok = (dB < -60.0);
+                $display("  Channel %0d %6.4f stopband %8.3f dB -- %s", i,
+                              frequency[i], dB, ok ? "PASS" : "FAIL");
+            end
+            if (!ok) good = 0;
+        end
+    end
+    end
+endtask
+
+// Samples arriving before the previous sample has been processed
+// are dropped and flagged.  A coupling write clears the flag.
+task checkOverrun;
+    reg [(CHANNEL_COUNT*DATA_WIDTH)-1:0] x;
+    begin
+    x = {CHANNEL_COUNT{24'h123456}};
+    modelSample(x);
+    @(posedge clk) begin
+        inTDATA <= x;
+        inTVALID <= 1;
+    end
+    @(posedge clk) inTVALID <= 0;
+    repeat (10) @(posedge clk) ;
+    @(posedge clk) begin
+        inTDATA <= ~x;
+        inTVALID <= 1;
+    end
+    @(posedge clk) inTVALID <= 0;
+    repeat (SAMPLE_INTERVAL) @(posedge clk) ;
+    if (!sysFilterStatus[31] || (expectHead != expectTail)) begin
+        $display("Overrun not detected -- FAIL");
+        good = 0;
+    end
+    writeCoupling(modelCoupling);
+    repeat (10) @(posedge clk) ;
+    if (sysFilterStatus[31]) begin
+        $display("Overrun not cleared -- FAIL");
+        good = 0;
+    end
+    end
+endtask
+
+// Present a sample to the device under test and to the model
+task feedSample;
+    input integer n;
+    reg [(CHANNEL_COUNT*DATA_WIDTH)-1:0] x;
+    integer i, v;
+    begin
+    for (i = 0 ; i < CHANNEL_COUNT ; i = i + 1) begin
+        if (frequency[i] < 0) begin
+            v = ((n / 20) % 2) ? -FULL_SCALE - 1 : FULL_SCALE;
+        end
+        else begin
+            v = $rtoi(AMPLITUDE * $cos(2.0 * PI * frequency[i] * n));
+        end
+        x[i*DATA_WIDTH+:DATA_WIDTH] = v;
+    end
+    modelSample(x);
+    @(posedge clk) begin
+        inTDATA <= x;
+        inTVALID <= 1;
+    end
+    @(posedge clk) begin
+        inTDATA <= {CHANNEL_COUNT*DATA_WIDTH{1'bx}};
+        inTVALID <= 0;
+    end
+    repeat (SAMPLE_INTERVAL - 2) @(posedge clk) ;
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// Filter design
+
+// Notch with unity gain at DC
+task designNotch;
+    input integer channel, section;
+    input real f, r;
+    real w, g;
+    begin
+    w = 2.0 * PI * f;
+    g = (1.0 - (2.0 * r * $cos(w)) + (r * r)) / (2.0 - (2.0 * $cos(w)));
+    writeAddress(channel, section, 0);
+    writeSection(channel, section, g, -2.0 * g * $cos(w), g,
+                                   2.0 * r * $cos(w), -(r * r));
+    end
+endtask
+
+// Fourth order lowpass -- two second order Butterworth sections
+task designLowpass;
+    input integer channel;
+    input real f;
+    real w, alpha, a0;
+    integer sect;
+    begin
+    w = 2.0 * PI * f;
+    alpha = $sin(w) / $sqrt(2.0);
+    a0 = 1.0 + alpha;
+    writeAddress(channel, 0, 0);
+    for (sect = 0 ; sect < SECTION_COUNT ; sect = sect + 1) begin
+        writeSection(channel, sect, (1.0 - $cos(w)) / (2.0 * a0),
+                                    (1.0 - $cos(w)) / a0,
+                                    (1.0 - $cos(w)) / (2.0 * a0),
+                                    (2.0 * $cos(w)) / a0,
+                                    -(1.0 - alpha) / a0);
+    end
+    end
+endtask
+
+// Write the five coefficients of a section
+// Relies on the address advancing automatically.
+task writeSection;
+    input integer channel, section;
+    input real b0, b1, b2, na1, na2;
+    integer base;
+    begin
+    base = ((channel * SECTION_COUNT) + section) * 5;
+    writeCoefficient(base + 0, b0);
+    writeCoefficient(base + 1, b1);
+    writeCoefficient(base + 2, b2);
+    writeCoefficient(base + 3, na1);
+    writeCoefficient(base + 4, na2);
+    end
+endtask
+
+task writeCoefficient;
+    input integer modelIndex;
+    input real value;
+    integer q;
+    begin
+    q = $rtoi($floor((value * UNITY) + 0.5));
+    modelCoefficients[modelIndex] = q;
+    writeFilter(q & ((1 << COEFFICIENT_WIDTH) - 1));
+    end
+endtask
+
+task writeAddress;
+    input integer channel, section, index;
+    begin
+    writeFilter(32'h80000000 | (channel << 8) | (section << 4) | index);
+    end
+endtask
+
+task writeFilter;
+    input [31:0] w;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= w;
+        sysFilterStrobe <= 1;
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysFilterStrobe <= 0;
+    end
+    end
+endtask
+
+// Select DC coupled channels
+task writeCoupling;
+    input [CHANNEL_COUNT-1:0] dcCoupled;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= dcCoupled;
+        sysCsrStrobe <= 1;
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysCsrStrobe <= 0;
+    end
+    modelCoupling = dcCoupled;
+    repeat (10) @(posedge clk) ;
+    end
+endtask
+
+endmodule
+`default_nettype wire
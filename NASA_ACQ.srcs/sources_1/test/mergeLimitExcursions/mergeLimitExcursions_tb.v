@@ -40,6 +40,7 @@ reg        M_TLAST = 0;
 reg  [7:0] M_TDATA = {8{1'bx}};
 wire       M_TREADY;
 reg [BITMAPS_WIDTH-1:0] packetLimitExcursions = {BITMAPS_WIDTH{1'bx}};
+reg              [31:0] packetSize = {32{1'bx}};
 wire       S_TVALID;
 wire       S_TLAST;
 wire [7:0] S_TDATA;
@@ -55,6 +56,7 @@ mergeLimitExcursions #(
     .S_TDATA(M_TDATA),
     .S_TREADY(M_TREADY),
     .packetLimitExcursions(packetLimitExcursions),
+    .packetSize(packetSize),
     .M_TVALID(S_TVALID),
     .M_TLAST(S_TLAST),
     .M_TDATA(S_TDATA),
@@ -86,6 +88,7 @@ task sendPacket;
             if (i == 99) begin
                 M_TLAST <= 1;
                 packetLimitExcursions <= 128'hA0_A1_A2_A3_A4_A5_A6_A7_A8_A9_AA_AB_AC_AD_AE_AF;
+                packetSize <= 100 + (BITMAPS_WIDTH / 8) - 8;
             end
         end
     end
@@ -93,52 +96,8 @@ task sendPacket;
         M_TVALID <= 0;
         M_TLAST <= 0;
         packetLimitExcursions <= {BITMAPS_WIDTH{1'bx}};
+        packetSize <= {32{1'bx}};
     end
     end
 endtask
 endmodule
-
-module buildPacketMergeBitmapsFIFO (
-    output wire       wr_rst_busy,
-    output wire       rd_rst_busy,
-    input  wire       s_aclk,
-    input  wire       s_aresetn,
-    input  wire       s_axis_tvalid,
-    output wire       s_axis_tready,
-    input  wire [7:0] s_axis_tdata,
-    input  wire       s_axis_tlast,
-    output wire       m_axis_tvalid,
-    input  wire       m_axis_tready,
-    output wire [7:0] m_axis_tdata,
-    output wire       m_axis_tlast,
-    output wire       axis_overflow);
-
-reg [10:0] head = 0, tail = 0;
-reg  [8:0] dpram [0:2047];
-
-assign axis_overflow = ((head + 1) == tail);
-assign s_axis_tready = !axis_overflow;
-
-assign m_axis_tvalid = (head != tail);
-assign m_axis_tdata = dpram[tail][7:0];
-assign m_axis_tlast = dpram[tail][8];
-
-assign wr_rst_busy = 1'b0;
-assign rd_rst_busy = 1'b0;
-
-always @(posedge s_aclk) begin
-    if (s_aresetn == 0) begin
-        head <= 0;
-        tail <= 0;
-    end
-    else begin
-        if (s_axis_tvalid) begin
-            dpram[head] <= {s_axis_tlast, s_axis_tdata};
-            head <= head + 1;
-        end
-        if (m_axis_tvalid && m_axis_tready) begin
-            tail <= tail + 1;
-        end
-    end
-end
-endmodule
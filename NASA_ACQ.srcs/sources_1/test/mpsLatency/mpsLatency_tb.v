@@ -0,0 +1,336 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Measure MPS trip latency from acquisition strobe to merged fiber character.
+ * A leaf node mpsLocal drives one uplink of an upstream mpsMerge through a
+ * fiber delay.  The acquisition and the two MGT transmit clocks all run at
+ * different rates or phases so each trip sees a different alignment.  The
+ * time at which each stage first shows the trip is noted and the worst case
+ * latencies reported in acquisition clocks.  The latencies recorded by the
+ * hardware instrumentation are checked against those measured here.
+ */
+`timescale 1ns/1ns
+
+`default_nettype none
+module mpsLatency_tb;
+
+parameter MPS_OUTPUT_COUNT = 8;
+parameter MPS_INPUT_COUNT  = 8;
+parameter ADC_COUNT        = 8;
+parameter TIMESTAMP_WIDTH  = 64;
+parameter MGT_COUNT        = 4;
+parameter MGT_DATA_WIDTH   = 16;
+parameter UPLINK           = 2;
+parameter FIBER_DELAY      = 5;
+parameter BITMAP_LATENCY   = 11;
+parameter TRIP_COUNT       = 40;
+
+localparam ACQ_CLK_PERIOD  = 10;
+localparam SYNC_SLACK      = 4;
+
+reg         sysClk = 0;
+reg         sysCsrStrobe = 0;
+reg         sysDataStrobe = 0;
+reg         sysMergeCsrStrobe = 0;
+reg         sysMergeDataStrobe = 0;
+reg  [31:0] sysGPIO_OUT = {32{1'bx}};
+wire [31:0] sysStatus, sysData, sysMergeStatus, sysMergeData;
+
+reg  evrClk = 0;
+reg  evrClearMPSstrobe = 0;
+
+reg                        acqClk = 0;
+reg                        acqStrobe = 0;
+reg                        acqLimitExcursionsTVALID = 0;
+reg  [(4*ADC_COUNT)-1:0]   acqLimitExcursions = 0;
+reg  [TIMESTAMP_WIDTH-1:0] acqTimestamp = 64'h100000000;
+wire                       acqMPStripped;
+
+reg         leafTxClk = 0;
+wire [15:0] mpsTxChars;
+wire        mpsTxCharIsK;
+
+reg                       mgtTxClk = 0;
+reg  [(MGT_COUNT*MGT_DATA_WIDTH)-1:0] mgtRxChars = 0;
+wire [MGT_DATA_WIDTH-1:0] mpfTxChars;
+wire                      mpfTxCharIsK;
+
+// Instantiate devices under test
+mpsLocal #(
+    .MPS_OUTPUT_COUNT(MPS_OUTPUT_COUNT),
+    .MPS_INPUT_COUNT(MPS_INPUT_COUNT),
+    .ADC_COUNT(ADC_COUNT),
+    .TIMESTAMP_WIDTH(TIMESTAMP_WIDTH))
+  mpsLocal_i (
+    .sysClk(sysClk),
+    .sysCsrStrobe(sysCsrStrobe),
+    .sysDataStrobe(sysDataStrobe),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .sysStatus(sysStatus),
+    .sysData(sysData),
+    .sysHistoryCsrStrobe(1'b0),
+    .sysHistoryStatus(),
+    .evrClk(evrClk),
+    .evrClearMPSstrobe(evrClearMPSstrobe),
+    .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
+    .acqLimitExcursions(acqLimitExcursions),
+    .acqLimitExcursionsTVALID(acqLimitExcursionsTVALID),
+    .acqTimestamp(acqTimestamp),
+    .mpsInputStates_a({MPS_INPUT_COUNT{1'b0}}),
+    .acqMPStripped(acqMPStripped),
+    .mgtTxClk(leafTxClk),
+    .mpsTxChars(mpsTxChars),
+    .mpsTxCharIsK(mpsTxCharIsK),
+    .M_TVALID(),
+    .M_TLAST(),
+    .M_TDATA(),
+    .M_TREADY(1'b1));
+
+mpsMerge #(
+    .MGT_COUNT(MGT_COUNT),
+    .MGT_DATA_WIDTH(MGT_DATA_WIDTH),
+    .MPS_OUTPUT_COUNT(MPS_OUTPUT_COUNT))
+  mpsMerge_i (
+    .sysClk(sysClk),
+    .sysCsrStrobe(sysMergeCsrStrobe),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .sysStatus(sysMergeStatus),
+    .sysIsEVG(1'b0),
+    .sysDataStrobe(sysMergeDataStrobe),
+    .sysData(sysMergeData),
+    .acqClk(acqClk),
+    .acqTicks(acqTimestamp[0+:32]),
+    .mgtRxClks({MGT_COUNT{leafTxClk}}),
+    .mgtRxChars(mgtRxChars),
+    .mgtRxCharIsK({MGT_COUNT{1'b0}}),
+    .mgtRxLinkUp({MGT_COUNT{1'b1}}),
+    .mgtTxClk(mgtTxClk),
+    .mpfTxChars(mpfTxChars),
+    .mpfTxCharIsK(mpfTxCharIsK),
+    .mpfTripped());
+
+// Generate clocks
+always begin #5 sysClk = !sysClk; end
+always begin #1 while(1) begin #4 evrClk = !evrClk; end end
+always begin #(ACQ_CLK_PERIOD/2) acqClk = !acqClk; end
+always begin #3 while(1) begin #4 leafTxClk = !leafTxClk; end end
+always begin #2 while(1) begin #4 mgtTxClk = !mgtTxClk; end end
+
+// Acquisition clock counter serves as the time stamp
+always @(posedge acqClk) begin
+    acqTimestamp[0+:32] <= acqTimestamp[0+:32] + 1;
+end
+
+// Fiber between leaf and upstream node
+reg [15:0] fiber [0:FIBER_DELAY-1];
+integer f;
+initial for (f = 0 ; f < FIBER_DELAY ; f = f + 1) fiber[f] = 0;
+always @(posedge leafTxClk) begin
+    fiber[0] <= mpsTxChars;
+    for (f = 1 ; f < FIBER_DELAY ; f = f + 1) fiber[f] <= fiber[f-1];
+    mgtRxChars[UPLINK*MGT_DATA_WIDTH+:MGT_DATA_WIDTH] <= fiber[FIBER_DELAY-1];
+end
+
+// Note the time at which each stage first shows the trip
+wire leafTxTripped = mpsTxChars[8];
+wire mergeRxTripped =
+             mgtRxChars[(UPLINK*MGT_DATA_WIDTH)+8];
+wire mergeTxTripped = mpfTxChars[8];
+time whenStrobe, whenTrip, whenLeafTx, whenMergeRx, whenMergeTx;
+always @(posedge acqMPStripped)  whenTrip    = $time;
+always @(posedge leafTxTripped)  whenLeafTx  = $time;
+always @(posedge mergeRxTripped) whenMergeRx = $time;
+always @(posedge mergeTxTripped) whenMergeTx = $time;
+
+// Latency, in acquisition clocks rounded up, from the acquisition strobe
+function integer clocks;
+    input [63:0] when;
+    begin
+    clocks = (when - whenStrobe + ACQ_CLK_PERIOD - 1) / ACQ_CLK_PERIOD;
+    end
+endfunction
+
+integer trip, good = 1;
+integer worstTrip = 0, worstLeafTx = 0, worstMergeRx = 0, worstMergeTx = 0;
+integer tripLatency, leafTxLatency, mergeRxLatency, mergeTxLatency;
+reg [31:0] v, sampleTicks;
+initial
+begin
+    $dumpfile("mpsLatency_tb.fst");
+    $dumpvars(0, mpsLatency_tb);
+
+    // HIHI on first channel trips first output
+    writeLocal(0, 0, 32'h1);
+    writeMerge(1 << UPLINK);
+    #200 ;
+
+    for (trip = 0 ; trip < TRIP_COUNT ; trip = trip + 1) begin
+        #($random & 7) ;
+        sample(1);
+        wait (mergeTxTripped) ;
+        #200 ;
+        tripLatency = clocks(whenTrip);
+        leafTxLatency = clocks(whenLeafTx);
+        mergeRxLatency = clocks(whenMergeRx);
+        mergeTxLatency = clocks(whenMergeTx);
+        if (tripLatency > worstTrip) worstTrip = tripLatency;
+        if (leafTxLatency > worstLeafTx) worstLeafTx = leafTxLatency;
+        if (mergeRxLatency > worstMergeRx) worstMergeRx = mergeRxLatency;
+        if (mergeTxLatency > worstMergeTx) worstMergeTx = mergeTxLatency;
+
+        // Compare with hardware instrumentation
+        readLocal(14, v);
+        if (v[15:0] != tripLatency) begin
+            $display("Trip %0d: trip latency %0d, expect %0d", trip,
+                                                      v[15:0], tripLatency);
+            good = 0;
+        end
+        if ((v[31:16] < leafTxLatency)
+         || (v[31:16] > (leafTxLatency + SYNC_SLACK))) begin
+            $display("Trip %0d: TX latency %0d, expect %0d", trip,
+                                                     v[31:16], leafTxLatency);
+            good = 0;
+        end
+        readLocal(15, sampleTicks);
+        readMerge(0, v);
+        checkMerge("RX", v - sampleTicks, mergeRxLatency);
+        readMerge(1, v);
+        checkMerge("TX", v - sampleTicks, mergeTxLatency);
+
+        // Remove fault and clear trip
+        sample(0);
+        #200 ;
+        clearTrip();
+        wait (!mergeTxTripped) ;
+        #200 ;
+    end
+    $display("Worst case latency from acquisition strobe, in acquisition clocks:");
+    $display("    Trip asserted:     %0d", worstTrip);
+    $display("    Leaf TX character: %0d", worstLeafTx);
+    $display("    Merge RX:          %0d", worstMergeRx);
+    $display("    Merged TX:         %0d", worstMergeTx);
+    $display("%s", good ? "PASS" : "FAIL");
+    $finish;
+end
+
+task checkMerge;
+    input [8*2-1:0] name;
+    input [31:0] recorded;
+    input integer measured;
+    begin
+    if ((recorded < measured) || (recorded > (measured + SYNC_SLACK))) begin
+        $display("Trip %0d: merge %s latency %0d, expect %0d", trip, name,
+                                                         recorded, measured);
+        good = 0;
+    end
+    end
+endtask
+
+// Acquisition strobe followed by limit excursions
+task sample;
+    input hihi;
+    begin
+    @(posedge acqClk) acqStrobe <= 1;
+    @(posedge acqClk) begin
+        acqStrobe <= 0;
+        whenStrobe = $time;
+    end
+    repeat (BITMAP_LATENCY - 1) @(posedge acqClk) ;
+    acqLimitExcursions <= hihi;
+    acqLimitExcursionsTVALID <= 1;
+    @(posedge acqClk) acqLimitExcursionsTVALID <= 0;
+    end
+endtask
+
+// Clear trip
+task clearTrip;
+    begin
+    @(posedge evrClk) evrClearMPSstrobe <= 1;
+    @(posedge evrClk) evrClearMPSstrobe <= 0;
+    end
+endtask
+
+//
+// System clock domain register access
+//
+task writeGPIO;
+    input integer sel;
+    input [31:0] w;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= w;
+        sysCsrStrobe <= (sel == 0);
+        sysDataStrobe <= (sel == 1);
+        sysMergeCsrStrobe <= (sel == 2);
+        sysMergeDataStrobe <= (sel == 3);
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysCsrStrobe <= 0;
+        sysDataStrobe <= 0;
+        sysMergeCsrStrobe <= 0;
+        sysMergeDataStrobe <= 0;
+    end
+    repeat (4) @(posedge sysClk) ;
+    end
+endtask
+
+task writeLocal;
+    input [7:0] m;
+    input [7:0] r;
+    input [31:0] w;
+    begin
+    writeGPIO(0, (r << 8) | m);
+    writeGPIO(1, w);
+    end
+endtask
+
+task readLocal;
+    input  [7:0] r;
+    output [31:0] v;
+    begin
+    writeGPIO(0, r << 8);
+    v = sysData;
+    end
+endtask
+
+task writeMerge;
+    input [31:0] w;
+    begin
+    writeGPIO(2, w);
+    end
+endtask
+
+task readMerge;
+    input  [31:0] sel;
+    output [31:0] v;
+    begin
+    writeGPIO(3, sel);
+    v = sysMergeData;
+    end
+endtask
+
+endmodule
@@ -23,7 +23,11 @@
  */
 
 /*
- * Test MPS merge operation
+ * Test local MPS operation
+ * Check that trip state reaches the MGT characters within the expected
+ * number of MGT transmit clocks and, with LOW_LATENCY set, that the
+ * non-comma characters carry a valid CRC.  Finish by checking the trip
+ * history packets against the trips and clears of the test sequence.
  */
 `timescale 1ns/1ns
 
@@ -34,6 +38,9 @@ parameter MPS_OUTPUT_COUNT = 8;
 parameter MPS_INPUT_COUNT  = 8;
 parameter ADC_COUNT        = 32;
 parameter TIMESTAMP_WIDTH  = 64;
+parameter LOW_LATENCY      = 0;
+
+localparam MAX_LATENCY = 3;
 
 reg          sysClk = 0;
 reg          sysCsrStrobe = 0;
@@ -41,11 +48,14 @@ reg          sysDataStrobe = 0;
 reg  [31:0] sysGPIO_OUT = {32{1'bx}};
 wire [31:0] sysStatus;
 wire [31:0] sysData;
+reg          sysHistoryCsrStrobe = 0;
+wire [31:0] sysHistoryStatus;
 
 reg  evrClk = 0;
 reg  evrClearMPSstrobe = 0;
 
 reg                        acqClk = 0;
+reg                        acqStrobe = 0;
 reg                        acqLimitExcursionsTVALID = 0;
 reg  [TIMESTAMP_WIDTH-1:0] acqTimestamp = 64'h300000000;
 reg  [MPS_INPUT_COUNT-1:0] mpsInputs = 0;
@@ -54,7 +64,12 @@ reg  [(4*ADC_COUNT)-1:0] acqLimitExcursions = {4*ADC_COUNT{1'bx}};
 reg         mgtTxClk = 0;
 wire [15:0] mpsTxChars;
 wire        mpsTxCharIsK;
-wire [MPS_OUTPUT_COUNT-1:0] mpsTripped = mpsTxChars[8+:MPS_OUTPUT_COUNT];
+// Trip state sent in MGT characters -- comma characters in
+// low-latency framing carry a source ID instead.
+reg  [MPS_OUTPUT_COUNT-1:0] mpsTripped = 0;
+
+wire       M_TVALID, M_TLAST;
+wire [7:0] M_TDATA;
 
 // Instantiate device under test
 mpsLocal #(
@@ -69,16 +84,23 @@ mpsLocal #(
     .sysGPIO_OUT(sysGPIO_OUT),
     .sysStatus(sysStatus),
     .sysData(sysData),
+    .sysHistoryCsrStrobe(sysHistoryCsrStrobe),
+    .sysHistoryStatus(sysHistoryStatus),
     .evrClk(evrClk),
     .evrClearMPSstrobe(evrClearMPSstrobe),
     .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
     .acqLimitExcursions(acqLimitExcursions),
     .acqLimitExcursionsTVALID(acqLimitExcursionsTVALID),
     .acqTimestamp(acqTimestamp),
     .mpsInputStates_a(mpsInputs),
     .mgtTxClk(mgtTxClk),
     .mpsTxChars(mpsTxChars),
-    .mpsTxCharIsK(mpsTxCharIsK));
+    .mpsTxCharIsK(mpsTxCharIsK),
+    .M_TVALID(M_TVALID),
+    .M_TLAST(M_TLAST),
+    .M_TDATA(M_TDATA),
+    .M_TREADY(1'b1));
 
 // Generate clocks
 always begin #5 sysClk = !sysClk; end
@@ -102,6 +124,42 @@ localparam R_FIRST_FAULT_SECONDS  = 8'h0B;
 localparam R_FIRST_FAULT_TICKS    = 8'h0C;
 localparam R_STATUS               = 8'h0D;
 
+// Check latency through to MGT characters and character framing
+integer good = 1;
+integer latency = 0, worstLatency = 0;
+always @(posedge mgtTxClk) begin
+    if (!mpsTxCharIsK || !LOW_LATENCY) begin
+        mpsTripped = mpsTxChars[8+:MPS_OUTPUT_COUNT];
+    end
+    else if (mpsTxChars[8+:8] != 8'h00) begin
+        $display("Bad source ID %x at %d", mpsTxChars, $time);
+        good = 0;
+    end
+    if (mpsTripped != mpsLocal_i.acqPerChannelTripped) begin
+        latency = latency + 1;
+        if (latency > worstLatency) worstLatency = latency;
+    end
+    else begin
+        latency = 0;
+    end
+    if (!mpsTxCharIsK && (mpsTxChars[0+:8] !=
+                             (LOW_LATENCY ? crc8(mpsTxChars[8+:8]) : 8'h00))) begin
+        $display("Bad character %x at %d", mpsTxChars, $time);
+        good = 0;
+    end
+end
+
+function [7:0] crc8;
+    input [7:0] d;
+    integer b;
+    begin
+    crc8 = d;
+    for (b = 0 ; b < 8 ; b = b + 1) begin
+        crc8 = crc8[7] ? ((crc8 << 1) ^ 8'h07) : (crc8 << 1);
+    end
+    end
+endfunction
+
 // Keep track of 'time of day'
 always @(posedge acqClk) begin
     if (acqTimestamp[0+:32] == 999) begin
@@ -116,7 +174,10 @@ end
 
 
 integer channel;
-integer good = 1;
+reg [31:0] faultSeconds [0:MPS_OUTPUT_COUNT-1];
+reg [31:0] faultTicks [0:MPS_OUTPUT_COUNT-1];
+reg [7:0] rxBuf [0:511];
+integer rxCount = 0, historyPacketCount = 0;
 initial
 begin
     $dumpfile("mpsLocal_tb.fst");
@@ -157,6 +218,8 @@ begin
         adc(~32'h80000000, ~32'hFFFFFFFF, ~32'h00001000, ~32'h00000400);
         mpsInputs = 0;
         checkTrip(1 << channel);
+        readReg(channel, R_FIRST_FAULT_SECONDS, faultSeconds[channel]);
+        readReg(channel, R_FIRST_FAULT_TICKS, faultTicks[channel]);
 
         // Mark all inputs 'uninteresting'
         writeReg(channel,     R_LOLO_BITMAP, 32'h0);
@@ -172,10 +235,86 @@ begin
         adc(0, 0, 0, 0);
         mpsInputs = 0;
     end
+
+    // Each output has seen trip, re-latch, clear, trip and clear events.
+    // The stretched clear event is acted on at both of its edges so the
+    // re-latch appears twice.
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= 32'h80000000;
+        sysHistoryCsrStrobe <= 1;
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysHistoryCsrStrobe <= 0;
+    end
+    #100;
+    while (sysHistoryStatus[31]) #1000;
+    if (historyPacketCount != MPS_OUTPUT_COUNT) begin
+        $display("Got %0d history packets -- FAIL", historyPacketCount);
+        good = 0;
+    end
+    $display("Worst case latency %0d MGT clocks, limit %0d",
+                                                   worstLatency, MAX_LATENCY);
+    if (worstLatency > MAX_LATENCY) good = 0;
     $display("%s", good ? "PASS" : "FAIL");
     $finish;
 end
 
+// Receive and check trip history packets
+always @(posedge acqClk) begin
+    if (M_TVALID) begin
+        if (rxCount < 512) rxBuf[rxCount] = M_TDATA;
+        rxCount = rxCount + 1;
+        if (M_TLAST) begin
+            checkHistory;
+            rxCount = 0;
+        end
+    end
+end
+
+function [31:0] rx32;
+    input integer i;
+    begin
+    rx32 = { rxBuf[i+0], rxBuf[i+1], rxBuf[i+2], rxBuf[i+3] };
+    end
+endfunction
+
+task checkHistory;
+    integer e, base, ok;
+    reg [31:0] status, flags;
+    begin
+    ok = 1;
+    status = rx32(8);
+    if ((rxCount != 32 + (6 * 28)) || (rx32(0) != "PSNB")
+     || (rx32(4) != rxCount - 8) || (status[31:24] != 5)
+     || (status[15:8] != historyPacketCount) || (status[0] != 0)
+     || (rx32(12) != 6)) begin
+        ok = 0;
+    end
+    else begin
+        for (e = 0 ; e < 6 ; e = e + 1) begin
+            base = 32 + (e * 28);
+            flags = rx32(base + 8);
+            case (e)
+            0: if ((flags != 32'hC0000000) || (rx32(base+24) != 32'h80000000))
+                                                                     ok = 0;
+            1, 2: if ((flags != 32'hC0000000)
+                   || (rx32(base+20) != 32'hFFFFFFFF)) ok = 0;
+            4: if ((flags != 32'hC0000010)
+                || (rx32(base) != faultSeconds[historyPacketCount])
+                || (rx32(base+4) != faultTicks[historyPacketCount] * 8))
+                                                                     ok = 0;
+            default: if (flags != 0) ok = 0;
+            endcase
+        end
+    end
+    $display("History %0d: %0d bytes, %0d entries -- %s", historyPacketCount,
+                                     rxCount, rx32(12), ok ? "PASS" : "FAIL");
+    if (!ok) good = 0;
+    historyPacketCount = historyPacketCount + 1;
+    end
+endtask
+
 // Write to register
 task writeReg;
     input [31:0] m;
@@ -214,7 +353,7 @@ task selectReg;
     input [31:0] m;
     input [31:0] r;
     begin
-    writeCSR((r << 8) | m);
+    writeCSR((LOW_LATENCY << 31) | (r << 8) | m);
     #40;
     end
 endtask
@@ -24,6 +24,13 @@
 
 /*
  * Test MPS merge operation
+ * Check that a change in the received characters reaches the transmitted
+ * MGT characters within the expected number of MGT clocks for the framing
+ * and the depth of the merge tree, that the low-latency limit is below
+ * the standard one, and check first-fault and per-link counts.  With LOW_LATENCY set also
+ * check the CRC of transmitted characters, that received characters
+ * with a bad CRC are ignored, or treated as a link down when persistent,
+ * and that first-fault source IDs are passed upstream.
  */
 `timescale 1ns/1ns
 
@@ -33,34 +40,48 @@ module mpsMerge_tb;
 parameter MGT_COUNT        = 8;
 parameter MGT_DATA_WIDTH   = 16;
 parameter MPS_OUTPUT_COUNT = 8;
+parameter MERGE_FANIN      = 8;
+parameter LOW_LATENCY      = 0;
 
 reg          sysClk = 0;
 reg          sysCsrStrobe = 0;
+reg          sysDataStrobe = 0;
 reg  [31:0] sysGPIO_OUT = {32{1'bx}};
-wire [31:0] sysStatus;
+wire [31:0] sysStatus, sysData;
 
 reg  [(MGT_COUNT*MGT_DATA_WIDTH)-1:0] mgtRxChars = 0;
+reg                   [MGT_COUNT-1:0] mgtRxCharIsK = 0;
 reg                   [MGT_COUNT-1:0] mgtRxLinkUp = 0;
 
 reg                       mgtTxClk = 0;
 wire [MGT_DATA_WIDTH-1:0] mpfTxChars;
 wire                      mpfTxCharIsK;
+wire [MPS_OUTPUT_COUNT-1:0] mpfTripped;
 
 // Instantiate device under test
 mpsMerge #(
     .MGT_COUNT(MGT_COUNT),
     .MGT_DATA_WIDTH(MGT_DATA_WIDTH),
-    .MPS_OUTPUT_COUNT(MPS_OUTPUT_COUNT))
+    .MPS_OUTPUT_COUNT(MPS_OUTPUT_COUNT),
+    .MERGE_FANIN(MERGE_FANIN))
   mpsMerge_i (
     .sysClk(sysClk),
     .sysCsrStrobe(sysCsrStrobe),
     .sysGPIO_OUT(sysGPIO_OUT),
     .sysStatus(sysStatus),
+    .sysIsEVG(1'b1),
+    .sysDataStrobe(sysDataStrobe),
+    .sysData(sysData),
+    .acqClk(sysClk),
+    .acqTicks(32'b0),
+    .mgtRxClks({MGT_COUNT{mgtTxClk}}),
     .mgtRxChars(mgtRxChars),
+    .mgtRxCharIsK(mgtRxCharIsK),
     .mgtRxLinkUp(mgtRxLinkUp),
     .mgtTxClk(mgtTxClk),
     .mpfTxChars(mpfTxChars),
-    .mpfTxCharIsK(mpfTxCharIsK));
+    .mpfTxCharIsK(mpfTxCharIsK),
+    .mpfTripped(mpfTripped));
 
 // Generate clocks
 always begin #5 sysClk = !sysClk; end
@@ -68,10 +89,62 @@ always begin #4 mgtTxClk = !mgtTxClk; end
 
 integer i;
 integer good = 1;
+integer maxLatency, standardLatency, lowLatency;
+reg [31:0] v, faultCount, downCount;
+
+// Note when received characters and sent trip state change
+// and check character framing.
+// Comma characters in low-latency framing carry a source ID instead.
+integer clocks = 0, rxChangeClock = 0, txChangeClock = 0, worstLatency = 0;
+reg rxChanged = 0, measuring = 1;
+reg [(MGT_COUNT*MGT_DATA_WIDTH)-1:0] rxCharsSeen = 0;
+reg [MPS_OUTPUT_COUNT-1:0] txTripped = 0;
+always @(posedge mgtTxClk) begin
+    clocks = clocks + 1;
+    if (mgtRxChars != rxCharsSeen) begin
+        rxCharsSeen = mgtRxChars;
+        rxChangeClock = clocks;
+        rxChanged = 1;
+    end
+    if (!mpfTxCharIsK || !LOW_LATENCY) begin
+        if (mpfTxChars[8+:MPS_OUTPUT_COUNT] != txTripped) begin
+            txTripped = mpfTxChars[8+:MPS_OUTPUT_COUNT];
+            txChangeClock = clocks;
+        end
+        if (txTripped != mpfTripped) begin
+            $display("Sent %x, expect %x at %d", txTripped, mpfTripped, $time);
+            good = 0;
+        end
+    end
+    if (!mpfTxCharIsK && (mpfTxChars[0+:8] !=
+                             (LOW_LATENCY ? crc8(mpfTxChars[8+:8]) : 8'h00))) begin
+        $display("Bad character %x at %d", mpfTxChars, $time);
+        good = 0;
+    end
+end
+
+function [7:0] crc8;
+    input [7:0] d;
+    integer b;
+    begin
+    crc8 = d;
+    for (b = 0 ; b < 8 ; b = b + 1) begin
+        crc8 = crc8[7] ? ((crc8 << 1) ^ 8'h07) : (crc8 << 1);
+    end
+    end
+endfunction
+
 initial
 begin
     $dumpfile("mpsMerge_tb.fst");
     $dumpvars(0, mpsMerge_tb);
+    lowLatency = 3 + mpsMerge_i.TREE_LEVELS - 1;
+    standardLatency = 4 + mpsMerge_i.TREE_LEVELS - 1;
+    maxLatency = LOW_LATENCY ? lowLatency : standardLatency;
+    if (lowLatency >= standardLatency) begin
+        $display("Low-latency limit not below standard limit -- FAIL");
+        good = 0;
+    end
 
     // All uplinks important, all uplinks active, no faults
     mgtRxLinkUp = {MGT_COUNT{1'b1}};
@@ -107,7 +180,84 @@ begin
     writeCSR(8'h7E);
     check(8'h22);
 
+    // First fault and per-link counts
+    writeCSR(8'hFE);
+    for (i = 0 ; i < MGT_COUNT ; i = i + 1) setRx(i, 8'h00);
+    check(8'h00);
+    readData(3, 3, faultCount);
+    readData(3, 6, downCount);
+    setRx(3, 8'h04);
+    check(8'h04);
+    setRx(5, 8'h08);
+    check(8'h0C);
+    readData(2, 0, v);
+    expectData("First fault", v, {8'h00, 8'h04});
+    readData(3, 3, v);
+    expectData("Fault count", v, faultCount + 1);
+    setRx(3, 8'h00);
+    setRx(5, 8'h00);
+    check(8'h00);
+    mgtRxLinkUp[6] = 0;
+    check(8'hFF);
+    mgtRxLinkUp[6] = 1;
+    check(8'h00);
+    readData(3, 6, v);
+    expectData("Link down count", v, downCount + (1 << 16) + 1);
+    readData(2, 0, v);
+    expectData("First fault", v, {8'h00, 8'h07});
+
+    // Importance of a single link
+    writeData((1 << 31) | (0 << 30) | (4 << 8));
+    setRx(4, 8'h10);
+    check(8'h00);
+    writeData((1 << 31) | (1 << 30) | (4 << 8));
+    check(8'h10);
+    setRx(4, 8'h00);
+    check(8'h00);
+
+    if (LOW_LATENCY) begin
+        // Source ID from a downstream merge node
+        sendSource(4, 8'h03);
+        setRx(4, 8'h01);
+        check(8'h01);
+        readData(2, 0, v);
+        expectData("First fault source", v, {8'h03, 8'h05});
+        @(posedge mgtTxClk) ;
+        while (!mpfTxCharIsK) @(posedge mgtTxClk) ;
+        expectData("Upstream source", mpfTxChars[8+:8], 8'h05);
+        setRx(4, 8'h00);
+        check(8'h00);
+
+        // A single bad character is ignored
+        // Bad characters are deliberately slow, so don't measure them.
+        measuring = 0;
+        writeCSR(8'hFE);
+        for (i = 0 ; i < MGT_COUNT ; i = i + 1) setRx(i, 8'h00);
+        setRx(2, 8'h20);
+        check(8'h20);
+        @(posedge mgtTxClk) #1 mgtRxChars[(2*MGT_DATA_WIDTH)+:16] = 16'h0055;
+        @(posedge mgtTxClk) #1 setRx(2, 8'h20);
+        for (i = 0 ; i < 4 ; i = i + 1) begin
+            @(posedge mgtTxClk) ;
+            if (mpfTripped != 8'h20) begin
+                $display("Bad character not ignored -- FAIL");
+                good = 0;
+            end
+        end
+
+        // Persistent bad characters look like a link down
+        mgtRxChars[(2*MGT_DATA_WIDTH)+:16] = 16'h0055;
+        #40 ;
+        check(8'hFF);
+        setRx(2, 8'h00);
+        check(8'h00);
+    end
+
     #10 ;
+    $display("Worst case latency %0d MGT clocks, limit %0d (%0s framing)",
+                    worstLatency, maxLatency, LOW_LATENCY ? "low-latency" :
+                                                            "standard");
+    if (worstLatency > maxLatency) good = 0;
     $display("%s", good ? "PASS" : "FAIL");
     $finish;
 end
@@ -117,7 +267,7 @@ task writeCSR;
     input [31:0] w;
     begin
     @(posedge sysClk) begin
-        sysGPIO_OUT <= w;
+        sysGPIO_OUT <= (LOW_LATENCY << 31) | w;
         sysCsrStrobe <= 1;
     end
     @(posedge sysClk) begin
@@ -128,26 +278,97 @@ task writeCSR;
     end
 endtask
 
+// Write value to data register
+task writeData;
+    input [31:0] w;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= w;
+        sysDataStrobe <= 1;
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysDataStrobe <= 0;
+    end
+    @(posedge sysClk) ;
+    end
+endtask
+
+// Read from data register
+task readData;
+    input  [1:0] r;
+    input  [7:0] link;
+    output [31:0] v;
+    begin
+    writeData((link << 8) | r);
+    @(posedge sysClk) ;
+    v = sysData;
+    end
+endtask
+
+task expectData;
+    input [8*20-1:0] name;
+    input     [31:0] v;
+    input     [31:0] expected;
+    begin
+    $write("%0s: got %x want %x -- ", name, v, expected);
+    if (v == expected) begin
+        $display("PASS");
+    end
+    else begin
+        $display("FAIL");
+        good = 0;
+    end
+    end
+endtask
+
+// Send a comma character carrying a source ID
+task sendSource;
+    input integer i;
+    input [7:0] id;
+    reg  [15:0] c;
+    begin
+    c = mgtRxChars[(i*MGT_DATA_WIDTH)+:16];
+    @(posedge mgtTxClk) #1 begin
+        mgtRxChars[(i*MGT_DATA_WIDTH)+:16] = {id, 8'hBC};
+        mgtRxCharIsK[i] = 1;
+    end
+    @(posedge mgtTxClk) #1 begin
+        mgtRxChars[(i*MGT_DATA_WIDTH)+:16] = c;
+        mgtRxCharIsK[i] = 0;
+    end
+    end
+endtask
+
 // Set receiver distributed bus value
 task setRx;
     input integer i;
     input [7:0] c;
     begin
     mgtRxChars[((i*MGT_DATA_WIDTH)+8)+:8] = c;
+    mgtRxChars[((i*MGT_DATA_WIDTH)+0)+:8] = LOW_LATENCY ? crc8(c) : 8'h00;
     end
 endtask
 
 // Check for desired result
+// Measure latency from the received characters changing to the
+// transmitted characters changing, if both happened.
 task check;
     input [MPS_OUTPUT_COUNT-1:0] expect;
     reg [MPS_OUTPUT_COUNT-1:0] important;
     begin
-    #40;
+    #80;
+    if (measuring && rxChanged && (txChangeClock >= rxChangeClock)) begin
+        if ((txChangeClock - rxChangeClock) > worstLatency) begin
+            worstLatency = txChangeClock - rxChangeClock;
+        end
+    end
+    rxChanged = 0;
     important = sysStatus;
     $write("Use:%x Links:%x Rx:%x got:%x want:%x -- ",
                                        important, mgtRxLinkUp, mgtRxChars,
-                                       mpfTxChars[8+:MPS_OUTPUT_COUNT], expect);
-    if (mpfTxChars[8+:MPS_OUTPUT_COUNT] == expect) begin
+                                       mpfTripped, expect);
+    if (mpfTripped == expect) begin
         $display("PASS");
     end
     else begin
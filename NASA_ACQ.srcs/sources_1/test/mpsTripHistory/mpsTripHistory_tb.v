@@ -0,0 +1,323 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Test MPS trip history.
+ * Feed random events to random outputs, more than the history holds on
+ * some, and check every entry of every packet against a model with random
+ * back-pressure.  Then check that clearing empties the history and that
+ * events arriving for an output whose history is being sent are held off
+ * or, when one is already held off, lost and flagged.
+ */
+`timescale 1ns/1ns
+
+`default_nettype none
+module mpsTripHistory_tb;
+
+parameter MPS_OUTPUT_COUNT   = 4;
+parameter MPS_INPUT_COUNT    = 4;
+parameter ADC_COUNT          = 8;
+parameter LOG2_HISTORY_DEPTH = 3;
+parameter PACKET_GAP         = 20;
+parameter SECONDS            = 1234;
+
+localparam HISTORY_DEPTH = 1 << LOG2_HISTORY_DEPTH;
+localparam RECORD_WIDTH = 2 + MPS_INPUT_COUNT + (4 * ADC_COUNT);
+localparam PACKET_CAPACITY = 32 + (HISTORY_DEPTH * 28);
+localparam EXPECT_CAPACITY = 256;
+
+reg         sysClk = 0;
+reg         sysCsrStrobe = 0;
+reg  [31:0] sysGPIO_OUT = {32{1'bx}};
+wire [31:0] sysStatus;
+
+reg                                        acqClk = 0;
+reg                                 [31:0] acqTicks = 0;
+reg                 [MPS_OUTPUT_COUNT-1:0] acqEventStrobes = 0;
+reg  [(MPS_OUTPUT_COUNT*RECORD_WIDTH)-1:0] acqEventRecords = 0;
+wire                                       M_TVALID, M_TLAST;
+wire                                 [7:0] M_TDATA;
+reg                                        M_TREADY = 1;
+
+// Instantiate device under test
+mpsTripHistory #(
+    .MPS_OUTPUT_COUNT(MPS_OUTPUT_COUNT),
+    .MPS_INPUT_COUNT(MPS_INPUT_COUNT),
+    .ADC_COUNT(ADC_COUNT),
+    .LOG2_HISTORY_DEPTH(LOG2_HISTORY_DEPTH),
+    .PACKET_GAP(PACKET_GAP))
+  mpsTripHistory_i (
+    .sysClk(sysClk),
+    .sysCsrStrobe(sysCsrStrobe),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .sysStatus(sysStatus),
+    .acqClk(acqClk),
+    .acqSeconds(SECONDS),
+    .acqTicks(acqTicks),
+    .acqEventStrobes(acqEventStrobes),
+    .acqEventRecords(acqEventRecords),
+    .M_TVALID(M_TVALID),
+    .M_TLAST(M_TLAST),
+    .M_TDATA(M_TDATA),
+    .M_TREADY(M_TREADY));
+
+// Generate clocks
+always begin #5 sysClk = !sysClk; end
+always begin #4 acqClk = !acqClk; end
+
+always @(posedge acqClk) acqTicks <= acqTicks + 1;
+
+integer good = 1;
+integer c, n;
+reg randomReady = 0, stallReady = 0, checkEntries = 1;
+
+///////////////////////////////////////////////////////////////////////////////
+// Model
+// Every event presented is expected unless the test says otherwise.
+// The time stamp is that of the clock on which the output recorded the
+// event, i.e. the clock before the strobe is seen.
+reg [RECORD_WIDTH-1:0] expectRecord [0:(MPS_OUTPUT_COUNT*EXPECT_CAPACITY)-1];
+reg             [31:0] expectTicks  [0:(MPS_OUTPUT_COUNT*EXPECT_CAPACITY)-1];
+integer expectCount [0:MPS_OUTPUT_COUNT-1];
+reg ignoreOutput0 = 0;
+
+always @(posedge acqClk) begin: model
+    integer m;
+    for (m = 0 ; m < MPS_OUTPUT_COUNT ; m = m + 1) begin
+        if (acqEventStrobes[m] && !(ignoreOutput0 && (m == 0))) begin
+            expectRecord[(m*EXPECT_CAPACITY)+expectCount[m]] =
+                                acqEventRecords[m*RECORD_WIDTH+:RECORD_WIDTH];
+            expectTicks[(m*EXPECT_CAPACITY)+expectCount[m]] =
+                                                mpsTripHistory_i.eventTicks;
+            expectCount[m] = expectCount[m] + 1;
+        end
+    end
+end
+
+initial
+begin
+    $dumpfile("mpsTripHistory_tb.fst");
+    $dumpvars(0, mpsTripHistory_tb);
+    for (c = 0 ; c < MPS_OUTPUT_COUNT ; c = c + 1) expectCount[c] = 0;
+    writeCSR(32'h40000000);
+    repeat (10) @(posedge acqClk) ;
+
+    // Random events, wrapping the history of some outputs
+    for (n = 0 ; n < 60 ; n = n + 1) begin
+        randomEvents(($random & ((1 << MPS_OUTPUT_COUNT) - 1)) |
+                                                     ((n < 20) ? 1 : 0));
+        repeat (($random & 7) + MPS_OUTPUT_COUNT) @(posedge acqClk) ;
+    end
+    randomReady = 1;
+    sendHistory(0);
+    randomReady = 0;
+
+    // Clear
+    writeCSR(32'h40000000);
+    for (c = 0 ; c < MPS_OUTPUT_COUNT ; c = c + 1) expectCount[c] = 0;
+    repeat (10) @(posedge acqClk) ;
+    sendHistory(0);
+
+    // Events for output 0 arrive while its history is being sent,
+    // the first is held off, the second is lost.
+    checkEntries = 0;
+    stallReady = 1;
+    writeCSR(32'h80000000);
+    while (!M_TVALID) @(posedge acqClk) ;
+    randomEvents(1);
+    ignoreOutput0 = 1;
+    repeat (4) @(posedge acqClk) ;
+    randomEvents(1);
+    repeat (4) @(posedge acqClk) ;
+    ignoreOutput0 = 0;
+    stallReady = 0;
+    while (sysStatus[31]) @(posedge sysClk) ;
+    repeat (4) @(posedge sysClk) ;
+    if (!sysStatus[30]) begin
+        $display("Lost event not reported -- FAIL");
+        good = 0;
+    end
+    checkEntries = 1;
+    sendHistory(1);
+
+    #10 ;
+    $display("%0d packets", packetCount);
+    $display("%s", good ? "PASS" : "FAIL");
+    $finish;
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Receive and check packets
+reg [7:0] rxBuf [0:PACKET_CAPACITY-1];
+integer rxCount = 0, packetCount = 0, packetOutput = 0;
+reg expectLostFlag = 0;
+reg [63:0] expectSequence;
+
+always @(posedge acqClk) begin
+    M_TREADY <= stallReady ? 0 :
+                randomReady ? (($random & 3) != 0) : 1;
+    if (M_TVALID && M_TREADY) begin
+        if (rxCount < PACKET_CAPACITY) rxBuf[rxCount] = M_TDATA;
+        rxCount = rxCount + 1;
+        if (M_TLAST) begin
+            if (checkEntries) checkPacket;
+            rxCount = 0;
+        end
+    end
+end
+
+function [63:0] rx64;
+    input integer i;
+    begin
+    rx64 = { rxBuf[i+0], rxBuf[i+1], rxBuf[i+2], rxBuf[i+3],
+             rxBuf[i+4], rxBuf[i+5], rxBuf[i+6], rxBuf[i+7] };
+    end
+endfunction
+
+function [31:0] rx32;
+    input integer i;
+    begin
+    rx32 = { rxBuf[i+0], rxBuf[i+1], rxBuf[i+2], rxBuf[i+3] };
+    end
+endfunction
+
+task checkPacket;
+    integer e, n, base, index, mismatches;
+    reg [31:0] status, flags;
+    reg [RECORD_WIDTH-1:0] r;
+    begin
+    mismatches = 0;
+    status = rx32(8);
+    n = (expectCount[packetOutput] < HISTORY_DEPTH) ?
+                                   expectCount[packetOutput] : HISTORY_DEPTH;
+    if ((rxCount != 32 + (n * 28))
+     || (rx32(0) != "PSNB")
+     || (rx32(4) != rxCount - 8)
+     || (status[31:24] != 5)
+     || (status[15:8] != packetOutput)
+     || (status[0] != ((packetOutput == 0) && expectLostFlag))
+     || (rx32(12) != n)
+     || (rx32(24) != SECONDS)) begin
+        $display("Bad header %x %x %x %x %x %x, length %0d, expect %0d",
+                 rx32(0), rx32(4), status, rx32(12), rx64(16), rx32(24),
+                 rxCount, n);
+        good = 0;
+    end
+    else begin
+        for (e = 0 ; e < n ; e = e + 1) begin
+            base = 32 + (e * 28);
+            index = (packetOutput * EXPECT_CAPACITY) +
+                                         expectCount[packetOutput] - n + e;
+            r = expectRecord[index];
+            flags = { r[RECORD_WIDTH-1-:2], 14'b0,
+                      {16-MPS_INPUT_COUNT{1'b0}},
+                      r[4*ADC_COUNT+:MPS_INPUT_COUNT] };
+            if ((rx32(base) != SECONDS)
+             || (rx32(base+4) != expectTicks[index] * 8)
+             || (rx32(base+8) != flags)
+             || (rx32(base+12) != r[3*ADC_COUNT+:ADC_COUNT])
+             || (rx32(base+16) != r[2*ADC_COUNT+:ADC_COUNT])
+             || (rx32(base+20) != r[1*ADC_COUNT+:ADC_COUNT])
+             || (rx32(base+24) != r[0*ADC_COUNT+:ADC_COUNT])) begin
+                if (mismatches < 10) begin
+                    $display("Output %0d entry %0d: %x %x %x %x %x %x %x, "
+                             "expected %x %x", packetOutput, e,
+                             rx32(base), rx32(base+4), rx32(base+8),
+                             rx32(base+12), rx32(base+16), rx32(base+20),
+                             rx32(base+24), expectTicks[index] * 8, r);
+                end
+                mismatches = mismatches + 1;
+            end
+        end
+        if (mismatches) good = 0;
+    end
+    if ((packetOutput != 0) && (rx64(16) != expectSequence)) begin
+        $display("Bad sequence number %x, expected %x", rx64(16),
+                                                         expectSequence);
+        good = 0;
+    end
+    expectSequence = rx64(16) + 1;
+    $display("Output %0d: %0d entries", packetOutput, rx32(12));
+    packetOutput = packetOutput + 1;
+    packetCount = packetCount + 1;
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// Present random records to the selected outputs
+task randomEvents;
+    input [MPS_OUTPUT_COUNT-1:0] outputs;
+    begin
+    @(posedge acqClk) begin
+        acqEventStrobes <= outputs;
+        for (c = 0 ; c < MPS_OUTPUT_COUNT ; c = c + 1) begin
+            acqEventRecords[c*RECORD_WIDTH+:RECORD_WIDTH] <=
+                                          { $random, $random, $random };
+        end
+    end
+    @(posedge acqClk) begin
+        acqEventStrobes <= 0;
+        acqEventRecords <= {MPS_OUTPUT_COUNT*RECORD_WIDTH{1'bx}};
+    end
+    end
+endtask
+
+// Request history and wait for all packets
+task sendHistory;
+    input lostFlag;
+    begin
+    expectLostFlag = lostFlag;
+    packetOutput = 0;
+    writeCSR(32'h80000000);
+    repeat (4) @(posedge sysClk) ;
+    while (sysStatus[31]) @(posedge sysClk) ;
+    if (packetOutput != MPS_OUTPUT_COUNT) begin
+        $display("Got %0d packets, expected %0d -- FAIL", packetOutput,
+                                                            MPS_OUTPUT_COUNT);
+        good = 0;
+    end
+    if (sysStatus[15:8] != LOG2_HISTORY_DEPTH) begin
+        $display("Bad status %x", sysStatus);
+        good = 0;
+    end
+    end
+endtask
+
+// Write control register
+task writeCSR;
+    input [31:0] value;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= value;
+        sysCsrStrobe <= 1;
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysCsrStrobe <= 0;
+    end
+    end
+endtask
+
+endmodule
+`default_nettype wire
@@ -0,0 +1,396 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Test sample rate reduction.
+ * Compare every output sample against a bit-exact model of the decimator
+ * cascade and check passband and stopband attenuation using tones whose
+ * frequencies (normalized to the input sample rate) are listed below.
+ * The eighth channel is a full-scale square wave to exercise saturation
+ * and the tones repeat across the remaining channels.
+ * The channel count and sample interval are those of the full AD7768
+ * rate in the acquisition firmware so that overruns are caught.
+ */
+`timescale 1ns/1ns
+
+`default_nettype none
+module rateSelect_tb;
+
+parameter CHANNEL_COUNT     = 32;
+parameter DATA_WIDTH        = 24;
+parameter COEFFICIENT_WIDTH = 18;
+parameter TAP_COUNT_5       = 50;
+parameter TAP_COUNT_2       = 24;
+parameter SAMPLE_INTERVAL   = 488;
+parameter SETTLING_COUNT    = 40;
+parameter MEASURE_COUNT     = 400;
+
+localparam STAGE_COUNT     = 3;
+localparam MAX_TAPS        = 64;
+localparam EXPECT_CAPACITY = 64;
+localparam real PI         = 3.14159265358979;
+localparam real AMPLITUDE  = 4194304.0;
+localparam integer FULL_SCALE = (1 << (DATA_WIDTH - 1)) - 1;
+
+reg         sysClk = 0;
+reg         sysRateStrobe = 0;
+reg         sysFilterStrobe5 = 0;
+reg         sysFilterStrobe2 = 0;
+reg  [31:0] sysGPIO_OUT = {32{1'bx}};
+wire [31:0] sysStatus;
+
+reg                                  acqClk = 0;
+reg                                  acqEnabled = 0;
+reg  [(CHANNEL_COUNT*DATA_WIDTH)-1:0] S_TDATA = 0;
+reg                                  S_TVALID = 0;
+wire [(CHANNEL_COUNT*DATA_WIDTH)-1:0] M_TDATA;
+wire                                 M_TVALID;
+
+// Instantiate device under test
+rateSelect #(
+    .CHANNEL_COUNT(CHANNEL_COUNT),
+    .DATA_WIDTH(DATA_WIDTH),
+    .COEFFICIENT_WIDTH(COEFFICIENT_WIDTH),
+    .TAP_COUNT_5(TAP_COUNT_5),
+    .TAP_COUNT_2(TAP_COUNT_2))
+  rateSelect_i (
+    .sysClk(sysClk),
+    .sysRateStrobe(sysRateStrobe),
+    .sysFilterStrobe5(sysFilterStrobe5),
+    .sysFilterStrobe2(sysFilterStrobe2),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .sysStatus(sysStatus),
+    .acqClk(acqClk),
+    .acqEnabled(acqEnabled),
+    .S_TDATA(S_TDATA),
+    .S_TVALID(S_TVALID),
+    .M_TDATA(M_TDATA),
+    .M_TVALID(M_TVALID));
+
+// Generate clocks
+always begin #5 sysClk = !sysClk; end
+always begin #4 acqClk = !acqClk; end
+
+// Test tones -- negative value indicates square wave
+real frequency [0:CHANNEL_COUNT-1];
+integer fc;
+initial begin
+    frequency[0] = 0.0;
+    frequency[1] = 0.0025;
+    frequency[2] = 0.01;
+    frequency[3] = 0.03;
+    frequency[4] = 0.2;
+    frequency[5] = 0.33;
+    frequency[6] = 0.47;
+    frequency[7] = -1.0;
+    for (fc = 8 ; fc < CHANNEL_COUNT ; fc = fc + 1) begin
+        frequency[fc] = frequency[fc % 8];
+    end
+end
+
+integer good = 1;
+integer c;
+initial
+begin
+    $dumpfile("rateSelect_tb.fst");
+    $dumpvars(0, rateSelect_tb);
+
+    designFilter(0, TAP_COUNT_5, 0.1);
+    designFilter(1, TAP_COUNT_2, 0.25);
+    for (c = 0 ; c < STAGE_COUNT ; c = c + 1) modelClear(c);
+
+    //      Stages  Rate  Passband Stopband
+    runTest(3'b000,   1,  0.5,     1.0);
+    runTest(3'b001,   5,  0.04,    0.16);
+    runTest(3'b100,   2,  0.1,     0.4);
+    runTest(3'b101,  10,  0.02,    0.16);
+    runTest(3'b111,  50,  0.004,   0.16);
+
+    #10 ;
+    $display("%s", good ? "PASS" : "FAIL");
+    $finish;
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Golden model
+reg signed [DATA_WIDTH-1:0] modelHistory
+                                 [0:(STAGE_COUNT*CHANNEL_COUNT*MAX_TAPS)-1];
+integer modelPhase [0:STAGE_COUNT-1];
+integer coefficients [0:(2*MAX_TAPS)-1];
+reg [STAGE_COUNT-1:0] modelStages = 0;
+reg [(CHANNEL_COUNT*DATA_WIDTH)-1:0] expected [0:EXPECT_CAPACITY-1];
+integer expectHead = 0, expectTail = 0;
+
+task modelClear;
+    input integer s;
+    integer i;
+    begin
+    for (i = 0 ; i < CHANNEL_COUNT * MAX_TAPS ; i = i + 1) begin
+        modelHistory[(s*CHANNEL_COUNT*MAX_TAPS)+i] = 0;
+    end
+    end
+endtask
+
+task modelStage;
+    input integer s;
+    inout [(CHANNEL_COUNT*DATA_WIDTH)-1:0] v;
+    output valid;
+    integer ch, k, base, tapCount, decimation, coefficientBase;
+    reg signed [63:0] accumulator, rounded;
+    begin
+    tapCount = (s == STAGE_COUNT - 1) ? TAP_COUNT_2 : TAP_COUNT_5;
+    decimation = (s == STAGE_COUNT - 1) ? 2 : 5;
+    coefficientBase = (s == STAGE_COUNT - 1) ? MAX_TAPS : 0;
+    for (ch = 0 ; ch < CHANNEL_COUNT ; ch = ch + 1) begin
+        base = ((s * CHANNEL_COUNT) + ch) * MAX_TAPS;
+        for (k = tapCount - 1 ; k > 0 ; k = k - 1) begin
+            modelHistory[base+k] = modelHistory[base+k-1];
+        end
+        modelHistory[base] = v[ch*DATA_WIDTH+:DATA_WIDTH];
+    end
+    modelPhase[s] = modelPhase[s] + 1;
+    if (modelPhase[s] == decimation) begin
+        modelPhase[s] = 0;
+        valid = 1;
+        for (ch = 0 ; ch < CHANNEL_COUNT ; ch = ch + 1) begin
+            base = ((s * CHANNEL_COUNT) + ch) * MAX_TAPS;
+            accumulator = 0;
+            for (k = 0 ; k < tapCount ; k = k + 1) begin
+                accumulator = accumulator + (modelHistory[base+k] *
+                                          coefficients[coefficientBase+k]);
+            end
+            rounded = (accumulator + (1 << (COEFFICIENT_WIDTH - 2))) >>>
+                                                     (COEFFICIENT_WIDTH - 1);
+            if (rounded > FULL_SCALE) rounded = FULL_SCALE;
+            if (rounded < -FULL_SCALE - 1) rounded = -FULL_SCALE - 1;
+            v[ch*DATA_WIDTH+:DATA_WIDTH] = rounded[DATA_WIDTH-1:0];
+        end
+    end
+    else begin
+        valid = 0;
+    end
+    end
+endtask
+
+task modelSample;
+    input [(CHANNEL_COUNT*DATA_WIDTH)-1:0] x;
+    reg [(CHANNEL_COUNT*DATA_WIDTH)-1:0] v;
+    reg valid;
+    integer s;
+    begin
+    v = x;
+    valid = 1;
+    for (s = 0 ; s < STAGE_COUNT ; s = s + 1) begin
+        if (valid && modelStages[s]) modelStage(s, v, valid);
+    end
+    if (valid) begin
+        expected[expectTail % EXPECT_CAPACITY] = v;
+        expectTail = expectTail + 1;
+    end
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// Check outputs
+integer outputCount = 0, mismatchCount = 0;
+real sumSquares [0:CHANNEL_COUNT-1];
+integer oc;
+always @(posedge acqClk) begin
+    if (M_TVALID) begin
+        if (expectHead == expectTail) begin
+            if (mismatchCount < 10) $display("Unexpected output");
+            mismatchCount = mismatchCount + 1;
+        end
+        else begin
+            if (M_TDATA !== expected[expectHead % EXPECT_CAPACITY]) begin
+                if (mismatchCount < 10) begin
+                    $display("Output %0d got %x want %x", outputCount, M_TDATA,
+                                       expected[expectHead % EXPECT_CAPACITY]);
+                end
+                mismatchCount = mismatchCount + 1;
+            end
+            expectHead = expectHead + 1;
+        end
+        if ((outputCount >= SETTLING_COUNT)
+         && (outputCount < (SETTLING_COUNT + MEASURE_COUNT))) begin
+            for (oc = 0 ; oc < CHANNEL_COUNT ; oc = oc + 1) begin
+                sumSquares[oc] = sumSquares[oc] +
+                          $itor($signed(M_TDATA[oc*DATA_WIDTH+:DATA_WIDTH])) *
+                          $itor($signed(M_TDATA[oc*DATA_WIDTH+:DATA_WIDTH]));
+            end
+        end
+        outputCount = outputCount + 1;
+    end
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Run a test at the specified decimation rate
+task runTest;
+    input [STAGE_COUNT-1:0] stages;
+    input integer decimation;
+    input real passbandEdge, stopbandEdge;
+    integer i, n;
+    real rms, expectRMS, dB;
+    reg ok;
+    begin
+    @(posedge acqClk) acqEnabled <= 0;
+    writeRate(stages);
+    modelStages = stages;
+    for (i = 0 ; i < STAGE_COUNT ; i = i + 1) modelPhase[i] = 0;
+    outputCount = 0;
+    mismatchCount = 0;
+    for (i = 0 ; i < CHANNEL_COUNT ; i = i + 1) sumSquares[i] = 0.0;
+    repeat (10) @(posedge acqClk) ;
+    acqEnabled <= 1;
+    for (n = 0 ; n < decimation * (SETTLING_COUNT + MEASURE_COUNT) ; n = n + 1)
+    begin
+        feedSample(n);
+    end
+    repeat (8 * CHANNEL_COUNT * TAP_COUNT_5) @(posedge acqClk) ;
+    $display("Rate 1/%0d: %0d outputs, %0d mismatches", decimation,
+                                                  outputCount, mismatchCount);
+    if ((outputCount != (SETTLING_COUNT + MEASURE_COUNT))
+     || (mismatchCount != 0)
+     || (expectHead != expectTail)) begin
+        good = 0;
+    end
+    if (sysStatus[31]) begin
+        $display("Overrun -- FAIL");
+        good = 0;
+    end
+    for (i = 0 ; i < CHANNEL_COUNT ; i = i + 1) begin
+        if (frequency[i] >= 0) begin
+            rms = $sqrt(sumSquares[i] / MEASURE_COUNT);
+            expectRMS = (frequency[i] == 0) ? AMPLITUDE : AMPLITUDE / $sqrt(2.0);
+            dB = (rms > 0) ? 20.0 * $log10(rms / expectRMS) : -200.0;
+            if (frequency[i] <= passbandEdge) begin
+                ok = (dB > -0.1) && (dB < 0.1);
+                $display("  %6.4f passband %8.3f dB -- %s", frequency[i], dB,
+                                                         ok ? "PASS" : "FAIL");
+                if (!ok) good = 0;
+            end
+            else if (frequency[i] >= stopbandEdge) begin
+                ok = (dB < -60.0);
+                $display("  %6.4f stopband %8.3f dB -- %s", frequency[i], dB,
+                                                         ok ? "PASS" : "FAIL");
+                if (!ok) good = 0;
+            end
+        end
+    end
+    end
+endtask
+
+// Present a sample to the device under test and to the model
+task feedSample;
+    input integer n;
+    reg [(CHANNEL_COUNT*DATA_WIDTH)-1:0] x;
+    integer i, v;
+    begin
+    for (i = 0 ; i < CHANNEL_COUNT ; i = i + 1) begin
+        if (frequency[i] < 0) begin
+            v = ((n / 20) % 2) ? -FULL_SCALE - 1 : FULL_SCALE;
+        end
+        else begin
+            v = $rtoi(AMPLITUDE * $cos(2.0 * PI * frequency[i] * n));
+        end
+        x[i*DATA_WIDTH+:DATA_WIDTH] = v;
+    end
+    modelSample(x);
+    @(posedge acqClk) begin
+        S_TDATA <= x;
+        S_TVALID <= 1;
+    end
+    @(posedge acqClk) begin
+        S_TDATA <= {CHANNEL_COUNT*DATA_WIDTH{1'bx}};
+        S_TVALID <= 0;
+    end
+    repeat (SAMPLE_INTERVAL - 2) @(posedge acqClk) ;
+    end
+endtask
+
+// Blackman-windowed sinc lowpass
+real design [0:MAX_TAPS-1];
+task designFilter;
+    input integer stage2;
+    input integer tapCount;
+    input real cutoff;
+    integer n, q;
+    real m, sum;
+    begin
+    sum = 0.0;
+    for (n = 0 ; n < tapCount ; n = n + 1) begin
+        m = n - ((tapCount - 1) / 2.0);
+        design[n] = (m == 0) ? 2.0 * cutoff :
+                               $sin(2.0 * PI * cutoff * m) / (PI * m);
+        design[n] = design[n] * (0.42
+                               - 0.5 * $cos(2.0 * PI * n / (tapCount - 1))
+                               + 0.08 * $cos(4.0 * PI * n / (tapCount - 1)));
+        sum = sum + design[n];
+    end
+    for (n = 0 ; n < tapCount ; n = n + 1) begin
+        q = $rtoi($floor((design[n] / sum) * (1 << (COEFFICIENT_WIDTH - 1))
+                                                                      + 0.5));
+        coefficients[(stage2 * MAX_TAPS) + n] = q;
+        writeCoefficient(stage2, n, q);
+    end
+    end
+endtask
+
+// Write a filter coefficient
+task writeCoefficient;
+    input integer stage2;
+    input integer index;
+    input integer value;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= (index << 24) | (value & ((1 << COEFFICIENT_WIDTH) - 1));
+        if (stage2) sysFilterStrobe2 <= 1;
+        else        sysFilterStrobe5 <= 1;
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysFilterStrobe2 <= 0;
+        sysFilterStrobe5 <= 0;
+    end
+    end
+endtask
+
+// Select decimation stages
+task writeRate;
+    input [31:0] w;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= w;
+        sysRateStrobe <= 1;
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysRateStrobe <= 0;
+    end
+    @(posedge sysClk) ;
+    end
+endtask
+
+endmodule
+`default_nettype wire
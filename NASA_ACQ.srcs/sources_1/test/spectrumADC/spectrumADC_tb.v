@@ -0,0 +1,535 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Test ADC spectrum monitor.
+ * Compare every spectrum packet against a bit-exact model of the windowed
+ * transform and averaging, and check that a tone appears in the expected
+ * bin at the expected power.  The seconds count changes in the middle of
+ * every third frame.  The first test applies random back-pressure, the
+ * second feeds samples too quickly for the transform engine and checks
+ * that dropped frames are flagged.
+ */
+`timescale 1ns/1ns
+
+`default_nettype none
+module spectrumADC_tb;
+
+parameter ADC_CHIP_COUNT   = 1;
+parameter ADC_PER_CHIP     = 4;
+parameter ADC_WIDTH        = 24;
+parameter MONITOR_COUNT    = 2;
+parameter LOG2_FFT_SIZE    = 6;
+parameter BINS_PER_PACKET  = 16;
+parameter PACKET_GAP       = 20;
+parameter TICKS_PER_SAMPLE = 1000;
+parameter SECONDS          = 1234;
+parameter TONE_BIN         = 5;
+
+localparam CHANNEL_COUNT   = ADC_CHIP_COUNT * ADC_PER_CHIP;
+localparam FFT_SIZE        = 1 << LOG2_FFT_SIZE;
+localparam BIN_COUNT       = FFT_SIZE / 2;
+localparam PACKET_BYTES    = 32 + (BINS_PER_PACKET * 8);
+localparam FRAMES_PER_SECOND = 3;
+localparam INTERVAL_CAPACITY = 16;
+localparam WINDOW_WIDTH    = 18;
+localparam COSINE_FRACTION = 16;
+localparam GUARD_BITS      = 4;
+localparam SAMPLE_WIDTH    = ADC_WIDTH + GUARD_BITS;
+localparam real PI         = 3.14159265358979;
+localparam real AMPLITUDE  = 4194304.0;
+localparam integer FULL_SCALE = (1 << (ADC_WIDTH - 1)) - 1;
+
+reg         sysClk = 0;
+reg         sysCsrStrobe = 0;
+reg         sysTableStrobe = 0;
+reg  [31:0] sysGPIO_OUT = {32{1'bx}};
+wire [31:0] sysStatus;
+
+reg                                     acqClk = 0;
+reg                                     acqStrobe = 0;
+reg  [(CHANNEL_COUNT*ADC_WIDTH)-1:0]    acqData = 0;
+reg                              [31:0] acqSeconds = SECONDS;
+reg                              [31:0] acqTicks = 0;
+reg                                     acqEnableAcquisition = 0;
+wire                                    M_TVALID, M_TLAST;
+wire                              [7:0] M_TDATA;
+reg                                     M_TREADY = 1;
+
+// Instantiate device under test
+spectrumADC #(
+    .ADC_CHIP_COUNT(ADC_CHIP_COUNT),
+    .ADC_PER_CHIP(ADC_PER_CHIP),
+    .ADC_WIDTH(ADC_WIDTH),
+    .MONITOR_COUNT(MONITOR_COUNT),
+    .LOG2_FFT_SIZE(LOG2_FFT_SIZE),
+    .UDP_PACKET_CAPACITY(PACKET_BYTES),
+    .PACKET_GAP(PACKET_GAP))
+  spectrumADC_i (
+    .sysClk(sysClk),
+    .sysCsrStrobe(sysCsrStrobe),
+    .sysTableStrobe(sysTableStrobe),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .sysStatus(sysStatus),
+    .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
+    .acqData(acqData),
+    .acqSeconds(acqSeconds),
+    .acqTicks(acqTicks),
+    .acqEnableAcquisition(acqEnableAcquisition),
+    .M_TVALID(M_TVALID),
+    .M_TLAST(M_TLAST),
+    .M_TDATA(M_TDATA),
+    .M_TREADY(M_TREADY));
+
+// Generate clocks
+always begin #5 sysClk = !sysClk; end
+always begin #4 acqClk = !acqClk; end
+
+// Monitor 0 watches channel 2, monitor 1 watches channel 1
+integer monitorChannel [0:MONITOR_COUNT-1];
+integer good = 1;
+reg randomReady = 0;
+
+initial
+begin
+    $dumpfile("spectrumADC_tb.fst");
+    $dumpvars(0, spectrumADC_tb);
+
+    monitorChannel[0] = 2;
+    monitorChannel[1] = 1;
+    writeTables;
+
+    //      Interval Frames Back-pressure  Expect drops
+    runTest(30,      12,    1,             0);
+    runTest(10,       8,    0,             1);
+
+    #10 ;
+    $display("%s", good ? "PASS" : "FAIL");
+    $finish;
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Model
+integer windowValue [0:FFT_SIZE-1];
+integer cosineValue [0:FFT_SIZE-1];
+reg signed [SAMPLE_WIDTH-1:0] frameRe [0:(MONITOR_COUNT*FFT_SIZE)-1];
+reg signed [SAMPLE_WIDTH-1:0] workRe [0:FFT_SIZE-1];
+reg signed [SAMPLE_WIDTH-1:0] workIm [0:FFT_SIZE-1];
+reg [63:0] modelSum [0:(MONITOR_COUNT*BIN_COUNT)-1];
+reg [63:0] expectSum [0:(INTERVAL_CAPACITY*MONITOR_COUNT*BIN_COUNT)-1];
+integer expectCount [0:INTERVAL_CAPACITY-1];
+integer expectFirstSample [0:INTERVAL_CAPACITY-1];
+integer expectSeconds [0:INTERVAL_CAPACITY-1];
+integer modelIntervals = 0, modelFrames = 0, modelFirstSample = 0;
+integer modelFirstSeconds = 0;
+reg modelFirst = 1, modelPending = 0;
+
+function integer bitReverse;
+    input integer v;
+    integer i;
+    begin
+    bitReverse = 0;
+    for (i = 0 ; i < LOG2_FFT_SIZE ; i = i + 1) begin
+        if (v & (1 << i)) bitReverse = bitReverse | (1 << (LOG2_FFT_SIZE-1-i));
+    end
+    end
+endfunction
+
+function [SAMPLE_WIDTH-1:0] halveAndSaturate;
+    input signed [63:0] sum;
+    reg signed [63:0] half;
+    begin
+    half = sum >>> 1;
+    if (half > ((64'sd1 << (SAMPLE_WIDTH - 1)) - 1)) begin
+        half = (64'sd1 << (SAMPLE_WIDTH - 1)) - 1;
+    end
+    if (half < -(64'sd1 << (SAMPLE_WIDTH - 1))) begin
+        half = -(64'sd1 << (SAMPLE_WIDTH - 1));
+    end
+    halveAndSaturate = half[SAMPLE_WIDTH-1:0];
+    end
+endfunction
+
+// Window and save a reading
+task modelSample;
+    input integer n;
+    input [(CHANNEL_COUNT*ADC_WIDTH)-1:0] x;
+    integer m;
+    reg signed [63:0] v;
+    begin
+    for (m = 0 ; m < MONITOR_COUNT ; m = m + 1) begin
+        v = $signed(x[monitorChannel[m]*ADC_WIDTH+:ADC_WIDTH]);
+        v = ((v * windowValue[n % FFT_SIZE]) +
+                     (1 << (WINDOW_WIDTH - GUARD_BITS - 1))) >>>
+                                               (WINDOW_WIDTH - GUARD_BITS);
+        frameRe[(m*FFT_SIZE)+(n%FFT_SIZE)] = v[SAMPLE_WIDTH-1:0];
+    end
+    end
+endtask
+
+// Transform a frame and accumulate powers
+task modelFrame;
+    input integer m;
+    input accumulate;
+    integer s, b, k, i, j;
+    reg signed [63:0] wr, wi, xr, xi, tr, ti, sum;
+    reg [63:0] power;
+    reg [64:0] total;
+    begin
+    for (i = 0 ; i < FFT_SIZE ; i = i + 1) begin
+        workRe[i] = frameRe[(m*FFT_SIZE)+bitReverse(i)];
+        workIm[i] = 0;
+    end
+    for (s = 0 ; s < LOG2_FFT_SIZE ; s = s + 1) begin
+        for (b = 0 ; b < BIN_COUNT ; b = b + 1) begin
+            k = b % (1 << s);
+            i = ((b >> s) << (s + 1)) + k;
+            j = i + (1 << s);
+            wr = cosineValue[k << (LOG2_FFT_SIZE - 1 - s)];
+            wi = cosineValue[(k << (LOG2_FFT_SIZE - 1 - s)) + (FFT_SIZE / 4)];
+            xr = workRe[j];
+            xi = workIm[j];
+            tr = ((xr * wr) - (xi * wi) + (1 << (COSINE_FRACTION - 1))) >>>
+                                                            COSINE_FRACTION;
+            ti = ((xr * wi) + (xi * wr) + (1 << (COSINE_FRACTION - 1))) >>>
+                                                            COSINE_FRACTION;
+            xr = workRe[i];
+            xi = workIm[i];
+            workRe[i] = halveAndSaturate(xr + tr + 1);
+            workIm[i] = halveAndSaturate(xi + ti + 1);
+            workRe[j] = halveAndSaturate(xr - tr + 1);
+            workIm[j] = halveAndSaturate(xi - ti + 1);
+        end
+    end
+    for (b = 0 ; b < BIN_COUNT ; b = b + 1) begin
+        xr = workRe[b];
+        xi = workIm[b];
+        power = (xr * xr) + (xi * xi);
+        total = modelSum[(m*BIN_COUNT)+b] + power;
+        if (!accumulate) total = power;
+        if (total[64]) total = {65{1'b1}};
+        modelSum[(m*BIN_COUNT)+b] = total[63:0];
+    end
+    end
+endtask
+
+// A complete frame starts processing
+task modelFrameComplete;
+    input integer firstSample;
+    integer m, b;
+    begin
+    if (modelFirst) begin
+        modelFrames = 0;
+        modelFirstSample = firstSample;
+        modelFirstSeconds = expectSecondsAt(firstSample);
+    end
+    for (m = 0 ; m < MONITOR_COUNT ; m = m + 1) modelFrame(m, !modelFirst);
+    modelFrames = modelFrames + 1;
+    modelFirst = modelPending;
+    if (modelPending) begin
+        modelPending = 0;
+        for (m = 0 ; m < MONITOR_COUNT ; m = m + 1) begin
+            for (b = 0 ; b < BIN_COUNT ; b = b + 1) begin
+                expectSum[(((modelIntervals % INTERVAL_CAPACITY) *
+                            MONITOR_COUNT) + m) * BIN_COUNT + b] =
+                                               modelSum[(m*BIN_COUNT)+b];
+            end
+        end
+        expectCount[modelIntervals % INTERVAL_CAPACITY] = modelFrames;
+        expectFirstSample[modelIntervals % INTERVAL_CAPACITY] =
+                                                          modelFirstSample;
+        expectSeconds[modelIntervals % INTERVAL_CAPACITY] = modelFirstSeconds;
+        modelIntervals = modelIntervals + 1;
+    end
+    end
+endtask
+
+// Seconds count changes in the middle of every third frame
+function integer expectSecondsAt;
+    input integer n;
+    begin
+    expectSecondsAt = SECONDS + ((n + (FRAMES_PER_SECOND * FFT_SIZE) -
+                                  (FFT_SIZE / 2)) /
+                                 (FRAMES_PER_SECOND * FFT_SIZE));
+    end
+endfunction
+
+///////////////////////////////////////////////////////////////////////////////
+// Receive and check packets
+reg [7:0] rxBuf [0:PACKET_BYTES-1];
+integer rxCount = 0, packetCount = 0, spectrumCount = 0;
+integer droppedCount = 0, mismatchCount = 0;
+reg checkBins = 1;
+
+always @(posedge acqClk) begin
+    M_TREADY <= randomReady ? (($random & 3) != 0) : 1;
+    if (M_TVALID && M_TREADY) begin
+        if (rxCount < PACKET_BYTES) rxBuf[rxCount] = M_TDATA;
+        rxCount = rxCount + 1;
+        if (M_TLAST) begin
+            checkPacket;
+            rxCount = 0;
+        end
+    end
+end
+
+function [63:0] rx64;
+    input integer i;
+    begin
+    rx64 = { rxBuf[i+0], rxBuf[i+1], rxBuf[i+2], rxBuf[i+3],
+             rxBuf[i+4], rxBuf[i+5], rxBuf[i+6], rxBuf[i+7] };
+    end
+endfunction
+
+function [31:0] rx32;
+    input integer i;
+    begin
+    rx32 = { rxBuf[i+0], rxBuf[i+1], rxBuf[i+2], rxBuf[i+3] };
+    end
+endfunction
+
+task checkPacket;
+    integer m, firstBin, b, e, interval, peakBin;
+    reg [31:0] status;
+    reg [63:0] peak;
+    real dB;
+    begin
+    m = (packetCount / (BIN_COUNT / BINS_PER_PACKET)) % MONITOR_COUNT;
+    firstBin = (packetCount % (BIN_COUNT / BINS_PER_PACKET)) * BINS_PER_PACKET;
+    interval = spectrumCount % INTERVAL_CAPACITY;
+    status = rx32(8);
+    if (rxCount != PACKET_BYTES) begin
+        $display("Packet length %0d, expected %0d", rxCount, PACKET_BYTES);
+        good = 0;
+    end
+    else if ((rx32(0) != "PSNB")
+          || (rx32(4) != PACKET_BYTES - 8)
+          || (status[31:24] != 3)
+          || (status[15:8] != monitorChannel[m])
+          || (rx32(16) != spectrumCount + 1)
+          || (rx32(20) != ((firstBin << 16) | BINS_PER_PACKET))) begin
+        $display("Bad header %x %x %x %x %x %x %x %x", rx32(0), rx32(4),
+                  status, rx32(12), rx32(16), rx32(20), rx32(24), rx32(28));
+        good = 0;
+    end
+    else begin
+        if (status[0]) droppedCount = droppedCount + 1;
+        if (checkBins) begin
+            if ((status[0] != 0)
+             || (rx32(12) != expectCount[interval])
+             || (rx32(24) != expectSeconds[interval])
+             || (rx32(28) != 8 * TICKS_PER_SAMPLE *
+                                          expectFirstSample[interval])) begin
+                $display("Spectrum %0d: status %x, %0d frames at %0d:%0d, "
+                         "expected %0d frames at %0d:%0d", spectrumCount,
+                         status, rx32(12), rx32(24), rx32(28),
+                         expectCount[interval], expectSeconds[interval],
+                         8 * TICKS_PER_SAMPLE * expectFirstSample[interval]);
+                good = 0;
+            end
+            for (b = 0 ; b < BINS_PER_PACKET ; b = b + 1) begin
+                e = (((interval * MONITOR_COUNT) + m) * BIN_COUNT) +
+                                                               firstBin + b;
+                if (rx64(32 + (b * 8)) !== expectSum[e]) begin
+                    if (mismatchCount < 10) begin
+                        $display("Spectrum %0d monitor %0d bin %0d: %0d, "
+                                 "expected %0d", spectrumCount, m,
+                                 firstBin + b, rx64(32 + (b * 8)),
+                                 expectSum[e]);
+                    end
+                    mismatchCount = mismatchCount + 1;
+                    good = 0;
+                end
+            end
+
+            // Tone on channel 1 should land in its bin with a power of
+            // 1/16 of the squared windowed amplitude per frame.
+            if ((monitorChannel[m] == 1) && (firstBin == 0)) begin
+                peak = 0;
+                peakBin = 0;
+                for (b = 0 ; b < BINS_PER_PACKET ; b = b + 1) begin
+                    if (rx64(32 + (b * 8)) > peak) begin
+                        peak = rx64(32 + (b * 8));
+                        peakBin = b;
+                    end
+                end
+                dB = 10.0 * $log10($itor(peak) / (rx32(12) *
+                        (AMPLITUDE * (1 << GUARD_BITS) / 4.0) *
+                        (AMPLITUDE * (1 << GUARD_BITS) / 4.0)));
+                if ((peakBin != TONE_BIN) || (dB < -0.1) || (dB > 0.1)) begin
+                    $display("Spectrum %0d peak in bin %0d at %.3f dB",
+                                              spectrumCount, peakBin, dB);
+                    good = 0;
+                end
+            end
+        end
+    end
+    packetCount = packetCount + 1;
+    if ((packetCount % ((BIN_COUNT / BINS_PER_PACKET) * MONITOR_COUNT)) == 0)
+    begin
+        spectrumCount = spectrumCount + 1;
+    end
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// Run a test
+task runTest;
+    input integer sampleInterval;
+    input integer frameCount;
+    input backPressure;
+    input expectDrops;
+    integer n, startSpectra;
+    begin
+    @(posedge acqClk) acqEnableAcquisition <= 0;
+    writeCSR(0);
+    repeat (1000) @(posedge acqClk) ;
+    randomReady = backPressure;
+    checkBins = !expectDrops;
+    packetCount = 0;
+    droppedCount = 0;
+    mismatchCount = 0;
+    startSpectra = spectrumCount;
+    modelFirst = 1;
+    modelPending = 0;
+    modelIntervals = spectrumCount;
+    writeCSR(32'h80000000 | (monitorChannel[1] << 8) | monitorChannel[0]);
+    repeat (10) @(posedge acqClk) ;
+    acqEnableAcquisition <= 1;
+    for (n = 0 ; n < frameCount * FFT_SIZE ; n = n + 1) begin
+        feedSample(n, sampleInterval);
+    end
+    repeat (20 * PACKET_BYTES) @(posedge acqClk) ;
+    $display("Interval %0d: %0d spectra, %0d packets flagged with drops",
+                   sampleInterval, spectrumCount - startSpectra, droppedCount);
+    if ((packetCount % ((BIN_COUNT / BINS_PER_PACKET) * MONITOR_COUNT)) != 0)
+    begin
+        $display("Incomplete spectrum");
+        good = 0;
+    end
+    if (expectDrops) begin
+        if ((spectrumCount == startSpectra) || (droppedCount == 0)
+         || !sysStatus[30]) begin
+            good = 0;
+        end
+    end
+    else if ((spectrumCount != modelIntervals)
+          || (droppedCount != 0)
+          || sysStatus[30]) begin
+        good = 0;
+    end
+    if ((sysStatus[31] != 1) || (sysStatus[15:8] != MONITOR_COUNT)
+     || (sysStatus[7:0] != LOG2_FFT_SIZE)) begin
+        $display("Bad status %x", sysStatus);
+        good = 0;
+    end
+    end
+endtask
+
+// Present a sample to the device under test and to the model
+task feedSample;
+    input integer n;
+    input integer sampleInterval;
+    reg [(CHANNEL_COUNT*ADC_WIDTH)-1:0] x;
+    integer i, v;
+    begin
+    for (i = 0 ; i < CHANNEL_COUNT ; i = i + 1) begin
+        case (i)
+        1: v = $rtoi(AMPLITUDE * $cos(2.0 * PI * TONE_BIN * n / FFT_SIZE));
+        2: v = ((n / 3) % 2) ? -FULL_SCALE - 1 : FULL_SCALE;
+        default: v = $random;
+        endcase
+        x[i*ADC_WIDTH+:ADC_WIDTH] = v;
+    end
+    modelSample(n, x);
+    if ((n % (FRAMES_PER_SECOND * FFT_SIZE)) == (FFT_SIZE / 2)) begin
+        modelPending = 1;
+    end
+    if ((n % FFT_SIZE) == (FFT_SIZE - 1)) begin
+        modelFrameComplete(n - (FFT_SIZE - 1));
+    end
+    @(posedge acqClk) begin
+        acqData <= x;
+        acqSeconds <= expectSecondsAt(n);
+        acqTicks <= n * TICKS_PER_SAMPLE;
+        acqStrobe <= 1;
+    end
+    @(posedge acqClk) begin
+        acqData <= {CHANNEL_COUNT*ADC_WIDTH{1'bx}};
+        acqStrobe <= 0;
+    end
+    repeat (sampleInterval - 2) @(posedge acqClk) ;
+    end
+endtask
+
+// Write Hann window and cosine tables
+task writeTables;
+    integer i, v;
+    begin
+    for (i = 0 ; i < FFT_SIZE ; i = i + 1) begin
+        v = $rtoi($floor((0.5 - 0.5 * $cos(2.0 * PI * i / FFT_SIZE)) *
+                                               (1 << WINDOW_WIDTH) + 0.5));
+        if (v >= (1 << WINDOW_WIDTH)) v = (1 << WINDOW_WIDTH) - 1;
+        windowValue[i] = v;
+        writeTable((i << 18) | v);
+        v = $rtoi($floor($cos(2.0 * PI * i / FFT_SIZE) *
+                                            (1 << COSINE_FRACTION) + 0.5));
+        cosineValue[i] = v;
+        writeTable(32'h80000000 | (i << 18) | (v & ((1 << 18) - 1)));
+    end
+    end
+endtask
+
+task writeTable;
+    input [31:0] value;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= value;
+        sysTableStrobe <= 1;
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysTableStrobe <= 0;
+    end
+    end
+endtask
+
+// Write control register
+task writeCSR;
+    input [31:0] value;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= value;
+        sysCsrStrobe <= 1;
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysCsrStrobe <= 0;
+    end
+    end
+endtask
+
+endmodule
+`default_nettype wire
@@ -0,0 +1,318 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Test ADC summary statistics.
+ * Compare every summary packet against a model computed from the same
+ * readings.  The first test applies random back-pressure, the second
+ * uses a window too short for the packet to be sent and checks that
+ * windows are dropped cleanly and flagged.
+ */
+`timescale 1ns/1ns
+
+`default_nettype none
+module summarizeADC_tb;
+
+parameter ADC_CHIP_COUNT  = 1;
+parameter ADC_PER_CHIP    = 8;
+parameter ADC_WIDTH       = 24;
+parameter SAMPLE_INTERVAL = 150;
+parameter TICKS_PER_SAMPLE = 1000;
+parameter SECONDS         = 1234;
+
+localparam CHANNEL_COUNT   = ADC_CHIP_COUNT * ADC_PER_CHIP;
+localparam PACKET_BYTES    = 32 + (CHANNEL_COUNT * 24);
+localparam WINDOW_CAPACITY = 128;
+localparam integer FULL_SCALE = (1 << (ADC_WIDTH - 1)) - 1;
+
+reg         sysClk = 0;
+reg         sysCsrStrobe = 0;
+reg  [31:0] sysGPIO_OUT = {32{1'bx}};
+wire [31:0] sysStatus;
+
+reg                                     acqClk = 0;
+reg                                     acqStrobe = 0;
+reg  [(CHANNEL_COUNT*ADC_WIDTH)-1:0]    acqData = 0;
+reg                              [31:0] acqTicks = 0;
+reg                                     acqEnableAcquisition = 0;
+wire                                    M_TVALID, M_TLAST;
+wire                              [7:0] M_TDATA;
+reg                                     M_TREADY = 1;
+
+// Instantiate device under test
+summarizeADC #(
+    .ADC_CHIP_COUNT(ADC_CHIP_COUNT),
+    .ADC_PER_CHIP(ADC_PER_CHIP),
+    .ADC_WIDTH(ADC_WIDTH))
+  summarizeADC_i (
+    .sysClk(sysClk),
+    .sysCsrStrobe(sysCsrStrobe),
+    .sysGPIO_OUT(sysGPIO_OUT),
+    .sysStatus(sysStatus),
+    .acqClk(acqClk),
+    .acqStrobe(acqStrobe),
+    .acqData(acqData),
+    .acqSeconds(SECONDS),
+    .acqTicks(acqTicks),
+    .acqEnableAcquisition(acqEnableAcquisition),
+    .M_TVALID(M_TVALID),
+    .M_TLAST(M_TLAST),
+    .M_TDATA(M_TDATA),
+    .M_TREADY(M_TREADY));
+
+// Generate clocks
+always begin #5 sysClk = !sysClk; end
+always begin #4 acqClk = !acqClk; end
+
+integer good = 1;
+integer windowLength = 1;
+reg randomReady = 0;
+
+initial
+begin
+    $dumpfile("summarizeADC_tb.fst");
+    $dumpvars(0, summarizeADC_tb);
+
+    //      Window Samples Back-pressure  Expect drops
+    runTest(    5,    200, 1,             0);
+    runTest(   64,    256, 1,             0);
+    runTest(    1,     60, 0,             1);
+
+    #10 ;
+    $display("%s", good ? "PASS" : "FAIL");
+    $finish;
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Model
+reg signed [63:0] modelMin [0:CHANNEL_COUNT-1];
+reg signed [63:0] modelMax [0:CHANNEL_COUNT-1];
+reg signed [63:0] modelSum [0:CHANNEL_COUNT-1];
+reg        [63:0] modelSumSquares [0:CHANNEL_COUNT-1];
+reg signed [63:0] expectMin [0:(WINDOW_CAPACITY*CHANNEL_COUNT)-1];
+reg signed [63:0] expectMax [0:(WINDOW_CAPACITY*CHANNEL_COUNT)-1];
+reg signed [63:0] expectSum [0:(WINDOW_CAPACITY*CHANNEL_COUNT)-1];
+reg        [63:0] expectSumSquares [0:(WINDOW_CAPACITY*CHANNEL_COUNT)-1];
+
+task modelSample;
+    input integer n;
+    input [(CHANNEL_COUNT*ADC_WIDTH)-1:0] x;
+    integer ch, w;
+    reg signed [63:0] v;
+    begin
+    w = n / windowLength;
+    for (ch = 0 ; ch < CHANNEL_COUNT ; ch = ch + 1) begin
+        v = $signed(x[ch*ADC_WIDTH+:ADC_WIDTH]);
+        if ((n % windowLength) == 0) begin
+            modelMin[ch] = v;
+            modelMax[ch] = v;
+            modelSum[ch] = v;
+            modelSumSquares[ch] = v * v;
+        end
+        else begin
+            if (v < modelMin[ch]) modelMin[ch] = v;
+            if (v > modelMax[ch]) modelMax[ch] = v;
+            modelSum[ch] = modelSum[ch] + v;
+            modelSumSquares[ch] = modelSumSquares[ch] + (v * v);
+        end
+        if ((n % windowLength) == (windowLength - 1)) begin
+            expectMin[(w*CHANNEL_COUNT)+ch] = modelMin[ch];
+            expectMax[(w*CHANNEL_COUNT)+ch] = modelMax[ch];
+            expectSum[(w*CHANNEL_COUNT)+ch] = modelSum[ch];
+            expectSumSquares[(w*CHANNEL_COUNT)+ch] = modelSumSquares[ch];
+        end
+    end
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// Receive and check packets
+reg [7:0] rxBuf [0:PACKET_BYTES-1];
+integer rxCount = 0, packetCount = 0, lastWindow = -1, droppedCount = 0;
+
+always @(posedge acqClk) begin
+    M_TREADY <= randomReady ? (($random & 3) != 0) : 1;
+    if (M_TVALID && M_TREADY) begin
+        if (rxCount < PACKET_BYTES) rxBuf[rxCount] = M_TDATA;
+        rxCount = rxCount + 1;
+        if (M_TLAST) begin
+            checkPacket;
+            rxCount = 0;
+        end
+    end
+end
+
+function [63:0] rx64;
+    input integer i;
+    begin
+    rx64 = { rxBuf[i+0], rxBuf[i+1], rxBuf[i+2], rxBuf[i+3],
+             rxBuf[i+4], rxBuf[i+5], rxBuf[i+6], rxBuf[i+7] };
+    end
+endfunction
+
+function [31:0] rx32;
+    input integer i;
+    begin
+    rx32 = { rxBuf[i+0], rxBuf[i+1], rxBuf[i+2], rxBuf[i+3] };
+    end
+endfunction
+
+task checkPacket;
+    integer ch, w, e, base, mismatches;
+    reg [31:0] status, ns;
+    begin
+    mismatches = 0;
+    if (rxCount != PACKET_BYTES) begin
+        $display("Packet length %0d, expected %0d", rxCount, PACKET_BYTES);
+        good = 0;
+    end
+    else begin
+        status = rx32(8);
+        ns = rx32(28);
+        w = ns / (8 * TICKS_PER_SAMPLE * windowLength);
+        if ((rx32(0) != "PSNB")
+         || (rx32(4) != PACKET_BYTES - 8)
+         || (status[31:24] != 1)
+         || (status[0] != (w != (lastWindow + 1)))
+         || (rx32(12) != windowLength)
+         || (rx64(16) != {SECONDS, 32'b0} + packetCount)
+         || (rx32(24) != SECONDS)
+         || ((ns % (8 * TICKS_PER_SAMPLE * windowLength)) != 0)) begin
+            $display("Bad header %x %x %x %x %x %x %x", rx32(0), rx32(4),
+                                   status, rx32(12), rx64(16), rx32(24), ns);
+            good = 0;
+        end
+        if (w != (lastWindow + 1)) droppedCount = droppedCount + 1;
+        for (ch = 0 ; ch < CHANNEL_COUNT ; ch = ch + 1) begin
+            base = 32 + (ch * 24);
+            e = (w * CHANNEL_COUNT) + ch;
+            if (($signed(rx32(base)) != expectMin[e])
+             || ($signed(rx32(base+4)) != expectMax[e])
+             || ($signed(rx64(base+8)) != expectSum[e])
+             || (rx64(base+16) != expectSumSquares[e])) begin
+                $display("Window %0d channel %0d: %0d %0d %0d %0d, expected "
+                         "%0d %0d %0d %0d", w, ch,
+                         $signed(rx32(base)), $signed(rx32(base+4)),
+                         $signed(rx64(base+8)), rx64(base+16),
+                         expectMin[e], expectMax[e], expectSum[e],
+                         expectSumSquares[e]);
+                mismatches = mismatches + 1;
+            end
+        end
+        if (mismatches) good = 0;
+        lastWindow = w;
+    end
+    packetCount = packetCount + 1;
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// Run a test
+task runTest;
+    input integer length;
+    input integer sampleCount;
+    input backPressure;
+    input expectDrops;
+    integer n;
+    begin
+    @(posedge acqClk) acqEnableAcquisition <= 0;
+    writeCSR(0);
+    repeat (2 * PACKET_BYTES) @(posedge acqClk) ;
+    windowLength = length;
+    randomReady = backPressure;
+    packetCount = 0;
+    lastWindow = -1;
+    droppedCount = 0;
+    writeCSR(32'h80000000 | (length - 1));
+    repeat (10) @(posedge acqClk) ;
+    acqEnableAcquisition <= 1;
+    for (n = 0 ; n < sampleCount ; n = n + 1) begin
+        feedSample(n);
+    end
+    repeat (4 * PACKET_BYTES) @(posedge acqClk) ;
+    $display("Window %0d: %0d packets, %0d with preceding windows dropped",
+                                          length, packetCount, droppedCount);
+    if (expectDrops) begin
+        if ((packetCount == 0) || (droppedCount == 0) || !sysStatus[30]) begin
+            good = 0;
+        end
+    end
+    else if ((packetCount != (sampleCount / length))
+          || (droppedCount != 0)
+          || sysStatus[30]) begin
+        good = 0;
+    end
+    if ((sysStatus[31] != 1) || (sysStatus[15:0] != (length - 1))) begin
+        $display("Bad status %x", sysStatus);
+        good = 0;
+    end
+    end
+endtask
+
+// Present a sample to the device under test and to the model
+task feedSample;
+    input integer n;
+    reg [(CHANNEL_COUNT*ADC_WIDTH)-1:0] x;
+    integer i, v;
+    begin
+    for (i = 0 ; i < CHANNEL_COUNT ; i = i + 1) begin
+        case (i)
+        0: v = n;
+        1: v = ((n / 3) % 2) ? -FULL_SCALE - 1 : FULL_SCALE;
+        2: v = -FULL_SCALE - 1;
+        default: v = $random;
+        endcase
+        x[i*ADC_WIDTH+:ADC_WIDTH] = v;
+    end
+    modelSample(n, x);
+    @(posedge acqClk) begin
+        acqData <= x;
+        acqTicks <= n * TICKS_PER_SAMPLE;
+        acqStrobe <= 1;
+    end
+    @(posedge acqClk) begin
+        acqData <= {CHANNEL_COUNT*ADC_WIDTH{1'bx}};
+        acqStrobe <= 0;
+    end
+    repeat (SAMPLE_INTERVAL - 2) @(posedge acqClk) ;
+    end
+endtask
+
+// Write control register
+task writeCSR;
+    input [31:0] value;
+    begin
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= value;
+        sysCsrStrobe <= 1;
+    end
+    @(posedge sysClk) begin
+        sysGPIO_OUT <= {32{1'bx}};
+        sysCsrStrobe <= 0;
+    end
+    end
+endtask
+
+endmodule
+`default_nettype wire
@@ -0,0 +1,255 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Test distributed buffer reception.
+ * Send buffers of various lengths from an event generator looped back to
+ * the event receiver and check the contents, length and counts read by the
+ * processor.  Then corrupt a byte in transit and check that the buffer is
+ * counted as bad and that the previous buffer remains published.
+ * Then restart a frame twice in quick succession and check that both
+ * restarts are counted.
+ * The distributed bus and time stamp are checked along the way.
+ */
+`timescale 1ns/1ns
+
+`default_nettype none
+module tinyEVR_tb;
+
+parameter ADDRESS_WIDTH = 6;
+parameter SECONDS       = 32'h12345678;
+parameter BUS_VALUE     = 8'h5A;
+
+reg                      sysClk = 0;
+reg                      sysWriteStrobe = 0;
+reg  [ADDRESS_WIDTH-1:0] sysAddress = 0;
+reg                [7:0] sysData = 0;
+reg                      sysSendStrobe = 0;
+wire                     sysBusy;
+reg  [ADDRESS_WIDTH-1:0] sysBufferAddress = 0;
+wire               [7:0] sysBufferData;
+wire              [31:0] sysBufferStatus;
+
+reg         linkClk = 0;
+reg         ppsStrobe = 0, secondsStrobe = 0;
+wire [15:0] evgTxWord;
+wire  [1:0] evgTxIsK;
+reg   [7:0] corrupt = 0;
+reg         forceK = 0;
+wire        ppsMarker, timestampValid;
+wire [63:0] timestamp;
+wire  [7:0] distributedDataBus;
+
+// Instantiate generator
+tinyEVG #(.DISTRIBUTED_BUFFER_ADDRESS_WIDTH(ADDRESS_WIDTH))
+  tinyEVG_i (
+    .evgTxClk(linkClk),
+    .evgTxWord(evgTxWord),
+    .evgTxIsK(evgTxIsK),
+    .eventCode(8'h00),
+    .eventStrobe(1'b0),
+    .heartbeatRequest(1'b0),
+    .ppsStrobe(ppsStrobe),
+    .secondsStrobe(secondsStrobe),
+    .seconds(SECONDS),
+    .distributedBus(BUS_VALUE),
+    .sysClk(sysClk),
+    .sysWriteStrobe(sysWriteStrobe),
+    .sysAddress(sysAddress),
+    .sysData(sysData),
+    .sysSendStrobe(sysSendStrobe),
+    .sysBusy(sysBusy));
+
+// Instantiate device under test
+tinyEVR #(
+    .EVSTROBE_COUNT(126),
+    .DISTRIBUTED_BUFFER_ADDRESS_WIDTH(ADDRESS_WIDTH))
+  tinyEVR_i (
+    .evrRxClk(linkClk),
+    .evrRxWord(evgTxWord ^ {corrupt, 8'h00}),
+    .evrCharIsK(evgTxIsK | {forceK, 1'b0}),
+    .ppsMarker(ppsMarker),
+    .timestampValid(timestampValid),
+    .timestamp(timestamp),
+    .distributedDataBus(distributedDataBus),
+    .evStrobe(),
+    .sysClk(sysClk),
+    .sysBufferAddress(sysBufferAddress),
+    .sysBufferData(sysBufferData),
+    .sysBufferStatus(sysBufferStatus));
+
+// Generate clocks
+always begin #5 sysClk = !sysClk; end
+always begin #4 linkClk = !linkClk; end
+
+integer good = 1;
+integer i, goodCount = 0, badCount = 0;
+reg [7:0] sent [0:(1<<ADDRESS_WIDTH)-1];
+
+initial
+begin
+    $dumpfile("tinyEVR_tb.fst");
+    $dumpvars(0, tinyEVR_tb);
+
+    // Time of day
+    repeat (10) @(posedge linkClk) ;
+    @(posedge linkClk) secondsStrobe <= 1;
+    @(posedge linkClk) secondsStrobe <= 0;
+    repeat (2) begin
+        repeat (200) @(posedge linkClk) ;
+        @(posedge linkClk) ppsStrobe <= 1;
+        @(posedge linkClk) ppsStrobe <= 0;
+    end
+    repeat (20) @(posedge linkClk) ;
+    if (!timestampValid || (timestamp[63:32] != SECONDS + 1)) begin
+        $display("Bad time stamp %x, valid %d", timestamp, timestampValid);
+        good = 0;
+    end
+
+    // Buffers of various lengths
+    sendBuffer(1);
+    sendBuffer(17);
+    sendBuffer(1 << ADDRESS_WIDTH);
+    sendBuffer(2);
+    sendBuffer(40);
+
+    // Corrupt a data byte and check that the previous buffer is retained
+    for (i = 0 ; i < 40 ; i = i + 1) begin
+        writeByte(i, ~sent[i]);
+    end
+    startSend(40);
+    wait (tinyEVR_i.tinyEVRcommon.distributedBuffer.bufferCount == 5);
+    @(posedge linkClk) corrupt <= 8'h10;
+    repeat (2) @(posedge linkClk) ;
+    corrupt <= 0;
+    badCount = badCount + 1;
+    awaitStatus(40);
+    checkBuffer(40);
+
+    // Turn three consecutive idle buffer slots into K28.0 characters.
+    // The first starts a frame, the other two restart it.
+    @(negedge linkClk) ;
+    while (!tinyEVR_i.tinyEVRcommon.distributedBuffer.bufferSlot) begin
+        @(negedge linkClk) ;
+    end
+    corrupt = BUS_VALUE ^ 8'h1C;
+    forceK = 1;
+    repeat (5) @(negedge linkClk) ;
+    corrupt = 0;
+    forceK = 0;
+    badCount = badCount + 2;
+    awaitStatus(40);
+
+    // The restarted frame then overflows
+    repeat (200) @(posedge linkClk) ;
+    badCount = badCount + 1;
+    awaitStatus(40);
+    checkBuffer(40);
+
+    if (distributedDataBus != BUS_VALUE) begin
+        $display("Distributed bus %x, expected %x -- FAIL",
+                                                distributedDataBus, BUS_VALUE);
+        good = 0;
+    end
+    $display("%s", good ? "PASS" : "FAIL");
+    $finish;
+end
+
+// Send a buffer of random contents and check reception
+task sendBuffer;
+    input integer length;
+    begin
+    for (i = 0 ; i < length ; i = i + 1) begin
+        sent[i] = $random;
+        writeByte(i, sent[i]);
+    end
+    startSend(length);
+    goodCount = goodCount + 1;
+    awaitStatus(length);
+    checkBuffer(length);
+    end
+endtask
+
+task writeByte;
+    input integer address;
+    input   [7:0] value;
+    begin
+    @(posedge sysClk) begin
+        sysAddress <= address;
+        sysData <= value;
+        sysWriteStrobe <= 1;
+    end
+    @(posedge sysClk) sysWriteStrobe <= 0;
+    end
+endtask
+
+task startSend;
+    input integer length;
+    begin
+    @(posedge sysClk) begin
+        sysAddress <= length - 1;
+        sysSendStrobe <= 1;
+    end
+    @(posedge sysClk) sysSendStrobe <= 0;
+    end
+endtask
+
+// Wait for transmission to complete and status to be updated
+task awaitStatus;
+    input integer length;
+    reg [31:0] expectStatus;
+    begin
+    expectStatus = {goodCount[7:0], badCount[7:0], length[15:0]};
+    @(posedge sysClk) ;
+    while (sysBusy) @(posedge sysClk) ;
+    repeat (10) @(posedge sysClk) ;
+    if (sysBufferStatus != expectStatus) begin
+        $display("Status %x, expected %x -- FAIL", sysBufferStatus,
+                                                                expectStatus);
+        good = 0;
+    end
+    end
+endtask
+
+// Read back the published buffer
+task checkBuffer;
+    input integer length;
+    integer a, mismatches;
+    begin
+    mismatches = 0;
+    for (a = 0 ; a < length ; a = a + 1) begin
+        @(posedge sysClk) sysBufferAddress <= a;
+        repeat (2) @(posedge sysClk) ;
+        if (sysBufferData != sent[a]) mismatches = mismatches + 1;
+    end
+    if (mismatches != 0) begin
+        $display("Length %0d buffer had %0d mismatches -- FAIL", length,
+                                                                   mismatches);
+        good = 0;
+    end
+    end
+endtask
+
+endmodule
+`default_nettype wire
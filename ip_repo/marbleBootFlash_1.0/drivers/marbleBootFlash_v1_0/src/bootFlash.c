@@ -23,7 +23,9 @@
  */
 
 /*
- * Rudimentary bit-bash interface to small subset of SPI flash commands.
+ * Interface to small subset of SPI flash commands.
+ * Transfers use the firmware shift engine when present and fall back
+ * to bit-bashing when running on older firmware.
  */
 #include <stdio.h>
 #include <xil_io.h>
@@ -33,8 +35,23 @@
 #define CSR_RW_CS_B    0x2
 #define CSR_RW_MOSI    0x4
 #define CSR_R_MISO     0x8
-#define CSR_READ()   Xil_In32(csrAddress)
-#define CSR_WRITE(v) Xil_Out32(csrAddress, (v))
+#define CSR_W_START         0x80000000
+#define CSR_W_RELEASE_CS_B  0x20000
+#define CSR_W_RECEIVE       0x10000
+#define CSR_R_BUSY          0x80000000
+#define CSR_R_FIFO_LOG2(csr)    (((csr) >> 24) & 0xF)
+#define CSR_R_RX_COUNT(csr)     (((csr) >> 16) & 0xFF)
+#define CSR_R_TX_COUNT(csr)     (((csr) >> 8) & 0xFF)
+#define CSR_READ()    Xil_In32(csrAddress)
+#define CSR_WRITE(v)  Xil_Out32(csrAddress, (v))
+#define DATA_READ()   Xil_In32(csrAddress + 4)
+#define DATA_WRITE(v) Xil_Out32(csrAddress + 4, (v))
+
+/*
+ * Largest shift engine command byte count that keeps
+ * successive commands aligned to FIFO word boundaries.
+ */
+#define ENGINE_MAX_COUNT 0xFFFC
 
 #define MiB(x) ((x)*1024*1024)
 #define KiB(x) ((x)*1024)
@@ -45,6 +62,7 @@ static int flashLoSectorCount;
 static int flashLoSectorSize;
 static int flashHiSectorSize;
 static uint32_t csrAddress;
+static uint32_t engineFIFOcapacity;
 
 /*
  * Command bytes
@@ -61,6 +79,7 @@ static uint32_t csrAddress;
 #define CMD_BE          0x60
 #define CMD_PP          0x02
 #define CMD_READ        0x03
+#define CMD_FAST_READ   0x0B
 #define CMD_ERSP        0x75
 #define CMD_PGSP        0x85
 #define CMD_PGSP        0x85
@@ -90,13 +109,104 @@ bootFlashEnableWriteConfirmation(int enable)
     confirmWrite = (enable != 0);
 }
 
+/*
+ * Shift engine transfers
+ */
+static void
+engineAwaitIdle(void)
+{
+    while (CSR_READ() & CSR_R_BUSY) continue;
+}
+
+static void
+engineTx(const uint8_t *txBuf, uint32_t txLen, int releaseCS)
+{
+    do {
+        uint32_t n = (txLen > ENGINE_MAX_COUNT) ? ENGINE_MAX_COUNT : txLen;
+        uint32_t csr = CSR_W_START | n;
+        uint32_t space = 0;
+        txLen -= n;
+        if (releaseCS && (txLen == 0)) {
+            csr |= CSR_W_RELEASE_CS_B;
+        }
+        engineAwaitIdle();
+        CSR_WRITE(csr);
+        while (n) {
+            uint32_t w = 0;
+            int i;
+            while (space == 0) {
+                space = engineFIFOcapacity - CSR_R_TX_COUNT(CSR_READ());
+            }
+            for (i = 0 ; i < 4 ; i++) {
+                w <<= 8;
+                if (n) {
+                    w |= *txBuf++;
+                    n--;
+                }
+            }
+            DATA_WRITE(w);
+            space--;
+        }
+    } while (txLen);
+}
+
+static void
+engineRx(uint8_t *rxBuf, uint32_t rxLen)
+{
+    while (rxLen) {
+        uint32_t n = (rxLen > ENGINE_MAX_COUNT) ? ENGINE_MAX_COUNT : rxLen;
+        uint32_t available = 0;
+        rxLen -= n;
+        engineAwaitIdle();
+        CSR_WRITE(CSR_W_START | CSR_W_RECEIVE |
+                                   (rxLen ? 0 : CSR_W_RELEASE_CS_B) | n);
+        while (n) {
+            uint32_t w;
+            int i;
+            while (available == 0) {
+                available = CSR_R_RX_COUNT(CSR_READ());
+            }
+            w = DATA_READ();
+            available--;
+            for (i = 24 ; (i >= 0) && n ; i -= 8, n--) {
+                *rxBuf++ = w >> i;
+            }
+        }
+    }
+}
+
 /*
  * Transfer data to/from boot flash.
+ * Chip select remains asserted on return if rxBuf is NULL and rxLen
+ * is not zero so that the next call can continue the flash operation.
  */
 static void
 bootFlashTxRx(const uint8_t *txBuf, uint32_t txLen,
                    uint8_t *rxBuf, uint32_t rxLen)
 {
+    if (engineFIFOcapacity) {
+        uint32_t i;
+        int holdCS = (rxBuf == NULL) && (rxLen != 0);
+        engineTx(txBuf, txLen, !holdCS && (rxLen == 0));
+        if (!holdCS && rxLen) {
+            engineRx(rxBuf, rxLen);
+        }
+        engineAwaitIdle();
+        if (verbose) {
+            xil_printf("bootFlash Tx");
+            for (i = 0 ; i < txLen ; i++) {
+                xil_printf(" %02X", txBuf[i]);
+            }
+            if (!holdCS && rxLen) {
+                xil_printf(" Rx");
+                for (i = 0 ; i < rxLen ; i++) {
+                    xil_printf(" %02X", rxBuf[i]);
+                }
+            }
+            xil_printf("\r\n");
+        }
+        return;
+    }
     CSR_WRITE(0);
     if (verbose) {
         xil_printf("bootFlash Tx");
@@ -208,6 +318,8 @@ bootFlashInit(uint32_t baseAddress)
         return;
     }
     csrAddress = baseAddress;
+    i = CSR_R_FIFO_LOG2(CSR_READ());
+    engineFIFOcapacity = i ? (1 << i) : 0;
 
     /*
      * Toggle STARTUPE2 primitive USRCCLKO since the primitive eats
@@ -255,15 +367,22 @@ bootFlashInit(uint32_t baseAddress)
 int
 bootFlashRead(uint32_t address, uint32_t length, void *buf)
 {
-    uint8_t txBuf[4];
+    uint8_t txBuf[5];
     if (csrAddress == 0) {
         return -1;
     }
-    txBuf[0] = CMD_READ;
     txBuf[1] = address >> 16;
     txBuf[2] = address >> 8;
     txBuf[3] = address;
-    bootFlashTxRx(txBuf, 4, buf, length);
+    if (engineFIFOcapacity) {
+        txBuf[0] = CMD_FAST_READ;
+        txBuf[4] = 0;
+        bootFlashTxRx(txBuf, 5, buf, length);
+    }
+    else {
+        txBuf[0] = CMD_READ;
+        bootFlashTxRx(txBuf, 4, buf, length);
+    }
     return length;
 }
 
@@ -297,98 +416,233 @@ bootFlashCheck(uint32_t address, uint32_t length, const uint8_t *wBuf)
     return 0;
 }
 
+/*
+ * Incremental update.
+ * Each call to bootFlashCrank performs at most one flash operation or
+ * status poll so the application main loop continues to run while
+ * sectors are erased and pages are programmed.
+ */
+#define ERASE_POLL_LIMIT    2000000
+#define PROGRAM_POLL_LIMIT  1000000
+#define CHECK_CHUNK_SIZE    256
+
+enum updateState { US_IDLE,
+                   US_ERASE,
+                   US_ERASE_WAIT,
+                   US_ERASE_CHECK,
+                   US_PROGRAM,
+                   US_PROGRAM_WAIT,
+                   US_PROGRAM_CHECK,
+                   US_DONE,
+                   US_FAILED };
+
+static struct bootFlashUpdate {
+    enum updateState  state;
+    const uint8_t    *buf;
+    uint32_t          address;
+    uint32_t          length;
+    uint32_t          nLeft;
+    uint32_t          sectorSize;
+    uint32_t          checked;
+    uint32_t          wrCount;
+    int               pass;
+    int               polls;
+} update;
+
+static int
+updateActive(void)
+{
+    return (update.state != US_IDLE)
+        && (update.state != US_DONE)
+        && (update.state != US_FAILED);
+}
+
+static void
+updateFailed(void)
+{
+    bootFlashClearStatusRegister();
+    update.state = US_FAILED;
+}
+
+static void
+sendCommandAndAddress(int command, uint32_t address)
+{
+    uint8_t txBuf[4];
+    txBuf[0] = command;
+    txBuf[1] = address >> 16;
+    txBuf[2] = address >> 8;
+    txBuf[3] = address;
+    bootFlashTxRx(txBuf, 4, NULL, 0);
+}
+
 /* 
  * The following function imposes some constraints on how it is invoked.
  *  - The first write to a sector must begin at the first address of the sector.
  *  - Writes must not span a sector boundary.
+ *  - The buffer must remain valid until the update completes.
+ *  - No other boot flash operations may be performed until the update
+ *    completes.
  */
 int
-bootFlashWrite(uint32_t address, uint32_t length, const void *buf)
+bootFlashUpdateStart(uint32_t address, uint32_t length, const void *buf)
 {
-    uint32_t nLeft = length;
-    const uint8_t *txPtr = buf;
+    if ((csrAddress == 0) || updateActive()) {
+        return -1;
+    }
+    update.buf = buf;
+    update.address = address;
+    update.length = length;
+    update.nLeft = length;
+    update.pass = 0;
+    update.state = length ? US_ERASE : US_DONE;
+    return 0;
+}
+
+int
+bootFlashUpdateStatus(uint32_t *bytesWritten)
+{
+    if (bytesWritten) {
+        *bytesWritten = update.length - update.nLeft;
+    }
+    switch (update.state) {
+    case US_IDLE:   return BOOT_FLASH_UPDATE_IDLE;
+    case US_DONE:   return BOOT_FLASH_UPDATE_DONE;
+    case US_FAILED: return BOOT_FLASH_UPDATE_FAILED;
+    default:        return BOOT_FLASH_UPDATE_ACTIVE;
+    }
+}
+
+void
+bootFlashCrank(void)
+{
+    int sr;
     uint8_t txBuf[4];
-    volatile int timeout;
-    uint32_t sectorSize =
-                (address < (uint32_t)(flashLoSectorSize * flashLoSectorCount)) ?
+    uint32_t n;
+
+    switch (update.state) {
+    case US_ERASE:
+        update.sectorSize =
+         (update.address < (uint32_t)(flashLoSectorSize * flashLoSectorCount)) ?
                                           flashLoSectorSize : flashHiSectorSize;
+        if ((update.address % update.sectorSize) != 0) {
+            update.state = US_PROGRAM;
+            break;
+        }
+        if (++update.pass >= 3) {
+            updateFailed();
+            break;
+        }
+        bootFlashWriteEnable();
+        sendCommandAndAddress(update.sectorSize == KiB(4) ? CMD_P4E : CMD_SE,
+                                                                update.address);
+        update.polls = 0;
+        update.state = US_ERASE_WAIT;
+        break;
 
-    if (csrAddress == 0) {
-        return -1;
-    }
-    while (nLeft) {
-        int sr;
-        int wrCount = (nLeft < FLASH_PAGE_SIZE) ? nLeft : FLASH_PAGE_SIZE;
-        if ((address % sectorSize) == 0) {
-            int pass = 0;
-            for (;;) {
-                if (++pass >= 3) {
-                    return -1;
-                }
-                bootFlashWriteEnable();
-                txBuf[0] = (sectorSize == KiB(4)) ? CMD_P4E : CMD_SE;
-                txBuf[1] = address >> 16;
-                txBuf[2] = address >> 8;
-                txBuf[3] = address;
-                bootFlashTxRx(txBuf, 4, NULL, 0);
-                timeout = 0;
-                while (((sr = bootFlashReadStatus()) & 0x21) != 0) {
-                    if (sr & 0x20) {
-                        xil_printf("Erase(0x%X) failed. SR: %02X\r\n", address,
-                                                                            sr);
-                        bootFlashClearStatusRegister();
-                        return -1;
-                    }
-                    if (++timeout >= 2000000) {
-                        txBuf[0] = CMD_ERSP;
-                        bootFlashTxRx(txBuf, 1, NULL, 0);
-                        xil_printf("Erase(0x%X) didn't complete. SR:%02X\r\n",
-                                                                   address, sr);
-                        bootFlashClearStatusRegister();
-                        return -1;
-                    }
-                }
-                if (confirmErase) {
-                    if (bootFlashCheck(address, sectorSize, NULL) < 0) {
-                        continue;
-                    }
-                }
-                break;
+    case US_ERASE_WAIT:
+        sr = bootFlashReadStatus();
+        if (sr & 0x20) {
+            xil_printf("Erase(0x%X) failed. SR: %02X\r\n", update.address, sr);
+            updateFailed();
+        }
+        else if (sr & 0x01) {
+            if (++update.polls >= ERASE_POLL_LIMIT) {
+                txBuf[0] = CMD_ERSP;
+                bootFlashTxRx(txBuf, 1, NULL, 0);
+                xil_printf("Erase(0x%X) didn't complete. SR:%02X\r\n",
+                                                            update.address, sr);
+                updateFailed();
             }
         }
+        else if (confirmErase) {
+            update.checked = 0;
+            update.state = US_ERASE_CHECK;
+        }
+        else {
+            update.state = US_PROGRAM;
+        }
+        break;
+
+    case US_ERASE_CHECK:
+        n = update.sectorSize - update.checked;
+        if (n > CHECK_CHUNK_SIZE) n = CHECK_CHUNK_SIZE;
+        if (bootFlashCheck(update.address + update.checked, n, NULL) < 0) {
+            update.state = US_ERASE;
+            break;
+        }
+        update.checked += n;
+        if (update.checked == update.sectorSize) {
+            update.state = US_PROGRAM;
+        }
+        break;
+
+    case US_PROGRAM:
+        update.pass = 0;
+        update.wrCount = (update.nLeft < FLASH_PAGE_SIZE) ? update.nLeft :
+                                                                FLASH_PAGE_SIZE;
         bootFlashWriteEnable();
         txBuf[0] = CMD_PP;
-        txBuf[1] = address >> 16;
-        txBuf[2] = address >> 8;
-        txBuf[3] = address;
+        txBuf[1] = update.address >> 16;
+        txBuf[2] = update.address >> 8;
+        txBuf[3] = update.address;
         bootFlashTxRx(txBuf, 4, NULL, 0x1);
-        bootFlashTxRx(txPtr, wrCount, NULL, 0);
-        timeout = 0;
-        while (((sr = bootFlashReadStatus()) & 0x41) != 0) {
-            if (sr & 0x40) {
-                xil_printf("Program(0x%X) failed. SR: %02X\r\n", address, sr);
-                bootFlashClearStatusRegister();
-                return -1;
-            }
-            if (++timeout >= 1000000) {
+        bootFlashTxRx(update.buf, update.wrCount, NULL, 0);
+        update.polls = 0;
+        update.state = US_PROGRAM_WAIT;
+        break;
+
+    case US_PROGRAM_WAIT:
+        sr = bootFlashReadStatus();
+        if (sr & 0x40) {
+            xil_printf("Program(0x%X) failed. SR: %02X\r\n", update.address,sr);
+            updateFailed();
+            break;
+        }
+        if (sr & 0x01) {
+            if (++update.polls >= PROGRAM_POLL_LIMIT) {
                 xil_printf("Program(0x%X) didn't complete. SR:%02X\r\n",
-                                                                   address, sr);
+                                                            update.address, sr);
                 txBuf[0] = CMD_PGSP;
                 bootFlashTxRx(txBuf, 1, NULL, 0);
-                bootFlashClearStatusRegister();
-                return -1;
+                updateFailed();
             }
+            break;
         }
         if (confirmWrite) {
-            if (bootFlashCheck(address, wrCount, txPtr) < 0) {
-                return -1;
-            }
+            update.state = US_PROGRAM_CHECK;
+            break;
+        }
+        /* Fall through */
+    case US_PROGRAM_CHECK:
+        if ((update.state == US_PROGRAM_CHECK)
+         && (bootFlashCheck(update.address, update.wrCount, update.buf) < 0)) {
+            update.state = US_FAILED;
+            break;
         }
-        txPtr += wrCount;
-        address += wrCount;
-        nLeft -= wrCount;
+        update.buf += update.wrCount;
+        update.address += update.wrCount;
+        update.nLeft -= update.wrCount;
+        update.state = update.nLeft ? US_ERASE : US_DONE;
+        break;
+
+    default: break;
     }
-    return length;
+}
+
+/*
+ * Blocking write
+ */
+int
+bootFlashWrite(uint32_t address, uint32_t length, const void *buf)
+{
+    int status;
+    if (bootFlashUpdateStart(address, length, buf) < 0) {
+        return -1;
+    }
+    while ((status = bootFlashUpdateStatus(NULL)) == BOOT_FLASH_UPDATE_ACTIVE) {
+        bootFlashCrank();
+    }
+    return (status == BOOT_FLASH_UPDATE_DONE) ? (int)length : -1;
 }
 
 void
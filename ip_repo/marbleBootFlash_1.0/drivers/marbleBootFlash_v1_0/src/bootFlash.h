@@ -44,4 +44,16 @@ void bootFlashEnableEraseConfirmation(int enable);
 void bootFlashEnableWriteConfirmation(int enable);
 void bootFlashProtectGolden(void);
 
+/*
+ * Incremental update -- call bootFlashCrank from the main loop
+ * until bootFlashUpdateStatus no longer returns BOOT_FLASH_UPDATE_ACTIVE.
+ */
+#define BOOT_FLASH_UPDATE_IDLE      0
+#define BOOT_FLASH_UPDATE_ACTIVE    1
+#define BOOT_FLASH_UPDATE_DONE      2
+#define BOOT_FLASH_UPDATE_FAILED    3
+int bootFlashUpdateStart(uint32_t address, uint32_t length, const void *buf);
+int bootFlashUpdateStatus(uint32_t *bytesWritten);
+void bootFlashCrank(void);
+
 #endif /* _BOOT_FLASH_H_ */
@@ -0,0 +1,149 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host-side test of incremental boot flash updates against a mock flash.
+ * The main loop stand-in counts iterations and the largest number of
+ * register accesses made by a single bootFlashCrank call to show that
+ * no call waits for an erase or program operation to complete.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xil_io.h>
+#include "bootFlash.h"
+#include "mockBootFlash.h"
+
+#define IMAGE_SIZE          (300*1024)
+#define IMAGE_ADDRESS       0x400000
+#define SMALL_SECTOR_SIZE   (4*1024)
+#define SMALL_IMAGE_SIZE    (5*SMALL_SECTOR_SIZE + 100)
+#define CRANK_ACCESS_LIMIT  200
+
+static int good = 1;
+
+static void
+check(int condition, const char *msg)
+{
+    if (!condition) {
+        printf("FAIL: %s\n", msg);
+        good = 0;
+    }
+}
+
+/*
+ * Run an update to completion with one crank per main loop iteration
+ */
+static int
+runUpdate(uint32_t address, uint32_t length, const uint8_t *image)
+{
+    struct mockBootFlash *mp = mockInstance();
+    unsigned long iterations = 0, maxAccesses = 0, before;
+    uint32_t progress = 0, lastProgress = 0;
+    unsigned long polls = mp->statusPolls;
+    int status;
+
+    check(bootFlashUpdateStart(address, length, image) == 0, "start");
+    check(bootFlashUpdateStart(address, length, image) < 0,
+                                                 "start while update active");
+    while ((status = bootFlashUpdateStatus(&progress)) ==
+                                                    BOOT_FLASH_UPDATE_ACTIVE) {
+        check(progress >= lastProgress, "progress monotonic");
+        lastProgress = progress;
+        before = mp->transactions;
+        bootFlashCrank();
+        if ((mp->transactions - before) > maxAccesses) {
+            maxAccesses = mp->transactions - before;
+        }
+        iterations++;
+    }
+    printf("%7u bytes at %06X: %6lu iterations, %4lu status polls, "
+           "at most %3lu accesses per crank.\n", length, address,
+           iterations, mp->statusPolls - polls, maxAccesses);
+    check(maxAccesses <= CRANK_ACCESS_LIMIT, "accesses per crank");
+    check(iterations > (mp->statusPolls - polls), "polls spread over cranks");
+    if (status == BOOT_FLASH_UPDATE_DONE) {
+        check(progress == length, "final progress");
+    }
+    return status;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct mockBootFlash *mp;
+    static uint8_t image[IMAGE_SIZE];
+    static uint8_t readback[IMAGE_SIZE];
+    int i;
+
+    mockInit();
+    mp = mockInstance();
+    for (i = 0 ; i < IMAGE_SIZE ; i++) {
+        image[i] = rand();
+    }
+    bootFlashInit(MOCK_BASE_ADDRESS);
+    check(bootFlashUpdateStatus(NULL) == BOOT_FLASH_UPDATE_IDLE, "idle");
+    bootFlashEnableEraseConfirmation(1);
+    bootFlashEnableWriteConfirmation(1);
+
+    /*
+     * 64 KiB sectors
+     */
+    check(runUpdate(IMAGE_ADDRESS, IMAGE_SIZE, image) ==
+                                       BOOT_FLASH_UPDATE_DONE, "large update");
+    check(memcmp(mp->mem + IMAGE_ADDRESS, image, IMAGE_SIZE) == 0,
+                                                        "large image content");
+    check(mp->sectorErases == (IMAGE_SIZE + 65535) / 65536, "sector erases");
+    check(mp->pagePrograms == (IMAGE_SIZE + 255) / 256, "page programs");
+    check(bootFlashRead(IMAGE_ADDRESS, IMAGE_SIZE, readback) == IMAGE_SIZE,
+                                                                "read length");
+    check(memcmp(readback, image, IMAGE_SIZE) == 0, "read content");
+
+    /*
+     * 4 KiB sectors at bottom of flash, partial last page
+     */
+    check(runUpdate(0, SMALL_IMAGE_SIZE, image + 1) ==
+                                       BOOT_FLASH_UPDATE_DONE, "small update");
+    check(memcmp(mp->mem, image + 1, SMALL_IMAGE_SIZE) == 0,
+                                                        "small image content");
+
+    /*
+     * Program failure
+     */
+    mp->failNextProgram = 1;
+    check(runUpdate(IMAGE_ADDRESS, IMAGE_SIZE, image) ==
+                                  BOOT_FLASH_UPDATE_FAILED, "program failure");
+
+    /*
+     * Blocking write still works after a failure
+     */
+    check(bootFlashWrite(IMAGE_ADDRESS, SMALL_IMAGE_SIZE, image + 2) ==
+                                             SMALL_IMAGE_SIZE, "blocking write");
+    check(memcmp(mp->mem + IMAGE_ADDRESS, image + 2, SMALL_IMAGE_SIZE) == 0,
+                                                     "blocking write content");
+
+    printf("%s\n", good ? "PASS" : "FAIL");
+    return good ? 0 : 1;
+}
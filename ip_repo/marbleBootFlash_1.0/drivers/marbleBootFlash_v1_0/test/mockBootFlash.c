@@ -0,0 +1,272 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Mock marbleBootFlash shift engine and flash memory for host-side
+ * driver tests.  Transfers complete as soon as the driver supplies or
+ * consumes the data so the engine is never busy.  Erase and program
+ * operations keep the write-in-progress status bit set for a fixed
+ * number of status register reads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xil_io.h>
+#include "mockBootFlash.h"
+
+#define CSR_W_START         0x80000000
+#define CSR_W_RELEASE_CS_B  0x20000
+#define CSR_W_RECEIVE       0x10000
+#define FIFO_LOG2           4
+
+#define SR_WIP      0x01
+#define SR_WEL      0x02
+#define SR_E_ERR    0x20
+#define SR_P_ERR    0x40
+
+static struct mockBootFlash mock;
+
+/*
+ * Flash memory state
+ */
+static int csActive;
+static int cmd;
+static unsigned int byteIndex;
+static uint32_t address;
+static int wel;
+static int busyPolls;
+static int errorBits;
+
+/*
+ * Shift engine state
+ */
+static uint32_t txRemaining, rxRemaining;
+static int releaseAtEnd;
+
+void
+mockInit(void)
+{
+    if (mock.mem == NULL) {
+        mock.mem = malloc(MOCK_FLASH_SIZE);
+        if (mock.mem == NULL) {
+            fprintf(stderr, "Can't allocate mock flash memory.\n");
+            exit(2);
+        }
+    }
+    memset(mock.mem, 0x00, MOCK_FLASH_SIZE);
+}
+
+struct mockBootFlash *
+mockInstance(void)
+{
+    return &mock;
+}
+
+static void
+flashSelect(void)
+{
+    csActive = 1;
+    byteIndex = 0;
+    cmd = 0;
+}
+
+static void
+flashTx(int b)
+{
+    if (byteIndex == 0) {
+        cmd = b;
+    }
+    else if (byteIndex <= 3) {
+        address = ((address << 8) | b) & 0xFFFFFF;
+    }
+    else if ((cmd == 0x02) && wel && !busyPolls) {
+        mock.mem[address % MOCK_FLASH_SIZE] &= b;
+        address = (address & ~0xFF) | ((address + 1) & 0xFF);
+    }
+    byteIndex++;
+}
+
+static int
+flashRx(void)
+{
+    int r = 0xFF;
+    switch (cmd) {
+    case 0x05:
+        mock.statusPolls++;
+        if (busyPolls) busyPolls--;
+        r = (busyPolls ? SR_WIP : 0) | (wel ? SR_WEL : 0) | errorBits;
+        break;
+    case 0x9F:
+        switch (byteIndex - 1) {
+        case 0x00: r = 0x01; break;
+        case 0x01: r = 0x20; break;
+        case 0x02: r = 0x18; break;
+        case 0x04: r = 0x01; break;
+        case 0x4C: r = 0x03; break;
+        default:   r = 0x00; break;
+        }
+        break;
+    case 0x35: case 0x16: case 0xE0:
+        r = 0x00;
+        break;
+    case 0x03:
+        if (byteIndex >= 4) r = mock.mem[address++ % MOCK_FLASH_SIZE];
+        break;
+    case 0x0B:
+        if (byteIndex >= 5) r = mock.mem[address++ % MOCK_FLASH_SIZE];
+        break;
+    default: break;
+    }
+    byteIndex++;
+    return r;
+}
+
+static void
+flashRelease(void)
+{
+    uint32_t size;
+    csActive = 0;
+    if (byteIndex == 0) {
+        return;
+    }
+    switch (cmd) {
+    case 0x06:
+        wel = 1;
+        break;
+    case 0x30:
+        errorBits = 0;
+        busyPolls = 0;
+        break;
+    case 0xD8: case 0x20:
+        if (wel && !busyPolls && (byteIndex >= 4)) {
+            size = (cmd == 0x20) ? 4096 : 65536;
+            memset(mock.mem + ((address % MOCK_FLASH_SIZE) & ~(size - 1)),
+                                                                  0xFF, size);
+            busyPolls = MOCK_ERASE_POLLS;
+            mock.sectorErases++;
+        }
+        wel = 0;
+        break;
+    case 0x02:
+        if (wel && !busyPolls) {
+            busyPolls = MOCK_PROGRAM_POLLS;
+            mock.pagePrograms++;
+            if (mock.failNextProgram) {
+                mock.failNextProgram = 0;
+                errorBits |= SR_P_ERR;
+            }
+        }
+        wel = 0;
+        break;
+    case 0x01:
+        wel = 0;
+        break;
+    default: break;
+    }
+}
+
+static void
+engineFinish(void)
+{
+    if (releaseAtEnd) {
+        flashRelease();
+    }
+}
+
+uint32_t
+Xil_In32(UINTPTR addr)
+{
+    uint32_t w = 0;
+    int i;
+    mock.transactions++;
+    switch (addr - MOCK_BASE_ADDRESS) {
+    case 0:
+        return ((txRemaining || rxRemaining) ? 0x80000000 : 0)
+             | (FIFO_LOG2 << 24)
+             | (((rxRemaining + 3) / 4 > (1 << FIFO_LOG2) ?
+                            (1 << FIFO_LOG2) : (rxRemaining + 3) / 4) << 16)
+             | (csActive ? 0 : 0x2);
+    case 4:
+        if (rxRemaining == 0) {
+            return 0;
+        }
+        for (i = 0 ; i < 4 ; i++) {
+            w <<= 8;
+            if (rxRemaining) {
+                w |= flashRx();
+                rxRemaining--;
+            }
+        }
+        if (rxRemaining == 0) {
+            engineFinish();
+        }
+        return w;
+    default:
+        fprintf(stderr, "Bad mock address 0x%lX.\n", (unsigned long)addr);
+        exit(2);
+    }
+}
+
+void
+Xil_Out32(UINTPTR addr, uint32_t value)
+{
+    int i;
+    mock.transactions++;
+    switch (addr - MOCK_BASE_ADDRESS) {
+    case 0:
+        if ((value & CSR_W_START) == 0) {
+            return;
+        }
+        if (!csActive) {
+            flashSelect();
+        }
+        releaseAtEnd = ((value & CSR_W_RELEASE_CS_B) != 0);
+        if (value & CSR_W_RECEIVE) {
+            rxRemaining = value & 0xFFFF;
+        }
+        else {
+            txRemaining = value & 0xFFFF;
+        }
+        if ((value & 0xFFFF) == 0) {
+            engineFinish();
+        }
+        break;
+    case 4:
+        if (txRemaining == 0) {
+            return;
+        }
+        for (i = 24 ; (i >= 0) && txRemaining ; i -= 8) {
+            flashTx((value >> i) & 0xFF);
+            txRemaining--;
+        }
+        if (txRemaining == 0) {
+            engineFinish();
+        }
+        break;
+    default:
+        fprintf(stderr, "Bad mock address 0x%lX.\n", (unsigned long)addr);
+        exit(2);
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Mock marbleBootFlash shift engine and S25FL128S flash memory
+ * for host-side driver tests
+ */
+
+#ifndef _MOCK_BOOT_FLASH_H_
+#define _MOCK_BOOT_FLASH_H_
+
+#include <stdint.h>
+
+#define MOCK_BASE_ADDRESS       0x44A20000
+#define MOCK_FLASH_SIZE         (16*1024*1024)
+#define MOCK_ERASE_POLLS        40
+#define MOCK_PROGRAM_POLLS      4
+
+struct mockBootFlash {
+    uint8_t       *mem;
+    int            failNextProgram;
+    unsigned long  transactions;
+    unsigned long  statusPolls;
+    unsigned long  sectorErases;
+    unsigned long  pagePrograms;
+};
+
+void mockInit(void);
+struct mockBootFlash *mockInstance(void);
+
+#endif /* _MOCK_BOOT_FLASH_H_ */
@@ -23,14 +23,42 @@
  */
 
 /*
- * AXI4-Lite connection to simple bit-bash SPI.
+ * AXI4-Lite connection to SPI flash memory.
+ * Two 32-bit registers:
+ *   Offset 0 -- Control/status
+ *   Offset 4 -- Data
+ *
+ * Control write with bit 31 clear sets the pins directly for bit-bashing
+ * (bits 2:0 are MOSI, CSB, SCK) and discards any queued data.
+ * Control write with bit 31 set starts a shift engine command:
+ *   Bits 15:0 -- Number of bytes to transfer
+ *   Bit  16   -- Receive: shift out zeros, queue incoming bytes in RX FIFO
+ *                Transmit: shift out bytes from TX FIFO, discard incoming
+ *   Bit  17   -- Deassert chip select when command completes
+ * Chip select is asserted at the start of a command and remains asserted
+ * until the completion of a command with bit 17 set so a flash memory
+ * operation can be made up of a transmit command followed by a receive
+ * command.  The engine pauses, with SCK low, when it needs data from an
+ * empty TX FIFO or has data for a full RX FIFO.
+ * Control read:
+ *   Bit  31    -- Command in progress
+ *   Bits 27:24 -- Log2 of FIFO capacity, in words
+ *   Bits 20:16 -- RX FIFO word count
+ *   Bits 12:8  -- TX FIFO word count
+ *   Bits 3:0   -- MISO, MOSI, CSB, SCK pin states
+ * Data write pushes a word to the TX FIFO.  Data read pops a word from the
+ * RX FIFO.  Bytes are packed most significant byte first.  Leftover bytes
+ * in the final TX word of a command are discarded.  The final RX word of a
+ * command is left-justified and padded with zeros.
  */
 
 `default_nettype none
 
 module marbleBootflash #(
     ////////////////////// Application-specific Parameters ///////////////////
-    parameter C_S_AXI_ADDR_WIDTH = 2,
+    parameter C_S_AXI_ADDR_WIDTH = 3,
+    parameter SCK_HALF_PERIOD    = 2,
+    parameter FIFO_ADDR_WIDTH    = 4,
     parameter DEBUG              = "false",
     ////////////////////// AXI-Lite Boilerplate Parameters ///////////////////
     parameter C_S_AXI_DATA_WIDTH = 32
@@ -48,7 +76,7 @@ module marbleBootflash #(
     output reg                           s_axi_arready = 1,
     input  wire                    [2:0] s_axi_arprot,
     input  wire [C_S_AXI_ADDR_WIDTH-1:0] s_axi_araddr,
-    output wire [C_S_AXI_DATA_WIDTH-1:0] s_axi_rdata,
+    output reg  [C_S_AXI_DATA_WIDTH-1:0] s_axi_rdata,
     output reg                           s_axi_rvalid = 0,
     input  wire                          s_axi_rready,
     output wire                    [1:0] s_axi_rresp,
@@ -116,20 +144,229 @@ begin
 end
 //////////////////////// End of AXI-Lite Boilerplate ////////////////////////
 
-reg csb = 1, sck = 0, si = 0;
+localparam FIFO_CAPACITY = 1 << FIFO_ADDR_WIDTH;
+localparam FIFO_COUNT_WIDTH = FIFO_ADDR_WIDTH + 1;
+localparam [3:0] FIFO_LOG2_CAPACITY = FIFO_ADDR_WIDTH;
+
+/*
+ * Decode register writes
+ */
+wire writeControl = s_axi_wready && !s_axi_awaddr[2];
+wire writeData    = s_axi_wready &&  s_axi_awaddr[2];
+wire bitBash      = writeControl && !s_axi_wdata[31];
+wire startCommand = writeControl &&  s_axi_wdata[31];
+wire readData     = s_axi_arvalid && s_axi_arready && s_axi_araddr[2];
+
+/*
+ * Transmit FIFO
+ */
+reg [31:0] txFIFO [0:FIFO_CAPACITY-1];
+reg [FIFO_ADDR_WIDTH-1:0] txHead = 0, txTail = 0;
+(*MARK_DEBUG=DEBUG*) reg [FIFO_COUNT_WIDTH-1:0] txCount = 0;
+wire txFull = txCount[FIFO_COUNT_WIDTH-1];
+wire txEmpty = (txCount == 0);
+wire txPush = writeData && !txFull;
+wire txPop;
+always @(posedge s_axi_aclk) begin
+    if (txPush) begin
+        txFIFO[txHead] <= s_axi_wdata;
+    end
+    if (!s_axi_aresetn || bitBash) begin
+        txHead <= 0;
+        txTail <= 0;
+        txCount <= 0;
+    end
+    else begin
+        if (txPush) txHead <= txHead + 1;
+        if (txPop) txTail <= txTail + 1;
+        if (txPush && !txPop) txCount <= txCount + 1;
+        else if (!txPush && txPop) txCount <= txCount - 1;
+    end
+end
+
+/*
+ * Receive FIFO
+ */
+reg [31:0] rxFIFO [0:FIFO_CAPACITY-1];
+reg [FIFO_ADDR_WIDTH-1:0] rxHead = 0, rxTail = 0;
+(*MARK_DEBUG=DEBUG*) reg [FIFO_COUNT_WIDTH-1:0] rxCount = 0;
+wire rxFull = rxCount[FIFO_COUNT_WIDTH-1];
+wire rxEmpty = (rxCount == 0);
+wire rxPop = readData && !rxEmpty;
+wire rxPush;
+wire [31:0] rxPushData;
+always @(posedge s_axi_aclk) begin
+    if (rxPush) begin
+        rxFIFO[rxHead] <= rxPushData;
+    end
+    if (!s_axi_aresetn || bitBash) begin
+        rxHead <= 0;
+        rxTail <= 0;
+        rxCount <= 0;
+    end
+    else begin
+        if (rxPush) rxHead <= rxHead + 1;
+        if (rxPop) rxTail <= rxTail + 1;
+        if (rxPush && !rxPop) rxCount <= rxCount + 1;
+        else if (!rxPush && rxPop) rxCount <= rxCount - 1;
+    end
+end
+
+/*
+ * SPI clock generation
+ */
+localparam SCK_COUNTER_LOAD = SCK_HALF_PERIOD - 2;
+localparam SCK_COUNTER_WIDTH = $clog2(SCK_COUNTER_LOAD+1) + 1;
+reg [SCK_COUNTER_WIDTH-1:0] sckCounter = SCK_COUNTER_LOAD;
+wire sckTick = sckCounter[SCK_COUNTER_WIDTH-1];
+
+/*
+ * Shift engine
+ */
+localparam ST_IDLE  = 3'd0,
+           ST_LOAD  = 3'd1,
+           ST_SHIFT = 3'd2,
+           ST_STORE = 3'd3,
+           ST_END   = 3'd4;
+(*MARK_DEBUG=DEBUG*) reg [2:0] state = ST_IDLE;
+(*MARK_DEBUG=DEBUG*) reg [15:0] byteCount = 0;
+reg cmdReceive = 0, cmdRelease = 0;
+reg [1:0] byteIndex = 0;
+reg [31:0] txWord = 0;
+reg [23:0] rxWord = 0;
+(*MARK_DEBUG=DEBUG*) reg [7:0] shiftReg = 0;
+reg [3:0] bitCounter = 0;
+wire bitsDone = bitCounter[3];
+(*IOB="TRUE"*) reg SIreg = 0;
+wire busy = (state != ST_IDLE);
+wire lastByte = (byteCount == 1);
+
+assign txPop = (state == ST_LOAD) && (byteCount != 0) && !cmdReceive &&
+                                                 (byteIndex == 0) && !txEmpty;
+assign rxPush = (state == ST_STORE) && cmdReceive &&
+                                               ((byteIndex == 3) || lastByte);
+assign rxPushData = (byteIndex == 0) ? { shiftReg, 24'b0 } :
+                    (byteIndex == 1) ? { rxWord[7:0], shiftReg, 16'b0 } :
+                    (byteIndex == 2) ? { rxWord[15:0], shiftReg, 8'b0 } :
+                                       { rxWord[23:0], shiftReg };
+
 always @(posedge s_axi_aclk) begin
+    SIreg <= SI;
     if (!s_axi_aresetn) begin
         SCK <= 1;
         CSB <= 1;
         SO  <= 0;
+        state <= ST_IDLE;
     end
-    else if (s_axi_wready) begin
-        SCK <= s_axi_wdata[0];
-        CSB <= s_axi_wdata[1];
-        SO  <= s_axi_wdata[2];
+    else begin
+        case (state)
+        ST_IDLE: begin
+            if (bitBash) begin
+                SCK <= s_axi_wdata[0];
+                CSB <= s_axi_wdata[1];
+                SO  <= s_axi_wdata[2];
+            end
+            else if (startCommand) begin
+                byteCount <= s_axi_wdata[15:0];
+                cmdReceive <= s_axi_wdata[16];
+                cmdRelease <= s_axi_wdata[17];
+                byteIndex <= 0;
+                SCK <= 0;
+                CSB <= 0;
+                state <= ST_LOAD;
+            end
+        end
+        ST_LOAD: begin
+            sckCounter <= SCK_COUNTER_LOAD;
+            bitCounter <= 6;
+            if (byteCount == 0) begin
+                state <= ST_END;
+            end
+            else if (cmdReceive) begin
+                if (!rxFull) begin
+                    shiftReg <= 8'h00;
+                    SO <= 0;
+                    state <= ST_SHIFT;
+                end
+            end
+            else if (byteIndex == 0) begin
+                if (!txEmpty) begin
+                    txWord <= txFIFO[txTail];
+                    shiftReg <= txFIFO[txTail][31:24];
+                    SO <= txFIFO[txTail][31];
+                    state <= ST_SHIFT;
+                end
+            end
+            else begin
+                shiftReg <= (byteIndex == 1) ? txWord[23:16] :
+                            (byteIndex == 2) ? txWord[15:8] : txWord[7:0];
+                SO <= (byteIndex == 1) ? txWord[23] :
+                      (byteIndex == 2) ? txWord[15] : txWord[7];
+                state <= ST_SHIFT;
+            end
+        end
+        ST_SHIFT: begin
+            if (sckTick) begin
+                sckCounter <= SCK_COUNTER_LOAD;
+                if (!SCK) begin
+                    SCK <= 1;
+                    shiftReg <= { shiftReg[6:0], SIreg };
+                end
+                else begin
+                    SCK <= 0;
+                    if (bitsDone) begin
+                        state <= ST_STORE;
+                    end
+                    else begin
+                        bitCounter <= bitCounter - 1;
+                        SO <= shiftReg[7];
+                    end
+                end
+            end
+            else begin
+                sckCounter <= sckCounter - 1;
+            end
+        end
+        ST_STORE: begin
+            rxWord <= { rxWord[15:0], shiftReg };
+            byteCount <= byteCount - 1;
+            byteIndex <= lastByte ? 0 : byteIndex + 1;
+            state <= ST_LOAD;
+        end
+        ST_END: begin
+            // Ensure minimum chip select deassertion time
+            if (cmdRelease) begin
+                CSB <= 1;
+            end
+            if (sckTick) begin
+                state <= ST_IDLE;
+            end
+            else begin
+                sckCounter <= sckCounter - 1;
+            end
+        end
+        default: state <= ST_IDLE;
+        endcase
+    end
+end
+
+/*
+ * Register readback
+ */
+always @(posedge s_axi_aclk) begin
+    if (s_axi_arvalid && s_axi_arready) begin
+        if (s_axi_araddr[2]) begin
+            s_axi_rdata <= rxFIFO[rxTail];
+        end
+        else begin
+            s_axi_rdata <= { busy, 3'b0,
+                             FIFO_LOG2_CAPACITY,
+                             {8-FIFO_COUNT_WIDTH{1'b0}}, rxCount,
+                             {8-FIFO_COUNT_WIDTH{1'b0}}, txCount,
+                             4'b0, SIreg, SO, CSB, SCK };
+        end
     end
 end
-assign s_axi_rdata = { 28'd0, SI, SO, CSB, SCK };
 
 endmodule
 
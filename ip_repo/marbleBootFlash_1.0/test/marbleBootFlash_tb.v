@@ -0,0 +1,557 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Compare bit-bashed and shift engine access to a simulated SPI flash.
+ * The register access sequences mirror those of the bootFlash driver
+ * so the cycle counts give the speedup of bootFlashRead and bootFlashWrite.
+ * CPU_ACCESS_OVERHEAD approximates the processor and interconnect cost of
+ * each AXI-Lite access.
+ */
+`timescale 1ns/1ns
+
+`default_nettype none
+module marbleBootFlash_tb;
+
+parameter READ_LENGTH         = 4096;
+parameter PAGE_SIZE           = 256;
+parameter CPU_ACCESS_OVERHEAD = 8;
+
+localparam CSR_RW_CLK         = 32'h1;
+localparam CSR_RW_CS_B        = 32'h2;
+localparam CSR_RW_MOSI        = 32'h4;
+localparam CSR_R_MISO         = 32'h8;
+localparam CSR_W_START        = 32'h80000000;
+localparam CSR_W_RELEASE_CS_B = 32'h20000;
+localparam CSR_W_RECEIVE      = 32'h10000;
+localparam CSR_R_BUSY         = 32'h80000000;
+localparam ENGINE_MAX_COUNT   = 32'hFFFC;
+
+localparam CMD_WREN      = 8'h06;
+localparam CMD_RDSR      = 8'h05;
+localparam CMD_PP        = 8'h02;
+localparam CMD_READ      = 8'h03;
+localparam CMD_FAST_READ = 8'h0B;
+
+reg         clk = 0;
+reg         aresetn = 0;
+reg   [2:0] awaddr = 0, araddr = 0;
+reg         awvalid = 0, wvalid = 0, arvalid = 0;
+reg  [31:0] wdata = 0;
+wire        awready, wready, arready, rvalid, bvalid;
+wire [31:0] rdata;
+wire  [1:0] rresp, bresp;
+wire        SCK, CSB, SO, SI;
+
+// Instantiate device under test
+marbleBootflash #(.C_S_AXI_ADDR_WIDTH(3))
+  marbleBootflash_i (
+    .SCK(SCK),
+    .CSB(CSB),
+    .SO(SO),
+    .SI(SI),
+    .s_axi_aclk(clk),
+    .s_axi_aresetn(aresetn),
+    .s_axi_arvalid(arvalid),
+    .s_axi_arready(arready),
+    .s_axi_arprot(3'b0),
+    .s_axi_araddr(araddr),
+    .s_axi_rdata(rdata),
+    .s_axi_rvalid(rvalid),
+    .s_axi_rready(1'b1),
+    .s_axi_rresp(rresp),
+    .s_axi_awvalid(awvalid),
+    .s_axi_awready(awready),
+    .s_axi_awprot(3'b0),
+    .s_axi_awaddr(awaddr),
+    .s_axi_wvalid(wvalid),
+    .s_axi_wready(wready),
+    .s_axi_wstrb(4'hF),
+    .s_axi_wdata(wdata),
+    .s_axi_bvalid(bvalid),
+    .s_axi_bready(1'b1),
+    .s_axi_bresp(bresp));
+
+// Flash memory
+spiFlashModel spiFlashModel_i (
+    .sck(SCK),
+    .csb(CSB),
+    .si(SO),
+    .so(SI));
+
+// Generate clock
+always begin #5 clk = !clk; end
+
+integer good = 1;
+integer accessCount = 0;
+integer i, bbReadCycles, engineReadCycles, bbWriteCycles, engineWriteCycles;
+integer bbReadAccesses, engineReadAccesses;
+integer bbWriteAccesses, engineWriteAccesses;
+time t0;
+reg [7:0] txBuf [0:PAGE_SIZE+4];
+reg [7:0] rxBuf [0:READ_LENGTH-1];
+reg [7:0] pageData [0:PAGE_SIZE-1];
+reg [31:0] csr;
+integer engineFIFOcapacity;
+
+initial
+begin
+    $dumpfile("marbleBootFlash_tb.fst");
+    $dumpvars(0, marbleBootFlash_tb);
+
+    for (i = 0 ; i < PAGE_SIZE ; i = i + 1) begin
+        pageData[i] = (i * 37) ^ 8'h5A;
+    end
+    #40 aresetn = 1;
+    #40 ;
+    axiRead(0, csr);
+    engineFIFOcapacity = 1 << csr[27:24];
+    if (csr[27:24] == 0) begin
+        $display("Shift engine not present.");
+        good = 0;
+    end
+
+    // bootFlashRead
+    clearRx;
+    t0 = $time;
+    accessCount = 0;
+    bbRead(24'h1234, READ_LENGTH);
+    bbReadCycles = ($time - t0) / 10;
+    bbReadAccesses = accessCount;
+    checkRead(24'h1234, READ_LENGTH);
+
+    clearRx;
+    t0 = $time;
+    accessCount = 0;
+    engineRead(24'h2345, READ_LENGTH);
+    engineReadCycles = ($time - t0) / 10;
+    engineReadAccesses = accessCount;
+    checkRead(24'h2345, READ_LENGTH);
+
+    // Page program portion of bootFlashWrite
+    t0 = $time;
+    accessCount = 0;
+    bbWrite(24'h8000);
+    bbWriteCycles = ($time - t0) / 10;
+    bbWriteAccesses = accessCount;
+    clearRx;
+    engineRead(24'h8000, PAGE_SIZE);
+    checkWrite;
+
+    t0 = $time;
+    accessCount = 0;
+    engineWrite(24'h8100);
+    engineWriteCycles = ($time - t0) / 10;
+    engineWriteAccesses = accessCount;
+    clearRx;
+    bbRead(24'h8100, PAGE_SIZE);
+    checkWrite;
+
+    $display("Read %0d bytes:", READ_LENGTH);
+    $display("    Bit-bash: %0d cycles, %0d accesses",
+                                              bbReadCycles, bbReadAccesses);
+    $display("      Engine: %0d cycles, %0d accesses -- %0d times faster",
+            engineReadCycles, engineReadAccesses,
+            bbReadCycles / engineReadCycles);
+    $display("Program %0d byte page (excluding flash programming time):",
+                                                                  PAGE_SIZE);
+    $display("    Bit-bash: %0d cycles, %0d accesses",
+                                            bbWriteCycles, bbWriteAccesses);
+    $display("      Engine: %0d cycles, %0d accesses -- %0d times faster",
+            engineWriteCycles, engineWriteAccesses,
+            bbWriteCycles / engineWriteCycles);
+    if (engineReadCycles * 10 > bbReadCycles) begin
+        $display("Insufficient read speedup.");
+        good = 0;
+    end
+    if (engineWriteCycles * 10 > bbWriteCycles) begin
+        $display("Insufficient write speedup.");
+        good = 0;
+    end
+    #10 ;
+    $display("%s", good ? "PASS" : "FAIL");
+    $finish;
+end
+
+///////////////////////////////////////////////////////////////////////////////
+// Checks
+task clearRx;
+    integer n;
+    begin
+    for (n = 0 ; n < READ_LENGTH ; n = n + 1) rxBuf[n] = 8'hxx;
+    end
+endtask
+
+task checkRead;
+    input [23:0] address;
+    input integer length;
+    integer n, bad;
+    begin
+    bad = 0;
+    for (n = 0 ; n < length ; n = n + 1) begin
+        if (rxBuf[n] !== spiFlashModel_i.mem[address + n]) begin
+            if (bad < 10) $display("Read %x: got %x, expected %x",
+                   address + n, rxBuf[n], spiFlashModel_i.mem[address + n]);
+            bad = bad + 1;
+        end
+    end
+    if (bad) good = 0;
+    end
+endtask
+
+task checkWrite;
+    integer n, bad;
+    begin
+    bad = 0;
+    for (n = 0 ; n < PAGE_SIZE ; n = n + 1) begin
+        if (rxBuf[n] !== pageData[n]) begin
+            if (bad < 10) $display("Write %0d: got %x, expected %x",
+                                                   n, rxBuf[n], pageData[n]);
+            bad = bad + 1;
+        end
+    end
+    if (bad) good = 0;
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// Driver bootFlashRead and bootFlashWrite equivalents
+task bbRead;
+    input [23:0] address;
+    input integer length;
+    begin
+    txBuf[0] = CMD_READ;
+    txBuf[1] = address[23:16];
+    txBuf[2] = address[15:8];
+    txBuf[3] = address[7:0];
+    bbTxRx(0, 4, length, 0);
+    end
+endtask
+
+task engineRead;
+    input [23:0] address;
+    input integer length;
+    begin
+    txBuf[0] = CMD_FAST_READ;
+    txBuf[1] = address[23:16];
+    txBuf[2] = address[15:8];
+    txBuf[3] = address[7:0];
+    txBuf[4] = 0;
+    engineTx(0, 5, 0);
+    engineRx(length);
+    engineAwaitIdle;
+    end
+endtask
+
+task bbWrite;
+    input [23:0] address;
+    integer n;
+    begin
+    txBuf[0] = CMD_WREN;
+    bbTxRx(0, 1, 0, 0);
+    txBuf[0] = CMD_PP;
+    txBuf[1] = address[23:16];
+    txBuf[2] = address[15:8];
+    txBuf[3] = address[7:0];
+    for (n = 0 ; n < PAGE_SIZE ; n = n + 1) txBuf[4+n] = pageData[n];
+    bbTxRx(0, 4, 1, 1);
+    bbTxRx(4, PAGE_SIZE, 0, 0);
+    txBuf[0] = CMD_RDSR;
+    rxBuf[0] = 1;
+    while (rxBuf[0] & 8'h1) bbTxRx(0, 1, 1, 0);
+    end
+endtask
+
+task engineWrite;
+    input [23:0] address;
+    integer n;
+    begin
+    txBuf[0] = CMD_WREN;
+    engineTx(0, 1, 1);
+    engineAwaitIdle;
+    txBuf[0] = CMD_PP;
+    txBuf[1] = address[23:16];
+    txBuf[2] = address[15:8];
+    txBuf[3] = address[7:0];
+    for (n = 0 ; n < PAGE_SIZE ; n = n + 1) txBuf[4+n] = pageData[n];
+    engineTx(0, 4, 0);
+    engineTx(4, PAGE_SIZE, 1);
+    engineAwaitIdle;
+    txBuf[0] = CMD_RDSR;
+    rxBuf[0] = 1;
+    while (rxBuf[0] & 8'h1) begin
+        engineTx(0, 1, 0);
+        engineRx(1);
+        engineAwaitIdle;
+    end
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// Driver bootFlashTxRx bit-bash equivalent
+task bbTxRx;
+    input integer txOffset;
+    input integer txLen;
+    input integer rxLen;
+    input integer holdCS;
+    integer n, b;
+    reg [7:0] w;
+    reg [31:0] r;
+    begin
+    axiWrite(0, 0);
+    for (n = 0 ; n < txLen ; n = n + 1) begin
+        w = txBuf[txOffset + n];
+        for (b = 7 ; b >= 0 ; b = b - 1) begin
+            axiWrite(0, w[b] ? CSR_RW_MOSI : 0);
+            axiWrite(0, (w[b] ? CSR_RW_MOSI : 0) | CSR_RW_CLK);
+        end
+    end
+    if (!holdCS) begin
+        if (rxLen) begin
+            for (n = 0 ; n < rxLen ; n = n + 1) begin
+                for (b = 7 ; b >= 0 ; b = b - 1) begin
+                    axiWrite(0, CSR_RW_CLK);
+                    axiWrite(0, 0);
+                    axiRead(0, r);
+                    w[b] = ((r & CSR_R_MISO) != 0);
+                end
+                rxBuf[n] = w;
+            end
+        end
+        else begin
+            axiWrite(0, 0);
+        end
+        axiWrite(0, CSR_RW_CS_B);
+    end
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// Driver shift engine equivalents
+task engineAwaitIdle;
+    reg [31:0] r;
+    begin
+    r = CSR_R_BUSY;
+    while (r & CSR_R_BUSY) axiRead(0, r);
+    end
+endtask
+
+task engineTx;
+    input integer txOffset;
+    input integer txLen;
+    input integer releaseCS;
+    integer n, k, space;
+    reg [31:0] r, w;
+    begin
+    n = txLen;
+    space = 0;
+    engineAwaitIdle;
+    axiWrite(0, CSR_W_START | n | (releaseCS ? CSR_W_RELEASE_CS_B : 0));
+    while (n) begin
+        while (space == 0) begin
+            axiRead(0, r);
+            space = engineFIFOcapacity - r[15:8];
+        end
+        w = 0;
+        for (k = 0 ; k < 4 ; k = k + 1) begin
+            w = w << 8;
+            if (n) begin
+                w[7:0] = txBuf[txOffset];
+                txOffset = txOffset + 1;
+                n = n - 1;
+            end
+        end
+        axiWrite(4, w);
+        space = space - 1;
+    end
+    end
+endtask
+
+task engineRx;
+    input integer rxLen;
+    integer n, k, available, idx;
+    reg [31:0] r, w;
+    begin
+    n = rxLen;
+    idx = 0;
+    available = 0;
+    engineAwaitIdle;
+    axiWrite(0, CSR_W_START | CSR_W_RECEIVE | CSR_W_RELEASE_CS_B | n);
+    while (n) begin
+        while (available == 0) begin
+            axiRead(0, r);
+            available = r[23:16];
+        end
+        axiRead(4, w);
+        available = available - 1;
+        for (k = 24 ; (k >= 0) && n ; k = k - 8) begin
+            rxBuf[idx] = w >> k;
+            idx = idx + 1;
+            n = n - 1;
+        end
+    end
+    end
+endtask
+
+///////////////////////////////////////////////////////////////////////////////
+// AXI-Lite accesses
+task axiWrite;
+    input [2:0] addr;
+    input [31:0] data;
+    begin
+    repeat (CPU_ACCESS_OVERHEAD) @(posedge clk) ;
+    @(posedge clk) begin
+        awaddr <= addr;
+        wdata <= data;
+        awvalid <= 1;
+        wvalid <= 1;
+    end
+    @(posedge clk) ;
+    while (!(awready && wready)) @(posedge clk) ;
+    awvalid <= 0;
+    wvalid <= 0;
+    awaddr <= 3'bx;
+    wdata <= 32'bx;
+    @(posedge clk) ;
+    while (!bvalid) @(posedge clk) ;
+    accessCount = accessCount + 1;
+    end
+endtask
+
+task axiRead;
+    input  [2:0] addr;
+    output [31:0] data;
+    begin
+    repeat (CPU_ACCESS_OVERHEAD) @(posedge clk) ;
+    @(posedge clk) begin
+        araddr <= addr;
+        arvalid <= 1;
+    end
+    @(posedge clk) ;
+    while (!arready) @(posedge clk) ;
+    arvalid <= 0;
+    araddr <= 3'bx;
+    @(posedge clk) ;
+    while (!rvalid) @(posedge clk) ;
+    data = rdata;
+    accessCount = accessCount + 1;
+    end
+endtask
+
+endmodule
+
+/*
+ * Minimal SPI flash memory model.
+ * Mode 0, READ, FAST_READ, WREN, RDSR and PP commands only.
+ */
+module spiFlashModel #(
+    parameter ADDRESS_WIDTH = 16,
+    parameter PROGRAM_TIME  = 20000,
+    parameter OUTPUT_DELAY  = 7
+    ) (
+    input  wire sck,
+    input  wire csb,
+    input  wire si,
+    output reg  so = 1'bz);
+
+localparam CMD_WREN      = 8'h06;
+localparam CMD_RDSR      = 8'h05;
+localparam CMD_PP        = 8'h02;
+localparam CMD_READ      = 8'h03;
+localparam CMD_FAST_READ = 8'h0B;
+
+reg [7:0] mem [0:(1<<ADDRESS_WIDTH)-1];
+integer i;
+initial begin
+    for (i = 0 ; i < (1 << ADDRESS_WIDTH) ; i = i + 1) begin
+        mem[i] = (i < (1 << (ADDRESS_WIDTH-1))) ? ((i * 40503) >> 5) : 8'hFF;
+    end
+end
+
+reg [7:0] cmd = 0, inByte = 0, outByte = 8'hFF;
+reg [23:0] address = 0;
+integer bitCount = 0, byteCount = 0;
+reg wel = 0, wip = 0;
+
+always @(negedge csb) begin
+    bitCount = 0;
+    byteCount = 0;
+    outByte = 8'hFF;
+end
+
+always @(posedge csb) begin
+    so <= #OUTPUT_DELAY 1'bz;
+    if (byteCount != 0) begin
+        case (cmd)
+        CMD_WREN: wel = 1;
+        CMD_PP: if (wel) begin
+                    wel = 0;
+                    wip = 1;
+                    wip <= #PROGRAM_TIME 0;
+                end
+        default: ;
+        endcase
+    end
+end
+
+always @(negedge sck) begin
+    if (!csb) so <= #OUTPUT_DELAY outByte[7-bitCount];
+end
+
+always @(posedge sck) begin
+    if (!csb) begin
+        inByte = { inByte[6:0], si };
+        bitCount = bitCount + 1;
+        if (bitCount == 8) begin
+            bitCount = 0;
+            if (byteCount == 0) begin
+                cmd = inByte;
+            end
+            else if (byteCount <= 3) begin
+                address = { address[15:0], inByte };
+            end
+            else if ((cmd == CMD_PP) && wel && !wip) begin
+                mem[address[ADDRESS_WIDTH-1:0]] =
+                                  mem[address[ADDRESS_WIDTH-1:0]] & inByte;
+                address[7:0] = address[7:0] + 1;
+            end
+            byteCount = byteCount + 1;
+            case (cmd)
+            CMD_RDSR: outByte = { 6'b0, wel, wip };
+            CMD_READ: if (byteCount >= 4) begin
+                          outByte = mem[address[ADDRESS_WIDTH-1:0]];
+                          address = address + 1;
+                      end
+            CMD_FAST_READ: if (byteCount >= 5) begin
+                          outByte = mem[address[ADDRESS_WIDTH-1:0]];
+                          address = address + 1;
+                      end
+            default: outByte = 8'hFF;
+            endcase
+        end
+    end
+end
+
+endmodule
+`default_nettype wire
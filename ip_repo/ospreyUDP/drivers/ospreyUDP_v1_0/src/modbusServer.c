@@ -34,8 +34,18 @@
  *    2   Protocol  Must be 0.
  *    2   Size      Number of remaining bytes, including address and function.
  *    1   Unit      Slave address (ignored, but echoed).
- *    1   Function  MODBUS function code (this server supports 3, 6 and 16).
+ *    1   Function  MODBUS function code (this server supports 3, 6, 16 and 23
+ *                  and the vendor-specific codes described below).
  *    n             Data
+ *
+ * Vendor-specific bulk read functions.  Replies have a two byte byte count
+ * so that a single reply can fill a full size UDP packet.
+ *   65  Read holding registers
+ *         Request: 2 byte register base, 2 byte register count.
+ *         Reply:   2 byte byte count, register values.
+ *   66  Read register list
+ *         Request: 2 byte register count, register numbers.
+ *         Reply:   2 byte byte count, register values in request order.
  */
 
 #include <stdio.h>
@@ -45,16 +55,26 @@
 #define MODBUS_DEFAULT_UDP_PORT 502
 
 #define MAX_REGCOUNT    127
+#define MAX_FC23_WRITE_REGCOUNT 121
+#define MODBUS_PACKET_CAPACITY  1472
+#define MAX_BULK_REGCOUNT       ((MODBUS_PACKET_CAPACITY - 10) / 2)
 
 #define FC_READ_HOLDING_REGISTERS            3
 #define FC_WRITE_SINGLE_HOLDING_REGISTER     6
 #define FC_WRITE_MULTIPLE_HOLDING_REGISTERS 16
+#define FC_READ_WRITE_MULTIPLE_REGISTERS    23
+#define FC_BULK_READ_HOLDING_REGISTERS      65
+#define FC_BULK_READ_REGISTER_LIST          66
 
 #define U8COUNT_TO_PKSIZE(d)   ((d)+8)
 #define PKSIZE_TO_HSIZE(p)     ((p)-6)
 
 static int (*diagOut)(const char *fmt, ...);
-static uint8_t replyBuf[8+2+(MAX_REGCOUNT*2)];
+static union {
+    uint16_t align;
+    uint8_t  buf[MODBUS_PACKET_CAPACITY];
+} reply;
+#define replyBuf reply.buf
 
 void
 modbusServerSetDebugFunction(int (*prfunc)(const char *fmt, ...))
@@ -82,13 +102,12 @@ replyError(const uint8_t *cmd, int errorCode)
 }
 
 static int
-replyData(const uint8_t *cmd, uint16_t *regp)
+replyData(const uint8_t *cmd, int regCount, uint16_t *regp)
 {
-    int regCount = cmd[11]; /* regCount known to be <= MAX_REGCOUNT */
     uint16_t *endp = regp + regCount;
     int j = 9;
     replyBuf[7] = cmd[7];
-    replyBuf[8] = regCount * 2;
+    replyBuf[8] = regCount * 2; /* regCount known to be <= MAX_REGCOUNT */
     while (regp != endp) {
         int r = *regp++;
         replyBuf[j++] = r >> 8;
@@ -97,6 +116,50 @@ replyData(const uint8_t *cmd, uint16_t *regp)
     return j;
 }
 
+/*
+ * Bulk replies have a two byte byte count.
+ * Register values are in place starting at replyBuf[10].
+ */
+static int
+replyBulkData(const uint8_t *cmd, int regCount, uint16_t *regp)
+{
+    uint8_t *cp = (uint8_t *)regp;
+    int i;
+    replyBuf[7] = cmd[7];
+    replyBuf[8] = (regCount * 2) >> 8;
+    replyBuf[9] = regCount * 2;
+    for (i = 0 ; i < regCount ; i++) {
+        int r = regp[i];
+        *cp++ = r >> 8;
+        *cp++ = r;
+    }
+    return 10 + (regCount * 2);
+}
+
+/*
+ * Read a list of registers, merging runs of consecutive
+ * register numbers into a single application callback.
+ */
+static int
+readRegisterList(const uint8_t *list, int regCount, uint16_t *regp)
+{
+    int i = 0;
+    while (i < regCount) {
+        int regBase = (list[2*i] << 8) | list[2*i+1];
+        int n = 1;
+        while ((i + n) < regCount) {
+            int r = (list[2*(i+n)] << 8) | list[2*(i+n)+1];
+            if (r != (regBase + n)) break;
+            n++;
+        }
+        if (modbusServerCallbackCode3(regBase, n, regp + i) != 0) {
+            return -1;
+        }
+        i += n;
+    }
+    return 0;
+}
+
 static void
 modbusCallback(ospreyUDPendpoint endpoint, uint32_t farAddress, int farPort,
                                            const char *buf, int length)
@@ -134,7 +197,7 @@ modbusCallback(ospreyUDPendpoint endpoint, uint32_t farAddress, int farPort,
                     int regCount = (cmd[10] << 8) | cmd[11];
                     if ((regCount != 0) && (regCount <= MAX_REGCOUNT)) {
                         if (modbusServerCallbackCode3(regBase, regCount, regp) == 0)
-                            replyLen = replyData(cmd, regp);
+                            replyLen = replyData(cmd, regCount, regp);
                         else
                             replyLen = replyError(cmd, MODBUS_EXCEPTION_ILLEGAL_ADDRESS);
                     }
@@ -178,6 +241,68 @@ modbusCallback(ospreyUDPendpoint endpoint, uint32_t farAddress, int farPort,
                 }
                 break;
 
+            case FC_READ_WRITE_MULTIPLE_REGISTERS:
+                if (length >= U8COUNT_TO_PKSIZE(11)) {
+                    int rBase = (cmd[8] << 8) | cmd[9];
+                    int rCount = (cmd[10] << 8) | cmd[11];
+                    int wBase = (cmd[12] << 8) | cmd[13];
+                    int wCount = (cmd[14] << 8) | cmd[15];
+                    int bCount = cmd[16];
+                    if ((length == U8COUNT_TO_PKSIZE(9 + bCount))
+                     && (rCount != 0) && (rCount <= MAX_REGCOUNT)
+                     && (wCount != 0) && (wCount <= MAX_FC23_WRITE_REGCOUNT)
+                     && (bCount == (wCount * 2))) {
+                        int i, j;
+                        for (i = 0, j = 17 ; i < wCount ; i++) {
+                            int r;
+                            r = cmd[j++] << 8;
+                            r |= cmd[j++];
+                            regp[i] = r;
+                        }
+                        if ((modbusServerCallbackCode16(wBase, wCount, regp) == 0)
+                         && (modbusServerCallbackCode3(rBase, rCount, regp) == 0))
+                            replyLen = replyData(cmd, rCount, regp);
+                        else
+                            replyLen = replyError(cmd, MODBUS_EXCEPTION_ILLEGAL_ADDRESS);
+                    }
+                    else {
+                        replyLen = replyError(cmd, MODBUS_EXCEPTION_ILLEGAL_VALUE);
+                    }
+                }
+                break;
+
+            case FC_BULK_READ_HOLDING_REGISTERS:
+                if (length == U8COUNT_TO_PKSIZE(4)) {
+                    int regBase = (cmd[8] << 8) | cmd[9];
+                    int regCount = (cmd[10] << 8) | cmd[11];
+                    if ((regCount != 0) && (regCount <= MAX_BULK_REGCOUNT)) {
+                        if (modbusServerCallbackCode3(regBase, regCount, regp) == 0)
+                            replyLen = replyBulkData(cmd, regCount, regp);
+                        else
+                            replyLen = replyError(cmd, MODBUS_EXCEPTION_ILLEGAL_ADDRESS);
+                    }
+                    else {
+                        replyLen = replyError(cmd, MODBUS_EXCEPTION_ILLEGAL_VALUE);
+                    }
+                }
+                break;
+
+            case FC_BULK_READ_REGISTER_LIST:
+                if (length >= U8COUNT_TO_PKSIZE(4)) {
+                    int regCount = (cmd[8] << 8) | cmd[9];
+                    if ((length == U8COUNT_TO_PKSIZE(2 + (regCount * 2)))
+                     && (regCount != 0) && (regCount <= MAX_BULK_REGCOUNT)) {
+                        if (readRegisterList(&cmd[10], regCount, regp) == 0)
+                            replyLen = replyBulkData(cmd, regCount, regp);
+                        else
+                            replyLen = replyError(cmd, MODBUS_EXCEPTION_ILLEGAL_ADDRESS);
+                    }
+                    else {
+                        replyLen = replyError(cmd, MODBUS_EXCEPTION_ILLEGAL_VALUE);
+                    }
+                }
+                break;
+
             default:
                 replyLen = replyError(cmd, MODBUS_EXCEPTION_ILLEGAL_FUNCTION);
                 break;
@@ -24,16 +24,22 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <xil_io.h>
 #include "ospreyUDP.h"
 
+/* Busy checks with packets waiting before transmitter is declared stalled */
 #define SEND_CHECK_LIMIT    500000
 
+#define CSR_R_PKBUF_WINDOW      0x80000000
 #define CSR_R_RESET             0x40000000
 #define CSR_R_TX_BUSY           0x20000000
 #define CSR_R_RX_FULL           0x10000000
+#define CSR_R_RX_RING           0x8000000
+#define CSR_R_FAST_TABLE        0x4000000
 #define CSR_R_TX_OVERRUN        0x2000000
 #define CSR_R_RX_IRQ_ENABLE     0x1000000
+#define CSR_R_FAST_STREAMS      0x800000
 #define CSR_R_SPEED_MASK        0x300000
 #define CSR_R_PKADDR_MASK       0x7FFF
 #define CSR_W_REMOVE_RESET      0x80000000
@@ -55,10 +61,24 @@
 #define REG_NETMASK          36
 #define REG_FAST_DESTINATION 40
 #define REG_FAST_PORTS       44
+#define REG_RX_RING          48
+#define REG_RX_OVERFLOW      52
+#define REG_RX_BAD_FRAME     56
+#define REG_FAST_SUBSCRIBER  60
+#define FAST_SUBSCRIBER_W_ENABLE  0x80000000
+#define FAST_SUBSCRIBER_W_DISABLE 0x40000000
+#define FAST_SUBSCRIBER_W_STREAM  0x20000000
+#define FAST_SUBSCRIBER_W_STREAM_1 0x10000000
+#define FAST_SUBSCRIBER_CAPACITY(r) (((r) >> 24) & 0xFF)
+#define REG_PKBUF_WINDOW     0x8000
 #define REG_READ(ip,reg)    Xil_In32(ip->baseAddress+(reg))
 #define REG_WRITE(ip,reg,v) Xil_Out32(ip->baseAddress+(reg),(v))
 #define CSR_READ(ip)    REG_READ(ip, REG_CSR)
 #define CSR_WRITE(ip,v) REG_WRITE(ip, REG_CSR, (v))
+#define PKBUF_READ(ip,i)    REG_READ(ip, REG_PKBUF_WINDOW+((i)<<2))
+#define PKBUF_WRITE(ip,i,v) REG_WRITE(ip, REG_PKBUF_WINDOW+((i)<<2), (v))
+#define PKBUF_POINTER(ip)   ((char *)(UINTPTR)((ip)->baseAddress+REG_PKBUF_WINDOW))
+#define RX_RING_PENDING(r)  (((r) >> 16) & 0xFF)
 
 #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
 # define OSPREY_UDP_INTERFACE_ARG int interface,
@@ -66,9 +86,49 @@
 # define OSPREY_UDP_INTERFACE_ARG
 #endif
 
+/*
+ * Endpoints are found by hashing the near port number
+ */
+#ifndef OSPREY_UDP_PORT_HASH_SIZE
+# define OSPREY_UDP_PORT_HASH_SIZE 16   /* Must be a power of two */
+#endif
+#define PORT_HASH(p) (((p) ^ ((p) >> 4) ^ ((p) >> 8)) & \
+                                                 (OSPREY_UDP_PORT_HASH_SIZE-1))
+
+/*
+ * Packets waiting for the transmitter
+ */
+struct txQueueEntry {
+    struct endpoint *ep;
+    uint32_t         farAddress;
+    int              farPort;
+    unsigned int     length;
+    union {
+        uint32_t l[(OSPREY_UDP_PACKET_CAPACITY+sizeof(uint32_t)-1)/
+                                                              sizeof(uint32_t)];
+        char     c[OSPREY_UDP_PACKET_CAPACITY];
+    } buf;
+};
+
 struct interface {
     uint32_t         baseAddress;
-    struct endpoint *eHead;
+    struct endpoint *portHash[OSPREY_UDP_PORT_HASH_SIZE];
+    uint32_t         noListener;
+    int              hasWindow;
+    int              hasRing;
+    int              fastSubscriberCapacity;
+    int              hasFastStreams;
+    struct txQueueEntry txQueue[OSPREY_UDP_TX_QUEUE_CAPACITY];
+    unsigned int     txHead;
+    unsigned int     txTail;
+    unsigned int     txBusyChecks;
+    uint32_t         txHighWater;
+    uint32_t         txDropped;
+    uint32_t         txResets;
+    #ifdef OSPREY_UDP_RX_INTERRUPT
+    int              rxInterrupt;
+    volatile int     rxStalled;
+    #endif
 };
 static struct interface interfaces[OSPREY_UDP_INTERFACE_CAPACITY];
 static int interfaceCount = 0;
@@ -80,6 +140,10 @@ struct endpoint {
     #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
     uint16_t          interface;
     #endif
+    uint32_t          rxPackets;
+    uint32_t          txPackets;
+    uint32_t          rxDropped;
+    uint32_t          txDropped;
 };
 static struct endpoint *eFree;
 
@@ -93,12 +157,63 @@ resetHardware(struct interface *ip)
     for (d = 0 ; d < 10 ; d++) continue;
 }
 
+/*
+ * Reset the hardware after the transmitter has been busy for too long.
+ * The configuration registers are unaffected but the receive
+ * interrupt enable is cleared and must be restored.
+ */
+static void
+recoverTransmitter(struct interface *ip)
+{
+    ip->txResets++;
+    xil_printf("NETWORK TRANSMISSION LOCKED UP!  RESETTING HARDWARE.\n");
+    resetHardware(ip);
+    #ifdef OSPREY_UDP_RX_INTERRUPT
+    if (ip->rxInterrupt) {
+        ip->rxStalled = 0;
+        CSR_WRITE(ip, CSR_W_SET_RX_IRQ_ENABLE);
+    }
+    #endif
+}
+
+static int
+transmitterIdle(struct interface *ip)
+{
+    if ((CSR_READ(ip) & CSR_R_TX_BUSY) == 0) {
+        ip->txBusyChecks = 0;
+        return 1;
+    }
+    if (++ip->txBusyChecks >= SEND_CHECK_LIMIT) {
+        ip->txBusyChecks = 0;
+        recoverTransmitter(ip);
+        return 1;
+    }
+    return 0;
+}
+
+static void
+awaitTransmitter(struct interface *ip)
+{
+    while (!transmitterIdle(ip)) continue;
+}
+
+static struct interface *
+endpointInterface(struct endpoint *ep)
+{
+    #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
+    return &interfaces[ep->interface];
+    #else
+    return &interfaces[0];
+    #endif
+}
+
 int
 ospreyUDPregisterInterface(uint32_t baseAddress,
                        uint32_t address, uint32_t gateway, uint32_t netmask,
                        uint8_t mac[6])
 {
     struct interface *ip;
+    uint32_t csr;
     if (interfaceCount == 0) {
         static struct endpoint endpoints[OSPREY_UDP_ENDPOINT_CAPACITY];
         int i;
@@ -113,6 +228,17 @@ ospreyUDPregisterInterface(uint32_t baseAddress,
     ip = &interfaces[interfaceCount];
     ip->baseAddress = baseAddress;
     resetHardware(ip);
+    csr = CSR_READ(ip);
+    ip->hasWindow = ((csr & CSR_R_PKBUF_WINDOW) != 0);
+    ip->hasRing = ((csr & CSR_R_RX_RING) != 0);
+    if (csr & CSR_R_FAST_TABLE) {
+        ip->fastSubscriberCapacity =
+                     FAST_SUBSCRIBER_CAPACITY(REG_READ(ip, REG_FAST_SUBSCRIBER));
+    }
+    else {
+        ip->fastSubscriberCapacity = 1;
+    }
+    ip->hasFastStreams = ((csr & CSR_R_FAST_STREAMS) != 0);
     REG_WRITE(ip, REG_MAC_LO, (mac[2]<<24)|(mac[3]<<16)|(mac[4]<<8)|mac[5]);
     REG_WRITE(ip, REG_MAC_HI, (mac[0]<<8)|mac[1]);
     REG_WRITE(ip, REG_LOCAL, address);
@@ -143,55 +269,300 @@ ospreyUDPregisterEndpoint(OSPREY_UDP_INTERFACE_ARG int p, ospreyUDPcallback cb)
     eFree = ep->next;
     ep->nearPort = p;
     ep->callback = cb;
+    ep->rxPackets = 0;
+    ep->txPackets = 0;
+    ep->rxDropped = 0;
+    ep->txDropped = 0;
     #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
       ep->interface = interface;
       ip = &interfaces[ep->interface];
     #else
       ip = &interfaces[0];
     #endif
-    ep->next = ip->eHead;
-    ip->eHead = ep;
+    ep->next = ip->portHash[PORT_HASH(p)];
+    ip->portHash[PORT_HASH(p)] = ep;
     return ep;
 }
 
+static void
+startTransmission(struct interface *ip, struct endpoint *ep,
+         uint32_t farAddress, int farPort, const uint32_t *txp, int length)
+{
+    unsigned int i;
+    unsigned int n = (length+sizeof(uint32_t)-1)/sizeof(uint32_t);
+
+    ep->txPackets++;
+    REG_WRITE(ip, REG_ADDR, farAddress);
+    REG_WRITE(ip, REG_PORTS, (ep->nearPort << 16) | farPort);
+    REG_WRITE(ip, REG_LENGTH, length);
+    if (ip->hasWindow) {
+        /* Nothing to copy if packet was built in place */
+        if ((const char *)txp != PKBUF_POINTER(ip)) {
+            for (i = 0 ; i < n ; i++) {
+                PKBUF_WRITE(ip, i, txp[i]);
+            }
+        }
+    }
+    else {
+        CSR_WRITE(ip, 0);
+        for (i = 0 ; i < n ; i++) {
+            REG_WRITE(ip, REG_DATA, *txp++);
+        }
+    }
+    CSR_WRITE(ip, CSR_W_START_TRANSMISION);
+}
+
+/*
+ * Start the packet at the head of the transmit queue if the
+ * transmitter is free.  At most one packet can be started.
+ */
+static void
+drainTransmitQueue(struct interface *ip)
+{
+    if ((ip->txHead != ip->txTail) && transmitterIdle(ip)) {
+        struct txQueueEntry *qp;
+        qp = &ip->txQueue[ip->txTail & (OSPREY_UDP_TX_QUEUE_CAPACITY - 1)];
+        startTransmission(ip, qp->ep, qp->farAddress, qp->farPort,
+                                                      qp->buf.l, qp->length);
+        ip->txTail++;
+    }
+}
+
+/*
+ * Send immediately if the transmitter is free and nothing is
+ * waiting, otherwise queue the packet for ospreyUDPcrank to send.
+ * Never waits unless the packet was built in place.
+ */
 void
 ospreyUDPsendto(ospreyUDPendpoint endpoint, uint32_t farAddress,
                                        int farPort, const char *buf, int length)
 {
     struct endpoint *ep = (struct endpoint *)endpoint;
-    unsigned int i;
-    uint32_t *txp = (uint32_t *)buf;
-    struct interface *ip =
+    struct interface *ip = endpointInterface(ep);
+    struct txQueueEntry *qp;
+    unsigned int depth;
+
+    if (ip->hasWindow && (buf == PKBUF_POINTER(ip))) {
+        awaitTransmitter(ip);
+        startTransmission(ip, ep, farAddress, farPort,
+                                              (const uint32_t *)buf, length);
+        return;
+    }
+    drainTransmitQueue(ip);
+    if ((ip->txHead == ip->txTail) && transmitterIdle(ip)) {
+        startTransmission(ip, ep, farAddress, farPort,
+                                              (const uint32_t *)buf, length);
+        return;
+    }
+    depth = ip->txHead - ip->txTail;
+    if ((depth >= OSPREY_UDP_TX_QUEUE_CAPACITY)
+     || (length > OSPREY_UDP_PACKET_CAPACITY)) {
+        ep->txDropped++;
+        ip->txDropped++;
+        return;
+    }
+    qp = &ip->txQueue[ip->txHead & (OSPREY_UDP_TX_QUEUE_CAPACITY - 1)];
+    qp->ep = ep;
+    qp->farAddress = farAddress;
+    qp->farPort = farPort;
+    qp->length = length;
+    memcpy(qp->buf.c, buf, length);
+    ip->txHead++;
+    if (++depth > ip->txHighWater) {
+        ip->txHighWater = depth;
+    }
+}
+
+/*
+ * Return pointer to the hardware transmit buffer so a packet can be built
+ * in place and then sent, without copying, by passing the pointer to
+ * ospreyUDPsendto.  The buffer is write-only -- reads return the contents
+ * of the receive buffer.  Returns NULL if the hardware has no packet
+ * buffer window or if the transmitter is busy or has packets waiting,
+ * in which case the packet must be built in memory.
+ */
+char *
+ospreyUDPtransmitBuffer(ospreyUDPendpoint endpoint)
+{
+    struct interface *ip = endpointInterface((struct endpoint *)endpoint);
+    if (!ip->hasWindow) {
+        return NULL;
+    }
+    drainTransmitQueue(ip);
+    if ((ip->txHead != ip->txTail) || !transmitterIdle(ip)) {
+        return NULL;
+    }
+    return PKBUF_POINTER(ip);
+}
+
+int
+ospreyUDPtransmitStatistics(OSPREY_UDP_INTERFACE_ARG
+                                    struct ospreyUDPtransmitStatistics *stats)
+{
+    struct interface *ip;
     #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
-                            &interfaces[ep->interface];
+      if ((interface < 0)
+       || (interface >= interfaceCount)) {
+        return -1;
+      }
+      ip = &interfaces[interface];
     #else
-                            &interfaces[0];
+      ip = &interfaces[0];
     #endif
-    uint32_t csr = CSR_READ(ip);
-    if (csr & CSR_R_TX_BUSY) {
-        volatile int i = 0;
-        while (CSR_READ(ip) & CSR_R_TX_BUSY)  {
-            if (++i == SEND_CHECK_LIMIT) {
-                xil_printf("NETWORK TRANSMISSION LOCKED UP!  "
-                                                       "RESETTING HARDWARE.\n");
-                resetHardware(ip);
-                break;
-            }
-        }
+    if (ip->baseAddress == 0) {
+        return -1;
     }
-    REG_WRITE(ip, REG_ADDR, farAddress);
-    REG_WRITE(ip, REG_PORTS, (ep->nearPort << 16) | farPort);
-    REG_WRITE(ip, REG_LENGTH, length);
-    CSR_WRITE(ip, 0);
-    for (i = 0 ; i < ((length+sizeof(*txp)-1)/sizeof(*txp)) ; i++) {
-        REG_WRITE(ip, REG_DATA, *txp++);
+    stats->queued = ip->txHead - ip->txTail;
+    stats->maxQueued = ip->txHighWater;
+    stats->dropped = ip->txDropped;
+    stats->resets = ip->txResets;
+    return 0;
+}
+
+static struct interface *
+fastInterface(OSPREY_UDP_INTERFACE_ARG int index)
+{
+    struct interface *ip;
+    #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
+      if ((interface < 0)
+       || (interface >= interfaceCount)) {
+        return NULL;
+      }
+      ip = &interfaces[interface];
+    #else
+      ip = &interfaces[0];
+    #endif
+    if ((ip->baseAddress == 0)
+     || (index < 0)
+     || (index >= ip->fastSubscriberCapacity)) {
+        return NULL;
     }
-    CSR_WRITE(ip, CSR_W_START_TRANSMISION);
+    return ip;
+}
+
+int
+ospreyUDPaddFastSubscriber(OSPREY_UDP_INTERFACE_ARG int index,
+              uint32_t subscriberAddress, int publisherPort, int subscriberPort)
+{
+    #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
+    struct interface *ip = fastInterface(interface, index);
+    #else
+    struct interface *ip = fastInterface(index);
+    #endif
+    if (ip == NULL) {
+        return -1;
+    }
+    if (ip->fastSubscriberCapacity > 1) {
+        REG_WRITE(ip, REG_FAST_SUBSCRIBER, FAST_SUBSCRIBER_W_DISABLE | index);
+    }
+    REG_WRITE(ip, REG_FAST_DESTINATION, subscriberAddress);
+    REG_WRITE(ip, REG_FAST_PORTS, (publisherPort<<16)|(subscriberPort&0xFFFF));
+    if (ip->fastSubscriberCapacity > 1) {
+        REG_WRITE(ip, REG_FAST_SUBSCRIBER, FAST_SUBSCRIBER_W_ENABLE | index);
+    }
+    return 0;
+}
+
+int
+ospreyUDPremoveFastSubscriber(OSPREY_UDP_INTERFACE_ARG int index)
+{
+    #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
+    struct interface *ip = fastInterface(interface, index);
+    #else
+    struct interface *ip = fastInterface(index);
+    #endif
+    if ((ip == NULL) || (ip->fastSubscriberCapacity == 1)) {
+        return -1;
+    }
+    REG_WRITE(ip, REG_FAST_SUBSCRIBER, FAST_SUBSCRIBER_W_DISABLE | index);
+    return 0;
+}
+
+/*
+ * Choose the fast data stream (0 -- ADC data, 1 -- summary)
+ * sent to a subscriber.
+ */
+int
+ospreyUDPselectFastSubscriberStream(OSPREY_UDP_INTERFACE_ARG int index,
+                                                                    int stream)
+{
+    #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
+    struct interface *ip = fastInterface(interface, index);
+    #else
+    struct interface *ip = fastInterface(index);
+    #endif
+    if ((ip == NULL) || !ip->hasFastStreams || (stream < 0) || (stream > 1)) {
+        return -1;
+    }
+    REG_WRITE(ip, REG_FAST_SUBSCRIBER, FAST_SUBSCRIBER_W_STREAM |
+                            (stream ? FAST_SUBSCRIBER_W_STREAM_1 : 0) | index);
+    return 0;
+}
+
+int
+ospreyUDPfastSubscriberCapacity(OSPREY_UDP_INTERFACE_ARG_ONLY)
+{
+    #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
+    struct interface *ip = fastInterface(interface, 0);
+    #else
+    struct interface *ip = fastInterface(0);
+    #endif
+    return ip ? ip->fastSubscriberCapacity : -1;
 }
 
 int
 ospreyUDPregisterFastSubscriber(OSPREY_UDP_INTERFACE_ARG
               uint32_t subscriberAddress, int publisherPort, int subscriberPort)
+{
+    #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
+    return ospreyUDPaddFastSubscriber(interface, 0,
+                                subscriberAddress, publisherPort, subscriberPort);
+    #else
+    return ospreyUDPaddFastSubscriber(0,
+                                subscriberAddress, publisherPort, subscriberPort);
+    #endif
+}
+
+int
+ospreyUDPreceiveStatistics(OSPREY_UDP_INTERFACE_ARG
+                                     struct ospreyUDPreceiveStatistics *stats)
+{
+    struct interface *ip;
+    #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
+      if ((interface < 0)
+       || (interface >= interfaceCount)) {
+        return -1;
+      }
+      ip = &interfaces[interface];
+    #else
+      ip = &interfaces[0];
+    #endif
+    if ((ip->baseAddress == 0) || !ip->hasRing) {
+        return -1;
+    }
+    stats->pending = RX_RING_PENDING(REG_READ(ip, REG_RX_RING));
+    stats->fifoOverflow = REG_READ(ip, REG_RX_OVERFLOW);
+    stats->badFrame = REG_READ(ip, REG_RX_BAD_FRAME);
+    return 0;
+}
+
+int
+ospreyUDPendpointStatistics(ospreyUDPendpoint endpoint,
+                                     struct ospreyUDPendpointStatistics *stats)
+{
+    struct endpoint *ep = (struct endpoint *)endpoint;
+    if (ep == NULL) {
+        return -1;
+    }
+    stats->rxPackets = ep->rxPackets;
+    stats->txPackets = ep->txPackets;
+    stats->rxDropped = ep->rxDropped;
+    stats->txDropped = ep->txDropped;
+    return 0;
+}
+
+int
+ospreyUDPnoListenerCount(OSPREY_UDP_INTERFACE_ARG uint32_t *count)
 {
     struct interface *ip;
     #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
@@ -206,53 +577,276 @@ ospreyUDPregisterFastSubscriber(OSPREY_UDP_INTERFACE_ARG
     if (ip->baseAddress == 0) {
         return -1;
     }
-    REG_WRITE(ip, REG_FAST_DESTINATION, subscriberAddress);
-    REG_WRITE(ip, REG_FAST_PORTS, (publisherPort<<16)|(subscriberPort&0xFFFF));
+    *count = ip->noListener;
     return 0;
 }
 
-void
-ospreyUDPcrank(void)
+/*
+ * Find the endpoint for the packet at the tail of the receive ring.
+ * Packets that can not be delivered are counted and released.
+ */
+static struct endpoint *
+acceptPacket(struct interface *ip, uint32_t *farAddr, int *farPort,
+                                                         unsigned int *length)
+{
+    struct endpoint *ep;
+    unsigned int l;
+    int nearPort;
+    uint32_t r = REG_READ(ip, REG_PORTS);
+
+    nearPort = r & 0xFFFF;
+    for (ep = ip->portHash[PORT_HASH(nearPort)] ; ep != NULL ; ep = ep->next) {
+        if (ep->nearPort == nearPort) break;
+    }
+    if (ep == NULL) {
+        ip->noListener++;
+        CSR_WRITE(ip, CSR_W_FINISH_RECEPTION);
+        return NULL;
+    }
+    l = REG_READ(ip, REG_LENGTH);
+    if (l > OSPREY_UDP_PACKET_CAPACITY) {
+        ep->rxDropped++;
+        CSR_WRITE(ip, CSR_W_FINISH_RECEPTION);
+        return NULL;
+    }
+    ep->rxPackets++;
+    *farAddr = REG_READ(ip, REG_ADDR);
+    *farPort = r >> 16;
+    *length = l;
+    return ep;
+}
+
+/*
+ * Copy the packet at the tail of the receive ring and release the slot.
+ */
+static void
+copyPacket(struct interface *ip, uint32_t *rxp, unsigned int l)
+{
+    unsigned int i;
+    unsigned int n = (l+sizeof(*rxp)-1)/sizeof(*rxp);
+
+    if (ip->hasWindow) {
+        for (i = 0 ; i < n ; i++) {
+            rxp[i] = PKBUF_READ(ip, i);
+        }
+    }
+    else {
+        CSR_WRITE(ip, 0);
+        for (i = 0 ; i < n ; i++) {
+            *rxp++ = REG_READ(ip, REG_DATA);
+        }
+    }
+    CSR_WRITE(ip, CSR_W_FINISH_RECEPTION);
+}
+
+/*
+ * Hand the packet at the tail of the receive ring to its endpoint
+ * and release the slot.
+ */
+static void
+receivePacket(struct interface *ip)
 {
-    struct interface *ip = &interfaces[0];
     static union {
         uint32_t l[(OSPREY_UDP_PACKET_CAPACITY+sizeof(uint32_t)-1)/
                                                               sizeof(uint32_t)];
         char     c[OSPREY_UDP_PACKET_CAPACITY];
     } rxbuf;
+    struct endpoint *ep;
+    unsigned int l;
+    int farPort;
+    uint32_t farAddr;
+
+    ep = acceptPacket(ip, &farAddr, &farPort, &l);
+    if (ep == NULL) {
+        return;
+    }
+    #ifdef OSPREY_UDP_RX_IN_PLACE
+    if (ip->hasWindow) {
+        (*ep->callback)(ep, farAddr, farPort, PKBUF_POINTER(ip), l);
+        CSR_WRITE(ip, CSR_W_FINISH_RECEPTION);
+        return;
+    }
+    #endif
+    copyPacket(ip, rxbuf.l, l);
+    (*ep->callback)(ep, farAddr, farPort, rxbuf.c, l);
+}
+
+static unsigned int
+receivePending(struct interface *ip)
+{
+    if (ip->hasRing) {
+        return RX_RING_PENDING(REG_READ(ip, REG_RX_RING));
+    }
+    return (CSR_READ(ip) & CSR_R_RX_FULL) ? 1 : 0;
+}
+
+#ifdef OSPREY_UDP_RX_INTERRUPT
+/*
+ * Packets are copied to a queue by the interrupt handler
+ * and passed to their endpoints by ospreyUDPcrank.  This keeps
+ * packets from being lost while the main loop is busy but does
+ * not shorten the time until their callbacks are made.
+ * The handler is the only writer of the head index and
+ * ospreyUDPcrank the only writer of the tail index.
+ */
+static struct rxQueueEntry {
+    struct endpoint *ep;
+    uint32_t         farAddress;
+    int              farPort;
+    unsigned int     length;
+    uint32_t         arrival;
+    union {
+        uint32_t l[(OSPREY_UDP_PACKET_CAPACITY+sizeof(uint32_t)-1)/
+                                                              sizeof(uint32_t)];
+        char     c[OSPREY_UDP_PACKET_CAPACITY];
+    } buf;
+} rxQueue[OSPREY_UDP_RX_QUEUE_CAPACITY];
+static volatile unsigned int rxQueueHead, rxQueueTail;
+static struct ospreyUDPrxInterruptStatistics rxStats;
+static uint32_t (*timeSource)(void);
+
+int
+ospreyUDPenableRxInterrupt(OSPREY_UDP_INTERFACE_ARG int enable)
+{
+    struct interface *ip;
+    #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
+      if ((interface < 0)
+       || (interface >= interfaceCount)) {
+        return -1;
+      }
+      ip = &interfaces[interface];
+    #else
+      ip = &interfaces[0];
+    #endif
+    if (ip->baseAddress == 0) {
+        return -1;
+    }
+    /*
+     * Without the packet window the handler would read packets through
+     * the packet address pointer and data register that the main loop
+     * uses to fill outgoing packets.
+     */
+    if (enable && !ip->hasWindow) {
+        return -1;
+    }
+    ip->rxInterrupt = (enable != 0);
+    ip->rxStalled = 0;
+    CSR_WRITE(ip, enable ? CSR_W_SET_RX_IRQ_ENABLE : CSR_W_CLR_RX_IRQ_ENABLE);
+    return 0;
+}
 
+/*
+ * Connect to the interrupt controller with the interface index,
+ * cast to a pointer, as the callback reference.
+ */
+void
+ospreyUDPrxInterruptHandler(void *callbackRef)
+{
+    #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
+    struct interface *ip = &interfaces[(UINTPTR)callbackRef];
+    #else
+    struct interface *ip = &interfaces[0];
+    #endif
+    unsigned int pending = receivePending(ip);
+
+    rxStats.interrupts++;
+    while (pending--) {
+        struct rxQueueEntry *qp;
+        if ((rxQueueHead - rxQueueTail) >= OSPREY_UDP_RX_QUEUE_CAPACITY) {
+            /*
+             * Leave remaining packets in the receive ring
+             * until ospreyUDPcrank has made room for them.
+             */
+            CSR_WRITE(ip, CSR_W_CLR_RX_IRQ_ENABLE);
+            ip->rxStalled = 1;
+            rxStats.queueFull++;
+            return;
+        }
+        qp = &rxQueue[rxQueueHead & (OSPREY_UDP_RX_QUEUE_CAPACITY - 1)];
+        qp->ep = acceptPacket(ip, &qp->farAddress, &qp->farPort, &qp->length);
+        if (qp->ep) {
+            copyPacket(ip, qp->buf.l, qp->length);
+            qp->arrival = timeSource ? (*timeSource)() : 0;
+            rxQueueHead++;
+        }
+    }
+}
+
+void
+ospreyUDPsetTimeSource(uint32_t (*now)(void))
+{
+    timeSource = now;
+}
+
+void
+ospreyUDPrxInterruptStatistics(struct ospreyUDPrxInterruptStatistics *stats)
+{
+    *stats = rxStats;
+}
+
+/*
+ * Pass queued packets to their endpoints and record the time
+ * spent in the queue as a log2 histogram -- bin 0 counts zero
+ * ticks, bin n counts 2^(n-1) through 2^n-1 ticks and the last
+ * bin counts everything longer.
+ */
+static void
+dispatchQueue(void)
+{
+    unsigned int head = rxQueueHead;
+    while (rxQueueTail != head) {
+        struct rxQueueEntry *qp;
+        qp = &rxQueue[rxQueueTail & (OSPREY_UDP_RX_QUEUE_CAPACITY - 1)];
+        if (timeSource) {
+            uint32_t t = (*timeSource)() - qp->arrival;
+            int bin = 0;
+            while (t && (bin < (OSPREY_UDP_RX_LATENCY_BINS - 1))) {
+                t >>= 1;
+                bin++;
+            }
+            rxStats.latency[bin]++;
+        }
+        (*qp->ep->callback)(qp->ep, qp->farAddress, qp->farPort,
+                                                      qp->buf.c, qp->length);
+        rxQueueTail++;
+    }
+}
+#endif
+
+/*
+ * Dispatch all packets waiting in the receive ring.
+ * The pending count is read once so that packets arriving while
+ * callbacks run are left for the next call.
+ * Interfaces using interrupts are not polled.  Reception on
+ * any that stalled for lack of queue space is resumed.
+ * Also start the next queued packet on each idle transmitter.
+ */
+void
+ospreyUDPcrank(void)
+{
+    struct interface *ip = &interfaces[0];
+
+    #ifdef OSPREY_UDP_RX_INTERRUPT
+    dispatchQueue();
+    #endif
     #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
     for ( ; ip < &interfaces[interfaceCount] ; ip++)
     #endif
     {
-        struct endpoint *ep;
-        unsigned int i;
-        int consumed;
-        int nearPort, farPort;
-        uint32_t csr = CSR_READ(ip);
-        if (csr & CSR_R_RX_FULL) {
-            uint32_t r = REG_READ(ip, REG_PORTS);
-            farPort = r >> 16;
-            nearPort = r & 0xFFFF;
-            consumed = 0;
-            for (ep = ip->eHead ; ep != NULL ; ep = ep->next) {
-                unsigned int l;
-                if ((nearPort == ep->nearPort)
-                 && ((l=REG_READ(ip,REG_LENGTH))<=OSPREY_UDP_PACKET_CAPACITY)) {
-                    uint32_t farAddr = REG_READ(ip, REG_ADDR);
-                    uint32_t *rxp = rxp = rxbuf.l;
-                    CSR_WRITE(ip, 0);
-                    for (i = 0 ; i < ((l+sizeof(*rxp)-1)/sizeof(*rxp)) ; i++) {
-                        *rxp++ = REG_READ(ip, REG_DATA);
-                    }
-                    CSR_WRITE(ip, CSR_W_FINISH_RECEPTION);
-                    consumed = 1;
-                    (*ep->callback)(ep, farAddr, farPort, rxbuf.c, l);
-                    break;
-                }
+        drainTransmitQueue(ip);
+        #ifdef OSPREY_UDP_RX_INTERRUPT
+        if (ip->rxInterrupt) {
+            if (ip->rxStalled) {
+                ip->rxStalled = 0;
+                CSR_WRITE(ip, CSR_W_SET_RX_IRQ_ENABLE);
             }
-            if (!consumed) {
-                CSR_WRITE(ip, CSR_W_FINISH_RECEPTION);
+        }
+        else
+        #endif
+        {
+            unsigned int pending = receivePending(ip);
+            while (pending--) {
+                receivePacket(ip);
             }
         }
     }
@@ -33,14 +33,20 @@
 #ifndef OSPREY_UDP_ENDPOINT_CAPACITY
 # define OSPREY_UDP_ENDPOINT_CAPACITY   5
 #endif
+#ifndef OSPREY_UDP_TX_QUEUE_CAPACITY
+# define OSPREY_UDP_TX_QUEUE_CAPACITY   4  /* Must be a power of two */
+#endif
 #ifndef OSPREY_UDP_PACKET_CAPACITY
+  /* Must match the PKBUF_CAPACITY firmware parameter (8972 for jumbo) */
 # define OSPREY_UDP_PACKET_CAPACITY 1472
 #endif
 
 #if (OSPREY_UDP_INTERFACE_CAPACITY > 1)
 # define OSPREY_UDP_INTERFACE_ARG int interface,
+# define OSPREY_UDP_INTERFACE_ARG_ONLY int interface
 #else
 # define OSPREY_UDP_INTERFACE_ARG
+# define OSPREY_UDP_INTERFACE_ARG_ONLY void
 #endif
 
 typedef void *ospreyUDPendpoint;
@@ -59,8 +65,66 @@ void ospreyUDPsendto(ospreyUDPendpoint endpoint,
                                                uint32_t farAddress, int farPort,
                                                const char *buf, int length);
 
+char *ospreyUDPtransmitBuffer(ospreyUDPendpoint endpoint);
+
 int ospreyUDPregisterFastSubscriber(OSPREY_UDP_INTERFACE_ARG
              uint32_t subscriberAddress, int publisherPort, int subscriberPort);
+int ospreyUDPaddFastSubscriber(OSPREY_UDP_INTERFACE_ARG int index,
+             uint32_t subscriberAddress, int publisherPort, int subscriberPort);
+int ospreyUDPremoveFastSubscriber(OSPREY_UDP_INTERFACE_ARG int index);
+int ospreyUDPselectFastSubscriberStream(OSPREY_UDP_INTERFACE_ARG int index,
+                                                                    int stream);
+int ospreyUDPfastSubscriberCapacity(OSPREY_UDP_INTERFACE_ARG_ONLY);
+
+struct ospreyUDPreceiveStatistics {
+    uint32_t pending;      /* Packets waiting in receive ring */
+    uint32_t fifoOverflow; /* Packets dropped by full MAC receive FIFO */
+    uint32_t badFrame;     /* Packets dropped for bad FCS or framing */
+};
+int ospreyUDPreceiveStatistics(OSPREY_UDP_INTERFACE_ARG
+                                     struct ospreyUDPreceiveStatistics *stats);
+
+struct ospreyUDPendpointStatistics {
+    uint32_t rxPackets;    /* Packets passed to callback */
+    uint32_t txPackets;    /* Packets sent */
+    uint32_t rxDropped;    /* Packets too large for receive buffer */
+    uint32_t txDropped;    /* Packets not sent because queue was full */
+};
+int ospreyUDPendpointStatistics(ospreyUDPendpoint endpoint,
+                                     struct ospreyUDPendpointStatistics *stats);
+struct ospreyUDPtransmitStatistics {
+    uint32_t queued;       /* Packets waiting in transmit queue */
+    uint32_t maxQueued;    /* Most packets ever waiting */
+    uint32_t dropped;      /* Packets not sent because queue was full */
+    uint32_t resets;       /* Hardware resets after transmitter stalled */
+};
+int ospreyUDPtransmitStatistics(OSPREY_UDP_INTERFACE_ARG
+                                    struct ospreyUDPtransmitStatistics *stats);
+
+/* Packets dropped because no endpoint was registered for their port */
+int ospreyUDPnoListenerCount(OSPREY_UDP_INTERFACE_ARG uint32_t *count);
+
+#ifdef OSPREY_UDP_RX_INTERRUPT
+# ifndef OSPREY_UDP_RX_QUEUE_CAPACITY
+#  define OSPREY_UDP_RX_QUEUE_CAPACITY 4  /* Must be a power of two */
+# endif
+# define OSPREY_UDP_RX_LATENCY_BINS    16
+struct ospreyUDPrxInterruptStatistics {
+    uint32_t interrupts;   /* Calls to interrupt handler */
+    uint32_t queueFull;    /* Times reception stalled for lack of queue space */
+    uint32_t latency[OSPREY_UDP_RX_LATENCY_BINS]; /* Queue to callback, log2 */
+};
+/*
+ * Queues packets arriving while the main loop is busy rather than
+ * losing them -- callbacks are still made by ospreyUDPcrank.
+ * Enabling fails on firmware without the packet buffer window.
+ */
+int ospreyUDPenableRxInterrupt(OSPREY_UDP_INTERFACE_ARG int enable);
+void ospreyUDPrxInterruptHandler(void *callbackRef);
+void ospreyUDPsetTimeSource(uint32_t (*now)(void));
+void ospreyUDPrxInterruptStatistics(
+                                struct ospreyUDPrxInterruptStatistics *stats);
+#endif
 
 void ospreyUDPcrank(void);
 
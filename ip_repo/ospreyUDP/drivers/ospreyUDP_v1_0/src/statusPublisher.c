@@ -0,0 +1,197 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Periodic status publisher.
+ * Gathers a list of status registers into a single UDP packet sent at a
+ * fixed interval or once per second (on the PPS) to a subscriber.  This
+ * replaces repeated MODBUS polling of the same registers.
+ *
+ * Subscription request (multi-byte values are big-endian):
+ * Length Value     Description
+ *    4   Magic     "PSSR"
+ *    4   Interval  Publication interval in microseconds, 0 for once per second.
+ *                  A value of 0xFFFFFFFF cancels the subscription.
+ *    4   Count     Number of registers to publish.
+ *   4*n  Registers Register identifiers passed to statusPublisherCallbackRead.
+ * The sender of the most recent valid request becomes the subscriber.
+ * A publication is sent immediately to acknowledge the request.
+ *
+ * Publication:
+ * Length Value     Description
+ *    4   Magic     "PSSP"
+ *    4   Sequence  Incremented with each publication.
+ *    4   Seconds   Timestamp passed to statusPublisherCrank.
+ *    4   Nanosecs
+ *    4   Count     Number of registers.
+ *   4*n  Values    Register values.
+ * A count of 0 indicates that statusPublisherCallbackRead failed.
+ */
+
+#include <stdio.h>
+#include <ospreyUDP.h>
+#include "statusPublisher.h"
+
+#define REQUEST_MAGIC       0x50535352  /* PSSR */
+#define PUBLICATION_MAGIC   0x50535350  /* PSSP */
+#define INTERVAL_CANCEL     0xFFFFFFFF
+#define HEADER_WORDS        5
+
+static int (*diagOut)(const char *fmt, ...);
+static ospreyUDPendpoint publisherEndpoint;
+static uint32_t subscriberAddress;
+static int subscriberPort;
+static uint32_t intervalNs;
+static uint32_t sequence;
+static int isPending;
+static uint32_t lastSeconds, lastNanoseconds;
+static int regCount;
+static uint32_t regList[STATUS_PUBLISHER_REGISTER_CAPACITY];
+static uint32_t values[STATUS_PUBLISHER_REGISTER_CAPACITY];
+static uint8_t publication[(HEADER_WORDS+STATUS_PUBLISHER_REGISTER_CAPACITY)*4];
+
+void
+statusPublisherSetDebugFunction(int (*prfunc)(const char *fmt, ...))
+{
+    diagOut = prfunc;
+}
+
+static uint32_t
+get32(const uint8_t *cp)
+{
+    return ((uint32_t)cp[0] << 24) | (cp[1] << 16) | (cp[2] << 8) | cp[3];
+}
+
+static uint8_t *
+put32(uint8_t *cp, uint32_t v)
+{
+    *cp++ = v >> 24;
+    *cp++ = v >> 16;
+    *cp++ = v >> 8;
+    *cp++ = v;
+    return cp;
+}
+
+static void
+publish(uint32_t seconds, uint32_t nanoseconds)
+{
+    uint8_t *cp = publication;
+    int i, n = regCount;
+
+    if (statusPublisherCallbackRead(regList, n, values) != 0) {
+        n = 0;
+    }
+    cp = put32(cp, PUBLICATION_MAGIC);
+    cp = put32(cp, sequence++);
+    cp = put32(cp, seconds);
+    cp = put32(cp, nanoseconds);
+    cp = put32(cp, n);
+    for (i = 0 ; i < n ; i++) {
+        cp = put32(cp, values[i]);
+    }
+    ospreyUDPsendto(publisherEndpoint, subscriberAddress, subscriberPort,
+                                  (char *)publication, cp - publication);
+    lastSeconds = seconds;
+    lastNanoseconds = nanoseconds;
+}
+
+static void
+publisherCallback(ospreyUDPendpoint endpoint, uint32_t farAddress, int farPort,
+                                           const char *buf, int length)
+{
+    const uint8_t *cp = (const uint8_t *)buf;
+    uint32_t interval, count;
+    int i;
+
+    if ((length < 12) || (get32(cp) != REQUEST_MAGIC)) {
+        return;
+    }
+    interval = get32(cp + 4);
+    count = get32(cp + 8);
+    if (diagOut) {
+        (*diagOut)("statusPublisher: %d.%d.%d.%d:%d interval %u count %u\r\n",
+                                               (int)((farAddress >> 24) & 0xFF),
+                                               (int)((farAddress >> 16) & 0xFF),
+                                               (int)((farAddress >>  8) & 0xFF),
+                                               (int)((farAddress      ) & 0xFF),
+                                               farPort,
+                                               (unsigned int)interval,
+                                               (unsigned int)count);
+    }
+    if (interval == INTERVAL_CANCEL) {
+        if ((farAddress == subscriberAddress) && (farPort == subscriberPort)) {
+            subscriberAddress = 0;
+            subscriberPort = 0;
+        }
+        return;
+    }
+    if ((count > STATUS_PUBLISHER_REGISTER_CAPACITY)
+     || (length != (int)(12 + (count * 4)))
+     || (interval > 1000000)) {
+        return;
+    }
+    for (i = 0 ; i < (int)count ; i++) {
+        regList[i] = get32(cp + 12 + (i * 4));
+    }
+    regCount = count;
+    intervalNs = interval * 1000;
+    subscriberAddress = farAddress;
+    subscriberPort = farPort;
+    isPending = 1;
+}
+
+/*
+ * Call from the application main loop with the current time
+ */
+void
+statusPublisherCrank(uint32_t seconds, uint32_t nanoseconds)
+{
+    if (subscriberPort == 0) {
+        return;
+    }
+    if (isPending) {
+        isPending = 0;
+        publish(seconds, nanoseconds);
+    }
+    else if (intervalNs == 0) {
+        if (seconds != lastSeconds) {
+            publish(seconds, nanoseconds);
+        }
+    }
+    else {
+        uint32_t elapsed = ((seconds - lastSeconds) * 1000000000) +
+                                                 nanoseconds - lastNanoseconds;
+        if (((seconds - lastSeconds) > 1) || (elapsed >= intervalNs)) {
+            publish(seconds, nanoseconds);
+        }
+    }
+}
+
+int
+statusPublisherUDPinit(int port)
+{
+    if (port <= 0) port = STATUS_PUBLISHER_DEFAULT_UDP_PORT;
+    publisherEndpoint = ospreyUDPregisterEndpoint(port, publisherCallback);
+    return (publisherEndpoint == NULL) ? -1 : 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Periodic status publisher
+ */
+#ifndef _STATUS_PUBLISHER_H_
+#define _STATUS_PUBLISHER_H_
+#include <stdint.h>
+
+#define STATUS_PUBLISHER_DEFAULT_UDP_PORT   50010
+#define STATUS_PUBLISHER_REGISTER_CAPACITY  363
+
+int statusPublisherUDPinit(int port);
+void statusPublisherCrank(uint32_t seconds, uint32_t nanoseconds);
+void statusPublisherSetDebugFunction(int (*prfunc)(const char *fmt, ...));
+/* Application-supplied callback routine */
+int statusPublisherCallbackRead(const uint32_t *regList, int regCount,
+                                                             uint32_t *values);
+
+#endif /* _STATUS_PUBLISHER_H_ */
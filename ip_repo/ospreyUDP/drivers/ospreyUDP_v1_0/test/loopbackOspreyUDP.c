@@ -0,0 +1,105 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Loopback stand-in for ospreyUDP.
+ * Only the functions used by the MODBUS server and status publisher
+ * are provided.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ospreyUDP.h>
+#include "loopbackOspreyUDP.h"
+
+static struct endpoint {
+    int               port;
+    ospreyUDPcallback callback;
+} endpoints[OSPREY_UDP_ENDPOINT_CAPACITY];
+
+static unsigned char replyBuf[LOOPBACK_REPLY_CAPACITY];
+static int replyLength;
+static uint32_t replyAddress;
+static int replyPort;
+
+ospreyUDPendpoint
+ospreyUDPregisterEndpoint(int port, ospreyUDPcallback callback)
+{
+    int i;
+    for (i = 0 ; i < OSPREY_UDP_ENDPOINT_CAPACITY ; i++) {
+        if (endpoints[i].callback == NULL) {
+            endpoints[i].port = port;
+            endpoints[i].callback = callback;
+            return &endpoints[i];
+        }
+    }
+    return NULL;
+}
+
+void
+ospreyUDPsendto(ospreyUDPendpoint endpoint, uint32_t farAddress, int farPort,
+                                                const char *buf, int length)
+{
+    if (length > LOOPBACK_REPLY_CAPACITY) {
+        fprintf(stderr, "Bad loopback reply.\n");
+        return;
+    }
+    memcpy(replyBuf, buf, length);
+    replyLength = length;
+    replyAddress = farAddress;
+    replyPort = farPort;
+}
+
+/*
+ * Return the length of the packet sent since the previous call, or 0 if none
+ */
+int
+loopbackSent(const unsigned char **packet, uint32_t *farAddress, int *farPort)
+{
+    int n = replyLength;
+    replyLength = 0;
+    *packet = replyBuf;
+    if (farAddress) *farAddress = replyAddress;
+    if (farPort) *farPort = replyPort;
+    return n;
+}
+
+/*
+ * Deliver a request and return the length of the reply, or 0 if none
+ */
+int
+loopbackTransaction(int port, const void *request, int length,
+                                                    const unsigned char **reply)
+{
+    int i;
+    replyLength = 0;
+    for (i = 0 ; i < OSPREY_UDP_ENDPOINT_CAPACITY ; i++) {
+        if (endpoints[i].callback && (endpoints[i].port == port)) {
+            (*endpoints[i].callback)(&endpoints[i], LOOPBACK_FAR_ADDRESS,
+                                   LOOPBACK_FAR_PORT, request, length);
+            break;
+        }
+    }
+    return loopbackSent(reply, NULL, NULL);
+}
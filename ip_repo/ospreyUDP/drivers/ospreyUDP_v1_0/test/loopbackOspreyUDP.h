@@ -0,0 +1,45 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Loopback stand-in for ospreyUDP.
+ * Requests are passed directly to the registered endpoint callback
+ * and replies, and other transmitted packets, are captured for inspection.
+ */
+
+#ifndef _LOOPBACK_OSPREY_UDP_H_
+#define _LOOPBACK_OSPREY_UDP_H_
+
+#include <stdint.h>
+
+#define LOOPBACK_REPLY_CAPACITY 9000
+#define LOOPBACK_FAR_ADDRESS    0xC0A80101
+#define LOOPBACK_FAR_PORT       50001
+
+int loopbackTransaction(int port, const void *request, int length,
+                                                   const unsigned char **reply);
+int loopbackSent(const unsigned char **packet, uint32_t *farAddress,
+                                                                int *farPort);
+
+#endif /* _LOOPBACK_OSPREY_UDP_H_ */
@@ -0,0 +1,190 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Mock ospreyUDP register file for host-side driver tests.
+ * Each instance occupies MOCK_ADDRESS_SPAN bytes starting at a fixed
+ * address so that pointers into the packet buffer window work just as
+ * they do on the target.  The upper half of each instance is backed by
+ * real memory holding the receive buffer.  Stores made through a window
+ * pointer therefore land in the receive buffer rather than the transmit
+ * buffer, but stores made with Xil_Out32 are routed correctly.
+ * The receive ring is modelled by a count of pending packets, all of which
+ * share the single receive buffer and header registers.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <xil_io.h>
+#include "mockOspreyUDP.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+# define MAP_FIXED_NOREPLACE MAP_FIXED
+#endif
+
+#define WINDOW_OFFSET   (MOCK_ADDRESS_SPAN / 2)
+#define WINDOW_WORDS    (WINDOW_OFFSET / sizeof(uint32_t))
+
+static struct mockOspreyUDP mocks[MOCK_CAPACITY];
+static uint32_t txBufs[MOCK_CAPACITY][WINDOW_WORDS];
+
+void
+mockInit(void)
+{
+    int i;
+    void *p = mmap((void *)MOCK_BASE_ADDRESS, MOCK_CAPACITY*MOCK_ADDRESS_SPAN,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (p != (void *)MOCK_BASE_ADDRESS) {
+        fprintf(stderr, "Can't map mock hardware at 0x%X.\n",MOCK_BASE_ADDRESS);
+        exit(2);
+    }
+    for (i = 0 ; i < MOCK_CAPACITY ; i++) {
+        mocks[i].rxBuf = (uint32_t *)(UINTPTR)(mockBaseAddress(i)+WINDOW_OFFSET);
+        mocks[i].txBuf = txBufs[i];
+    }
+}
+
+struct mockOspreyUDP *
+mockInstance(int index)
+{
+    return &mocks[index];
+}
+
+uint32_t
+mockBaseAddress(int index)
+{
+    return MOCK_BASE_ADDRESS + (index * MOCK_ADDRESS_SPAN);
+}
+
+void
+mockReceive(int index, uint32_t farAddress, int farPort, int nearPort,
+                                                const char *buf, int length)
+{
+    struct mockOspreyUDP *mp = &mocks[index];
+    if (mp->rxPending >= (mp->hasRing ? MOCK_RING_CAPACITY : 1)) {
+        mp->rxOverflow++;
+        return;
+    }
+    if (buf) memcpy(mp->rxBuf, buf, length);
+    mp->rxAddress = farAddress;
+    mp->rxPorts = (farPort << 16) | nearPort;
+    mp->rxLength = length;
+    mp->rxPending++;
+}
+
+/*
+ * Level of the receive interrupt request line
+ */
+int
+mockRxIRQ(int index)
+{
+    return mocks[index].rxIrqEnable && (mocks[index].rxPending != 0);
+}
+
+static struct mockOspreyUDP *
+lookup(UINTPTR addr, unsigned int *offset)
+{
+    unsigned int i = (addr - MOCK_BASE_ADDRESS) / MOCK_ADDRESS_SPAN;
+    if ((addr < MOCK_BASE_ADDRESS) || (i >= MOCK_CAPACITY)) {
+        fprintf(stderr, "Bad mock address 0x%lX.\n", (unsigned long)addr);
+        exit(2);
+    }
+    *offset = (addr - MOCK_BASE_ADDRESS) % MOCK_ADDRESS_SPAN;
+    mocks[i].transactions++;
+    return &mocks[i];
+}
+
+uint32_t
+Xil_In32(UINTPTR addr)
+{
+    unsigned int offset;
+    struct mockOspreyUDP *mp = lookup(addr, &offset);
+    if (offset >= WINDOW_OFFSET) {
+        return mp->hasWindow ? mp->rxBuf[(offset - WINDOW_OFFSET) / 4] : 0;
+    }
+    switch (offset) {
+    case 0:  return (mp->hasWindow ? 0x80000000 : 0)
+                  | (mp->txBusy ? 0x20000000 : 0)
+                  | (mp->rxPending ? 0x10000000 : 0)
+                  | (mp->hasRing ? 0x8000000 : 0)
+                  | (mp->hasFastTable ? 0x4800000 : 0)
+                  | (mp->rxIrqEnable ? 0x1000000 : 0)
+                  | mp->pkAddr;
+    case 4:  return mp->rxBuf[mp->pkAddr++ % WINDOW_WORDS];
+    case 8:  return mp->rxAddress;
+    case 12: return mp->rxPorts;
+    case 16: return mp->rxLength;
+    case 48: return mp->hasRing ? ((MOCK_RING_CAPACITY << 24) |
+                                   (mp->rxPending << 16)) : 0;
+    case 52: return mp->hasRing ? mp->rxOverflow : 0;
+    case 60: return mp->hasFastTable ? ((MOCK_FAST_CAPACITY << 24) |
+                                        (mp->fastStreams << 16) |
+                                        (mp->fastSelect << 8) |
+                                        mp->fastEnables) : 0;
+    default: return 0;
+    }
+}
+
+void
+Xil_Out32(UINTPTR addr, uint32_t value)
+{
+    unsigned int offset;
+    struct mockOspreyUDP *mp = lookup(addr, &offset);
+    if (offset >= WINDOW_OFFSET) {
+        if (mp->hasWindow) mp->txBuf[(offset - WINDOW_OFFSET) / 4] = value;
+        return;
+    }
+    switch (offset) {
+    case 0:
+        mp->pkAddr = value & 0x7FFF;
+        if (value & 0x40000000) mp->txBusy = mp->rxIrqEnable = 0;
+        if (value & 0x20000000) mp->txCount++;
+        if ((value & 0x10000000) && mp->rxPending) mp->rxPending--;
+        if (value & 0x2000000) mp->rxIrqEnable = 0;
+        else if (value & 0x1000000) mp->rxIrqEnable = 1;
+        break;
+    case 4:  mp->txBuf[mp->pkAddr++ % WINDOW_WORDS] = value;    break;
+    case 8:  mp->txAddress = value;                             break;
+    case 12: mp->txPorts = value;                               break;
+    case 16: mp->txLength = value;                              break;
+    case 40: mp->fastAddress[mp->fastSelect] = value;           break;
+    case 44: mp->fastPorts[mp->fastSelect] = value;             break;
+    case 60:
+        if (!mp->hasFastTable) break;
+        mp->fastSelect = value % MOCK_FAST_CAPACITY;
+        if (value & 0x80000000) mp->fastEnables |= 1 << mp->fastSelect;
+        else if (value & 0x40000000) mp->fastEnables &= ~(1 << mp->fastSelect);
+        if (value & 0x20000000) {
+            if (value & 0x10000000) mp->fastStreams |= 1 << mp->fastSelect;
+            else                    mp->fastStreams &= ~(1 << mp->fastSelect);
+        }
+        break;
+    default: break;
+    }
+}
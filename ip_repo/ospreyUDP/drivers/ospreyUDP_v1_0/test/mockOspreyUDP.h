@@ -0,0 +1,74 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Mock ospreyUDP register file for host-side driver tests
+ */
+
+#ifndef _MOCK_OSPREY_UDP_H_
+#define _MOCK_OSPREY_UDP_H_
+
+#include <stdint.h>
+
+#define MOCK_BASE_ADDRESS   0x44A30000
+#define MOCK_ADDRESS_SPAN   0x10000
+#define MOCK_CAPACITY       2
+#define MOCK_RING_CAPACITY  4
+#define MOCK_FAST_CAPACITY  4
+
+struct mockOspreyUDP {
+    int           hasWindow;
+    int           hasRing;
+    unsigned int  pkAddr;
+    unsigned int  rxPending;
+    unsigned long rxOverflow;
+    int           rxIrqEnable;
+    int           hasFastTable;
+    unsigned int  fastSelect;
+    uint32_t      fastEnables;
+    uint32_t      fastStreams;
+    uint32_t      fastAddress[MOCK_FAST_CAPACITY];
+    uint32_t      fastPorts[MOCK_FAST_CAPACITY];
+    uint32_t      rxAddress;
+    uint32_t      rxPorts;
+    uint32_t      rxLength;
+    uint32_t      txAddress;
+    uint32_t      txPorts;
+    uint32_t      txLength;
+    unsigned long txCount;
+    int           txBusy;
+    unsigned long transactions;
+    uint32_t     *rxBuf;
+    uint32_t     *txBuf;
+};
+
+void mockInit(void);
+struct mockOspreyUDP *mockInstance(int index);
+uint32_t mockBaseAddress(int index);
+void mockReceive(int index, uint32_t farAddress, int farPort, int nearPort,
+                                                const char *buf, int length);
+int mockRxIRQ(int index);
+
+#endif /* _MOCK_OSPREY_UDP_H_ */
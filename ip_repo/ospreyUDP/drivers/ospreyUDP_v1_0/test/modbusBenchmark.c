@@ -0,0 +1,322 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host-side benchmark of MODBUS scans over a loopback ospreyUDP stand-in.
+ * A scan reads a block of contiguous status registers and a set of
+ * scattered threshold and MPS registers.  The 'standard' scan uses
+ * function code 3 requests, the 'bulk' scan uses the vendor-specific bulk
+ * and register list reads.  The measured rate includes only server and
+ * loopback processing so the modelled rate, which charges ROUND_TRIP_US
+ * for each request/reply exchange with the instrument, is the better
+ * guide to IOC performance.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include "modbusServer.h"
+#include "loopbackOspreyUDP.h"
+
+#define SCAN_COUNT      20000
+#define ROUND_TRIP_US   250.0
+#define MODBUS_PORT     502
+#define REG_COUNT       4096
+#define STATUS_BASE     0
+#define STATUS_COUNT    600
+#define GROUP_COUNT     8
+#define GROUP_SIZE      6
+#define GROUP_BASE      1000
+#define GROUP_STRIDE    64
+#define SCATTER_COUNT   (GROUP_COUNT * GROUP_SIZE)
+#define FC3_LIMIT       127
+#define BULK_LIMIT      731
+
+static uint16_t registers[REG_COUNT];
+static uint16_t values[BULK_LIMIT + 1];
+static int scatterList[SCATTER_COUNT];
+static unsigned int transactionId;
+static unsigned long transactionCount;
+static int good = 1;
+
+/*
+ * Application callbacks
+ */
+int
+modbusServerCallbackCode3(int regBase, int regCount, uint16_t *reg)
+{
+    if ((regBase < 0) || ((regBase + regCount) > REG_COUNT)) return -1;
+    memcpy(reg, &registers[regBase], regCount * sizeof *reg);
+    return 0;
+}
+
+int
+modbusServerCallbackCode16(int regBase, int regCount, const uint16_t *reg)
+{
+    if ((regBase < 0) || ((regBase + regCount) > REG_COUNT)) return -1;
+    memcpy(&registers[regBase], reg, regCount * sizeof *reg);
+    return 0;
+}
+
+/*
+ * Client side
+ */
+static int
+transaction(int function, const uint8_t *data, int dataLength,
+                                                    const unsigned char **reply)
+{
+    uint8_t request[1500];
+    int size = dataLength + 2;
+    transactionId++;
+    transactionCount++;
+    request[0] = transactionId >> 8;
+    request[1] = transactionId;
+    request[2] = 0;
+    request[3] = 0;
+    request[4] = size >> 8;
+    request[5] = size;
+    request[6] = 1;
+    request[7] = function;
+    memcpy(&request[8], data, dataLength);
+    return loopbackTransaction(MODBUS_PORT, request, dataLength + 8, reply);
+}
+
+static int
+unpack(const unsigned char *cp, int regCount, uint16_t *dest)
+{
+    int i;
+    for (i = 0 ; i < regCount ; i++, cp += 2) {
+        dest[i] = (cp[0] << 8) | cp[1];
+    }
+    return regCount;
+}
+
+static int
+readFC3(int regBase, int regCount, uint16_t *dest)
+{
+    const unsigned char *r;
+    uint8_t d[4] = { regBase >> 8, regBase, regCount >> 8, regCount };
+    int n = transaction(3, d, 4, &r);
+    if ((n != (9 + (regCount * 2))) || (r[7] != 3) || (r[8] != regCount * 2)) {
+        return -1;
+    }
+    return unpack(r + 9, regCount, dest);
+}
+
+static int
+readBulk(int regBase, int regCount, uint16_t *dest)
+{
+    const unsigned char *r;
+    uint8_t d[4] = { regBase >> 8, regBase, regCount >> 8, regCount };
+    int n = transaction(65, d, 4, &r);
+    if ((n != (10 + (regCount * 2)))
+     || (r[7] != 65)
+     || (((r[8] << 8) | r[9]) != (regCount * 2))) {
+        return (n == 9) ? -r[8] : -100;
+    }
+    return unpack(r + 10, regCount, dest);
+}
+
+static int
+readList(const int *list, int regCount, uint16_t *dest)
+{
+    const unsigned char *r;
+    uint8_t d[2 + (2 * (BULK_LIMIT + 1))];
+    int i, n;
+    d[0] = regCount >> 8;
+    d[1] = regCount;
+    for (i = 0 ; i < regCount ; i++) {
+        d[2+(2*i)] = list[i] >> 8;
+        d[3+(2*i)] = list[i];
+    }
+    n = transaction(66, d, 2 + (2 * regCount), &r);
+    if ((n != (10 + (regCount * 2)))
+     || (r[7] != 66)
+     || (((r[8] << 8) | r[9]) != (regCount * 2))) {
+        return (n == 9) ? -r[8] : -100;
+    }
+    return unpack(r + 10, regCount, dest);
+}
+
+static int
+readWriteFC23(int rBase, int rCount, int wBase, int wCount,
+                                           const uint16_t *src, uint16_t *dest)
+{
+    const unsigned char *r;
+    uint8_t d[9 + 2 * 121];
+    int i, n;
+    d[0] = rBase >> 8; d[1] = rBase; d[2] = rCount >> 8; d[3] = rCount;
+    d[4] = wBase >> 8; d[5] = wBase; d[6] = wCount >> 8; d[7] = wCount;
+    d[8] = wCount * 2;
+    for (i = 0 ; i < wCount ; i++) {
+        d[9+(2*i)] = src[i] >> 8;
+        d[10+(2*i)] = src[i];
+    }
+    n = transaction(23, d, 9 + (2 * wCount), &r);
+    if ((n != (9 + (rCount * 2))) || (r[7] != 23) || (r[8] != rCount * 2)) {
+        return -1;
+    }
+    return unpack(r + 9, rCount, dest);
+}
+
+static void
+check(int condition, const char *msg)
+{
+    if (!condition) {
+        printf("FAIL: %s\n", msg);
+        good = 0;
+    }
+}
+
+static int
+checkValues(const uint16_t *v, int regBase, int regCount)
+{
+    int i;
+    for (i = 0 ; i < regCount ; i++) {
+        if (v[i] != registers[regBase + i]) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Scans
+ */
+static int
+scanStandard(void)
+{
+    int i, n, ok = 1;
+    for (i = 0 ; i < STATUS_COUNT ; i += n) {
+        n = STATUS_COUNT - i;
+        if (n > FC3_LIMIT) n = FC3_LIMIT;
+        ok &= (readFC3(STATUS_BASE + i, n, values) == n)
+           && checkValues(values, STATUS_BASE + i, n);
+    }
+    for (i = 0 ; i < GROUP_COUNT ; i++) {
+        int base = GROUP_BASE + (i * GROUP_STRIDE);
+        ok &= (readFC3(base, GROUP_SIZE, values) == GROUP_SIZE)
+           && checkValues(values, base, GROUP_SIZE);
+    }
+    return ok;
+}
+
+static int
+scanBulk(void)
+{
+    int i, ok;
+    ok = (readBulk(STATUS_BASE, STATUS_COUNT, values) == STATUS_COUNT)
+      && checkValues(values, STATUS_BASE, STATUS_COUNT);
+    ok &= (readList(scatterList, SCATTER_COUNT, values) == SCATTER_COUNT);
+    for (i = 0 ; i < SCATTER_COUNT ; i++) {
+        ok &= (values[i] == registers[scatterList[i]]);
+    }
+    return ok;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1.0e-9);
+}
+
+static double
+benchmark(const char *name, int (*scan)(void))
+{
+    unsigned long transactions = transactionCount;
+    double start = now(), seconds, perScan;
+    int i;
+    for (i = 0 ; i < SCAN_COUNT ; i++) {
+        if (!(*scan)()) {
+            printf("%s: scan %d FAILED.\n", name, i);
+            good = 0;
+            break;
+        }
+    }
+    seconds = now() - start;
+    perScan = (double)(transactionCount - transactions) / SCAN_COUNT;
+    printf("%-8s %4.1f requests/scan %9.0f scans/s measured "
+           "%6.0f scans/s modelled\n", name, perScan, SCAN_COUNT / seconds,
+           1.0e6 / ((perScan * ROUND_TRIP_US) + (seconds * 1.0e6 / SCAN_COUNT)));
+    return perScan;
+}
+
+int
+main(int argc, char **argv)
+{
+    uint16_t w[3] = { 0x1234, 0x5678, 0x9ABC };
+    int i, j;
+    double standard, bulk;
+
+    for (i = 0 ; i < REG_COUNT ; i++) {
+        registers[i] = (i * 2654435761u) >> 16;
+    }
+    for (i = 0 ; i < GROUP_COUNT ; i++) {
+        for (j = 0 ; j < GROUP_SIZE ; j++) {
+            /* Interleave groups to exercise run merging */
+            scatterList[(j * GROUP_COUNT) + i] = (j < (GROUP_SIZE / 2)) ?
+                                 GROUP_BASE + (i * GROUP_STRIDE) + j :
+                                 GROUP_BASE + (i * GROUP_STRIDE) + j + 7;
+        }
+    }
+    check(modbusServerUDPinit(0) == 0, "init");
+
+    /*
+     * Protocol checks
+     */
+    check(readBulk(100, BULK_LIMIT, values) == BULK_LIMIT
+       && checkValues(values, 100, BULK_LIMIT), "largest bulk read");
+    check(readBulk(100, BULK_LIMIT + 1, values) == -3, "oversize bulk read");
+    check(readBulk(REG_COUNT - 10, 20, values) == -2, "bulk read address");
+    check(readList(scatterList, 1, values) == 1
+       && values[0] == registers[scatterList[0]], "single entry list");
+    {
+        int list[BULK_LIMIT + 1];
+        for (i = 0 ; i <= BULK_LIMIT ; i++) list[i] = (i * 5) % REG_COUNT;
+        check(readList(list, BULK_LIMIT, values) == BULK_LIMIT, "largest list");
+        for (i = 0 ; i < BULK_LIMIT ; i++) {
+            if (values[i] != registers[list[i]]) break;
+        }
+        check(i == BULK_LIMIT, "largest list content");
+        check(readList(list, BULK_LIMIT + 1, values) == -3, "oversize list");
+        list[3] = REG_COUNT;
+        check(readList(list, 10, values) == -2, "list address");
+    }
+    check(readWriteFC23(1998, 6, 2000, 3, w, values) == 6
+       && registers[2000] == w[0] && registers[2002] == w[2]
+       && checkValues(values, 1998, 6), "read/write multiple");
+    check(readFC3(0, FC3_LIMIT, values) == FC3_LIMIT
+       && checkValues(values, 0, FC3_LIMIT), "standard read");
+
+    /*
+     * Scan rate
+     */
+    standard = benchmark("Standard", scanStandard);
+    bulk = benchmark("Bulk", scanBulk);
+    check(bulk < standard, "fewer requests per scan");
+
+    printf("%s\n", good ? "PASS" : "FAIL");
+    return good ? 0 : 1;
+}
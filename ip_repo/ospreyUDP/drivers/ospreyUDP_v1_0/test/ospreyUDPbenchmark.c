@@ -0,0 +1,440 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Host-side benchmark of the ospreyUDP driver against a mock register file.
+ * Interface 0 has the packet buffer window and receive ring, interface 1
+ * has neither, so the lines for each direction compare the window and the
+ * data register (PIO) paths.  Transaction counts are driver accesses to
+ * the hardware.
+ * When built with OSPREY_UDP_RX_IN_PLACE the receive callback reads the
+ * window directly so its own accesses (here, a 12 byte header) are
+ * additional bus transactions on the target.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <xil_io.h>
+#include "ospreyUDP.h"
+#include "mockOspreyUDP.h"
+
+#define PACKET_COUNT    200000
+#define NEAR_PORT       50000
+#define FAR_PORT        50001
+#define FAR_ADDRESS     0xC0A80101
+#define HEADER_LENGTH   12
+
+static union {
+    uint32_t l[(OSPREY_UDP_PACKET_CAPACITY+sizeof(uint32_t)-1)/sizeof(uint32_t)];
+    char     c[OSPREY_UDP_PACKET_CAPACITY];
+} packet;
+
+static unsigned long callbackCount;
+static int checkPayload, payloadGood;
+static unsigned int headerSum;
+static int good = 1;
+
+static void
+callback(ospreyUDPendpoint endpoint, uint32_t farAddress, int farPort,
+                                                const char *buf, int length)
+{
+    int i;
+    callbackCount++;
+    for (i = 0 ; i < HEADER_LENGTH ; i++) {
+        headerSum += (uint8_t)buf[i];
+    }
+    if (checkPayload) {
+        payloadGood = (farAddress == FAR_ADDRESS)
+                   && (farPort == FAR_PORT)
+                   && (length == sizeof packet.c)
+                   && (memcmp(buf, packet.c, length) == 0);
+    }
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1.0e-9);
+}
+
+static void
+report(const char *name, unsigned long transactions, double seconds)
+{
+    printf("%-22s %7.1f transactions/packet %8.1f ns/packet\n", name,
+                                   (double)transactions / PACKET_COUNT,
+                                   (seconds * 1.0e9) / PACKET_COUNT);
+}
+
+static void
+benchmarkReceive(int interface, const char *name, unsigned int batch)
+{
+    struct mockOspreyUDP *mp = mockInstance(interface);
+    unsigned long transactions, count;
+    double start;
+    int n;
+
+    mockReceive(interface, FAR_ADDRESS, FAR_PORT, NEAR_PORT,
+                                                 packet.c, sizeof packet.c);
+    checkPayload = 1;
+    payloadGood = 0;
+    ospreyUDPcrank();
+    checkPayload = 0;
+    if (!payloadGood || mp->rxPending) {
+        printf("%s: receive FAILED.\n", name);
+        good = 0;
+    }
+    count = callbackCount;
+    transactions = mp->transactions;
+    start = now();
+    for (n = 0 ; n < PACKET_COUNT ; n += batch) {
+        mp->rxPending = batch;
+        ospreyUDPcrank();
+    }
+    report(name, mp->transactions - transactions, now() - start);
+    if (((callbackCount - count) != PACKET_COUNT) || mp->rxPending) {
+        printf("%s: callback count FAILED.\n", name);
+        good = 0;
+    }
+}
+
+static void
+checkReceiveStatistics(void)
+{
+    struct ospreyUDPreceiveStatistics stats;
+    struct mockOspreyUDP *mp = mockInstance(0);
+    int i;
+
+    mp->rxOverflow = 0;
+    for (i = 0 ; i < MOCK_RING_CAPACITY + 2 ; i++) {
+        mockReceive(0, FAR_ADDRESS, FAR_PORT, NEAR_PORT, NULL, 8);
+    }
+    if ((ospreyUDPreceiveStatistics(0, &stats) != 0)
+     || (stats.pending != MOCK_RING_CAPACITY)
+     || (stats.fifoOverflow != 2)
+     || (ospreyUDPreceiveStatistics(1, &stats) != -1)) {
+        printf("Receive statistics FAILED.\n");
+        good = 0;
+    }
+    ospreyUDPcrank();
+    if (mp->rxPending) {
+        printf("Ring drain FAILED.\n");
+        good = 0;
+    }
+}
+
+static void
+benchmarkTransmit(int interface, ospreyUDPendpoint ep, const char *name,
+                                                                   int inPlace)
+{
+    struct mockOspreyUDP *mp = mockInstance(interface);
+    unsigned long transactions, count;
+    double start;
+    int n;
+
+    count = mp->txCount;
+    if (!inPlace) {
+        memset(mp->txBuf, 0, sizeof packet);
+        ospreyUDPsendto(ep, FAR_ADDRESS, FAR_PORT, packet.c, sizeof packet.c);
+        if ((mp->txAddress != FAR_ADDRESS)
+         || (mp->txPorts != ((NEAR_PORT << 16) | FAR_PORT))
+         || (mp->txLength != sizeof packet.c)
+         || (memcmp(mp->txBuf, packet.c, sizeof packet.c) != 0)) {
+            printf("%s: transmit FAILED.\n", name);
+            good = 0;
+        }
+    }
+    transactions = mp->transactions;
+    start = now();
+    for (n = 0 ; n < PACKET_COUNT ; n++) {
+        if (inPlace) {
+            char *p = ospreyUDPtransmitBuffer(ep);
+            memcpy(p, packet.c, sizeof packet.c);
+            ospreyUDPsendto(ep, FAR_ADDRESS, FAR_PORT, p, sizeof packet.c);
+        }
+        else {
+            ospreyUDPsendto(ep, FAR_ADDRESS, FAR_PORT, packet.c,sizeof packet.c);
+        }
+    }
+    report(name, mp->transactions - transactions, now() - start);
+    if ((mp->txCount - count) != (PACKET_COUNT + !inPlace)) {
+        printf("%s: transmit count FAILED.\n", name);
+        good = 0;
+    }
+}
+
+static void
+checkFastSubscribers(void)
+{
+    struct mockOspreyUDP *mp = mockInstance(0);
+    struct mockOspreyUDP *old = mockInstance(1);
+    int i, capacity = ospreyUDPfastSubscriberCapacity(0);
+
+    mp->fastEnables = 0x1;
+    for (i = 0 ; i < capacity ; i++) {
+        if (ospreyUDPaddFastSubscriber(0, i, FAR_ADDRESS + i,
+                                                    NEAR_PORT, FAR_PORT + i)) {
+            good = 0;
+        }
+    }
+    if ((capacity != MOCK_FAST_CAPACITY)
+     || (mp->fastEnables != ((1 << MOCK_FAST_CAPACITY) - 1))
+     || (mp->fastAddress[2] != FAR_ADDRESS + 2)
+     || (mp->fastPorts[3] != ((NEAR_PORT << 16) | (FAR_PORT + 3)))
+     || (ospreyUDPremoveFastSubscriber(0, 1) != 0)
+     || (mp->fastEnables != (((1 << MOCK_FAST_CAPACITY) - 1) & ~0x2))
+     || (ospreyUDPaddFastSubscriber(0, capacity, FAR_ADDRESS, 1, 2) != -1)
+     || (ospreyUDPregisterFastSubscriber(0, FAR_ADDRESS + 9, 1, 2) != 0)
+     || (mp->fastAddress[0] != FAR_ADDRESS + 9)) {
+        good = 0;
+    }
+    /* Summary stream to one subscriber, ADC data to the rest */
+    if ((ospreyUDPselectFastSubscriberStream(0, 2, 1) != 0)
+     || (mp->fastStreams != 0x4)
+     || (mp->fastEnables != (((1 << MOCK_FAST_CAPACITY) - 1) & ~0x2))
+     || (ospreyUDPselectFastSubscriberStream(0, 2, 0) != 0)
+     || (mp->fastStreams != 0)
+     || (ospreyUDPselectFastSubscriberStream(0, 2, 2) != -1)
+     || (ospreyUDPselectFastSubscriberStream(1, 0, 1) != -1)) {
+        good = 0;
+    }
+    /* Firmware without a subscriber table has one fixed subscriber */
+    if ((ospreyUDPfastSubscriberCapacity(1) != 1)
+     || (ospreyUDPregisterFastSubscriber(1, FAR_ADDRESS, 1, 2) != 0)
+     || (old->fastAddress[0] != FAR_ADDRESS)
+     || (ospreyUDPremoveFastSubscriber(1, 0) != -1)
+     || (ospreyUDPaddFastSubscriber(1, 1, FAR_ADDRESS, 1, 2) != -1)) {
+        good = 0;
+    }
+    if (!good) {
+        printf("Fast subscriber table FAILED.\n");
+    }
+}
+
+static void
+checkTransmitQueue(ospreyUDPendpoint ep)
+{
+    struct ospreyUDPtransmitStatistics before, stats;
+    struct ospreyUDPendpointStatistics epStats, epAfter;
+    struct mockOspreyUDP *mp = mockInstance(0);
+    unsigned long count = mp->txCount;
+    long i;
+
+    ospreyUDPtransmitStatistics(0, &before);
+    ospreyUDPendpointStatistics(ep, &epStats);
+    mp->txBusy = 1;
+    for (i = 0 ; i < OSPREY_UDP_TX_QUEUE_CAPACITY + 2 ; i++) {
+        ospreyUDPsendto(ep, FAR_ADDRESS, FAR_PORT, packet.c, 8 + (4 * i));
+    }
+    if ((ospreyUDPtransmitStatistics(0, &stats) != 0)
+     || (stats.queued != OSPREY_UDP_TX_QUEUE_CAPACITY)
+     || (stats.maxQueued != OSPREY_UDP_TX_QUEUE_CAPACITY)
+     || (stats.dropped != (before.dropped + 2))
+     || (ospreyUDPtransmitBuffer(ep) != NULL)
+     || (mp->txCount != count)) {
+        printf("Transmit queue FAILED.\n");
+        good = 0;
+    }
+    mp->txBusy = 0;
+    for (i = 0 ; i < OSPREY_UDP_TX_QUEUE_CAPACITY ; i++) {
+        ospreyUDPcrank();
+        if ((mp->txCount != (count + i + 1))
+         || (mp->txLength != (8 + (4 * i)))
+         || (memcmp(mp->txBuf, packet.c, mp->txLength) != 0)) {
+            printf("Transmit queue drain FAILED.\n");
+            good = 0;
+        }
+    }
+    epStats.txDropped += 2;
+    epStats.txPackets += OSPREY_UDP_TX_QUEUE_CAPACITY;
+    ospreyUDPtransmitStatistics(0, &stats);
+    if ((stats.queued != 0)
+     || (ospreyUDPtransmitBuffer(ep) == NULL)
+     || (ospreyUDPendpointStatistics(ep, &epAfter) != 0)
+     || (epAfter.txPackets != epStats.txPackets)
+     || (epAfter.txDropped != epStats.txDropped)) {
+        printf("Transmit queue statistics FAILED.\n");
+        good = 0;
+    }
+
+    /*
+     * Transmitter stuck busy
+     */
+    count = mp->txCount;
+    mp->txBusy = 1;
+    ospreyUDPsendto(ep, FAR_ADDRESS, FAR_PORT, packet.c, 8);
+    for (i = 0 ; (i < 10000000) && (mp->txCount == count) ; i++) {
+        ospreyUDPcrank();
+    }
+    ospreyUDPtransmitStatistics(0, &stats);
+    if ((stats.resets != 1) || (stats.queued != 0) || (mp->txCount != count+1)){
+        printf("Transmitter stall recovery FAILED.\n");
+        good = 0;
+    }
+    else {
+        printf("Transmitter stall recovered after %ld busy checks.\n", i);
+    }
+}
+
+static void
+checkEndpointStatistics(ospreyUDPendpoint ep)
+{
+    struct ospreyUDPendpointStatistics before, after;
+    uint32_t noListenerBefore, noListenerAfter;
+    struct mockOspreyUDP *mp = mockInstance(0);
+    unsigned long count = callbackCount;
+
+    if ((ospreyUDPendpointStatistics(ep, &before) != 0)
+     || (ospreyUDPnoListenerCount(0, &noListenerBefore) != 0)) {
+        printf("Endpoint statistics FAILED.\n");
+        good = 0;
+        return;
+    }
+    mockReceive(0, FAR_ADDRESS, FAR_PORT, NEAR_PORT + 1, NULL, 8);
+    ospreyUDPcrank();
+    mockReceive(0, FAR_ADDRESS, FAR_PORT, NEAR_PORT, NULL,
+                                             OSPREY_UDP_PACKET_CAPACITY + 1);
+    ospreyUDPcrank();
+    mockReceive(0, FAR_ADDRESS, FAR_PORT, NEAR_PORT, NULL, 8);
+    ospreyUDPcrank();
+    ospreyUDPsendto(ep, FAR_ADDRESS, FAR_PORT, packet.c, 8);
+    if ((ospreyUDPendpointStatistics(ep, &after) != 0)
+     || (ospreyUDPnoListenerCount(0, &noListenerAfter) != 0)
+     || (noListenerAfter != (noListenerBefore + 1))
+     || (after.rxDropped != (before.rxDropped + 1))
+     || (after.rxPackets != (before.rxPackets + 1))
+     || (after.txPackets != (before.txPackets + 1))
+     || ((callbackCount - count) != 1)
+     || mp->rxPending) {
+        printf("Endpoint statistics FAILED.\n");
+        good = 0;
+    }
+}
+
+/*
+ * Leave room for the endpoint on interface 1
+ */
+#define DISPATCH_ENDPOINT_LIMIT (OSPREY_UDP_ENDPOINT_CAPACITY - 1)
+
+/*
+ * Packet dispatch cost as the number of endpoints grows.
+ * Packets go to the first endpoint registered, which
+ * would be the last one found by a linear search.
+ */
+static void
+benchmarkDispatch(void)
+{
+    struct mockOspreyUDP *mp = mockInstance(0);
+    unsigned long transactions, count;
+    unsigned int endpointCount = 1, target;
+    int extraPort = NEAR_PORT + 100;
+    double start;
+    char name[40];
+    int n;
+
+    mockReceive(0, FAR_ADDRESS, FAR_PORT, NEAR_PORT, packet.c, 16);
+    for (;;) {
+        count = callbackCount;
+        transactions = mp->transactions;
+        start = now();
+        for (n = 0 ; n < PACKET_COUNT ; n++) {
+            mp->rxPending = 1;
+            ospreyUDPcrank();
+        }
+        sprintf(name, "Dispatch, %u endpoint%s", endpointCount,
+                                               endpointCount == 1 ? "" : "s");
+        report(name, mp->transactions - transactions, now() - start);
+        if ((callbackCount - count) != PACKET_COUNT) {
+            printf("%s: callback count FAILED.\n", name);
+            good = 0;
+        }
+        target = endpointCount * 4;
+        if (target > DISPATCH_ENDPOINT_LIMIT) {
+            break;
+        }
+        while (endpointCount < target) {
+            if (ospreyUDPregisterEndpoint(0, extraPort++, callback) == NULL) {
+                printf("Can't register endpoint %u.\n", endpointCount + 1);
+                good = 0;
+                return;
+            }
+            endpointCount++;
+        }
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    static uint8_t mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    ospreyUDPendpoint windowEndpoint, pioEndpoint;
+    unsigned int i;
+
+    for (i = 0 ; i < sizeof packet.c ; i++) {
+        packet.c[i] = i * 7;
+    }
+    mockInit();
+    mockInstance(0)->hasWindow = 1;
+    mockInstance(0)->hasRing = 1;
+    mockInstance(0)->hasFastTable = 1;
+    mockInstance(1)->hasWindow = 0;
+    mockInstance(1)->hasRing = 0;
+    if ((ospreyUDPregisterInterface(mockBaseAddress(0),
+                          0xC0A80102, 0xC0A801FE, 0xFFFFFF00, mac) != 0)
+     || (ospreyUDPregisterInterface(mockBaseAddress(1),
+                          0xC0A80202, 0xC0A802FE, 0xFFFFFF00, mac) != 1)) {
+        printf("Can't register interfaces.\n");
+        return 1;
+    }
+    windowEndpoint = ospreyUDPregisterEndpoint(0, NEAR_PORT, callback);
+    pioEndpoint = ospreyUDPregisterEndpoint(1, NEAR_PORT, callback);
+    if ((windowEndpoint == NULL) || (pioEndpoint == NULL)) {
+        printf("Can't register endpoints.\n");
+        return 1;
+    }
+
+    printf("%d byte packets%s\n", (int)sizeof packet.c,
+    #ifdef OSPREY_UDP_RX_IN_PLACE
+                                   ", receive in place"
+    #else
+                                   ""
+    #endif
+                                   );
+    benchmarkReceive(1, "Receive, PIO", 1);
+    benchmarkReceive(0, "Receive, window", 1);
+    benchmarkReceive(0, "Receive, ring batch", MOCK_RING_CAPACITY);
+    checkReceiveStatistics();
+    checkFastSubscribers();
+    benchmarkTransmit(1, pioEndpoint, "Transmit, PIO", 0);
+    benchmarkTransmit(0, windowEndpoint, "Transmit, window", 0);
+    benchmarkTransmit(0, windowEndpoint, "Transmit, in place", 1);
+    checkEndpointStatistics(windowEndpoint);
+    checkTransmitQueue(windowEndpoint);
+    benchmarkDispatch();
+    printf("%s\n", good ? "PASS" : "FAIL");
+    return !good;
+}
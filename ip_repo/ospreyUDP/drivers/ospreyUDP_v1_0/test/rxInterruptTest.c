@@ -0,0 +1,194 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host-side test of interrupt-driven ospreyUDP reception.
+ * A simulated main loop is occasionally busy for a long time (as when
+ * waiting for a flash erase) while requests keep arriving.  The same
+ * traffic is run with polled and with interrupt-driven reception.  Polled
+ * reception must lose packets to a full receive ring and interrupt-driven
+ * reception must deliver every one of them.  Callbacks wait for the main
+ * loop in both modes, so the time from arrival to callback is not reduced
+ * -- only reported.  Times are in simulated clock ticks.
+ * Interrupt-driven reception must be refused on an interface without
+ * the packet window.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <xil_io.h>
+#include "ospreyUDP.h"
+#include "mockOspreyUDP.h"
+
+#define NEAR_PORT       502
+#define FAR_PORT        50001
+#define FAR_ADDRESS     0xC0A80101
+#define RUN_TICKS       2000000
+#define ARRIVAL_TICKS   700     /* Request interval */
+#define WORK_TICKS      20      /* Usual main loop iteration */
+#define BUSY_TICKS      5000    /* Occasional long main loop iteration */
+#define BUSY_INTERVAL   100     /* Iterations between long ones */
+#define ARRIVAL_CAPACITY 64
+
+static uint32_t ticks;
+static uint32_t arrivals[ARRIVAL_CAPACITY];
+static unsigned int arrivalHead, arrivalTail;
+static unsigned long received, lost;
+static uint32_t maxLatency;
+static int good = 1;
+
+static uint32_t
+now(void)
+{
+    return ticks;
+}
+
+static void
+callback(ospreyUDPendpoint endpoint, uint32_t farAddress, int farPort,
+                                                const char *buf, int length)
+{
+    uint32_t latency;
+    if (arrivalTail == arrivalHead) {
+        printf("Unexpected packet FAILED.\n");
+        good = 0;
+        return;
+    }
+    latency = ticks - arrivals[arrivalTail++ % ARRIVAL_CAPACITY];
+    if (latency > maxLatency) maxLatency = latency;
+    received++;
+}
+
+/*
+ * Advance the clock, delivering packets and, when enabled,
+ * taking receive interrupts along the way.
+ */
+static void
+run(uint32_t count, int useInterrupt)
+{
+    static const char request[12] = { 0, 1, 0, 0, 0, 6, 1, 3, 0, 0, 0, 10 };
+    struct mockOspreyUDP *mp = mockInstance(0);
+
+    while (count--) {
+        if ((++ticks % ARRIVAL_TICKS) == 0) {
+            unsigned long overflow = mp->rxOverflow;
+            mockReceive(0, FAR_ADDRESS, FAR_PORT, NEAR_PORT,
+                                                  request, sizeof request);
+            if (mp->rxOverflow == overflow) {
+                arrivals[arrivalHead++ % ARRIVAL_CAPACITY] = ticks;
+            }
+            else {
+                lost++;
+            }
+        }
+        if (useInterrupt && mockRxIRQ(0)) {
+            ospreyUDPrxInterruptHandler((void *)0);
+        }
+    }
+}
+
+static void
+scenario(const char *name, int useInterrupt)
+{
+    unsigned long iteration = 0;
+
+    ticks = 0;
+    received = lost = 0;
+    maxLatency = 0;
+    arrivalHead = arrivalTail = 0;
+    ospreyUDPenableRxInterrupt(0, useInterrupt);
+    while (ticks < RUN_TICKS) {
+        run((++iteration % BUSY_INTERVAL) ? WORK_TICKS : BUSY_TICKS,
+                                                               useInterrupt);
+        ospreyUDPcrank();
+    }
+    run(WORK_TICKS, useInterrupt);
+    ospreyUDPcrank();
+    printf("%-9s %6lu received %5lu lost  %5u ticks maximum latency\n",
+                                          name, received, lost, maxLatency);
+}
+
+int
+main(int argc, char **argv)
+{
+    static uint8_t mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    static uint8_t oldMac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+    struct ospreyUDPrxInterruptStatistics stats;
+    unsigned long polledReceived, polledLost, total = 0;
+    int i;
+
+    mockInit();
+    mockInstance(0)->hasWindow = 1;
+    mockInstance(0)->hasRing = 1;
+    mockInstance(1)->hasWindow = 0;
+    mockInstance(1)->hasRing = 1;
+    if ((ospreyUDPregisterInterface(mockBaseAddress(0),
+                          0xC0A80102, 0xC0A801FE, 0xFFFFFF00, mac) != 0)
+     || (ospreyUDPregisterInterface(mockBaseAddress(1),
+                          0xC0A80202, 0xC0A802FE, 0xFFFFFF00, oldMac) != 1)
+     || (ospreyUDPregisterEndpoint(0, NEAR_PORT, callback) == NULL)) {
+        printf("Can't register interface.\n");
+        return 1;
+    }
+    ospreyUDPsetTimeSource(now);
+
+    if ((ospreyUDPenableRxInterrupt(1, 1) == 0)
+     || mockInstance(1)->rxIrqEnable
+     || (ospreyUDPenableRxInterrupt(1, 0) != 0)) {
+        printf("Interrupt enable without packet window FAILED.\n");
+        good = 0;
+    }
+
+    scenario("Polled", 0);
+    polledReceived = received;
+    polledLost = lost;
+    ospreyUDPrxInterruptStatistics(&stats);
+    if ((stats.interrupts != 0) || (polledLost == 0)) {
+        printf("Polled reception FAILED.\n");
+        good = 0;
+    }
+
+    scenario("Interrupt", 1);
+    ospreyUDPrxInterruptStatistics(&stats);
+    printf("%lu interrupts, %lu queue full, time in queue:\n",
+              (unsigned long)stats.interrupts, (unsigned long)stats.queueFull);
+    for (i = 0 ; i < OSPREY_UDP_RX_LATENCY_BINS ; i++) {
+        total += stats.latency[i];
+        if (stats.latency[i]) {
+            printf("  < %6lu ticks: %lu\n", 1UL << i,
+                                            (unsigned long)stats.latency[i]);
+        }
+    }
+    if ((lost != 0)
+     || (received != (polledReceived + polledLost))
+     || (total != received)
+     || (arrivalHead != arrivalTail)
+     || (stats.queueFull == 0)
+     || mockInstance(0)->rxPending
+     || !mockInstance(0)->rxIrqEnable) {
+        printf("Interrupt reception FAILED.\n");
+        good = 0;
+    }
+    printf("%s\n", good ? "PASS" : "FAIL");
+    return !good;
+}
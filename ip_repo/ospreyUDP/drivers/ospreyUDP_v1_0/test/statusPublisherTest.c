@@ -0,0 +1,213 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Osprey DCS
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Host-side test of the status publisher over a loopback ospreyUDP stand-in.
+ * Compares the packets needed to keep a set of status registers up to date
+ * by publication with those needed by MODBUS polling.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "statusPublisher.h"
+#include "loopbackOspreyUDP.h"
+
+#define PUBLISHER_PORT  50010
+#define REG_COUNT       40
+#define BLOCK_COUNT     8   /* Separate MODBUS blocks holding the registers */
+
+static int good = 1;
+static int readCalls;
+
+int
+statusPublisherCallbackRead(const uint32_t *regList, int regCount,
+                                                             uint32_t *values)
+{
+    int i;
+    readCalls++;
+    for (i = 0 ; i < regCount ; i++) {
+        if (regList[i] >= 1000) return -1;
+        values[i] = (regList[i] * 2654435761u) ^ readCalls;
+    }
+    return 0;
+}
+
+static void
+check(int condition, const char *msg)
+{
+    if (!condition) {
+        printf("FAIL: %s\n", msg);
+        good = 0;
+    }
+}
+
+static uint32_t
+get32(const unsigned char *cp)
+{
+    return ((uint32_t)cp[0] << 24) | (cp[1] << 16) | (cp[2] << 8) | cp[3];
+}
+
+static void
+put32(unsigned char *cp, uint32_t v)
+{
+    cp[0] = v >> 24;
+    cp[1] = v >> 16;
+    cp[2] = v >> 8;
+    cp[3] = v;
+}
+
+static int
+subscribe(uint32_t interval, const uint32_t *regs, int count)
+{
+    unsigned char req[12 + (4 * (STATUS_PUBLISHER_REGISTER_CAPACITY + 1))];
+    const unsigned char *reply;
+    int i;
+    memcpy(req, "PSSR", 4);
+    put32(req + 4, interval);
+    put32(req + 8, count);
+    for (i = 0 ; i < count ; i++) {
+        put32(req + 12 + (4 * i), regs[i]);
+    }
+    return loopbackTransaction(PUBLISHER_PORT, req, 12 + (4 * count), &reply);
+}
+
+/*
+ * Check a publication, return its sequence number or -1 if none
+ */
+static int
+checkPublication(uint32_t seconds, uint32_t ns, const uint32_t *regs,
+                                                                     int count)
+{
+    const unsigned char *p;
+    uint32_t farAddress;
+    int farPort, i;
+    int n = loopbackSent(&p, &farAddress, &farPort);
+    if (n == 0) {
+        return -1;
+    }
+    check(n == 20 + (4 * count), "publication length");
+    check(farAddress == LOOPBACK_FAR_ADDRESS, "subscriber address");
+    check(farPort == LOOPBACK_FAR_PORT, "subscriber port");
+    check(memcmp(p, "PSSP", 4) == 0, "publication magic");
+    check(get32(p + 8) == seconds, "seconds");
+    check(get32(p + 12) == ns, "nanoseconds");
+    check(get32(p + 16) == (uint32_t)count, "count");
+    for (i = 0 ; (i < count) && (n == 20 + (4 * count)) ; i++) {
+        if (get32(p + 20 + (4 * i)) != ((regs[i] * 2654435761u) ^ readCalls)){
+            check(0, "value");
+            break;
+        }
+    }
+    return get32(p + 4);
+}
+
+int
+main(int argc, char **argv)
+{
+    uint32_t regs[STATUS_PUBLISHER_REGISTER_CAPACITY + 1];
+    const unsigned char *p;
+    int i, seq, count, publications;
+    uint32_t s, ns;
+
+    for (i = 0 ; i <= STATUS_PUBLISHER_REGISTER_CAPACITY ; i++) {
+        regs[i] = (i * 7) % 1000;
+    }
+    check(statusPublisherUDPinit(0) == 0, "init");
+
+    /*
+     * Nothing sent before subscription
+     */
+    statusPublisherCrank(100, 0);
+    check(loopbackSent(&p, NULL, NULL) == 0, "no subscriber");
+
+    /*
+     * 10 Hz publication
+     */
+    subscribe(100000, regs, REG_COUNT);
+    statusPublisherCrank(100, 5000);
+    seq = checkPublication(100, 5000, regs, REG_COUNT);
+    check(seq == 0, "acknowledge");
+    publications = 0;
+    for (s = 100, ns = 5000 ; s < 110 ; ) {
+        ns += 1000000;
+        if (ns >= 1000000000) {
+            ns -= 1000000000;
+            s++;
+        }
+        statusPublisherCrank(s, ns);
+        i = checkPublication(s, ns, regs, REG_COUNT);
+        if (i >= 0) {
+            check(i == ++seq, "sequence");
+            publications++;
+        }
+    }
+    check((publications >= 99) && (publications <= 100), "10 Hz rate");
+
+    /*
+     * Once per second, largest list
+     */
+    count = STATUS_PUBLISHER_REGISTER_CAPACITY;
+    subscribe(0, regs, count);
+    statusPublisherCrank(200, 500);
+    check(checkPublication(200, 500, regs, count) == ++seq, "PPS acknowledge");
+    statusPublisherCrank(200, 999999999);
+    check(loopbackSent(&p, NULL, NULL) == 0, "PPS wait");
+    statusPublisherCrank(201, 20);
+    check(checkPublication(201, 20, regs, count) == ++seq, "PPS");
+
+    /*
+     * Invalid requests are ignored
+     */
+    subscribe(0, regs, count + 1);
+    statusPublisherCrank(202, 20);
+    check(checkPublication(202, 20, regs, count) == ++seq, "oversize list");
+
+    /*
+     * Read failure
+     */
+    regs[0] = 1000;
+    subscribe(0, regs, 4);
+    statusPublisherCrank(203, 20);
+    check(checkPublication(203, 20, regs, 0) == ++seq, "read failure");
+    regs[0] = 0;
+
+    /*
+     * Cancel
+     */
+    subscribe(0xFFFFFFFF, regs, 0);
+    statusPublisherCrank(204, 20);
+    statusPublisherCrank(205, 20);
+    check(loopbackSent(&p, NULL, NULL) == 0, "cancel");
+
+    /*
+     * Traffic comparison for REG_COUNT registers in BLOCK_COUNT blocks at 10 Hz
+     */
+    printf("%d registers in %d blocks at 10 Hz: MODBUS polling %d packets/s, "
+           "publication %d packets/s\n", REG_COUNT, BLOCK_COUNT,
+           2 * 10 * BLOCK_COUNT, publications / 10);
+
+    printf("%s\n", good ? "PASS" : "FAIL");
+    return good ? 0 : 1;
+}
@@ -28,6 +28,28 @@
  * Stack doesn't seem to support sending UDP packets with 0-length payload.
  * Based on Axi-Lite example with one additional cycle of read latency.
  * Extra cycle is needed in case of back-to-back read cycles.
+ *
+ * The upper half of the address space is a window onto the packet buffers.
+ * Reads return words from the receive buffer, writes (with byte strobes)
+ * go to the transmit buffer.  This lets the processor access packet data
+ * directly rather than through the auto-incrementing data register.
+ *
+ * Received packets are stored in a ring of RX_RING_CAPACITY slots so that
+ * the network stack can continue to accept packets while the processor is
+ * busy.  The processor always sees the packet at the tail of the ring.
+ * Writing the 'finish reception' bit releases that slot and exposes the
+ * next packet, if any.  Head and tail indices cross clock domains as Gray
+ * codes.  Counts of packets dropped by the MAC receive FIFO and of bad
+ * frames are maintained in the system clock domain.
+ *
+ * The fast data stream can be published to up to FAST_SUBSCRIBER_CAPACITY
+ * subscribers.  Each packet from the fastTx stream is transmitted once to
+ * each enabled entry of the subscriber table, in index order.  Subscriber
+ * entry 0 is enabled at power-up so software that knows nothing of the
+ * table sees the original single-subscriber behaviour.
+ * The fastTx_tuser input identifies the stream (0 or 1) to which a packet
+ * belongs.  Each subscriber receives packets from a single stream, stream 0
+ * at power-up.
  */
 
 `default_nettype none
@@ -46,8 +68,10 @@ module ospreyUDP #(
     parameter DEBUG_ICMP       = "false",
     parameter PKBUF_CAPACITY   = 1472,
     parameter RX_FIFO_DEPTH    = 4096,
+    parameter RX_RING_CAPACITY = 4,
+    parameter FAST_SUBSCRIBER_CAPACITY = 4,
     ////////////////////// AXI-Lite Boilerplate Parameters ///////////////////
-    parameter C_S_AXI_ADDR_WIDTH = 6,
+    parameter C_S_AXI_ADDR_WIDTH = 16,
     parameter C_S_AXI_DATA_WIDTH = 32
     ) (
     ////////////////////// Application-specific Ports ///////////////////
@@ -67,6 +91,7 @@ module ospreyUDP #(
 (*MARK_DEBUG=DEBUG_TX_FAST*) input  wire  [7:0] fastTx_tdata,
 (*MARK_DEBUG=DEBUG_TX_FAST*) input  wire        fastTx_tvalid,
 (*MARK_DEBUG=DEBUG_TX_FAST*) input  wire        fastTx_tlast,
+(*MARK_DEBUG=DEBUG_TX_FAST*) input  wire        fastTx_tuser,
 (*MARK_DEBUG=DEBUG_TX_FAST*) output reg         fastTx_tready = 0,
 
     ////////////////////// AXI-Lite Boilerplate Ports ///////////////////
@@ -159,6 +184,28 @@ end
 //////////////////////// End of AXI-Lite Boilerplate ////////////////////////
 
 localparam PK_BYTE_COUNT_WIDTH = $clog2(PKBUF_CAPACITY+1);
+localparam PKBUF_WINDOW_BIT = C_S_AXI_ADDR_WIDTH - 1;
+localparam RX_SLOT_WIDTH = $clog2(RX_RING_CAPACITY);
+localparam RX_INDEX_WIDTH = RX_SLOT_WIDTH + 1;
+localparam FAST_SUBSCRIBER_WIDTH = $clog2(FAST_SUBSCRIBER_CAPACITY);
+
+// MAC transmit frame FIFO must hold an entire frame (payload plus UDP, IP
+// and Ethernet headers) or it silently drops it.  Grow with jumbo packets.
+localparam MAC_TX_FIFO_DEPTH = (PKBUF_CAPACITY + 64) > 4096 ?
+                                   (1 << $clog2(PKBUF_CAPACITY + 64)) : 4096;
+
+function [RX_INDEX_WIDTH-1:0] BinaryToGray(input [RX_INDEX_WIDTH-1:0] binary);
+    BinaryToGray = binary ^ (binary >> 1);
+endfunction
+function [RX_INDEX_WIDTH-1:0] GrayToBinary(input [RX_INDEX_WIDTH-1:0] gray);
+    integer i;
+    begin
+    GrayToBinary[RX_INDEX_WIDTH-1] = gray[RX_INDEX_WIDTH-1];
+    for (i = RX_INDEX_WIDTH - 2 ; i >= 0 ; i = i - 1) begin
+        GrayToBinary[i] = GrayToBinary[i+1] ^ gray[i];
+    end
+    end
+endfunction
 
 (*MARK_DEBUG=DEBUG_AXI*) wire sysCsrStrobe;
 (*MARK_DEBUG=DEBUG_AXI*) wire sysTxDataStrobe;
@@ -173,27 +220,34 @@ localparam PK_BYTE_COUNT_WIDTH = $clog2(PKBUF_CAPACITY+1);
 (*MARK_DEBUG=DEBUG_AXI*) wire sysRxDataStrobe;
 (*MARK_DEBUG=DEBUG_AXI*) wire fastTxDestAddrStrobe;
 (*MARK_DEBUG=DEBUG_AXI*) wire fastTxPortsStrobe;
-assign sysCsrStrobe       = s_axi_lite_wready&&(s_axi_lite_awaddr[5:2] == 4'h0);
-assign sysTxDataStrobe    = s_axi_lite_wready&&(s_axi_lite_awaddr[5:2] == 4'h1);
-assign sysTxDestAddrStrobe= s_axi_lite_wready&&(s_axi_lite_awaddr[5:2] == 4'h2);
-assign sysTxPortsStrobe   = s_axi_lite_wready&&(s_axi_lite_awaddr[5:2] == 4'h3);
-assign sysTxLengthStrobe  = s_axi_lite_wready&&(s_axi_lite_awaddr[5:2] == 4'h4);
-assign sysMACloStrobe     = s_axi_lite_wready&&(s_axi_lite_awaddr[5:2] == 4'h5);
-assign sysMAChiStrobe     = s_axi_lite_wready&&(s_axi_lite_awaddr[5:2] == 4'h6);
-assign sysLocalAddrStrobe = s_axi_lite_wready&&(s_axi_lite_awaddr[5:2] == 4'h7);
-assign sysGatewayStrobe   = s_axi_lite_wready&&(s_axi_lite_awaddr[5:2] == 4'h8);
-assign sysNetmaskStrobe   = s_axi_lite_wready&&(s_axi_lite_awaddr[5:2] == 4'h9);
-assign fastTxDestAddrStrobe=s_axi_lite_wready&&(s_axi_lite_awaddr[5:2] == 4'hA);
-assign fastTxPortsStrobe  = s_axi_lite_wready&&(s_axi_lite_awaddr[5:2] == 4'hB);
+(*MARK_DEBUG=DEBUG_AXI*) wire fastTxSubscriberStrobe;
+(*MARK_DEBUG=DEBUG_AXI*) wire sysTxWindowStrobe;
+wire sysRegWrite = s_axi_lite_wready && !s_axi_lite_awaddr[PKBUF_WINDOW_BIT];
+assign sysCsrStrobe       = sysRegWrite&&(s_axi_lite_awaddr[5:2] == 4'h0);
+assign sysTxDataStrobe    = sysRegWrite&&(s_axi_lite_awaddr[5:2] == 4'h1);
+assign sysTxDestAddrStrobe= sysRegWrite&&(s_axi_lite_awaddr[5:2] == 4'h2);
+assign sysTxPortsStrobe   = sysRegWrite&&(s_axi_lite_awaddr[5:2] == 4'h3);
+assign sysTxLengthStrobe  = sysRegWrite&&(s_axi_lite_awaddr[5:2] == 4'h4);
+assign sysMACloStrobe     = sysRegWrite&&(s_axi_lite_awaddr[5:2] == 4'h5);
+assign sysMAChiStrobe     = sysRegWrite&&(s_axi_lite_awaddr[5:2] == 4'h6);
+assign sysLocalAddrStrobe = sysRegWrite&&(s_axi_lite_awaddr[5:2] == 4'h7);
+assign sysGatewayStrobe   = sysRegWrite&&(s_axi_lite_awaddr[5:2] == 4'h8);
+assign sysNetmaskStrobe   = sysRegWrite&&(s_axi_lite_awaddr[5:2] == 4'h9);
+assign fastTxDestAddrStrobe=sysRegWrite&&(s_axi_lite_awaddr[5:2] == 4'hA);
+assign fastTxPortsStrobe  = sysRegWrite&&(s_axi_lite_awaddr[5:2] == 4'hB);
+assign fastTxSubscriberStrobe=sysRegWrite&&(s_axi_lite_awaddr[5:2] == 4'hF);
 assign sysRxDataStrobe    = s_axi_lite_rvalid && s_axi_lite_rready &&
+                                                 !raddr[PKBUF_WINDOW_BIT] &&
                                                            (raddr[5:2] == 4'h1);
+assign sysTxWindowStrobe  = s_axi_lite_wready &&
+                                           s_axi_lite_awaddr[PKBUF_WINDOW_BIT];
 
 // Enable/disable network stack
 reg sysResetn = 0;
 
 // Dual-port RAM
 localparam PKBUF_WORD_ADDR_WIDTH = $clog2((PKBUF_CAPACITY+3)/4);
-reg [31:0] rxBuf [0:(1<<PKBUF_WORD_ADDR_WIDTH)-1], rxBufQ;
+reg [31:0] rxBuf [0:(RX_RING_CAPACITY<<PKBUF_WORD_ADDR_WIDTH)-1], rxBufQ;
 reg [31:0] txBuf [0:(1<<PKBUF_WORD_ADDR_WIDTH)-1], txBufQ;
 reg [31:0] fastTxBuf [0:(1<<PKBUF_WORD_ADDR_WIDTH)-1], fastTxBufQ;
 
@@ -220,11 +274,23 @@ end
 
 // System side of dual port RAM
 reg [PKBUF_WORD_ADDR_WIDTH-1:0] sysPkAddr;
-always @(posedge s_axi_lite_aclk) begin
-    if (sysTxDataStrobe) begin
-        txBuf[sysPkAddr] <= s_axi_lite_wdata;
+wire [PKBUF_WORD_ADDR_WIDTH-1:0] sysTxWrAddr = sysTxWindowStrobe ?
+                       s_axi_lite_awaddr[2+:PKBUF_WORD_ADDR_WIDTH] : sysPkAddr;
+wire [PKBUF_WORD_ADDR_WIDTH-1:0] sysRxRdAddr = raddr[PKBUF_WINDOW_BIT] ?
+                                   raddr[2+:PKBUF_WORD_ADDR_WIDTH] : sysPkAddr;
+genvar w;
+generate
+for (w = 0 ; w < 4 ; w = w + 1) begin : txByteWrite
+    always @(posedge s_axi_lite_aclk) begin
+        if (sysTxDataStrobe || (sysTxWindowStrobe && s_axi_lite_wstrb[w])) begin
+            txBuf[sysTxWrAddr][w*8+:8] <= s_axi_lite_wdata[w*8+:8];
+        end
     end
-    rxBufQ <= rxBuf[sysPkAddr];
+end
+endgenerate
+wire [RX_SLOT_WIDTH-1:0] sysRxSlot;
+always @(posedge s_axi_lite_aclk) begin
+    rxBufQ <= rxBuf[{sysRxSlot, sysRxRdAddr}];
 end
 always @(posedge s_axi_lite_aclk) begin
     if (sysCsrStrobe) begin
@@ -252,8 +318,12 @@ end
 reg [31:0] sysTxDestinationAddress;
 reg [15:0] sysTxSourcePort, sysTxDestinationPort;
 reg [PK_BYTE_COUNT_WIDTH-1:0] sysTxLength;
-reg [31:0] fastTxDestinationAddress;
-reg [15:0] fastTxSourcePort, fastTxDestinationPort;
+reg [31:0] fastTxDestinationAddress [0:FAST_SUBSCRIBER_CAPACITY-1];
+reg [15:0] fastTxSourcePort          [0:FAST_SUBSCRIBER_CAPACITY-1];
+reg [15:0] fastTxDestinationPort     [0:FAST_SUBSCRIBER_CAPACITY-1];
+reg [FAST_SUBSCRIBER_CAPACITY-1:0] fastTxSubscriberEnables = 1;
+reg [FAST_SUBSCRIBER_CAPACITY-1:0] fastTxSubscriberStreams = 0;
+reg [FAST_SUBSCRIBER_WIDTH-1:0] sysFastTxSelect = 0;
 reg sysTxStartToggle = 0;
 (*MARK_DEBUG=DEBUG_TX*) reg txDoneToggle = 0;
 (*ASYNC_REG="true"*) reg sysTxDoneToggle_m = 0;
@@ -290,28 +360,47 @@ always @(posedge s_axi_lite_aclk) begin
         sysTxLength <= s_axi_lite_wdata[0+:PK_BYTE_COUNT_WIDTH];
     end
     if (fastTxDestAddrStrobe) begin
-        fastTxDestinationAddress <= s_axi_lite_wdata;
+        fastTxDestinationAddress[sysFastTxSelect] <= s_axi_lite_wdata;
     end
     if (fastTxPortsStrobe) begin
-        fastTxDestinationPort <= s_axi_lite_wdata[0+:16];
-        fastTxSourcePort <= s_axi_lite_wdata[16+:16];
+        fastTxDestinationPort[sysFastTxSelect] <= s_axi_lite_wdata[0+:16];
+        fastTxSourcePort[sysFastTxSelect] <= s_axi_lite_wdata[16+:16];
+    end
+    if (fastTxSubscriberStrobe) begin
+        sysFastTxSelect <= s_axi_lite_wdata[0+:FAST_SUBSCRIBER_WIDTH];
+        if (s_axi_lite_wdata[31]) begin
+            fastTxSubscriberEnables[s_axi_lite_wdata[0+:FAST_SUBSCRIBER_WIDTH]]
+                                                                         <= 1;
+        end
+        else if (s_axi_lite_wdata[30]) begin
+            fastTxSubscriberEnables[s_axi_lite_wdata[0+:FAST_SUBSCRIBER_WIDTH]]
+                                                                         <= 0;
+        end
+        if (s_axi_lite_wdata[29]) begin
+            fastTxSubscriberStreams[s_axi_lite_wdata[0+:FAST_SUBSCRIBER_WIDTH]]
+                                                      <= s_axi_lite_wdata[28];
+        end
     end
 end
 
 // Packet reception
 // Receiver control/status
-reg sysRxDoneToggle = 0;
-(*MARK_DEBUG=DEBUG_RX*) reg rxFullToggle = 0;
-(*ASYNC_REG="true"*) reg sysRxFullToggle_m = 0;
-reg sysRxFullToggle = 0;
-wire rxPacketPresent = (sysRxDoneToggle ^ sysRxFullToggle);
+(*MARK_DEBUG=DEBUG_RX*) reg [RX_INDEX_WIDTH-1:0] rxHeadGray = 0;
+(*ASYNC_REG="true"*) reg [RX_INDEX_WIDTH-1:0] sysRxHeadGray_m = 0;
+reg [RX_INDEX_WIDTH-1:0] sysRxHeadGray = 0;
+reg [RX_INDEX_WIDTH-1:0] sysRxTail = 0, sysRxTailGray = 0;
+wire [RX_INDEX_WIDTH-1:0] sysRxHead = GrayToBinary(sysRxHeadGray);
+wire [RX_INDEX_WIDTH-1:0] sysRxPending = sysRxHead - sysRxTail;
+wire rxPacketPresent = (sysRxHeadGray != sysRxTailGray);
+assign sysRxSlot = sysRxTail[RX_SLOT_WIDTH-1:0];
 reg  rxInterruptEnable = 0;
 
 always @(posedge s_axi_lite_aclk) begin
     if (!sysResetn) begin
-        sysRxFullToggle_m <= 0;
-        sysRxFullToggle   <= 0;
-        sysRxDoneToggle   <= 0;
+        sysRxHeadGray_m   <= 0;
+        sysRxHeadGray     <= 0;
+        sysRxTail         <= 0;
+        sysRxTailGray     <= 0;
         rxInterruptEnable <= 0;
         rxIRQ <= 0;
     end
@@ -319,7 +408,8 @@ always @(posedge s_axi_lite_aclk) begin
         rxIRQ <= (rxPacketPresent && rxInterruptEnable);
         if (sysCsrStrobe) begin
             if (s_axi_lite_wdata[28] && rxPacketPresent) begin
-                sysRxDoneToggle <= !sysRxDoneToggle;
+                sysRxTail <= sysRxTail + 1;
+                sysRxTailGray <= BinaryToGray(sysRxTail + 1);
             end
             if (s_axi_lite_wdata[25]) begin
                 rxInterruptEnable <= 0;
@@ -328,37 +418,79 @@ always @(posedge s_axi_lite_aclk) begin
                 rxInterruptEnable <= 1;
             end
         end
-        sysRxFullToggle_m <= rxFullToggle;
-        sysRxFullToggle   <= sysRxFullToggle_m;
+        sysRxHeadGray_m <= rxHeadGray;
+        sysRxHeadGray   <= sysRxHeadGray_m;
+    end
+end
+
+// Dropped packet counters
+// Events are at least one minimum-length frame apart so toggles suffice.
+reg rxOverflowToggle = 0, rxBadFrameToggle = 0;
+(*ASYNC_REG="true"*) reg sysRxOverflowToggle_m = 0, sysRxBadFrameToggle_m = 0;
+reg sysRxOverflowToggle = 0, sysRxOverflowToggle_d = 0;
+reg sysRxBadFrameToggle = 0, sysRxBadFrameToggle_d = 0;
+reg [31:0] sysRxOverflowCount = 0, sysRxBadFrameCount = 0;
+always @(posedge s_axi_lite_aclk) begin
+    sysRxOverflowToggle_m <= rxOverflowToggle;
+    sysRxOverflowToggle   <= sysRxOverflowToggle_m;
+    sysRxOverflowToggle_d <= sysRxOverflowToggle;
+    if (sysRxOverflowToggle != sysRxOverflowToggle_d) begin
+        sysRxOverflowCount <= sysRxOverflowCount + 1;
+    end
+    sysRxBadFrameToggle_m <= rxBadFrameToggle;
+    sysRxBadFrameToggle   <= sysRxBadFrameToggle_m;
+    sysRxBadFrameToggle_d <= sysRxBadFrameToggle;
+    if (sysRxBadFrameToggle != sysRxBadFrameToggle_d) begin
+        sysRxBadFrameCount <= sysRxBadFrameCount + 1;
     end
 end
 
 // Status register
 wire [1:0] speed;
-wire [31:0]  sysStatus = { 1'b0, !sysResetn, sysTxBusy, rxPacketPresent,
-                           2'b0, sysTxOverrun, rxInterruptEnable,
-                           2'b0, speed,
+wire [31:0]  sysStatus = { 1'b1, !sysResetn, sysTxBusy, rxPacketPresent,
+                           1'b1, 1'b1, sysTxOverrun, rxInterruptEnable,
+                           1'b1, 1'b0, speed,
                            {20-PKBUF_WORD_ADDR_WIDTH{1'b0}}, sysPkAddr };
 
 // Multiplex AXI read data
 reg  [31:0] rdMux;
+wire [7:0] sysRxCapacity = RX_RING_CAPACITY;
+wire [31:0] sysRxRing = { sysRxCapacity,
+                          {8-RX_INDEX_WIDTH{1'b0}}, sysRxPending,
+                          {8-RX_INDEX_WIDTH{1'b0}}, sysRxHead,
+                          {8-RX_INDEX_WIDTH{1'b0}}, sysRxTail };
+wire [7:0] sysFastTxCapacity = FAST_SUBSCRIBER_CAPACITY;
+wire [7:0] sysFastTxStreams = fastTxSubscriberStreams;
+wire [7:0] sysFastTxSelectWord = sysFastTxSelect;
+wire [7:0] sysFastTxEnables = fastTxSubscriberEnables;
+wire [31:0] sysFastTxSubscribers = { sysFastTxCapacity, sysFastTxStreams,
+                                     sysFastTxSelectWord, sysFastTxEnables };
 wire [31:0] sysRxSourceAddress;
 wire [31:0] sysRxPorts;
 wire [31:0] sysRxLength;
 always @(posedge s_axi_lite_aclk) begin
-    case (raddr[5:2])
-    4'h0:   rdMux <= sysStatus;
-    4'h1:   rdMux <= rxBufQ;
-    4'h2:   rdMux <= sysRxSourceAddress;
-    4'h3:   rdMux <= sysRxPorts;
-    4'h4:   rdMux <= sysRxLength;
-    4'h5:   rdMux <= local_mac[0+:32];
-    4'h6:   rdMux <= {16'h0000, local_mac[32+:16]};
-    4'h7:   rdMux <= local_ip;
-    4'h8:   rdMux <= gateway_ip;
-    4'h9:   rdMux <= subnet_mask;
-    default: ;
-    endcase
+    if (raddr[PKBUF_WINDOW_BIT]) begin
+        rdMux <= rxBufQ;
+    end
+    else begin
+        case (raddr[5:2])
+        4'h0:   rdMux <= sysStatus;
+        4'h1:   rdMux <= rxBufQ;
+        4'h2:   rdMux <= sysRxSourceAddress;
+        4'h3:   rdMux <= sysRxPorts;
+        4'h4:   rdMux <= sysRxLength;
+        4'h5:   rdMux <= local_mac[0+:32];
+        4'h6:   rdMux <= {16'h0000, local_mac[32+:16]};
+        4'h7:   rdMux <= local_ip;
+        4'h8:   rdMux <= gateway_ip;
+        4'h9:   rdMux <= subnet_mask;
+        4'hC:   rdMux <= sysRxRing;
+        4'hD:   rdMux <= sysRxOverflowCount;
+        4'hE:   rdMux <= sysRxBadFrameCount;
+        4'hF:   rdMux <= sysFastTxSubscribers;
+        default: ;
+        endcase
+    end
 end
 assign s_axi_lite_rdata = rdMux;
 
@@ -377,13 +509,14 @@ always @(posedge clk125) begin
 end
 (*MARK_DEBUG=DEBUG_TX*) wire [7:0] txBufByte;
 (*MARK_DEBUG=DEBUG_RX*) reg [PKBUF_WORD_ADDR_WIDTH-1:0] rxWrAddr;
+(*MARK_DEBUG=DEBUG_RX*) wire        [RX_SLOT_WIDTH-1:0] rxSlot;
 (*MARK_DEBUG=DEBUG_RX*) wire                      [7:0] rxWrData;
 (*MARK_DEBUG=DEBUG_RX*) wire                      [3:0] rxWrEnable;
 genvar b;
 generate;
 for (b = 0 ; b < 4 ; b = b + 1) begin : rxByteWrite
     always @(posedge clk125) begin
-        if (rxWrEnable[b]) rxBuf[rxWrAddr][b*8+:8] <= rxWrData;
+        if (rxWrEnable[b]) rxBuf[{rxSlot, rxWrAddr}][b*8+:8] <= rxWrData;
     end
 end
 endgenerate
@@ -443,40 +576,60 @@ assign phy_reset_n = !resetStack;
 (*MARK_DEBUG=DEBUG_TX_UDP*) wire        tx_udp_payload_axis_tuser = 0;
 
 // Packet reception
-(*ASYNC_REG="true"*) reg rxDoneToggle_m = 0;
-(*MARK_DEBUG=DEBUG_RX*) reg rxDoneToggle = 0;
+// Header values are stored per slot and read by the system clock
+// domain only after the slot has been handed over.
+(*ASYNC_REG="true"*) reg [RX_INDEX_WIDTH-1:0] rxTailGray_m = 0;
+(*MARK_DEBUG=DEBUG_RX*) reg [RX_INDEX_WIDTH-1:0] rxTailGray = 0;
+(*MARK_DEBUG=DEBUG_RX*) reg [RX_INDEX_WIDTH-1:0] rxHead = 0;
+wire [RX_INDEX_WIDTH-1:0] rxTail = GrayToBinary(rxTailGray);
+wire rxRingFull = (rxHead[RX_SLOT_WIDTH-1:0] == rxTail[RX_SLOT_WIDTH-1:0])
+               && (rxHead[RX_SLOT_WIDTH] != rxTail[RX_SLOT_WIDTH]);
+assign rxSlot = rxHead[RX_SLOT_WIDTH-1:0];
 localparam RX_S_IDLE  = 2'd0,
            RX_S_ACCEPT= 2'd1,
            RX_S_FULL  = 2'd2;
 (*MARK_DEBUG=DEBUG_RX*) reg [1:0] rxState = RX_S_IDLE;
 (*MARK_DEBUG=DEBUG_RX*) reg rxBadPacket;
-(*MARK_DEBUG=DEBUG_RX*) reg                      [31:0] rxSourceAddress;
-(*MARK_DEBUG=DEBUG_RX*) reg                      [31:0] rxPorts;
-(*MARK_DEBUG=DEBUG_RX*) reg   [PK_BYTE_COUNT_WIDTH-1:0] rxLength;
+reg                     [31:0] rxSourceAddress [0:RX_RING_CAPACITY-1];
+reg                     [31:0] rxPorts         [0:RX_RING_CAPACITY-1];
+reg  [PK_BYTE_COUNT_WIDTH-1:0] rxLength        [0:RX_RING_CAPACITY-1];
 (*MARK_DEBUG=DEBUG_RX*) reg                       [3:0] rxByteSelect = 0;
 assign rxWrEnable = rxByteSelect & {4{rx_udp_payload_axis_tvalid &&
                                       rx_udp_payload_axis_tready}};
 assign rxWrData = rx_udp_payload_axis_tdata;
+wire rxFifoOverflow, rxFifoBadFrame;
+reg rxDiscard = 0;
+always @(posedge clk125) begin
+    if (rxFifoOverflow) rxOverflowToggle <= !rxOverflowToggle;
+    if (rxFifoBadFrame || rxDiscard) rxBadFrameToggle <= !rxBadFrameToggle;
+end
 always @(posedge clk125) begin
+    if (rx_udp_hdr_valid && rx_udp_hdr_ready) begin
+        rxSourceAddress[rxSlot] <= rx_udp_ip_source_ip;
+        rxPorts[rxSlot] <= {rx_udp_source_port, rx_udp_dest_port};
+        rxLength[rxSlot] <= rx_udp_length - 8;
+    end
+end
+always @(posedge clk125) begin
+    rxDiscard <= 0;
     if (resetStack) begin
-        rxDoneToggle_m             <= 0;
-        rxDoneToggle               <= 0;
-        rxFullToggle               <= 0;
+        rxTailGray_m               <= 0;
+        rxTailGray                 <= 0;
+        rxHead                     <= 0;
+        rxHeadGray                 <= 0;
         rx_udp_hdr_ready           <= 1;
         rx_udp_payload_axis_tready <= 0;
+        rxState                    <= RX_S_IDLE;
     end
     else begin
-        rxDoneToggle_m <= sysRxDoneToggle;
-        rxDoneToggle   <= rxDoneToggle_m;
+        rxTailGray_m <= sysRxTailGray;
+        rxTailGray   <= rxTailGray_m;
         case (rxState)
         RX_S_IDLE: begin
             rxWrAddr <= 0;
             rxByteSelect = 4'b0001;
             rxBadPacket <= 0;
             if (rx_udp_hdr_valid) begin
-                rxSourceAddress <= rx_udp_ip_source_ip;
-                rxPorts <= {rx_udp_source_port, rx_udp_dest_port};
-                rxLength <= rx_udp_length - 8;
                 rx_udp_hdr_ready <= 0;
                 rx_udp_payload_axis_tready <= 1;
                 rxState <= RX_S_ACCEPT;
@@ -494,18 +647,21 @@ always @(posedge clk125) begin
                 if (rx_udp_payload_axis_tlast) begin
                     rx_udp_payload_axis_tready <= 0;
                     if (rxBadPacket || rx_udp_payload_axis_tuser) begin
+                        rxDiscard <= 1;
                         rx_udp_hdr_ready <= 1;
                         rxState <= RX_S_IDLE;
                     end
                     else begin
-                        rxFullToggle <= !rxFullToggle;
+                        rxHead <= rxHead + 1;
+                        rxHeadGray <= BinaryToGray(rxHead + 1);
                         rxState <= RX_S_FULL;
                     end
                 end
             end
         end
         RX_S_FULL: begin
-            if (rxDoneToggle == rxFullToggle) begin
+            // Wait for a free slot
+            if (!rxRingFull) begin
                 rx_udp_hdr_ready <= 1;
                 rxState <= RX_S_IDLE;
             end
@@ -523,9 +679,9 @@ end
  * No need for clock-crossing logic.
  * Values will be used only when stable
  */
-assign sysRxSourceAddress = rxSourceAddress;
-assign sysRxPorts = rxPorts;
-assign sysRxLength = { {32-PK_BYTE_COUNT_WIDTH{1'b0}}, rxLength};
+assign sysRxSourceAddress = rxSourceAddress[sysRxSlot];
+assign sysRxPorts = rxPorts[sysRxSlot];
+assign sysRxLength = { {32-PK_BYTE_COUNT_WIDTH{1'b0}}, rxLength[sysRxSlot]};
 
 // Fast data stream support
 reg fastTxFlushToggle = 0, fastTxFlushDone = 0;
@@ -535,6 +691,12 @@ wire [PKBUF_WORD_ADDR_WIDTH-1:0] fastTxWrAddr =
                                            fastTxCount[PK_BYTE_COUNT_WIDTH-1:2];
 wire [1:0] fastTxWrByteSel = fastTxCount[1:0];
 reg fastTx = 0;
+(*MARK_DEBUG=DEBUG_TX_FAST*) reg fastTxStream = 0;
+(*MARK_DEBUG=DEBUG_TX_FAST*) reg [FAST_SUBSCRIBER_WIDTH-1:0] fastTxSubscriber = 0;
+wire fastTxLastSubscriber =
+                       (fastTxSubscriber == (FAST_SUBSCRIBER_CAPACITY - 1));
+wire fastTxSubscriberWanted = fastTxSubscriberEnables[fastTxSubscriber] &&
+               (fastTxSubscriberStreams[fastTxSubscriber] == fastTxStream);
 
 // Single-clock, simple dual port RAM (from Verilog template)
 genvar i;
@@ -570,6 +732,7 @@ always @(posedge clk125) begin
                 if (fastTx_tvalid) begin
                     fastTxCount <= fastTxCount + 1;
                     if (fastTx_tlast) begin
+                        fastTxStream <= fastTx_tuser;
                         fastTxStartToggle <= !fastTxStartToggle;
                         fastTx_tready <= 0;
                     end
@@ -610,6 +773,7 @@ always @(posedge clk125) begin
         tx_udp_hdr_valid <= 0;
         tx_udp_payload_axis_tvalid <= 0;
         fastTxFlushToggle <= fastTxFlushDone;
+        fastTxSubscriber <= 0;
     end
     else begin
         txStartToggle_m <= sysTxStartToggle;
@@ -619,14 +783,24 @@ always @(posedge clk125) begin
             txByteSelect <= 0;
             txRdAddr <= 0;
             if (fastTxDoneToggle != fastTxStartToggle) begin
-                tx_udp_ip_dest_ip <= fastTxDestinationAddress;
-                tx_udp_dest_port <= fastTxDestinationPort;
-                tx_udp_source_port <= fastTxSourcePort;
-                tx_udp_length <= fastTxCount + 8;
-                txCounter <= fastTxCount - 2;
-                fastTx <= 1;
-                txState <= TX_S_SEND_HEADER;
-                tx_udp_hdr_valid <= 1;
+                if (fastTxSubscriberWanted) begin
+                    tx_udp_ip_dest_ip <=
+                                     fastTxDestinationAddress[fastTxSubscriber];
+                    tx_udp_dest_port <= fastTxDestinationPort[fastTxSubscriber];
+                    tx_udp_source_port <= fastTxSourcePort[fastTxSubscriber];
+                    tx_udp_length <= fastTxCount + 8;
+                    txCounter <= fastTxCount - 2;
+                    fastTx <= 1;
+                    txState <= TX_S_SEND_HEADER;
+                    tx_udp_hdr_valid <= 1;
+                end
+                else begin
+                    // Skip disabled subscriber or one on another stream
+                    fastTxSubscriber <= fastTxSubscriber + 1;
+                    if (fastTxLastSubscriber) begin
+                        fastTxDoneToggle <= !fastTxDoneToggle;
+                    end
+                end
             end
             else if (txDoneToggle != txStartToggle) begin
                 tx_udp_ip_dest_ip <= sysTxDestinationAddress;
@@ -657,7 +831,11 @@ always @(posedge clk125) begin
                 if (tx_udp_payload_axis_tlast) begin
                     tx_udp_payload_axis_tvalid <= 0;
                     if (fastTx) begin
-                        fastTxDoneToggle <= !fastTxDoneToggle;
+                        // Release buffer after sending to last subscriber
+                        fastTxSubscriber <= fastTxSubscriber + 1;
+                        if (fastTxLastSubscriber) begin
+                            fastTxDoneToggle <= !fastTxDoneToggle;
+                        end
                     end
                     else begin
                         txDoneToggle <= !txDoneToggle;
@@ -914,7 +1092,7 @@ eth_mac_1g_rgmii_fifo #(
     .USE_CLK90("FALSE"),
     .ENABLE_PADDING(1),
     .MIN_FRAME_LENGTH(64),
-    .TX_FIFO_DEPTH(4096),
+    .TX_FIFO_DEPTH(MAC_TX_FIFO_DEPTH),
     .TX_FRAME_FIFO(1),
     .RX_FIFO_DEPTH(RX_FIFO_DEPTH),
     .RX_FRAME_FIFO(1)
@@ -953,8 +1131,8 @@ eth_mac_inst (
     .tx_fifo_good_frame(),
     .rx_error_bad_frame(),
     .rx_error_bad_fcs(),
-    .rx_fifo_overflow(),
-    .rx_fifo_bad_frame(),
+    .rx_fifo_overflow(rxFifoOverflow),
+    .rx_fifo_bad_frame(rxFifoBadFrame),
     .rx_fifo_good_frame(),
     .speed(speed),
 
@@ -27,6 +27,12 @@ proc init_gui { IPINST } {
   set_property tooltip {Enable MARK_DEBUG attribute for receiver MAC nets} ${DEBUG_RX_MAC}
   set RX_FIFO_DEPTH [ipgui::add_param $IPINST -name "RX_FIFO_DEPTH" -widget comboBox]
   set_property tooltip {Number of bytes in FIFO from PHY} ${RX_FIFO_DEPTH}
+  set RX_RING_CAPACITY [ipgui::add_param $IPINST -name "RX_RING_CAPACITY" -widget comboBox]
+  set_property tooltip {Number of received packets buffered for processor} ${RX_RING_CAPACITY}
+  set FAST_SUBSCRIBER_CAPACITY [ipgui::add_param $IPINST -name "FAST_SUBSCRIBER_CAPACITY" -widget comboBox]
+  set_property tooltip {Number of fast data stream subscribers} ${FAST_SUBSCRIBER_CAPACITY}
+  set PKBUF_CAPACITY [ipgui::add_param $IPINST -name "PKBUF_CAPACITY"]
+  set_property tooltip {Largest UDP payload, in bytes.  Up to 8972 for jumbo frames.} ${PKBUF_CAPACITY}
 
 }
 
@@ -135,6 +141,11 @@ proc update_PARAM_VALUE.PKBUF_CAPACITY { PARAM_VALUE.PKBUF_CAPACITY } {
 
 proc validate_PARAM_VALUE.PKBUF_CAPACITY { PARAM_VALUE.PKBUF_CAPACITY } {
 	# Procedure called to validate PKBUF_CAPACITY
+	set capacity [get_property value ${PARAM_VALUE.PKBUF_CAPACITY}]
+	if {($capacity < 1472) || ($capacity > 8972)} {
+		set_property errmsg "Packet capacity must be between 1472 and 8972 bytes" ${PARAM_VALUE.PKBUF_CAPACITY}
+		return false
+	}
 	return true
 }
 
@@ -147,6 +158,24 @@ proc validate_PARAM_VALUE.RX_FIFO_DEPTH { PARAM_VALUE.RX_FIFO_DEPTH } {
 	return true
 }
 
+proc update_PARAM_VALUE.RX_RING_CAPACITY { PARAM_VALUE.RX_RING_CAPACITY } {
+	# Procedure called to update RX_RING_CAPACITY when any of the dependent parameters in the arguments change
+}
+
+proc validate_PARAM_VALUE.RX_RING_CAPACITY { PARAM_VALUE.RX_RING_CAPACITY } {
+	# Procedure called to validate RX_RING_CAPACITY
+	return true
+}
+
+proc update_PARAM_VALUE.FAST_SUBSCRIBER_CAPACITY { PARAM_VALUE.FAST_SUBSCRIBER_CAPACITY } {
+	# Procedure called to update FAST_SUBSCRIBER_CAPACITY when any of the dependent parameters in the arguments change
+}
+
+proc validate_PARAM_VALUE.FAST_SUBSCRIBER_CAPACITY { PARAM_VALUE.FAST_SUBSCRIBER_CAPACITY } {
+	# Procedure called to validate FAST_SUBSCRIBER_CAPACITY
+	return true
+}
+
 proc update_PARAM_VALUE.DEBUG_TX_FAST { PARAM_VALUE.DEBUG_TX_FAST } {
 	# Procedure called to update DEBUG_TX_FAST when any of the dependent parameters in the arguments change
 }
@@ -245,3 +274,13 @@ proc update_MODELPARAM_VALUE.RX_FIFO_DEPTH { MODELPARAM_VALUE.RX_FIFO_DEPTH PARA
 	set_property value [get_property value ${PARAM_VALUE.RX_FIFO_DEPTH}] ${MODELPARAM_VALUE.RX_FIFO_DEPTH}
 }
 
+proc update_MODELPARAM_VALUE.RX_RING_CAPACITY { MODELPARAM_VALUE.RX_RING_CAPACITY PARAM_VALUE.RX_RING_CAPACITY } {
+	# Procedure called to set VHDL generic/Verilog parameter value(s) based on TCL parameter value
+	set_property value [get_property value ${PARAM_VALUE.RX_RING_CAPACITY}] ${MODELPARAM_VALUE.RX_RING_CAPACITY}
+}
+
+proc update_MODELPARAM_VALUE.FAST_SUBSCRIBER_CAPACITY { MODELPARAM_VALUE.FAST_SUBSCRIBER_CAPACITY PARAM_VALUE.FAST_SUBSCRIBER_CAPACITY } {
+	# Procedure called to set VHDL generic/Verilog parameter value(s) based on TCL parameter value
+	set_property value [get_property value ${PARAM_VALUE.FAST_SUBSCRIBER_CAPACITY}] ${MODELPARAM_VALUE.FAST_SUBSCRIBER_CAPACITY}
+}
+